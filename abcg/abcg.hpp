@@ -14,8 +14,12 @@
 #define ABCG_HPP_
 
 #include "abcgApplication.hpp"
+#include "abcgConcurrency.hpp"
+#include "abcgDynamicResolution.hpp"
 #include "abcgException.hpp"
 #include "abcgExternal.hpp"
+#include "abcgRenderQueue.hpp"
+#include "abcgTrace.hpp"
 #include "abcgTrackball.hpp"
 #include "abcgUtil.hpp"
 #include "abcgWindow.hpp"
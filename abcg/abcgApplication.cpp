@@ -11,10 +11,17 @@
 #include "abcgApplication.hpp"
 
 #include <SDL_image.h>
+#include <fmt/core.h>
+#include <gsl/gsl>
 
+#include <algorithm>
+#include <cmath>
 #include <span>
+#include <string_view>
+#include <thread>
 
 #include "abcgException.hpp"
+#include "abcgTrace.hpp"
 #include "abcgWindow.hpp"
 
 #if defined(__EMSCRIPTEN__)
@@ -44,8 +51,19 @@ void abcg::mainLoopCallback(void *userData) {
  * of which the last one is nullptr and the previous ones, if any, point to
  * null-terminated multibyte strings that represent the arguments passed to the
  * program from the execution environment.
+ *
+ * The following options are handled by the application:
+ *
+ * - `--trace <path>`: records a Chrome trace of the frames to @a path. See
+ * abcg::Tracer.
+ * - `--trace-frames <first>:<last>`: records the trace from frame @a first to
+ * frame @a last, inclusive. If @a last is omitted, the trace is recorded until
+ * the application exits. By default, the trace is recorded from the creation
+ * of the window, including the loading of assets, to the exit.
+ *
+ * @throw abcg::RuntimeError if an option is missing its argument.
  */
-abcg::Application::Application([[maybe_unused]] int argc, char **argv) {
+abcg::Application::Application(int argc, char **argv) {
   // Get executable relative path
   std::string const argv_str{*std::span{&argv, 1}[0]};
 #if defined(WIN32)
@@ -61,6 +79,26 @@ abcg::Application::Application([[maybe_unused]] int argc, char **argv) {
 #endif
 
   abcg::Application::m_assetsPath = abcg::Application::m_basePath + "/assets/";
+
+  std::span const args{argv, gsl::narrow<std::size_t>(argc)};
+  for (std::size_t index{1}; index < args.size(); ++index) {
+    std::string_view const option{args[index]};
+    if (option != "--trace" && option != "--trace-frames")
+      continue;
+    if (index + 1 == args.size()) {
+      throw abcg::RuntimeError(fmt::format("Missing argument of {}", option));
+    }
+    std::string const argument{args[++index]};
+    if (option == "--trace") {
+      m_tracePath = argument;
+    } else {
+      auto const separator{argument.find(':')};
+      m_traceFirstFrame = std::stoul(argument.substr(0, separator));
+      if (separator != std::string::npos && separator + 1 < argument.size()) {
+        m_traceLastFrame = std::stoul(argument.substr(separator + 1));
+      }
+    }
+  }
 }
 
 /**
@@ -90,6 +128,11 @@ void abcg::Application::run(Window &window) {
   }
 #endif
 
+  Tracer::setThreadName("Main");
+  if (!m_tracePath.empty() && m_traceFirstFrame == 0) {
+    Tracer::start(m_tracePath);
+  }
+
   m_window = &window;
   m_window->templateCreate();
 
@@ -104,6 +147,8 @@ void abcg::Application::run(Window &window) {
 
   m_window->templateDestroy();
 
+  Tracer::stop();
+
 #if !defined(__EMSCRIPTEN__)
   IMG_Quit();
 #endif
@@ -145,14 +190,101 @@ std::string const &abcg::Application::getBasePath() noexcept {
   return m_basePath;
 }
 
-void abcg::Application::mainLoopIterator([[maybe_unused]] bool &done) const {
-  SDL_Event event{};
-  while (SDL_PollEvent(&event) != 0) {
+void abcg::Application::mainLoopIterator([[maybe_unused]] bool &done) {
+  auto const &windowSettings{m_window->getWindowSettings()};
+  if (windowSettings.renderOnDemand && !m_window->isRedrawPending()) {
+#if defined(__EMSCRIPTEN__)
+    // The browser calls this function for every frame, so the loop cannot
+    // block. Just skip the frame if no event requested a redraw
+    SDL_Event event{};
+    while (SDL_PollEvent(&event) != 0) {
+      handleEvent(event, done);
+    }
+    if (!m_window->isRedrawPending())
+      return;
+#else
+    waitForEvents(done);
+#endif
+  }
+
+  if (!m_tracePath.empty() && m_frameIndex == m_traceFirstFrame &&
+      m_frameIndex > 0) {
+    Tracer::start(m_tracePath);
+  }
+
+  {
+    TraceScope const frameScope{"Frame", "frame"};
+    SDL_Event event{};
+    while (SDL_PollEvent(&event) != 0) {
+      handleEvent(event, done);
+    }
+    m_window->templatePaint();
+  }
+
+  if (m_frameIndex == m_traceLastFrame) {
+    Tracer::stop();
+  }
+  ++m_frameIndex;
+
+#if defined(__EMSCRIPTEN__)
+  // There is no background thread to write the events
+  Tracer::flush();
+#else
+  limitFrameRate(windowSettings.maxFrameRate);
+#endif
+}
+
+void abcg::Application::handleEvent(SDL_Event const &event,
+                                    [[maybe_unused]] bool &done) {
 #if !defined(__EMSCRIPTEN__)
-    if (event.type == SDL_QUIT)
-      done = true;
+  if (event.type == SDL_QUIT)
+    done = true;
 #endif
-    m_window->templateHandleEvent(event, done);
+  m_window->templateHandleEvent(event, done);
+}
+
+// Blocks until an event arrives or the idle timeout runs out
+void abcg::Application::waitForEvents(bool &done) {
+  TraceScope const idleScope{"Idle", "idle"};
+
+  auto const idleTimeout{m_window->getWindowSettings().idleTimeout};
+  auto const timeout{idleTimeout < 0.0
+                         ? -1
+                         : gsl::narrow_cast<int>(std::lround(
+                               std::min(idleTimeout, 86400.0) * 1000.0))};
+  if (SDL_Event event{}; SDL_WaitEventTimeout(&event, timeout) != 0) {
+    handleEvent(event, done);
+  }
+  m_window->resumeFromIdle();
+}
+
+// Sleeps until the end of the frame period. The sleep ends a little earlier
+// because the OS may oversleep, and the remaining time is spent spinning
+void abcg::Application::limitFrameRate(double maxFrameRate) {
+  using Clock = std::chrono::steady_clock;
+
+  auto const now{Clock::now()};
+  if (maxFrameRate <= 0.0) {
+    m_frameDeadline = now;
+    return;
+  }
+
+  auto const period{std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(1.0 / maxFrameRate))};
+  m_frameDeadline += period;
+
+  // Start over if behind schedule, instead of rushing the next frames to
+  // catch up
+  if (m_frameDeadline <= now) {
+    m_frameDeadline = now;
+    return;
+  }
+
+  constexpr std::chrono::milliseconds spinTime{2};
+  if (auto const remaining{m_frameDeadline - now}; remaining > spinTime) {
+    std::this_thread::sleep_for(remaining - spinTime);
+  }
+  while (Clock::now() < m_frameDeadline) {
+    std::this_thread::yield();
   }
-  m_window->templatePaint();
 }
@@ -11,6 +11,11 @@
 #ifndef ABCG_APPLICATION_HPP_
 #define ABCG_APPLICATION_HPP_
 
+#include <SDL_events.h>
+
+#include <chrono>
+#include <cstddef>
+#include <limits>
 #include <string>
 
 #define ABCG_VERSION_MAJOR 3
@@ -44,10 +49,21 @@ public:
   static std::string const &getBasePath() noexcept;
 
 private:
-  void mainLoopIterator(bool &done) const;
+  void mainLoopIterator(bool &done);
+  void handleEvent(SDL_Event const &event, bool &done);
+  void waitForEvents(bool &done);
+  void limitFrameRate(double maxFrameRate);
 
   Window *m_window{};
 
+  // Time at which the current frame should end when the frame rate is limited
+  std::chrono::steady_clock::time_point m_frameDeadline;
+
+  std::string m_tracePath;
+  std::size_t m_traceFirstFrame{};
+  std::size_t m_traceLastFrame{std::numeric_limits<std::size_t>::max()};
+  std::size_t m_frameIndex{};
+
 #if defined(__EMSCRIPTEN__)
   friend void mainLoopCallback(void *userData);
 #endif
@@ -0,0 +1,170 @@
+/**
+ * @file abcgConcurrency.hpp
+ * @brief Header file of abcg::TripleBuffer and abcg::SPSCQueue.
+ *
+ * Lock-free containers for passing data between two threads.
+ *
+ * This file is part of ABCg (https://github.com/hbatagelo/abcg).
+ *
+ * @copyright (c) 2021--2023 Harlen Batagelo. All rights reserved.
+ * This project is released under the MIT License.
+ */
+
+#ifndef ABCG_CONCURRENCY_HPP_
+#define ABCG_CONCURRENCY_HPP_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace abcg {
+template <typename T> class TripleBuffer;
+template <typename T, std::size_t Capacity> class SPSCQueue;
+
+// Size used to keep data written by different threads in different cache
+// lines. std::hardware_destructive_interference_size is not available in
+// every standard library
+inline constexpr std::size_t cacheLineSize{64};
+} // namespace abcg
+
+/**
+ * @brief Lock-free triple buffer for passing snapshots from a writer thread to
+ * a reader thread.
+ *
+ * The writer fills the buffer returned by abcg::TripleBuffer::getWriteBuffer
+ * and calls abcg::TripleBuffer::publish. The reader calls
+ * abcg::TripleBuffer::update and then reads the latest published snapshot
+ * with abcg::TripleBuffer::getReadBuffer. Neither thread ever waits for the
+ * other. Snapshots published between two updates of the reader are skipped.
+ *
+ * The buffers are reused, so the writer should overwrite every field of the
+ * snapshot. Containers in the snapshot keep their capacity, so publishing
+ * snapshots of the same size does not allocate memory.
+ *
+ * @tparam T Type of the snapshot.
+ */
+template <typename T> class abcg::TripleBuffer {
+public:
+  /**
+   * @brief Returns the buffer to be filled by the writer thread.
+   *
+   * @return Reference to a buffer that is not seen by the reader.
+   */
+  [[nodiscard]] T &getWriteBuffer() noexcept {
+    return m_buffers.at(m_writeIndex).value;
+  }
+
+  /**
+   * @brief Makes the write buffer the latest snapshot.
+   *
+   * This is called by the writer thread. A new write buffer is then returned
+   * by abcg::TripleBuffer::getWriteBuffer.
+   */
+  void publish() noexcept {
+    m_writeIndex =
+        m_shared.exchange(m_writeIndex | freshBit, std::memory_order_acq_rel) &
+        indexMask;
+  }
+
+  /**
+   * @brief Acquires the latest snapshot, if any.
+   *
+   * This is called by the reader thread.
+   *
+   * @return Whether a new snapshot was published since the last update.
+   */
+  bool update() noexcept {
+    if ((m_shared.load(std::memory_order_relaxed) & freshBit) == 0)
+      return false;
+    m_readIndex =
+        m_shared.exchange(m_readIndex, std::memory_order_acq_rel) & indexMask;
+    return true;
+  }
+
+  /**
+   * @brief Returns the snapshot acquired by the last update.
+   *
+   * @return Reference to a buffer that is not modified by the writer until
+   * the next call to abcg::TripleBuffer::update.
+   */
+  [[nodiscard]] T const &getReadBuffer() const noexcept {
+    return m_buffers.at(m_readIndex).value;
+  }
+
+private:
+  static constexpr std::uint8_t indexMask{0b011};
+  static constexpr std::uint8_t freshBit{0b100};
+
+  struct alignas(cacheLineSize) Slot {
+    T value{};
+  };
+
+  std::array<Slot, 3> m_buffers{};
+  // Index of the buffer in between, and whether it holds a snapshot that was
+  // not acquired yet
+  alignas(cacheLineSize) std::atomic<std::uint8_t> m_shared{1};
+  alignas(cacheLineSize) std::uint8_t m_writeIndex{0};
+  alignas(cacheLineSize) std::uint8_t m_readIndex{2};
+};
+
+/**
+ * @brief Lock-free bounded queue with a single producer thread and a single
+ * consumer thread.
+ *
+ * @tparam T Type of the elements.
+ * @tparam Capacity Maximum number of elements. Must be a power of two.
+ */
+template <typename T, std::size_t Capacity> class abcg::SPSCQueue {
+public:
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of two");
+
+  /**
+   * @brief Adds an element to the end of the queue.
+   *
+   * This is called by the producer thread.
+   *
+   * @param value Element to be added.
+   *
+   * @return `false` if the queue is full, in which case @a value is not
+   * added.
+   */
+  bool push(T const &value) noexcept(
+      std::is_nothrow_copy_assignable_v<T>) {
+    auto const tail{m_tail.load(std::memory_order_relaxed)};
+    if (tail - m_head.load(std::memory_order_acquire) == Capacity)
+      return false;
+    m_items.at(tail & (Capacity - 1)) = value;
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Removes the element at the front of the queue.
+   *
+   * This is called by the consumer thread.
+   *
+   * @return The removed element, or `std::nullopt` if the queue is empty.
+   */
+  std::optional<T> pop() noexcept(std::is_nothrow_move_constructible_v<T>) {
+    auto const head{m_head.load(std::memory_order_relaxed)};
+    if (head == m_tail.load(std::memory_order_acquire))
+      return std::nullopt;
+    std::optional<T> value{std::move(m_items.at(head & (Capacity - 1)))};
+    m_head.store(head + 1, std::memory_order_release);
+    return value;
+  }
+
+private:
+  std::array<T, Capacity> m_items{};
+  // Read position, written by the consumer
+  alignas(cacheLineSize) std::atomic<std::size_t> m_head{};
+  // Write position, written by the producer
+  alignas(cacheLineSize) std::atomic<std::size_t> m_tail{};
+};
+
+#endif
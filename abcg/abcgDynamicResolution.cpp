@@ -0,0 +1,141 @@
+/**
+ * @file abcgDynamicResolution.cpp
+ * @brief Definition of abcg::DynamicResolutionController members.
+ *
+ * This file is part of ABCg (https://github.com/hbatagelo/abcg).
+ *
+ * @copyright (c) 2021--2023 Harlen Batagelo. All rights reserved.
+ * This project is released under the MIT License.
+ */
+
+#include "abcgDynamicResolution.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+constexpr float scaleStep{1.0f / 32.0f};
+
+// Weight of the newest frame time in the exponential moving average
+constexpr double smoothing{0.2};
+
+// Number of frame times measured at a scale before it can change again
+constexpr int settleSamples{4};
+
+// Fraction of the budget aimed at when the scale changes
+constexpr double headroom{0.9};
+
+// The scale is raised only if the frame time is below this fraction of the
+// budget, and by at most this factor
+constexpr double raiseThreshold{0.75};
+constexpr double maxRaiseFactor{1.1};
+} // namespace
+
+/**
+ * @brief Sets the configuration settings.
+ *
+ * The current scale is clamped to the new range. If dynamic resolution is
+ * disabled, the scale is reset to 1.
+ *
+ * @param settings Dynamic resolution settings.
+ */
+void abcg::DynamicResolutionController::setSettings(
+    DynamicResolutionSettings const &settings) noexcept {
+  auto const wasEnabled{m_settings.enabled};
+  m_settings = settings;
+  m_settings.minScale = std::max(m_settings.minScale, scaleStep);
+  m_settings.maxScale = std::max(m_settings.maxScale, m_settings.minScale);
+
+  if (!m_settings.enabled || !wasEnabled) {
+    reset();
+  } else {
+    setScale(m_scale);
+  }
+}
+
+/**
+ * @brief Returns the configuration settings.
+ *
+ * @return Reference to the settings, with the scales clamped to valid values.
+ */
+abcg::DynamicResolutionSettings const &
+abcg::DynamicResolutionController::getSettings() const noexcept {
+  return m_settings;
+}
+
+/**
+ * @brief Discards the measured frame times.
+ *
+ * The scale is set to the largest scale, or to 1 if dynamic resolution is
+ * disabled.
+ */
+void abcg::DynamicResolutionController::reset() noexcept {
+  m_scale = m_settings.enabled ? m_settings.maxScale : 1.0f;
+  m_frameTime = -1.0;
+  m_samples = 0;
+}
+
+/**
+ * @brief Updates the scale with the frame time of a frame.
+ *
+ * @param frameTime Frame time, in milliseconds. Ignored if not positive.
+ * @param scale Scale at which the frame was rendered. The frame time is
+ * ignored if this is not the current scale.
+ *
+ * @return Scale of the next frames.
+ */
+float abcg::DynamicResolutionController::update(double frameTime,
+                                                float scale) noexcept {
+  if (!m_settings.enabled || frameTime <= 0.0 ||
+      std::abs(scale - m_scale) > scaleStep * 0.5f)
+    return m_scale;
+
+  m_frameTime = m_frameTime < 0.0
+                    ? frameTime
+                    : m_frameTime + (frameTime - m_frameTime) * smoothing;
+  if (++m_samples < settleSamples)
+    return m_scale;
+
+  auto const budget{m_settings.targetFrameTime};
+  if (m_frameTime > budget) {
+    auto const factor{std::sqrt(budget * headroom / m_frameTime)};
+    setScale(std::min(m_scale * static_cast<float>(factor),
+                      m_scale - scaleStep));
+  } else if (m_frameTime < budget * raiseThreshold) {
+    auto const factor{
+        std::min(std::sqrt(budget * headroom / m_frameTime), maxRaiseFactor)};
+    setScale(std::max(m_scale * static_cast<float>(factor),
+                      m_scale + scaleStep));
+  }
+  return m_scale;
+}
+
+/**
+ * @brief Returns the current scale.
+ *
+ * @return Scale of each dimension of the render target.
+ */
+float abcg::DynamicResolutionController::getScale() const noexcept {
+  return m_scale;
+}
+
+/**
+ * @brief Returns the smoothed frame time at the current scale.
+ *
+ * @return Frame time, in milliseconds, or a negative value if no frame was
+ * measured since the last change of scale.
+ */
+double abcg::DynamicResolutionController::getFrameTime() const noexcept {
+  return m_frameTime;
+}
+
+void abcg::DynamicResolutionController::setScale(float scale) noexcept {
+  auto const quantized{std::clamp(std::round(scale / scaleStep) * scaleStep,
+                                  m_settings.minScale, m_settings.maxScale)};
+  if (std::abs(quantized - m_scale) < scaleStep * 0.5f)
+    return;
+
+  m_scale = quantized;
+  m_frameTime = -1.0;
+  m_samples = 0;
+}
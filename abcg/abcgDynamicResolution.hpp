@@ -0,0 +1,76 @@
+/**
+ * @file abcgDynamicResolution.hpp
+ * @brief Header file of abcg::DynamicResolutionController.
+ *
+ * Declaration of abcg::DynamicResolutionSettings and
+ * abcg::DynamicResolutionController.
+ *
+ * This file is part of ABCg (https://github.com/hbatagelo/abcg).
+ *
+ * @copyright (c) 2021--2023 Harlen Batagelo. All rights reserved.
+ * This project is released under the MIT License.
+ */
+
+#ifndef ABCG_DYNAMIC_RESOLUTION_HPP_
+#define ABCG_DYNAMIC_RESOLUTION_HPP_
+
+namespace abcg {
+struct DynamicResolutionSettings;
+class DynamicResolutionController;
+} // namespace abcg
+
+/**
+ * @brief Configuration settings of dynamic resolution scaling.
+ *
+ * @sa abcg::DynamicResolutionController.
+ * @sa abcg::OpenGLWindow::setDynamicResolutionSettings.
+ */
+struct abcg::DynamicResolutionSettings {
+  /** @brief Whether the scale follows the frame time. If disabled, the scale
+   * is 1. */
+  bool enabled{false};
+  /** @brief Frame time budget, in milliseconds. */
+  double targetFrameTime{1000.0 / 60.0};
+  /** @brief Smallest scale of each dimension of the render target. */
+  float minScale{0.5f};
+  /** @brief Largest scale of each dimension of the render target. */
+  float maxScale{1.0f};
+};
+
+/**
+ * @brief Chooses the scale of a render target from measured frame times.
+ *
+ * The frame time is assumed to be roughly proportional to the number of
+ * pixels, i.e., to the square of the scale. When the smoothed frame time
+ * exceeds the budget, the scale is lowered to fit the budget with a margin.
+ * It is raised only when the frame time is well below the budget, and by
+ * small steps, so that it does not oscillate around the budget.
+ *
+ * The scale is quantized to multiples of 1/32, and each change is followed by
+ * a few frames in which the frame time at the new scale is measured. Frame
+ * times measured at other scales, such as those of frames still in flight
+ * when the scale changed, are ignored.
+ */
+class abcg::DynamicResolutionController {
+public:
+  void setSettings(DynamicResolutionSettings const &settings) noexcept;
+  [[nodiscard]] DynamicResolutionSettings const &getSettings() const noexcept;
+
+  void reset() noexcept;
+  float update(double frameTime, float scale) noexcept;
+
+  [[nodiscard]] float getScale() const noexcept;
+  [[nodiscard]] double getFrameTime() const noexcept;
+
+private:
+  void setScale(float scale) noexcept;
+
+  DynamicResolutionSettings m_settings;
+  float m_scale{1.0f};
+  // Smoothed frame time at the current scale, in milliseconds, or negative if
+  // not measured yet
+  double m_frameTime{-1.0};
+  int m_samples{};
+};
+
+#endif
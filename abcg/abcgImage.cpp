@@ -11,92 +11,182 @@
 #include "abcgImage.hpp"
 
 #include <cppitertools/itertools.hpp>
+#include <fmt/core.h>
 #include <gsl/gsl>
 
+#include <cmath>
+#include <memory>
 #include <span>
-#include <vector>
+#include <string>
+
+#include "abcgException.hpp"
+#include "abcgImageKernels.hpp"
+
+namespace {
+using SurfacePtr = std::unique_ptr<SDL_Surface, decltype(&SDL_FreeSurface)>;
+
+SurfacePtr loadRGBA(std::string_view path) {
+  SurfacePtr loaded{IMG_Load(std::string{path}.c_str()), SDL_FreeSurface};
+  if (!loaded) {
+    throw abcg::SDLImageError(
+        fmt::format("Failed to load image {}", path));
+  }
+  SurfacePtr converted{
+      SDL_ConvertSurfaceFormat(loaded.get(), SDL_PIXELFORMAT_RGBA32, 0),
+      SDL_FreeSurface};
+  if (!converted) {
+    throw abcg::SDLError(fmt::format("Failed to convert image {}", path));
+  }
+  return converted;
+}
+} // namespace
+
+namespace {
+abcg::ImageView getImageView(SDL_Surface &surface) {
+  return {.pixels = static_cast<std::byte *>(surface.pixels),
+          .width = surface.w,
+          .height = surface.h,
+          .pitch = gsl::narrow<std::size_t>(surface.pitch),
+          .channels = gsl::narrow<int>(surface.format->BytesPerPixel)};
+}
+} // namespace
 
 /**
  * @brief Flips an image horizontally.
  *
- * Reverses each row of the image, in place.
+ * Reverses each row of the image, in place. See
+ * abcg::flipImageHorizontally.
  *
  * @param surface SDL surface of a RGB or RGBA image.
  */
 void abcg::flipHorizontally(SDL_Surface &surface) {
-  auto const bytesPerPixel{gsl::narrow<int>(surface.format->BytesPerPixel)};
-  auto const widthInBytes{gsl::narrow<std::size_t>(surface.w * bytesPerPixel)};
-  auto const height{gsl::narrow<std::size_t>(surface.h)};
-  std::span const pixels{static_cast<std::byte *>(surface.pixels),
-                         widthInBytes * height};
-
-  // Temporary row of pixels for the swap
-  std::vector<std::byte> pixelRow(gsl::narrow<std::size_t>(widthInBytes), {});
-
   SDL_LockSurface(&surface);
-
-  // For each row
-  for (auto const rowIndex : iter::range(height)) {
-    auto const rowStart{widthInBytes * rowIndex};
-    auto const rowEnd{rowStart + widthInBytes};
-    // For each pixel (RGB/RGA) of current row
-    auto srcBegin{pixels.begin() + gsl::narrow<long>(rowEnd)};
-    auto dstBegin{pixelRow.begin()};
-    for ([[maybe_unused]] auto const pixelIndex : iter::range(surface.w)) {
-      srcBegin -= bytesPerPixel;
-      std::copy(srcBegin, srcBegin + bytesPerPixel, dstBegin);
-      dstBegin += bytesPerPixel;
-    }
-    // std::ranges::copy(pixelRow, pixels.subspan(rowStart).begin());
-    std::copy(pixelRow.begin(),
-              pixelRow.begin() + gsl::narrow<long>(widthInBytes),
-              pixels.subspan(rowStart).begin());
-  }
-
-  SDL_UnlockSurface(&surface);
+  auto const unlock{gsl::finally([&surface] { SDL_UnlockSurface(&surface); })};
+  flipImageHorizontally(getImageView(surface));
 }
 
 /**
  * @brief Flips an image vertically.
  *
- * Reverses each column of the image, in place.
+ * Reverses each column of the image, in place. See abcg::flipImageVertically.
  *
  * @param surface SDL surface of a RGB or RGBA image.
  */
 void abcg::flipVertically(SDL_Surface &surface) {
-  auto const bytesPerPixel{gsl::narrow<int>(surface.format->BytesPerPixel)};
-  auto const widthInBytes{gsl::narrow<std::size_t>(surface.w * bytesPerPixel)};
-  auto const height{gsl::narrow<std::size_t>(surface.h)};
-  std::span const pixels{static_cast<std::byte *>(surface.pixels),
-                         gsl::narrow<std::size_t>(widthInBytes * height)};
+  SDL_LockSurface(&surface);
+  auto const unlock{gsl::finally([&surface] { SDL_UnlockSurface(&surface); })};
+  flipImageVertically(getImageView(surface));
+}
+
+/**
+ * @brief Compares an image against a reference image.
+ *
+ * This is intended for image regression tests, such as comparing frames
+ * rendered in headless mode (see abcg::OpenGLHeadlessSettings) with golden
+ * images. Both images are converted to RGBA before comparison.
+ *
+ * @param path Path of the image to be tested.
+ * @param referencePath Path of the reference (golden) image.
+ * @param tolerance Maximum absolute difference per channel for two pixels to
+ * be considered equal.
+ * @param differencePath If not empty, path of a PNG file where the per-pixel
+ * absolute difference is written. Pixels above the tolerance are painted red.
+ *
+ * @return Statistics of the difference between the images.
+ *
+ * @throw abcg::SDLImageError if an image cannot be loaded.
+ * @throw abcg::SDLImageError if the difference image cannot be saved.
+ * @throw abcg::RuntimeError if the image sizes differ.
+ */
+abcg::ImageDifference abcg::compareImages(std::string_view path,
+                                          std::string_view referencePath,
+                                          int tolerance,
+                                          std::string_view differencePath) {
+  auto const image{loadRGBA(path)};
+  auto const reference{loadRGBA(referencePath)};
+
+  if (image->w != reference->w || image->h != reference->h) {
+    throw abcg::RuntimeError(fmt::format(
+        "Image size mismatch: {} is {}x{}, {} is {}x{}", path, image->w,
+        image->h, referencePath, reference->w, reference->h));
+  }
 
-  // Temporary row of pixels for the swap
-  std::vector<std::byte> pixelRow(widthInBytes, std::byte{});
+  std::size_t const channels{4};
+  auto const width{gsl::narrow<std::size_t>(image->w)};
+  auto const height{gsl::narrow<std::size_t>(image->h)};
+  auto const widthInBytes{width * channels};
 
-  SDL_LockSurface(&surface);
+  SurfacePtr difference{nullptr, SDL_FreeSurface};
+  if (!differencePath.empty()) {
+    difference.reset(SDL_CreateRGBSurfaceWithFormat(
+        0, image->w, image->h, 32, SDL_PIXELFORMAT_RGBA32));
+  }
+
+  ImageDifference result{.totalPixels = width * height};
+  auto sumSquaredError{0.0};
+
+  SDL_LockSurface(image.get());
+  SDL_LockSurface(reference.get());
 
-  // If height is odd, won't swap the middle row
-  for (auto const halfHeight{height / 2};
-       auto const rowIndex : iter::range(halfHeight)) {
-    auto const rowStartFromTop{widthInBytes * rowIndex};
-    auto const rowStartFromBottom{widthInBytes * (height - rowIndex - 1)};
-
-    auto const &topSpan{pixels.subspan(rowStartFromTop)};
-    auto const &bottomSpan{pixels.subspan(rowStartFromBottom)};
-
-    // std::ranges::copy(topSpan.subspan(0, widthInBytes), pixelRow.begin());
-    // std::ranges::copy(bottomSpan.subspan(0, widthInBytes), topSpan.begin());
-    // std::ranges::copy(pixelRow, bottomSpan.begin());
-    std::copy(topSpan.begin(),
-              topSpan.begin() + gsl::narrow<long>(widthInBytes),
-              pixelRow.begin());
-    std::copy(bottomSpan.begin(),
-              bottomSpan.begin() + gsl::narrow<long>(widthInBytes),
-              topSpan.begin());
-    std::copy(pixelRow.begin(),
-              pixelRow.begin() + gsl::narrow<long>(widthInBytes),
-              bottomSpan.begin());
+  for (auto const rowIndex : iter::range(height)) {
+    // Rows may be padded, so each one is addressed through the pitch
+    std::span const row{
+        static_cast<std::uint8_t const *>(image->pixels) +
+            rowIndex * gsl::narrow<std::size_t>(image->pitch),
+        widthInBytes};
+    std::span const referenceRow{
+        static_cast<std::uint8_t const *>(reference->pixels) +
+            rowIndex * gsl::narrow<std::size_t>(reference->pitch),
+        widthInBytes};
+    std::span<std::uint8_t> differenceRow{};
+    if (difference) {
+      differenceRow = {static_cast<std::uint8_t *>(difference->pixels) +
+                           rowIndex *
+                               gsl::narrow<std::size_t>(difference->pitch),
+                       widthInBytes};
+    }
+
+    for (auto const pixelIndex : iter::range(width)) {
+      auto pixelError{0};
+      for (auto const channel : iter::range(channels)) {
+        auto const index{pixelIndex * channels + channel};
+        auto const error{std::abs(row[index] - referenceRow[index])};
+        pixelError = std::max(pixelError, error);
+        sumSquaredError += error * error;
+        if (!differenceRow.empty()) {
+          differenceRow[index] = gsl::narrow<std::uint8_t>(error);
+        }
+      }
+      result.maxError = std::max(result.maxError, pixelError);
+      if (pixelError > tolerance) {
+        ++result.differentPixels;
+        if (!differenceRow.empty()) {
+          auto const pixel{differenceRow.subspan(pixelIndex * channels, 4)};
+          pixel[0] = 255;
+          pixel[1] = 0;
+          pixel[2] = 0;
+        }
+      }
+      if (!differenceRow.empty()) {
+        differenceRow[pixelIndex * channels + 3] = 255;
+      }
+    }
+  }
+
+  SDL_UnlockSurface(reference.get());
+  SDL_UnlockSurface(image.get());
+
+  if (result.totalPixels > 0) {
+    result.rmsError = std::sqrt(
+        sumSquaredError /
+        gsl::narrow_cast<double>(result.totalPixels * channels));
   }
 
-  SDL_UnlockSurface(&surface);
-}
\ No newline at end of file
+  if (difference &&
+      IMG_SavePNG(difference.get(), std::string{differencePath}.c_str()) != 0) {
+    throw abcg::SDLImageError(
+        fmt::format("Failed to save image {}", differencePath));
+  }
+
+  return result;
+}
@@ -13,9 +13,36 @@
 
 #include <SDL_image.h>
 
+#include <cstddef>
+#include <string_view>
+
 namespace abcg {
+struct ImageDifference;
 void flipHorizontally(SDL_Surface &surface);
 void flipVertically(SDL_Surface &surface);
+ImageDifference compareImages(std::string_view path,
+                              std::string_view referencePath,
+                              int tolerance = 0,
+                              std::string_view differencePath = {});
 } // namespace abcg
 
+/**
+ * @brief Result of abcg::compareImages.
+ */
+struct abcg::ImageDifference {
+  /** @brief Number of pixels with at least one channel that differs by more
+   * than the tolerance. */
+  std::size_t differentPixels{};
+  /** @brief Total number of pixels compared. */
+  std::size_t totalPixels{};
+  /** @brief Largest absolute difference found in any channel, in the range
+   * [0, 255]. */
+  int maxError{};
+  /** @brief Root mean square error of all channels, in the range [0, 255]. */
+  double rmsError{};
+
+  /** @brief Whether all pixels are within the tolerance. */
+  [[nodiscard]] bool matches() const noexcept { return differentPixels == 0; }
+};
+
 #endif
@@ -0,0 +1,744 @@
+/**
+ * @file abcgImageKernels.cpp
+ * @brief Definition of image processing kernels.
+ *
+ * This file is part of ABCg (https://github.com/hbatagelo/abcg).
+ *
+ * @copyright (c) 2021--2023 Harlen Batagelo. All rights reserved.
+ * This project is released under the MIT License.
+ */
+
+#include "abcgImageKernels.hpp"
+
+#include <fmt/core.h>
+#include <gsl/gsl>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <numbers>
+#include <thread>
+#include <vector>
+
+#include "abcgException.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define ABCG_IMAGE_SSE 1
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define ABCG_IMAGE_NEON 1
+#include <arm_neon.h>
+#endif
+
+// NOLINTBEGIN(cppcoreguidelines-pro-type-reinterpret-cast)
+// NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+
+namespace {
+
+#if defined(ABCG_IMAGE_SSE)
+// SSE2 is part of x86-64, but SSSE3 is checked at runtime so that the library
+// does not need to be compiled with -mssse3
+#if defined(__GNUC__) || defined(__clang__)
+#define ABCG_TARGET_SSSE3 __attribute__((target("ssse3")))
+bool hasSSSE3() {
+  static bool const supported{__builtin_cpu_supports("ssse3") != 0};
+  return supported;
+}
+#else
+#define ABCG_TARGET_SSSE3
+bool hasSSSE3() {
+  static bool const supported{[] {
+    std::array<int, 4> info{};
+    __cpuid(info.data(), 1);
+    return (info[2] & (1 << 9)) != 0;
+  }()};
+  return supported;
+}
+#endif
+#endif
+
+using RangeFunction = std::function<void(std::size_t, std::size_t)>;
+
+// Calls function(begin, end) for blocks of the range [0, count), in parallel
+// if each thread gets at least 1 MiB of data
+void parallelFor(std::size_t count, std::size_t bytesPerItem,
+                 RangeFunction const &function) {
+  std::size_t threadCount{1};
+#if !defined(__EMSCRIPTEN__)
+  constexpr std::size_t minBytesPerThread{std::size_t{1} << 20U};
+  threadCount = std::min({std::size_t{std::thread::hardware_concurrency()},
+                          std::size_t{8}, count,
+                          count * bytesPerItem / minBytesPerThread});
+#endif
+  if (threadCount <= 1) {
+    function(0, count);
+    return;
+  }
+
+  auto const blockSize{(count + threadCount - 1) / threadCount};
+  std::vector<std::thread> workers;
+  workers.reserve(threadCount - 1);
+  try {
+    for (auto begin{blockSize}; begin < count; begin += blockSize) {
+      workers.emplace_back(function, begin, std::min(begin + blockSize, count));
+    }
+    function(0, blockSize);
+  } catch (...) {
+    for (auto &worker : workers) {
+      worker.join();
+    }
+    throw;
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+std::uint8_t *getRow(abcg::ImageView const &image, std::size_t row) {
+  return reinterpret_cast<std::uint8_t *>(image.pixels) + row * image.pitch;
+}
+
+void checkChannels(abcg::ImageView const &image) {
+  if (image.channels < 1 || image.channels > 4) {
+    throw abcg::RuntimeError(
+        fmt::format("Unsupported number of channels: {}", image.channels));
+  }
+}
+
+// Swaps pixels from both ends of [first, last] until they meet
+void reverseRowScalar(std::uint8_t *row, std::size_t first, std::size_t last,
+                      std::size_t channels) {
+  while (first < last) {
+    std::swap_ranges(row + first * channels, row + (first + 1) * channels,
+                     row + last * channels);
+    ++first;
+    --last;
+  }
+}
+
+void reverseRowRGBA(std::uint8_t *row, std::size_t width) {
+  std::size_t left{};
+  auto right{width};
+#if defined(ABCG_IMAGE_SSE)
+  // Swap blocks of 4 pixels from both ends
+  while (right - left >= 8) {
+    auto *const leftBlock{reinterpret_cast<__m128i *>(row + left * 4)};
+    auto *const rightBlock{reinterpret_cast<__m128i *>(row + (right - 4) * 4)};
+    auto const leftPixels{_mm_loadu_si128(leftBlock)};
+    auto const rightPixels{_mm_loadu_si128(rightBlock)};
+    _mm_storeu_si128(leftBlock, _mm_shuffle_epi32(rightPixels, 0x1B));
+    _mm_storeu_si128(rightBlock, _mm_shuffle_epi32(leftPixels, 0x1B));
+    left += 4;
+    right -= 4;
+  }
+#elif defined(ABCG_IMAGE_NEON)
+  auto const reverse{[](uint8x16_t pixels) {
+    auto const swapped{vrev64q_u32(vreinterpretq_u32_u8(pixels))};
+    return vreinterpretq_u8_u32(vextq_u32(swapped, swapped, 2));
+  }};
+  while (right - left >= 8) {
+    auto *const leftBlock{row + left * 4};
+    auto *const rightBlock{row + (right - 4) * 4};
+    auto const leftPixels{vld1q_u8(leftBlock)};
+    auto const rightPixels{vld1q_u8(rightBlock)};
+    vst1q_u8(leftBlock, reverse(rightPixels));
+    vst1q_u8(rightBlock, reverse(leftPixels));
+    left += 4;
+    right -= 4;
+  }
+#endif
+  if (right > left) {
+    reverseRowScalar(row, left, right - 1, 4);
+  }
+}
+
+#if defined(ABCG_IMAGE_SSE)
+// Swaps blocks of 5 RGB pixels (15 bytes) from both ends with 16-byte loads
+// and stores. The extra byte of each store is restored from the load, so the
+// blocks must be at least 12 pixels apart.
+ABCG_TARGET_SSSE3 void reverseRowRGBSSSE3(std::uint8_t *row, std::size_t &left,
+                                          std::size_t &right) {
+  // Reverses the pixels of the right block, which are in bytes 1 to 15, to
+  // bytes 0 to 14
+  auto const reverseRight{_mm_setr_epi8(13, 14, 15, 10, 11, 12, 7, 8, 9, 4, 5,
+                                        6, 1, 2, 3, -128)};
+  // Reverses the pixels of the left block, which are in bytes 0 to 14, to
+  // bytes 1 to 15
+  auto const reverseLeft{_mm_setr_epi8(-128, 12, 13, 14, 9, 10, 11, 6, 7, 8, 3,
+                                       4, 5, 0, 1, 2)};
+  auto const lastByte{
+      _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, -1)};
+  auto const firstByte{
+      _mm_setr_epi8(-1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)};
+
+  while (right - left >= 12) {
+    auto *const leftBlock{reinterpret_cast<__m128i *>(row + left * 3)};
+    auto *const rightBlock{
+        reinterpret_cast<__m128i *>(row + (right - 5) * 3 - 1)};
+    auto const leftPixels{_mm_loadu_si128(leftBlock)};
+    auto const rightPixels{_mm_loadu_si128(rightBlock)};
+    _mm_storeu_si128(leftBlock,
+                     _mm_or_si128(_mm_shuffle_epi8(rightPixels, reverseRight),
+                                  _mm_and_si128(leftPixels, lastByte)));
+    _mm_storeu_si128(rightBlock,
+                     _mm_or_si128(_mm_shuffle_epi8(leftPixels, reverseLeft),
+                                  _mm_and_si128(rightPixels, firstByte)));
+    left += 5;
+    right -= 5;
+  }
+}
+#endif
+
+void reverseRowRGB(std::uint8_t *row, std::size_t width) {
+  std::size_t left{};
+  auto right{width};
+#if defined(ABCG_IMAGE_SSE)
+  if (hasSSSE3()) {
+    reverseRowRGBSSSE3(row, left, right);
+  }
+#elif defined(ABCG_IMAGE_NEON)
+  auto const reverse{[](uint8x16_t channel) {
+    auto const swapped{vrev64q_u8(channel)};
+    return vextq_u8(swapped, swapped, 8);
+  }};
+  // Swap blocks of 16 deinterleaved pixels from both ends
+  while (right - left >= 32) {
+    auto *const leftBlock{row + left * 3};
+    auto *const rightBlock{row + (right - 16) * 3};
+    auto leftPixels{vld3q_u8(leftBlock)};
+    auto rightPixels{vld3q_u8(rightBlock)};
+    for (auto const channel : {0, 1, 2}) {
+      auto const leftChannel{leftPixels.val[channel]};
+      leftPixels.val[channel] = reverse(rightPixels.val[channel]);
+      rightPixels.val[channel] = reverse(leftChannel);
+    }
+    vst3q_u8(leftBlock, leftPixels);
+    vst3q_u8(rightBlock, rightPixels);
+    left += 16;
+    right -= 16;
+  }
+#endif
+  if (right > left) {
+    reverseRowScalar(row, left, right - 1, 3);
+  }
+}
+
+void swapRows(std::uint8_t *first, std::uint8_t *second, std::size_t size) {
+  std::size_t offset{};
+#if defined(ABCG_IMAGE_SSE)
+  for (; offset + 64 <= size; offset += 64) {
+    auto *const a{reinterpret_cast<__m128i *>(first + offset)};
+    auto *const b{reinterpret_cast<__m128i *>(second + offset)};
+    auto const a0{_mm_loadu_si128(a)};
+    auto const a1{_mm_loadu_si128(a + 1)};
+    auto const a2{_mm_loadu_si128(a + 2)};
+    auto const a3{_mm_loadu_si128(a + 3)};
+    auto const b0{_mm_loadu_si128(b)};
+    auto const b1{_mm_loadu_si128(b + 1)};
+    auto const b2{_mm_loadu_si128(b + 2)};
+    auto const b3{_mm_loadu_si128(b + 3)};
+    _mm_storeu_si128(a, b0);
+    _mm_storeu_si128(a + 1, b1);
+    _mm_storeu_si128(a + 2, b2);
+    _mm_storeu_si128(a + 3, b3);
+    _mm_storeu_si128(b, a0);
+    _mm_storeu_si128(b + 1, a1);
+    _mm_storeu_si128(b + 2, a2);
+    _mm_storeu_si128(b + 3, a3);
+  }
+#elif defined(ABCG_IMAGE_NEON)
+  for (; offset + 64 <= size; offset += 64) {
+    auto const a{vld1q_u8_x4(first + offset)};
+    auto const b{vld1q_u8_x4(second + offset)};
+    vst1q_u8_x4(first + offset, b);
+    vst1q_u8_x4(second + offset, a);
+  }
+#endif
+  std::swap_ranges(first + offset, first + size, second + offset);
+}
+
+void expandRowScalar(std::uint8_t const *source, std::uint8_t *destination,
+                     std::size_t first, std::size_t width,
+                     std::uint8_t alpha) {
+  for (auto pixel{first}; pixel < width; ++pixel) {
+    destination[pixel * 4 + 0] = source[pixel * 3 + 0];
+    destination[pixel * 4 + 1] = source[pixel * 3 + 1];
+    destination[pixel * 4 + 2] = source[pixel * 3 + 2];
+    destination[pixel * 4 + 3] = alpha;
+  }
+}
+
+#if defined(ABCG_IMAGE_SSE)
+// Expands 4 pixels per iteration. Each load reads 16 bytes, so it stops 6
+// pixels before the end of the row
+ABCG_TARGET_SSSE3 std::size_t
+expandRowSSSE3(std::uint8_t const *source, std::uint8_t *destination,
+               std::size_t width, std::uint8_t alpha) {
+  auto const expand{_mm_setr_epi8(0, 1, 2, -128, 3, 4, 5, -128, 6, 7, 8, -128,
+                                  9, 10, 11, -128)};
+  auto const alphaMask{_mm_set1_epi32(gsl::narrow_cast<int>(
+      static_cast<std::uint32_t>(alpha) << 24U))};
+  std::size_t pixel{};
+  for (; pixel + 6 <= width; pixel += 4) {
+    auto const pixels{_mm_loadu_si128(
+        reinterpret_cast<__m128i const *>(source + pixel * 3))};
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i *>(destination + pixel * 4),
+        _mm_or_si128(_mm_shuffle_epi8(pixels, expand), alphaMask));
+  }
+  return pixel;
+}
+#endif
+
+void expandRow(std::uint8_t const *source, std::uint8_t *destination,
+               std::size_t width, std::uint8_t alpha) {
+  std::size_t pixel{};
+#if defined(ABCG_IMAGE_SSE)
+  if (hasSSSE3()) {
+    pixel = expandRowSSSE3(source, destination, width, alpha);
+  }
+#elif defined(ABCG_IMAGE_NEON)
+  for (; pixel + 16 <= width; pixel += 16) {
+    auto const rgb{vld3q_u8(source + pixel * 3)};
+    uint8x16x4_t rgba{};
+    rgba.val[0] = rgb.val[0];
+    rgba.val[1] = rgb.val[1];
+    rgba.val[2] = rgb.val[2];
+    rgba.val[3] = vdupq_n_u8(alpha);
+    vst4q_u8(destination + pixel * 4, rgba);
+  }
+#endif
+  expandRowScalar(source, destination, pixel, width, alpha);
+}
+
+// Lookup table from 8-bit sRGB to linear values
+std::array<float, 256> const &getDecodeTable() {
+  static auto const table{[] {
+    std::array<float, 256> values{};
+    for (std::size_t index{}; index < values.size(); ++index) {
+      auto const value{gsl::narrow_cast<float>(index) / 255.0f};
+      values.at(index) =
+          value <= 0.04045f ? value / 12.92f
+                            : std::pow((value + 0.055f) / 1.055f, 2.4f);
+    }
+    return values;
+  }()};
+  return table;
+}
+
+// Lookup table from linear values quantized to 12 bits to 8-bit sRGB. The
+// error is at most one unit of the 8-bit value
+constexpr std::size_t encodeTableSize{4096};
+std::array<std::uint8_t, encodeTableSize> const &getEncodeTable() {
+  static auto const table{[] {
+    std::array<std::uint8_t, encodeTableSize> values{};
+    for (std::size_t index{}; index < values.size(); ++index) {
+      auto const value{gsl::narrow_cast<double>(index) /
+                       gsl::narrow_cast<double>(encodeTableSize - 1)};
+      auto const encoded{value <= 0.0031308
+                             ? value * 12.92
+                             : 1.055 * std::pow(value, 1.0 / 2.4) - 0.055};
+      values.at(index) =
+          gsl::narrow_cast<std::uint8_t>(std::lround(encoded * 255.0));
+    }
+    return values;
+  }()};
+  return table;
+}
+
+using EncodeTable = std::array<std::uint8_t, encodeTableSize>;
+
+std::uint8_t encodeSRGB(float value, EncodeTable const &table) {
+  // Also maps NaN to zero
+  if (!(value > 0.0f))
+    return 0;
+  auto const index{gsl::narrow_cast<std::size_t>(
+      std::min(value, 1.0f) * gsl::narrow_cast<float>(encodeTableSize - 1) +
+      0.5f)};
+  return table[index];
+}
+
+std::uint8_t encodeUnorm(float value) {
+  if (!(value > 0.0f))
+    return 0;
+  return gsl::narrow_cast<std::uint8_t>(std::min(value, 1.0f) * 255.0f + 0.5f);
+}
+
+// Whether a channel holds alpha, which is always linear
+bool isAlpha(std::size_t channel, std::size_t channels) {
+  return channels == 4 && channel == 3;
+}
+
+void downsampleBoxRows(abcg::ImageView const &source,
+                       abcg::ImageView const &destination, bool sRGB,
+                       std::size_t firstRow, std::size_t lastRow) {
+  auto const channels{gsl::narrow<std::size_t>(source.channels)};
+  auto const sourceWidth{gsl::narrow<std::size_t>(source.width)};
+  auto const sourceHeight{gsl::narrow<std::size_t>(source.height)};
+  auto const width{gsl::narrow<std::size_t>(destination.width)};
+  auto const &decode{getDecodeTable()};
+  auto const &encode{getEncodeTable()};
+
+  for (auto row{firstRow}; row < lastRow; ++row) {
+    auto const *const top{getRow(source, std::min(2 * row, sourceHeight - 1))};
+    auto const *const bottom{
+        getRow(source, std::min(2 * row + 1, sourceHeight - 1))};
+    auto *const output{getRow(destination, row)};
+
+    std::size_t pixel{};
+    if (!sRGB && channels == 4) {
+      // Two output pixels per iteration, from 4x2 input pixels
+#if defined(ABCG_IMAGE_SSE)
+      auto const zero{_mm_setzero_si128()};
+      auto const rounding{_mm_set1_epi16(2)};
+      for (; 2 * pixel + 4 <= sourceWidth; pixel += 2) {
+        auto const a{_mm_loadu_si128(
+            reinterpret_cast<__m128i const *>(top + pixel * 8))};
+        auto const b{_mm_loadu_si128(
+            reinterpret_cast<__m128i const *>(bottom + pixel * 8))};
+        auto const low{_mm_add_epi16(_mm_unpacklo_epi8(a, zero),
+                                     _mm_unpacklo_epi8(b, zero))};
+        auto const high{_mm_add_epi16(_mm_unpackhi_epi8(a, zero),
+                                      _mm_unpackhi_epi8(b, zero))};
+        auto const sum{_mm_unpacklo_epi64(
+            _mm_add_epi16(low, _mm_srli_si128(low, 8)),
+            _mm_add_epi16(high, _mm_srli_si128(high, 8)))};
+        auto const average{_mm_srli_epi16(_mm_add_epi16(sum, rounding), 2)};
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(output + pixel * 4),
+                         _mm_packus_epi16(average, average));
+      }
+#elif defined(ABCG_IMAGE_NEON)
+      for (; 2 * pixel + 4 <= sourceWidth; pixel += 2) {
+        auto const a{vld1q_u8(top + pixel * 8)};
+        auto const b{vld1q_u8(bottom + pixel * 8)};
+        auto const low{vaddl_u8(vget_low_u8(a), vget_low_u8(b))};
+        auto const high{vaddl_u8(vget_high_u8(a), vget_high_u8(b))};
+        auto const sum{
+            vcombine_u16(vadd_u16(vget_low_u16(low), vget_high_u16(low)),
+                         vadd_u16(vget_low_u16(high), vget_high_u16(high)))};
+        vst1_u8(output + pixel * 4, vrshrn_n_u16(sum, 2));
+      }
+#endif
+    }
+
+    for (; pixel < width; ++pixel) {
+      auto const left{std::min(2 * pixel, sourceWidth - 1) * channels};
+      auto const right{std::min(2 * pixel + 1, sourceWidth - 1) * channels};
+      for (std::size_t channel{}; channel < channels; ++channel) {
+        auto const a{top[left + channel]};
+        auto const b{top[right + channel]};
+        auto const c{bottom[left + channel]};
+        auto const d{bottom[right + channel]};
+        if (sRGB && !isAlpha(channel, channels)) {
+          output[pixel * channels + channel] = encodeSRGB(
+              (decode[a] + decode[b] + decode[c] + decode[d]) * 0.25f, encode);
+        } else {
+          output[pixel * channels + channel] =
+              gsl::narrow_cast<std::uint8_t>((a + b + c + d + 2) / 4);
+        }
+      }
+    }
+  }
+}
+
+// Weights of the 6 taps of the Kaiser-windowed sinc filter used for halving
+// the resolution. The taps are centered between the two source pixels that
+// correspond to a destination pixel.
+std::array<float, 6> const &getKaiserWeights() {
+  static auto const weights{[] {
+    // Modified Bessel function of the first kind of order zero
+    auto const besselI0{[](double x) {
+      auto sum{1.0};
+      auto term{1.0};
+      for (auto k{1}; k < 32; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+      }
+      return sum;
+    }};
+    auto const beta{4.0};
+    auto const radius{1.5};
+
+    std::array<double, 6> unnormalized{};
+    auto total{0.0};
+    for (std::size_t tap{}; tap < unnormalized.size(); ++tap) {
+      // Distance to the center, in destination pixels
+      auto const t{(gsl::narrow_cast<double>(tap) - 2.5) / 2.0};
+      auto const sinc{std::sin(std::numbers::pi * t) / (std::numbers::pi * t)};
+      auto const ratio{t / radius};
+      auto const window{besselI0(beta * std::sqrt(1.0 - ratio * ratio)) /
+                        besselI0(beta)};
+      unnormalized.at(tap) = sinc * window;
+      total += unnormalized.at(tap);
+    }
+
+    std::array<float, 6> values{};
+    for (std::size_t tap{}; tap < values.size(); ++tap) {
+      values.at(tap) = gsl::narrow_cast<float>(unnormalized.at(tap) / total);
+    }
+    return values;
+  }()};
+  return weights;
+}
+
+void downsampleKaiser(abcg::ImageView const &source,
+                      abcg::ImageView const &destination, bool sRGB) {
+  auto const channels{gsl::narrow<std::size_t>(source.channels)};
+  auto const sourceWidth{gsl::narrow<std::size_t>(source.width)};
+  auto const sourceHeight{gsl::narrow<std::size_t>(source.height)};
+  auto const width{gsl::narrow<std::size_t>(destination.width)};
+  auto const height{gsl::narrow<std::size_t>(destination.height)};
+  auto const &weights{getKaiserWeights()};
+  auto const &decode{getDecodeTable()};
+  auto const &encode{getEncodeTable()};
+
+  // Clamps a tap index, which may be negative, to [0, size - 1]
+  auto const clampTap{[](std::size_t center, std::size_t tap,
+                         std::size_t size) {
+    auto const index{gsl::narrow_cast<std::ptrdiff_t>(2 * center + tap) - 2};
+    return gsl::narrow_cast<std::size_t>(std::clamp<std::ptrdiff_t>(
+        index, 0, gsl::narrow_cast<std::ptrdiff_t>(size) - 1));
+  }};
+
+  // Horizontal pass, from every source row to a row of floats
+  auto const rowSize{width * channels};
+  std::vector<float> horizontal(sourceHeight * rowSize);
+  parallelFor(sourceHeight, sourceWidth * channels * 2,
+              [&](std::size_t firstRow, std::size_t lastRow) {
+                for (auto row{firstRow}; row < lastRow; ++row) {
+                  auto const *const input{getRow(source, row)};
+                  auto *const output{horizontal.data() + row * rowSize};
+                  for (std::size_t pixel{}; pixel < width; ++pixel) {
+                    for (std::size_t channel{}; channel < channels;
+                         ++channel) {
+                      auto const linear{sRGB && !isAlpha(channel, channels)};
+                      auto sum{0.0f};
+                      for (std::size_t tap{}; tap < weights.size(); ++tap) {
+                        auto const value{
+                            input[clampTap(pixel, tap, sourceWidth) *
+                                      channels +
+                                  channel]};
+                        sum += weights.at(tap) *
+                               (linear ? decode[value]
+                                       : gsl::narrow_cast<float>(value) /
+                                             255.0f);
+                      }
+                      output[pixel * channels + channel] = sum;
+                    }
+                  }
+                }
+              });
+
+  // Vertical pass
+  parallelFor(height, rowSize * 6,
+              [&](std::size_t firstRow, std::size_t lastRow) {
+                for (auto row{firstRow}; row < lastRow; ++row) {
+                  auto *const output{getRow(destination, row)};
+                  for (std::size_t index{}; index < rowSize; ++index) {
+                    auto sum{0.0f};
+                    for (std::size_t tap{}; tap < weights.size(); ++tap) {
+                      sum += weights.at(tap) *
+                             horizontal[clampTap(row, tap, sourceHeight) *
+                                            rowSize +
+                                        index];
+                    }
+                    output[index] =
+                        sRGB && !isAlpha(index % channels, channels)
+                            ? encodeSRGB(sum, encode)
+                            : encodeUnorm(sum);
+                  }
+                }
+              });
+}
+
+} // namespace
+
+/**
+ * @brief Flips an image horizontally, in place.
+ *
+ * Pixels are swapped from both ends of each row with 16-byte shuffles when
+ * SSSE3 or NEON is available.
+ *
+ * @param image Image to be flipped.
+ *
+ * @throw abcg::RuntimeError if the number of channels is not supported.
+ */
+void abcg::flipImageHorizontally(ImageView const &image) {
+  checkChannels(image);
+  auto const width{gsl::narrow<std::size_t>(image.width)};
+  auto const channels{gsl::narrow<std::size_t>(image.channels)};
+
+  parallelFor(gsl::narrow<std::size_t>(image.height), width * channels,
+              [&](std::size_t firstRow, std::size_t lastRow) {
+                for (auto row{firstRow}; row < lastRow; ++row) {
+                  auto *const pixels{getRow(image, row)};
+                  if (channels == 4) {
+                    reverseRowRGBA(pixels, width);
+                  } else if (channels == 3) {
+                    reverseRowRGB(pixels, width);
+                  } else if (width > 0) {
+                    reverseRowScalar(pixels, 0, width - 1, channels);
+                  }
+                }
+              });
+}
+
+/**
+ * @brief Flips an image vertically, in place.
+ *
+ * Rows are swapped directly in blocks of 64 bytes, without a temporary row.
+ *
+ * @param image Image to be flipped.
+ *
+ * @throw abcg::RuntimeError if the number of channels is not supported.
+ */
+void abcg::flipImageVertically(ImageView const &image) {
+  checkChannels(image);
+  auto const height{gsl::narrow<std::size_t>(image.height)};
+  auto const rowSize{gsl::narrow<std::size_t>(image.width) *
+                     gsl::narrow<std::size_t>(image.channels)};
+
+  // If height is odd, the middle row is not swapped
+  parallelFor(height / 2, rowSize * 2,
+              [&](std::size_t firstRow, std::size_t lastRow) {
+                for (auto row{firstRow}; row < lastRow; ++row) {
+                  swapRows(getRow(image, row), getRow(image, height - row - 1),
+                           rowSize);
+                }
+              });
+}
+
+/**
+ * @brief Converts an RGB image to RGBA.
+ *
+ * @param source RGB image.
+ * @param destination RGBA image of the same size. It must not overlap with
+ * @a source.
+ * @param alpha Value written to the alpha channel.
+ *
+ * @throw abcg::RuntimeError if the formats or sizes of the images do not
+ * match.
+ */
+void abcg::expandRGBToRGBA(ImageView const &source,
+                           ImageView const &destination, std::uint8_t alpha) {
+  if (source.channels != 3 || destination.channels != 4 ||
+      source.width != destination.width ||
+      source.height != destination.height) {
+    throw abcg::RuntimeError("Invalid images for RGB to RGBA expansion");
+  }
+  auto const width{gsl::narrow<std::size_t>(source.width)};
+
+  parallelFor(gsl::narrow<std::size_t>(source.height), width * 7,
+              [&](std::size_t firstRow, std::size_t lastRow) {
+                for (auto row{firstRow}; row < lastRow; ++row) {
+                  expandRow(getRow(source, row), getRow(destination, row),
+                            width, alpha);
+                }
+              });
+}
+
+/**
+ * @brief Converts 8-bit sRGB values to linear floating-point values.
+ *
+ * If @a channels is 4, the fourth channel is treated as linear alpha and is
+ * only normalized to [0, 1].
+ *
+ * @param source Interleaved sRGB values.
+ * @param destination Linear values, with at least the size of @a source.
+ * @param channels Number of interleaved channels.
+ *
+ * @throw abcg::RuntimeError if @a destination is smaller than @a source.
+ */
+void abcg::convertSRGBToLinear(std::span<std::uint8_t const> source,
+                               std::span<float> destination, int channels) {
+  if (destination.size() < source.size() || channels < 1) {
+    throw abcg::RuntimeError("Invalid buffers for sRGB to linear conversion");
+  }
+  auto const channelCount{gsl::narrow<std::size_t>(channels)};
+  auto const &decode{getDecodeTable()};
+
+  parallelFor(source.size(), 5, [&](std::size_t first, std::size_t last) {
+    for (auto index{first}; index < last; ++index) {
+      destination[index] =
+          isAlpha(index % channelCount, channelCount)
+              ? gsl::narrow_cast<float>(source[index]) / 255.0f
+              : decode[source[index]];
+    }
+  });
+}
+
+/**
+ * @brief Converts linear floating-point values to 8-bit sRGB values.
+ *
+ * Values are clamped to [0, 1]. If @a channels is 4, the fourth channel is
+ * treated as linear alpha and is only scaled to [0, 255].
+ *
+ * @param source Interleaved linear values.
+ * @param destination sRGB values, with at least the size of @a source.
+ * @param channels Number of interleaved channels.
+ *
+ * @throw abcg::RuntimeError if @a destination is smaller than @a source.
+ */
+void abcg::convertLinearToSRGB(std::span<float const> source,
+                               std::span<std::uint8_t> destination,
+                               int channels) {
+  if (destination.size() < source.size() || channels < 1) {
+    throw abcg::RuntimeError("Invalid buffers for linear to sRGB conversion");
+  }
+  auto const channelCount{gsl::narrow<std::size_t>(channels)};
+  auto const &encode{getEncodeTable()};
+
+  parallelFor(source.size(), 5, [&](std::size_t first, std::size_t last) {
+    for (auto index{first}; index < last; ++index) {
+      destination[index] = isAlpha(index % channelCount, channelCount)
+                               ? encodeUnorm(source[index])
+                               : encodeSRGB(source[index], encode);
+    }
+  });
+}
+
+/**
+ * @brief Computes the next mip level of an image.
+ *
+ * @param source Source image.
+ * @param destination Image with half the width and height of @a source,
+ * rounded down and at least 1, and with the same number of channels.
+ * @param filter Downsampling filter.
+ * @param sRGB Whether the color channels are sRGB encoded. If `true`, the
+ * filtering is done in linear space. If the image has 4 channels, the fourth
+ * one is treated as linear alpha.
+ *
+ * @throw abcg::RuntimeError if the sizes or formats of the images do not
+ * match.
+ */
+void abcg::downsampleImage(ImageView const &source,
+                           ImageView const &destination, MipFilter filter,
+                           bool sRGB) {
+  checkChannels(source);
+  if (source.channels != destination.channels ||
+      destination.width != std::max(source.width / 2, 1) ||
+      destination.height != std::max(source.height / 2, 1)) {
+    throw abcg::RuntimeError("Invalid images for downsampling");
+  }
+
+  if (filter == MipFilter::Kaiser) {
+    downsampleKaiser(source, destination, sRGB);
+    return;
+  }
+
+  auto const rowSize{gsl::narrow<std::size_t>(source.width) *
+                     gsl::narrow<std::size_t>(source.channels)};
+  parallelFor(gsl::narrow<std::size_t>(destination.height), rowSize * 2,
+              [&](std::size_t firstRow, std::size_t lastRow) {
+                downsampleBoxRows(source, destination, sRGB, firstRow,
+                                  lastRow);
+              });
+}
+
+// NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+// NOLINTEND(cppcoreguidelines-pro-type-reinterpret-cast)
@@ -0,0 +1,74 @@
+/**
+ * @file abcgImageKernels.hpp
+ * @brief Declaration of image processing kernels.
+ *
+ * The kernels work on raw pixel buffers with 8 bits per channel. They use
+ * SSE2/SSSE3 or NEON instructions when available, with scalar fallbacks, and
+ * split the rows of large images across threads.
+ *
+ * This file is part of ABCg (https://github.com/hbatagelo/abcg).
+ *
+ * @copyright (c) 2021--2023 Harlen Batagelo. All rights reserved.
+ * This project is released under the MIT License.
+ */
+
+#ifndef ABCG_IMAGE_KERNELS_HPP_
+#define ABCG_IMAGE_KERNELS_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace abcg {
+struct ImageView;
+enum class MipFilter;
+void flipImageHorizontally(ImageView const &image);
+void flipImageVertically(ImageView const &image);
+void expandRGBToRGBA(ImageView const &source, ImageView const &destination,
+                     std::uint8_t alpha = 255);
+void convertSRGBToLinear(std::span<std::uint8_t const> source,
+                         std::span<float> destination, int channels);
+void convertLinearToSRGB(std::span<float const> source,
+                         std::span<std::uint8_t> destination, int channels);
+void downsampleImage(ImageView const &source, ImageView const &destination,
+                     MipFilter filter, bool sRGB = false);
+} // namespace abcg
+
+/**
+ * @brief Non-owning view of an image with 8 bits per channel.
+ *
+ * Rows may be padded, as in SDL surfaces, and are addressed through the
+ * pitch.
+ */
+struct abcg::ImageView {
+  /** @brief Pointer to the first byte of the first row. */
+  std::byte *pixels{};
+  /** @brief Width, in pixels. */
+  int width{};
+  /** @brief Height, in pixels. */
+  int height{};
+  /** @brief Distance between the start of consecutive rows, in bytes. */
+  std::size_t pitch{};
+  /** @brief Number of channels (bytes) per pixel, from 1 to 4. */
+  int channels{};
+};
+
+/**
+ * @brief Enumeration of filters used by abcg::downsampleImage.
+ */
+enum class abcg::MipFilter {
+  /** @brief Average of 2x2 pixels.
+   *
+   * This is the fastest filter, and is equivalent to the filter used by most
+   * implementations of `glGenerateMipmap`.
+   */
+  Box,
+  /** @brief Separable 6x6 Kaiser-windowed sinc filter.
+   *
+   * Keeps more detail than the box filter and reduces aliasing in the
+   * smaller mip levels.
+   */
+  Kaiser
+};
+
+#endif
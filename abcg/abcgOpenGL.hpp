@@ -14,8 +14,13 @@
 #define ABCG_OPENGL_HPP_
 
 #include "abcg.hpp"
+#include "abcgOpenGLDynamicResolution.hpp"
+#include "abcgOpenGLFrameCapture.hpp"
+#include "abcgOpenGLFrameGraph.hpp"
 #include "abcgOpenGLImage.hpp"
+#include "abcgOpenGLProfiler.hpp"
 #include "abcgOpenGLShader.hpp"
+#include "abcgOpenGLStreamBuffer.hpp"
 #include "abcgOpenGLWindow.hpp"
 
 #endif
@@ -0,0 +1,770 @@
+/**
+ * @file abcgOpenGLDynamicResolution.cpp
+ * @brief Definition of abcg::OpenGLDynamicResolution members.
+ *
+ * This file is part of ABCg (https://github.com/hbatagelo/abcg).
+ *
+ * @copyright (c) 2021--2023 Harlen Batagelo. All rights reserved.
+ * This project is released under the MIT License.
+ */
+
+#include "abcgOpenGLDynamicResolution.hpp"
+
+#include <algorithm>
+
+#include "abcgException.hpp"
+#include "abcgOpenGLShader.hpp"
+
+namespace {
+// Fullscreen triangle
+char const *const fullscreenVertexShader{R"glsl(
+out vec2 fragTexCoord;
+
+void main() {
+  vec2 position = vec2(float((gl_VertexID & 1) << 2),
+                       float((gl_VertexID & 2) << 1)) - 1.0;
+  fragTexCoord = position * 0.5 + 0.5;
+  gl_Position = vec4(position, 0.0, 1.0);
+}
+)glsl"};
+
+// Catmull-Rom filter with 9 bilinear taps instead of 16 point taps. The two
+// inner weights of each axis are positive, so their texels are read by a
+// single bilinear tap between them. The taps are clamped to the rendered part
+// of the texture.
+char const *const upscaleFragmentShader{R"glsl(
+#ifdef GL_ES
+precision highp float;
+#endif
+
+in vec2 fragTexCoord;
+
+uniform sampler2D colorTexture;
+uniform vec2 renderSize;
+uniform vec2 textureSize;
+
+layout(location = 0) out vec4 outColor;
+
+vec3 tap(float x, float y) {
+  vec2 position = clamp(vec2(x, y), vec2(0.5), renderSize - 0.5);
+  return texture(colorTexture, position / textureSize).rgb;
+}
+
+void main() {
+  vec2 position = fragTexCoord * renderSize;
+  vec2 texel1 = floor(position - 0.5) + 0.5;
+  vec2 f = position - texel1;
+
+  vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+  vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+  vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+  vec2 w3 = f * f * (-0.5 + 0.5 * f);
+  vec2 w12 = w1 + w2;
+
+  vec2 texel0 = texel1 - 1.0;
+  vec2 texel12 = texel1 + w2 / w12;
+  vec2 texel3 = texel1 + 2.0;
+
+  vec3 color = (tap(texel0.x, texel0.y) * w0.x +
+                tap(texel12.x, texel0.y) * w12.x +
+                tap(texel3.x, texel0.y) * w3.x) * w0.y +
+               (tap(texel0.x, texel12.y) * w0.x +
+                tap(texel12.x, texel12.y) * w12.x +
+                tap(texel3.x, texel12.y) * w3.x) * w12.y +
+               (tap(texel0.x, texel3.y) * w0.x +
+                tap(texel12.x, texel3.y) * w12.x +
+                tap(texel3.x, texel3.y) * w3.x) * w3.y;
+
+  // The negative lobes can overshoot near edges
+  outColor = vec4(max(color, 0.0), 1.0);
+}
+)glsl"};
+
+// FXAA 3.11 quality preset 12: finds the direction of the edge from the luma
+// of the 3x3 neighborhood, searches both ends of the edge along it, and
+// blends with the neighbor across the edge by the distance to the nearest
+// end. Thin features shorter than a pixel are blended by the subpixel term.
+// The luma is computed from the color, so the scene needs no luma channel.
+char const *const fxaaFragmentShader{R"glsl(
+#ifdef GL_ES
+precision highp float;
+#endif
+
+in vec2 fragTexCoord;
+
+uniform sampler2D colorTexture;
+uniform vec2 renderSize;
+uniform vec2 textureSize;
+
+layout(location = 0) out vec4 outColor;
+
+const float edgeThresholdMin = 0.0312;
+const float edgeThresholdMax = 0.125;
+const float subpixelQuality = 0.75;
+const int searchSteps = 12;
+const float stepSizes[12] = float[](1.0, 1.0, 1.0, 1.0, 1.0, 1.5, 2.0, 2.0,
+                                    2.0, 2.0, 4.0, 8.0);
+
+vec3 fetch(vec2 position) {
+  position = clamp(position, vec2(0.5), renderSize - 0.5);
+  return texture(colorTexture, position / textureSize).rgb;
+}
+
+float luma(vec3 color) {
+  return sqrt(dot(color, vec3(0.299, 0.587, 0.114)));
+}
+
+float lumaAt(vec2 position) { return luma(fetch(position)); }
+
+void main() {
+  vec2 center = fragTexCoord * renderSize;
+  vec3 colorCenter = fetch(center);
+
+  float lumaCenter = luma(colorCenter);
+  float lumaDown = lumaAt(center + vec2(0.0, -1.0));
+  float lumaUp = lumaAt(center + vec2(0.0, 1.0));
+  float lumaLeft = lumaAt(center + vec2(-1.0, 0.0));
+  float lumaRight = lumaAt(center + vec2(1.0, 0.0));
+
+  float lumaMin = min(lumaCenter, min(min(lumaDown, lumaUp),
+                                      min(lumaLeft, lumaRight)));
+  float lumaMax = max(lumaCenter, max(max(lumaDown, lumaUp),
+                                      max(lumaLeft, lumaRight)));
+  float lumaRange = lumaMax - lumaMin;
+
+  // Not an edge
+  if (lumaRange < max(edgeThresholdMin, lumaMax * edgeThresholdMax)) {
+    outColor = vec4(colorCenter, 1.0);
+    return;
+  }
+
+  float lumaDownLeft = lumaAt(center + vec2(-1.0, -1.0));
+  float lumaUpRight = lumaAt(center + vec2(1.0, 1.0));
+  float lumaUpLeft = lumaAt(center + vec2(-1.0, 1.0));
+  float lumaDownRight = lumaAt(center + vec2(1.0, -1.0));
+
+  float lumaDownUp = lumaDown + lumaUp;
+  float lumaLeftRight = lumaLeft + lumaRight;
+  float lumaLeftCorners = lumaDownLeft + lumaUpLeft;
+  float lumaDownCorners = lumaDownLeft + lumaDownRight;
+  float lumaRightCorners = lumaDownRight + lumaUpRight;
+  float lumaUpCorners = lumaUpRight + lumaUpLeft;
+
+  float edgeHorizontal = abs(-2.0 * lumaLeft + lumaLeftCorners) +
+                         abs(-2.0 * lumaCenter + lumaDownUp) * 2.0 +
+                         abs(-2.0 * lumaRight + lumaRightCorners);
+  float edgeVertical = abs(-2.0 * lumaUp + lumaUpCorners) +
+                       abs(-2.0 * lumaCenter + lumaLeftRight) * 2.0 +
+                       abs(-2.0 * lumaDown + lumaDownCorners);
+  bool isHorizontal = edgeHorizontal >= edgeVertical;
+
+  // Side of the edge with the steepest gradient
+  float luma1 = isHorizontal ? lumaDown : lumaLeft;
+  float luma2 = isHorizontal ? lumaUp : lumaRight;
+  float gradient1 = luma1 - lumaCenter;
+  float gradient2 = luma2 - lumaCenter;
+  bool is1Steepest = abs(gradient1) >= abs(gradient2);
+  float gradientScaled = 0.25 * max(abs(gradient1), abs(gradient2));
+
+  float stepLength = is1Steepest ? -1.0 : 1.0;
+  float lumaLocalAverage = 0.5 * ((is1Steepest ? luma1 : luma2) + lumaCenter);
+
+  // Search both ends of the edge, halfway between the two sides
+  vec2 edge = center;
+  vec2 offset;
+  if (isHorizontal) {
+    edge.y += stepLength * 0.5;
+    offset = vec2(1.0, 0.0);
+  } else {
+    edge.x += stepLength * 0.5;
+    offset = vec2(0.0, 1.0);
+  }
+
+  vec2 end1 = edge - offset;
+  vec2 end2 = edge + offset;
+  float lumaEnd1 = lumaAt(end1) - lumaLocalAverage;
+  float lumaEnd2 = lumaAt(end2) - lumaLocalAverage;
+  bool reached1 = abs(lumaEnd1) >= gradientScaled;
+  bool reached2 = abs(lumaEnd2) >= gradientScaled;
+
+  for (int i = 1; i < searchSteps && !(reached1 && reached2); ++i) {
+    if (!reached1) {
+      end1 -= offset * stepSizes[i];
+      lumaEnd1 = lumaAt(end1) - lumaLocalAverage;
+      reached1 = abs(lumaEnd1) >= gradientScaled;
+    }
+    if (!reached2) {
+      end2 += offset * stepSizes[i];
+      lumaEnd2 = lumaAt(end2) - lumaLocalAverage;
+      reached2 = abs(lumaEnd2) >= gradientScaled;
+    }
+  }
+
+  float distance1 = isHorizontal ? center.x - end1.x : center.y - end1.y;
+  float distance2 = isHorizontal ? end2.x - center.x : end2.y - center.y;
+  bool isDirection1 = distance1 < distance2;
+  float distanceFinal = min(distance1, distance2);
+  float edgeLength = distance1 + distance2;
+
+  // Blend only if the nearest end varies in the same way as the center
+  bool isLumaCenterSmaller = lumaCenter < lumaLocalAverage;
+  bool correctVariation =
+      ((isDirection1 ? lumaEnd1 : lumaEnd2) < 0.0) != isLumaCenterSmaller;
+  float pixelOffset =
+      correctVariation ? 0.5 - distanceFinal / edgeLength : 0.0;
+
+  float lumaAverage = (2.0 * (lumaDownUp + lumaLeftRight) + lumaLeftCorners +
+                       lumaRightCorners) / 12.0;
+  float subpixel = clamp(abs(lumaAverage - lumaCenter) / lumaRange, 0.0, 1.0);
+  subpixel = (-2.0 * subpixel + 3.0) * subpixel * subpixel;
+  pixelOffset = max(pixelOffset, subpixel * subpixel * subpixelQuality);
+
+  vec2 position = center;
+  if (isHorizontal) {
+    position.y += pixelOffset * stepLength;
+  } else {
+    position.x += pixelOffset * stepLength;
+  }
+  outColor = vec4(fetch(position), 1.0);
+}
+)glsl"};
+
+// Bytes per pixel of the color and depth attachments
+constexpr std::size_t colorBytes{4};
+constexpr std::size_t depthBytes{4};
+} // namespace
+
+/**
+ * @brief Creates the upscale and anti-aliasing programs.
+ *
+ * This must be called after the OpenGL context is created. The scene target
+ * is created by the first call to beginFrame.
+ *
+ * @param glslVersion `#version` directive of the shaders, such as
+ * `#version 330 core`.
+ * @param depthBufferSize Number of bits of the depth buffer. If zero, and if
+ * `stencilBufferSize` is zero, there is no depth buffer.
+ * @param stencilBufferSize Number of bits of the stencil buffer.
+ */
+void abcg::OpenGLDynamicResolution::create(std::string const &glslVersion,
+                                           int depthBufferSize,
+                                           int stencilBufferSize) {
+  destroy();
+
+  m_depthBufferSize = depthBufferSize;
+  m_stencilBufferSize = stencilBufferSize;
+
+#if !defined(__EMSCRIPTEN__)
+  // Timestamp queries are not available in OpenGL ES
+  m_timerQueries = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+#endif
+
+  auto const createPass{[&glslVersion](char const *fragmentShader) {
+    Pass pass;
+    pass.program = abcg::createOpenGLProgram(
+        {{.source = glslVersion + fullscreenVertexShader,
+          .stage = abcg::ShaderStage::Vertex},
+         {.source = glslVersion + fragmentShader,
+          .stage = abcg::ShaderStage::Fragment}});
+    pass.renderSizeLoc = glGetUniformLocation(pass.program, "renderSize");
+    pass.textureSizeLoc = glGetUniformLocation(pass.program, "textureSize");
+    return pass;
+  }};
+  m_upscalePass = createPass(upscaleFragmentShader);
+  m_fxaaPass = createPass(fxaaFragmentShader);
+
+  glGenVertexArrays(1, &m_emptyVAO);
+
+  m_controller.reset();
+  m_renderScale = m_controller.getScale();
+  m_frameTimerStarted = false;
+}
+
+/**
+ * @brief Releases the OpenGL resources.
+ */
+void abcg::OpenGLDynamicResolution::destroy() {
+  if (m_upscalePass.program == 0)
+    return;
+
+  destroyTarget();
+  m_frameGraph.destroy();
+  for (auto &query : m_queries) {
+    if (query.begin != 0) {
+      std::array const names{query.begin, query.end};
+      glDeleteQueries(gsl::narrow<GLsizei>(names.size()), names.data());
+    }
+    query = {};
+  }
+  m_currentQuery = 0;
+
+  glDeleteVertexArrays(1, &m_emptyVAO);
+  for (auto *pass : {&m_upscalePass, &m_fxaaPass}) {
+    glDeleteProgram(pass->program);
+    *pass = {};
+  }
+  m_emptyVAO = 0;
+}
+
+/**
+ * @brief Returns whether the OpenGL resources were created.
+ *
+ * @return `true` if create was called and destroy was not called after it.
+ */
+bool abcg::OpenGLDynamicResolution::isCreated() const noexcept {
+  return m_upscalePass.program != 0;
+}
+
+/**
+ * @brief Sets the configuration settings.
+ *
+ * The scene target is resized, if needed, by the next call to beginFrame.
+ *
+ * @param settings Dynamic resolution settings.
+ */
+void abcg::OpenGLDynamicResolution::setSettings(
+    DynamicResolutionSettings const &settings) noexcept {
+  m_controller.setSettings(settings);
+}
+
+/**
+ * @brief Returns the configuration settings.
+ *
+ * @return Reference to the settings, with the scales clamped to valid values.
+ */
+abcg::DynamicResolutionSettings const &
+abcg::OpenGLDynamicResolution::getSettings() const noexcept {
+  return m_controller.getSettings();
+}
+
+/**
+ * @brief Sets the anti-aliasing method of the scene target.
+ *
+ * The scene target is recreated by the next call to beginFrame. The number of
+ * samples is clamped to `GL_MAX_SAMPLES`.
+ *
+ * @param settings Anti-aliasing settings.
+ */
+void abcg::OpenGLDynamicResolution::setAntiAliasingSettings(
+    OpenGLAntiAliasingSettings const &settings) noexcept {
+  m_antiAliasingSettings = settings;
+  m_antiAliasingSettings.samples = std::max(settings.samples, 0);
+  m_targetDirty = true;
+}
+
+/**
+ * @brief Returns the anti-aliasing method of the scene target.
+ *
+ * @return Reference to the anti-aliasing settings.
+ */
+abcg::OpenGLAntiAliasingSettings const &
+abcg::OpenGLDynamicResolution::getAntiAliasingSettings() const noexcept {
+  return m_antiAliasingSettings;
+}
+
+/**
+ * @brief Returns the memory used by the scene target.
+ *
+ * @return Size of the attachments of the scene target and of the transient
+ * textures of the resolve and FXAA passes, in bytes.
+ */
+std::size_t abcg::OpenGLDynamicResolution::getMemoryUsage() const noexcept {
+  return m_memoryUsage + m_frameGraph.getMemoryUsage();
+}
+
+/**
+ * @brief Estimates the memory used by a scene target at scale 1.
+ *
+ * This counts the color and depth attachments of the scene and the texture
+ * read by the upscale or by FXAA, but not the framebuffer of the window.
+ *
+ * @param size Size of the scene target, in pixels.
+ * @param settings Anti-aliasing settings.
+ * @param hasDepth Whether the scene target has a depth or depth-stencil
+ * attachment.
+ *
+ * @return Size of the attachments, in bytes.
+ */
+std::size_t abcg::OpenGLDynamicResolution::estimateMemoryUsage(
+    glm::ivec2 const &size, OpenGLAntiAliasingSettings const &settings,
+    bool hasDepth) noexcept {
+  auto const pixels{gsl::narrow_cast<std::size_t>(std::max(size.x, 0)) *
+                    gsl::narrow_cast<std::size_t>(std::max(size.y, 0))};
+  auto const samples{
+      settings.method == OpenGLAntiAliasing::MSAA
+          ? gsl::narrow_cast<std::size_t>(std::max(settings.samples, 0))
+          : 0};
+
+  // The single-sampled color texture is rendered to directly if there is no
+  // multisampling, and is the resolve target otherwise
+  auto bytes{pixels * colorBytes};
+  if (samples > 0) {
+    bytes += pixels * samples * colorBytes;
+  }
+  if (hasDepth) {
+    bytes += pixels * std::max<std::size_t>(samples, 1) * depthBytes;
+  }
+  return bytes;
+}
+
+/**
+ * @brief Starts rendering the scene.
+ *
+ * Passes the frame times that became available to the controller, chooses
+ * the render size from the current scale, and binds the scene target with a
+ * viewport of that size.
+ *
+ * @param windowSize Size of the framebuffer to which the scene is upscaled,
+ * in pixels.
+ */
+void abcg::OpenGLDynamicResolution::beginFrame(glm::ivec2 const &windowSize) {
+  if (!isCreated())
+    return;
+
+  auto const &settings{m_controller.getSettings()};
+  auto const targetScale{settings.enabled ? settings.maxScale : 1.0f};
+  auto const targetSize{glm::max(
+      glm::ivec2{glm::ceil(glm::vec2{windowSize} * targetScale)},
+      glm::ivec2{1})};
+  if (m_targetDirty || targetSize != m_targetSize) {
+    destroyTarget();
+    createTarget(targetSize);
+  }
+  m_windowSize = windowSize;
+
+#if !defined(__EMSCRIPTEN__)
+  if (m_timerQueries) {
+    // Oldest first, as queries complete in order
+    for (auto const offset : iter::range(m_queries.size())) {
+      auto &query{m_queries.at((m_currentQuery + offset) % m_queries.size())};
+      if (!collect(query))
+        break;
+    }
+  }
+#endif
+  if (!m_timerQueries) {
+    if (m_frameTimerStarted) {
+      m_controller.update(m_frameTimer.elapsed() * 1000.0, m_renderScale);
+    }
+    m_frameTimer.restart();
+    m_frameTimerStarted = true;
+  }
+
+  m_renderScale = m_controller.getScale();
+  m_renderSize = glm::clamp(
+      glm::ivec2{glm::round(glm::vec2{windowSize} * m_renderScale)},
+      glm::ivec2{1}, m_targetSize);
+
+#if !defined(__EMSCRIPTEN__)
+  if (m_timerQueries) {
+    // The results of this query, if any, were not available in time and are
+    // dropped
+    auto &query{m_queries.at(m_currentQuery)};
+    if (query.begin == 0) {
+      std::array<GLuint, 2> names{};
+      glGenQueries(gsl::narrow<GLsizei>(names.size()), names.data());
+      query.begin = names.at(0);
+      query.end = names.at(1);
+    }
+    query.scale = m_renderScale;
+    query.pending = false;
+    glQueryCounter(query.begin, GL_TIMESTAMP);
+  }
+#endif
+
+  glBindFramebuffer(GL_FRAMEBUFFER, m_sceneFBO);
+  glViewport(0, 0, m_renderSize.x, m_renderSize.y);
+}
+
+/**
+ * @brief Applies the anti-aliasing and upscales the scene to a framebuffer.
+ *
+ * The framebuffer is left bound with a viewport of the size of the window.
+ *
+ * @param framebuffer Framebuffer that represents the window.
+ */
+void abcg::OpenGLDynamicResolution::endFrame(GLuint framebuffer) {
+  if (!isCreated())
+    return;
+
+  upscale(framebuffer);
+
+#if !defined(__EMSCRIPTEN__)
+  if (m_timerQueries) {
+    auto &query{m_queries.at(m_currentQuery)};
+    glQueryCounter(query.end, GL_TIMESTAMP);
+    query.pending = true;
+    m_currentQuery = (m_currentQuery + 1) % m_queries.size();
+  }
+#endif
+}
+
+/**
+ * @brief Returns the scene target.
+ *
+ * Bind this instead of the window framebuffer when restoring the scene target
+ * between beginFrame and endFrame.
+ *
+ * @return Name of the framebuffer object, or zero if the resources were not
+ * created.
+ */
+GLuint abcg::OpenGLDynamicResolution::getFramebuffer() const noexcept {
+  return m_sceneFBO;
+}
+
+/**
+ * @brief Returns the size of the part of the scene target used by the
+ * current frame.
+ *
+ * @return Render size, in pixels.
+ */
+glm::ivec2 abcg::OpenGLDynamicResolution::getRenderSize() const noexcept {
+  return m_renderSize;
+}
+
+/**
+ * @brief Returns the scale of the current frame.
+ *
+ * @return Ratio between the render size and the window size.
+ */
+float abcg::OpenGLDynamicResolution::getScale() const noexcept {
+  return m_renderScale;
+}
+
+/**
+ * @brief Returns the smoothed frame time at the current scale.
+ *
+ * @return Frame time, in milliseconds, or a negative value if no frame was
+ * measured since the last change of scale.
+ */
+double abcg::OpenGLDynamicResolution::getFrameTime() const noexcept {
+  return m_controller.getFrameTime();
+}
+
+void abcg::OpenGLDynamicResolution::createTarget(glm::ivec2 const &size) {
+  m_targetSize = size;
+  m_targetDirty = false;
+
+  GLint maxSamples{};
+  glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+  m_samples = m_antiAliasingSettings.method == OpenGLAntiAliasing::MSAA
+                  ? std::min(m_antiAliasingSettings.samples, maxSamples)
+                  : 0;
+
+  auto const createRenderbuffer{[&size](GLsizei samples,
+                                        GLenum internalFormat) {
+    GLuint renderbuffer{};
+    glGenRenderbuffers(1, &renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, internalFormat,
+                                     size.x, size.y);
+    return renderbuffer;
+  }};
+
+  glGenFramebuffers(1, &m_sceneFBO);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_sceneFBO);
+  if (m_samples > 0) {
+    m_sceneColorRBO = createRenderbuffer(m_samples, GL_RGBA8);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                              GL_RENDERBUFFER, m_sceneColorRBO);
+  } else {
+    // Read directly by FXAA or by the upscale. Keep the texture binding of
+    // the caller
+    GLint textureBinding{};
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &textureBinding);
+    glGenTextures(1, &m_colorTexture);
+    glBindTexture(GL_TEXTURE_2D, m_colorTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size.x, size.y, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, gsl::narrow<GLuint>(textureBinding));
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           m_colorTexture, 0);
+  }
+
+  if (m_depthBufferSize > 0 || m_stencilBufferSize > 0) {
+    auto const hasStencil{m_stencilBufferSize > 0};
+    m_sceneDepthRBO = createRenderbuffer(
+        m_samples, hasStencil ? GL_DEPTH24_STENCIL8 : GL_DEPTH_COMPONENT24);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER,
+                              hasStencil ? GL_DEPTH_STENCIL_ATTACHMENT
+                                         : GL_DEPTH_ATTACHMENT,
+                              GL_RENDERBUFFER, m_sceneDepthRBO);
+  }
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    throw abcg::RuntimeError("Failed to create dynamic resolution target");
+  }
+
+  // The resolved and antialiased textures are transient textures of the
+  // frame graph
+  m_memoryUsage = gsl::narrow_cast<std::size_t>(size.x) *
+                  gsl::narrow_cast<std::size_t>(size.y) *
+                  gsl::narrow_cast<std::size_t>(std::max(m_samples, 1)) *
+                  (colorBytes + (m_sceneDepthRBO != 0 ? depthBytes : 0));
+
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_sceneFBO);
+}
+
+void abcg::OpenGLDynamicResolution::destroyTarget() {
+  if (m_sceneFBO == 0)
+    return;
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  for (auto *renderbuffer : {&m_sceneColorRBO, &m_sceneDepthRBO}) {
+    glDeleteRenderbuffers(1, renderbuffer);
+    *renderbuffer = 0;
+  }
+  glDeleteFramebuffers(1, &m_sceneFBO);
+  glDeleteTextures(1, &m_colorTexture);
+  m_sceneFBO = 0;
+  m_colorTexture = 0;
+  m_targetSize = {};
+  m_memoryUsage = 0;
+}
+
+// Passes the frame time of a query to the controller if it is available.
+// Returns false if the query is still pending.
+bool abcg::OpenGLDynamicResolution::collect(Query &query) {
+#if !defined(__EMSCRIPTEN__)
+  if (!query.pending)
+    return true;
+
+  GLuint available{};
+  glGetQueryObjectuiv(query.end, GL_QUERY_RESULT_AVAILABLE, &available);
+  if (available != GL_TRUE)
+    return false;
+
+  GLuint64 begin{};
+  GLuint64 end{};
+  glGetQueryObjectui64v(query.begin, GL_QUERY_RESULT, &begin);
+  glGetQueryObjectui64v(query.end, GL_QUERY_RESULT, &end);
+  query.pending = false;
+  m_controller.update(gsl::narrow_cast<double>(end - begin) * 1.0e-6,
+                      query.scale);
+#else
+  query.pending = false;
+#endif
+  return true;
+}
+
+// Runs the resolve, FXAA and upscale passes. The transient textures between
+// them are taken from the pool of the frame graph, which follows the size of
+// the target
+void abcg::OpenGLDynamicResolution::upscale(GLuint framebuffer) {
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  GLint windowSampleBuffers{};
+  glGetIntegerv(GL_SAMPLE_BUFFERS, &windowSampleBuffers);
+
+  auto const fullResolution{m_renderSize == m_windowSize};
+  auto const fxaa{m_antiAliasingSettings.method == OpenGLAntiAliasing::FXAA};
+  auto const window{
+      m_frameGraph.importFramebuffer("Window", framebuffer, m_windowSize)};
+  auto const scene{
+      m_frameGraph.importFramebuffer("Scene", m_sceneFBO, m_targetSize)};
+  auto const blit{[this](glm::ivec2 const &size) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_sceneFBO);
+    glBlitFramebuffer(0, 0, m_renderSize.x, m_renderSize.y, 0, 0, size.x,
+                      size.y, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+  }};
+
+  // At full resolution and without FXAA, a blit is enough, unless the window
+  // is multisampled
+  if (fullResolution && !fxaa && windowSampleBuffers == 0) {
+    m_frameGraph.addPass(
+        "Blit",
+        [&](auto &builder) {
+          builder.read(scene);
+          builder.write(window);
+        },
+        [this, &blit] { blit(m_windowSize); });
+    m_frameGraph.execute();
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    return;
+  }
+
+  auto color{m_samples > 0 ? scene
+                           : m_frameGraph.importTexture(
+                                 "Scene color", m_colorTexture, m_targetSize)};
+  if (m_samples > 0) {
+    m_frameGraph.addPass(
+        "Resolve",
+        [&](auto &builder) {
+          builder.read(scene);
+          color = builder.write(
+              builder.create("Resolved", {.size = m_targetSize}));
+        },
+        [this, &blit] { blit(m_renderSize); });
+  }
+
+  auto const draw{[this](Pass const &pass, OpenGLFrameGraph::Resource input) {
+    glUseProgram(pass.program);
+    glUniform2f(pass.renderSizeLoc, gsl::narrow<float>(m_renderSize.x),
+                gsl::narrow<float>(m_renderSize.y));
+    glUniform2f(pass.textureSizeLoc, gsl::narrow<float>(m_targetSize.x),
+                gsl::narrow<float>(m_targetSize.y));
+    glBindTexture(GL_TEXTURE_2D, m_frameGraph.getTexture(input));
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+  }};
+
+  // FXAA runs at the render resolution, before the upscale
+  if (fxaa && !fullResolution) {
+    auto const input{color};
+    m_frameGraph.addPass(
+        "FXAA",
+        [&](auto &builder) {
+          builder.read(input);
+          color = builder.write(
+              builder.create("Antialiased", {.size = m_targetSize}));
+        },
+        [this, &draw, input] {
+          glViewport(0, 0, m_renderSize.x, m_renderSize.y);
+          draw(m_fxaaPass, input);
+        });
+  }
+
+  auto const &lastPass{fxaa && fullResolution ? m_fxaaPass : m_upscalePass};
+  m_frameGraph.addPass(
+      fxaa && fullResolution ? "FXAA" : "Upscale",
+      [&](auto &builder) {
+        builder.read(color);
+        builder.write(window);
+      },
+      [&draw, &lastPass, color] { draw(lastPass, color); });
+
+  // Keep the state of the scene, except for the framebuffer and viewport
+  std::array<GLenum, 5> const capabilities{GL_BLEND, GL_CULL_FACE,
+                                           GL_DEPTH_TEST, GL_SCISSOR_TEST,
+                                           GL_STENCIL_TEST};
+  std::array<GLboolean, capabilities.size()> enabled{};
+  for (auto const index : iter::range(capabilities.size())) {
+    enabled.at(index) = glIsEnabled(capabilities.at(index));
+    glDisable(capabilities.at(index));
+  }
+  GLint program{};
+  GLint vertexArray{};
+  GLint activeTexture{};
+  GLint textureBinding{};
+  glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+  glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vertexArray);
+  glGetIntegerv(GL_ACTIVE_TEXTURE, &activeTexture);
+  glActiveTexture(GL_TEXTURE0);
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &textureBinding);
+  glBindVertexArray(m_emptyVAO);
+
+  m_frameGraph.execute();
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+  glBindVertexArray(gsl::narrow<GLuint>(vertexArray));
+  glBindTexture(GL_TEXTURE_2D, gsl::narrow<GLuint>(textureBinding));
+  glActiveTexture(gsl::narrow<GLenum>(activeTexture));
+  glUseProgram(gsl::narrow<GLuint>(program));
+  for (auto const index : iter::range(capabilities.size())) {
+    if (enabled.at(index) == GL_TRUE) {
+      glEnable(capabilities.at(index));
+    }
+  }
+}
@@ -0,0 +1,176 @@
+/**
+ * @file abcgOpenGLDynamicResolution.hpp
+ * @brief Header file of abcg::OpenGLDynamicResolution.
+ *
+ * Declaration of abcg::OpenGLDynamicResolution.
+ *
+ * This file is part of ABCg (https://github.com/hbatagelo/abcg).
+ *
+ * @copyright (c) 2021--2023 Harlen Batagelo. All rights reserved.
+ * This project is released under the MIT License.
+ */
+
+#ifndef ABCG_OPENGL_DYNAMIC_RESOLUTION_HPP_
+#define ABCG_OPENGL_DYNAMIC_RESOLUTION_HPP_
+
+#include <array>
+#include <cstddef>
+#include <string>
+
+#include "abcgDynamicResolution.hpp"
+#include "abcgExternal.hpp"
+#include "abcgOpenGLFrameGraph.hpp"
+#include "abcgOpenGLFunction.hpp"
+#include "abcgTimer.hpp"
+
+namespace abcg {
+enum class OpenGLAntiAliasing;
+struct OpenGLAntiAliasingSettings;
+class OpenGLDynamicResolution;
+} // namespace abcg
+
+/**
+ * @brief Anti-aliasing method of the scene.
+ *
+ * @sa abcg::OpenGLAntiAliasingSettings.
+ */
+enum class abcg::OpenGLAntiAliasing {
+  /** @brief No anti-aliasing. */
+  None,
+  /** @brief Multisample anti-aliasing of the scene target. */
+  MSAA,
+  /** @brief Fast approximate anti-aliasing. Applied to the single-sampled
+   * scene target as a post-process, before the upscale. */
+  FXAA
+};
+
+/**
+ * @brief Anti-aliasing settings of the scene.
+ *
+ * @sa abcg::OpenGLWindow::setAntiAliasingSettings.
+ */
+struct abcg::OpenGLAntiAliasingSettings {
+  /** @brief Anti-aliasing method. */
+  OpenGLAntiAliasing method{OpenGLAntiAliasing::MSAA};
+  /** @brief Number of samples of the scene target. Used only by
+   * abcg::OpenGLAntiAliasing::MSAA. */
+  int samples{4};
+};
+
+/**
+ * @brief Offscreen scene target whose resolution follows the GPU frame time.
+ *
+ * The scene is rendered to a framebuffer object with the largest size the
+ * scale can reach, of which only the lower-left part of size
+ * abcg::OpenGLDynamicResolution::getRenderSize is used, so that changes of
+ * scale do not reallocate the attachments. At the end of the frame, the
+ * multisampled attachments are resolved and the result is upscaled to the
+ * window with a Catmull-Rom filter. If the anti-aliasing method is
+ * abcg::OpenGLAntiAliasing::FXAA, the scene target is single-sampled and FXAA
+ * is applied at the render resolution before the upscale, which uses a
+ * fraction of the memory and bandwidth of MSAA. These passes run in an
+ * abcg::OpenGLFrameGraph, which pools the textures between them.
+ *
+ * The time taken by the GPU from the start of the scene to the end of the
+ * upscale is measured with timestamp queries, read a few frames later without
+ * waiting, and passed to an abcg::DynamicResolutionController that chooses
+ * the scale of the next frames.
+ *
+ * If timestamp queries are not supported, as in WebGL, the time between
+ * frames is used instead. This time cannot fall below the refresh interval
+ * when vertical sync is enabled.
+ *
+ * @code
+ * dynamicResolution.beginFrame(windowSize);
+ * // Render the scene to dynamicResolution.getFramebuffer() with a viewport
+ * // of size dynamicResolution.getRenderSize()
+ * dynamicResolution.endFrame(windowFramebuffer);
+ * // Render the UI at the window resolution
+ * @endcode
+ *
+ * abcg::OpenGLWindow does this around abcg::OpenGLWindow::onPaint if dynamic
+ * resolution is enabled.
+ */
+class abcg::OpenGLDynamicResolution {
+public:
+  void create(std::string const &glslVersion, int depthBufferSize,
+              int stencilBufferSize);
+  void destroy();
+
+  [[nodiscard]] bool isCreated() const noexcept;
+  void setSettings(DynamicResolutionSettings const &settings) noexcept;
+  [[nodiscard]] DynamicResolutionSettings const &getSettings() const noexcept;
+  void
+  setAntiAliasingSettings(OpenGLAntiAliasingSettings const &settings) noexcept;
+  [[nodiscard]] OpenGLAntiAliasingSettings const &
+  getAntiAliasingSettings() const noexcept;
+
+  void beginFrame(glm::ivec2 const &windowSize);
+  void endFrame(GLuint framebuffer);
+
+  [[nodiscard]] GLuint getFramebuffer() const noexcept;
+  [[nodiscard]] glm::ivec2 getRenderSize() const noexcept;
+  [[nodiscard]] float getScale() const noexcept;
+  [[nodiscard]] double getFrameTime() const noexcept;
+  [[nodiscard]] std::size_t getMemoryUsage() const noexcept;
+
+  [[nodiscard]] static std::size_t
+  estimateMemoryUsage(glm::ivec2 const &size,
+                      OpenGLAntiAliasingSettings const &settings,
+                      bool hasDepth) noexcept;
+
+private:
+  struct Query {
+    GLuint begin{};
+    GLuint end{};
+    float scale{};
+    bool pending{};
+  };
+
+  // Fullscreen pass reading the scene target
+  struct Pass {
+    GLuint program{};
+    GLint renderSizeLoc{-1};
+    GLint textureSizeLoc{-1};
+  };
+
+  void createTarget(glm::ivec2 const &size);
+  void destroyTarget();
+  bool collect(Query &query);
+  void upscale(GLuint framebuffer);
+
+  DynamicResolutionController m_controller;
+  OpenGLAntiAliasingSettings m_antiAliasingSettings;
+  bool m_targetDirty{};
+  int m_samples{};
+  int m_depthBufferSize{};
+  int m_stencilBufferSize{};
+
+  // Scene target, multisampled if m_samples > 0
+  GLuint m_sceneFBO{};
+  GLuint m_sceneColorRBO{};
+  GLuint m_sceneDepthRBO{};
+  // Color attachment of the scene if m_samples == 0
+  GLuint m_colorTexture{};
+  glm::ivec2 m_targetSize{};
+  std::size_t m_memoryUsage{};
+  glm::ivec2 m_windowSize{};
+  glm::ivec2 m_renderSize{};
+  float m_renderScale{1.0f};
+
+  // Resolve, FXAA and upscale passes, and their transient textures
+  OpenGLFrameGraph m_frameGraph;
+  Pass m_upscalePass;
+  Pass m_fxaaPass;
+  GLuint m_emptyVAO{};
+
+  // Timestamps of the frames in flight
+  std::array<Query, 4> m_queries{};
+  std::size_t m_currentQuery{};
+  bool m_timerQueries{};
+  // Fallback when timestamp queries are not supported
+  Timer m_frameTimer;
+  bool m_frameTimerStarted{};
+};
+
+#endif
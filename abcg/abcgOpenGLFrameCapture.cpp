@@ -0,0 +1,387 @@
+/**
+ * @file abcgOpenGLFrameCapture.cpp
+ * @brief Definition of abcg::OpenGLFrameCapture members.
+ *
+ * This file is part of ABCg (https://github.com/hbatagelo/abcg).
+ *
+ * @copyright (c) 2021--2023 Harlen Batagelo. All rights reserved.
+ * This project is released under the MIT License.
+ */
+
+#include "abcgOpenGLFrameCapture.hpp"
+
+#include <cppitertools/itertools.hpp>
+#include <fmt/core.h>
+#include <gsl/gsl>
+
+#include <cstring>
+#include <span>
+
+#include "abcgException.hpp"
+#include "abcgImage.hpp"
+#include "abcgTrace.hpp"
+
+abcg::OpenGLFrameCapture::~OpenGLFrameCapture() {
+  if (m_worker.joinable()) {
+    {
+      std::scoped_lock const lock{m_mutex};
+      m_stopWorker = true;
+    }
+    m_jobAvailable.notify_one();
+    m_worker.join();
+  }
+}
+
+/**
+ * @brief Starts capturing frames.
+ *
+ * Creates the pixel pack buffers and starts the encoder thread. This must be
+ * called with the OpenGL context current.
+ *
+ * @param settings Capture settings.
+ *
+ * @throw abcg::RuntimeError if the output stream could not be opened.
+ */
+void abcg::OpenGLFrameCapture::create(FrameCaptureSettings const &settings) {
+  destroy();
+
+  m_settings = settings;
+  m_settings.bufferCount = std::max(m_settings.bufferCount, 2);
+  m_settings.maxQueuedFrames = std::max(m_settings.maxQueuedFrames, 1);
+
+  if (m_settings.format == FrameCaptureFormat::Y4M) {
+    m_stream.open(m_settings.path, std::ios::binary);
+    if (!m_stream) {
+      throw abcg::RuntimeError(
+          fmt::format("Failed to open {} for writing", m_settings.path));
+    }
+    m_streamSize = {};
+  }
+
+#if !defined(__EMSCRIPTEN__)
+  m_slots.resize(gsl::narrow<std::size_t>(m_settings.bufferCount));
+  for (auto &slot : m_slots) {
+    glGenBuffers(1, &slot.buffer);
+  }
+
+  m_stopWorker = false;
+  m_worker = std::thread{[this] { workerLoop(); }};
+#endif
+
+  m_nextSlot = 0;
+  m_frameIndex = 0;
+  m_capturedFrames = 0;
+  m_skippedFrames = 0;
+  m_active = true;
+}
+
+/**
+ * @brief Stops capturing frames.
+ *
+ * Reads back the frames still in flight, waits until all frames are encoded,
+ * and releases the pixel pack buffers. This must be called with the OpenGL
+ * context current.
+ */
+void abcg::OpenGLFrameCapture::destroy() {
+  if (!m_active)
+    return;
+
+  // Read back the remaining frames, oldest first
+  for ([[maybe_unused]] auto const index : iter::range(m_slots.size())) {
+    auto &slot{m_slots.at(m_nextSlot)};
+    if (slot.fence != nullptr) {
+      readBack(slot);
+    }
+    m_nextSlot = (m_nextSlot + 1) % m_slots.size();
+  }
+
+  if (m_worker.joinable()) {
+    {
+      std::scoped_lock const lock{m_mutex};
+      m_stopWorker = true;
+    }
+    m_jobAvailable.notify_one();
+    m_worker.join();
+  }
+
+  for (auto &slot : m_slots) {
+    glDeleteBuffers(1, &slot.buffer);
+  }
+  m_slots.clear();
+  m_freeBuffers.clear();
+
+  if (m_stream.is_open()) {
+    m_stream.close();
+  }
+
+  m_active = false;
+}
+
+/**
+ * @brief Captures the current contents of a framebuffer.
+ *
+ * Call this after the frame is rendered and before the buffers are swapped.
+ * The function only issues the read into a pixel pack buffer. The frame
+ * issued `bufferCount` calls earlier, if any, is mapped and sent to the
+ * encoder thread.
+ *
+ * @param framebuffer Framebuffer to read from (zero for the default
+ * framebuffer). Must not be multisampled, unless it is the default
+ * framebuffer.
+ * @param readBuffer Color buffer to read from, e.g., `GL_BACK` or
+ * `GL_COLOR_ATTACHMENT0`.
+ * @param size Size of the region to read, in pixels, starting from the
+ * bottom-left corner.
+ */
+void abcg::OpenGLFrameCapture::capture(GLuint framebuffer, GLenum readBuffer,
+                                       glm::ivec2 const &size) {
+  if (!m_active || size.x <= 0 || size.y <= 0)
+    return;
+
+  auto const byteSize{gsl::narrow<std::size_t>(size.x) *
+                      gsl::narrow<std::size_t>(size.y) * 4};
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+  glReadBuffer(readBuffer);
+
+#if defined(__EMSCRIPTEN__)
+  Job job{.pixels = std::vector<std::byte>(byteSize),
+          .size = size,
+          .frameIndex = m_frameIndex++};
+  glReadPixels(0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE,
+               job.pixels.data());
+  enqueue(std::move(job));
+#else
+  auto &slot{m_slots.at(m_nextSlot)};
+  m_nextSlot = (m_nextSlot + 1) % m_slots.size();
+
+  if (slot.fence != nullptr) {
+    readBack(slot);
+  }
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+  if (slot.size != size) {
+    glBufferData(GL_PIXEL_PACK_BUFFER, gsl::narrow<GLsizeiptr>(byteSize),
+                 nullptr, GL_STREAM_READ);
+    slot.size = size;
+  }
+  glReadPixels(0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  slot.frameIndex = m_frameIndex++;
+#endif
+}
+
+/**
+ * @brief Returns whether frames are being captured.
+ *
+ * @return `true` between calls to abcg::OpenGLFrameCapture::create and
+ * abcg::OpenGLFrameCapture::destroy.
+ */
+bool abcg::OpenGLFrameCapture::isActive() const noexcept { return m_active; }
+
+/**
+ * @brief Returns the number of frames encoded so far.
+ *
+ * @return Number of frames written to the output.
+ */
+std::size_t abcg::OpenGLFrameCapture::getCapturedFrames() const noexcept {
+  return m_capturedFrames;
+}
+
+/**
+ * @brief Returns the number of frames that could not be written.
+ *
+ * Frames are skipped if the output file could not be written, or if the
+ * frame size changes during a Y4M capture.
+ *
+ * @return Number of skipped frames.
+ */
+std::size_t abcg::OpenGLFrameCapture::getSkippedFrames() const noexcept {
+  return m_skippedFrames;
+}
+
+void abcg::OpenGLFrameCapture::readBack(Slot &slot) {
+  // This blocks only if the ring is too short to hide the transfer latency
+  auto const timeout{GLuint64{100'000'000}}; // 100 ms
+  while (true) {
+    auto const result{
+        abcg::glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout)};
+    if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+      break;
+    if (result == GL_WAIT_FAILED) {
+      throw abcg::RuntimeError("Failed to wait for frame capture");
+    }
+  }
+  abcg::glDeleteSync(slot.fence);
+  slot.fence = nullptr;
+
+  auto const byteSize{gsl::narrow<std::size_t>(slot.size.x) *
+                      gsl::narrow<std::size_t>(slot.size.y) * 4};
+
+  Job job{.pixels = {}, .size = slot.size, .frameIndex = slot.frameIndex};
+  {
+    // Reuse a buffer already returned by the encoder thread
+    std::scoped_lock const lock{m_mutex};
+    if (!m_freeBuffers.empty()) {
+      job.pixels = std::move(m_freeBuffers.back());
+      m_freeBuffers.pop_back();
+    }
+  }
+  job.pixels.resize(byteSize);
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+  if (auto const *data{glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                                        gsl::narrow<GLsizeiptr>(byteSize),
+                                        GL_MAP_READ_BIT)}) {
+    std::memcpy(job.pixels.data(), data, byteSize);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    enqueue(std::move(job));
+  } else {
+    ++m_skippedFrames;
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void abcg::OpenGLFrameCapture::enqueue(Job job) {
+#if defined(__EMSCRIPTEN__)
+  encode(job);
+#else
+  {
+    std::unique_lock lock{m_mutex};
+    m_jobDone.wait(lock, [this] {
+      return m_jobs.size() <
+             gsl::narrow<std::size_t>(m_settings.maxQueuedFrames);
+    });
+    m_jobs.push_back(std::move(job));
+  }
+  m_jobAvailable.notify_one();
+#endif
+}
+
+void abcg::OpenGLFrameCapture::workerLoop() {
+  Tracer::setThreadName("Frame capture");
+  while (true) {
+    Job job;
+    {
+      std::unique_lock lock{m_mutex};
+      m_jobAvailable.wait(lock,
+                          [this] { return m_stopWorker || !m_jobs.empty(); });
+      // Stop only after all pending frames are encoded
+      if (m_jobs.empty())
+        return;
+      job = std::move(m_jobs.front());
+      m_jobs.pop_front();
+    }
+    m_jobDone.notify_one();
+
+    encode(job);
+
+    std::scoped_lock const lock{m_mutex};
+    m_freeBuffers.push_back(std::move(job.pixels));
+  }
+}
+
+void abcg::OpenGLFrameCapture::encode(Job &job) {
+  TraceScope const scope{"Encode frame", "capture"};
+  // Exceptions must not escape the encoder thread
+  try {
+    switch (m_settings.format) {
+    case FrameCaptureFormat::PNG: {
+      auto const filename{
+          fmt::format(fmt::runtime(m_settings.path), job.frameIndex)};
+      auto *const surface{SDL_CreateRGBSurfaceFrom(
+          job.pixels.data(), job.size.x, job.size.y, 32, job.size.x * 4,
+          0x000000FF, 0x0000FF00, 0x00FF0000, 0xFF000000)};
+      if (surface == nullptr) {
+        ++m_skippedFrames;
+        return;
+      }
+      // OpenGL returns the rows bottom to top
+      abcg::flipVertically(*surface);
+      auto const result{IMG_SavePNG(surface, filename.c_str())};
+      SDL_FreeSurface(surface);
+      if (result != 0) {
+        ++m_skippedFrames;
+        return;
+      }
+    } break;
+    case FrameCaptureFormat::Raw: {
+      auto const filename{
+          fmt::format(fmt::runtime(m_settings.path), job.frameIndex)};
+      std::ofstream stream(filename, std::ios::binary);
+      auto const pitch{gsl::narrow<std::size_t>(job.size.x) * 4};
+      std::span const pixels{job.pixels};
+      for (auto const row : iter::range(job.size.y)) {
+        auto const line{pixels.subspan(
+            gsl::narrow<std::size_t>(job.size.y - row - 1) * pitch, pitch)};
+        stream.write(reinterpret_cast<char const *>(line.data()),
+                     gsl::narrow<std::streamsize>(pitch));
+      }
+      if (!stream) {
+        ++m_skippedFrames;
+        return;
+      }
+    } break;
+    case FrameCaptureFormat::Y4M:
+      writeY4M(job);
+      return;
+    }
+    ++m_capturedFrames;
+  } catch (std::exception const &exception) {
+    fmt::print(stderr, "Frame capture: {}\n", exception.what());
+    ++m_skippedFrames;
+  }
+}
+
+void abcg::OpenGLFrameCapture::writeY4M(Job const &job) {
+  if (m_streamSize == glm::ivec2{}) {
+    m_streamSize = job.size;
+    m_stream << fmt::format("YUV4MPEG2 W{} H{} F{}:1 Ip A1:1 C444\n",
+                            job.size.x, job.size.y, m_settings.frameRate);
+  }
+
+  // The frame size is fixed by the stream header
+  if (job.size != m_streamSize) {
+    ++m_skippedFrames;
+    return;
+  }
+
+  auto const width{gsl::narrow<std::size_t>(job.size.x)};
+  auto const height{gsl::narrow<std::size_t>(job.size.y)};
+  auto const planeSize{width * height};
+  m_streamFrame.resize(planeSize * 3);
+
+  std::span const pixels{job.pixels};
+  std::span const frame{m_streamFrame};
+  auto const yPlane{frame.subspan(0, planeSize)};
+  auto const uPlane{frame.subspan(planeSize, planeSize)};
+  auto const vPlane{frame.subspan(planeSize * 2, planeSize)};
+
+  // RGB to studio-swing BT.601 YCbCr, flipping rows to top to bottom order
+  for (auto const row : iter::range(height)) {
+    auto const source{pixels.subspan((height - row - 1) * width * 4, width * 4)};
+    for (auto const column : iter::range(width)) {
+      auto const red{std::to_integer<int>(source[column * 4])};
+      auto const green{std::to_integer<int>(source[column * 4 + 1])};
+      auto const blue{std::to_integer<int>(source[column * 4 + 2])};
+      auto const index{row * width + column};
+      yPlane[index] = gsl::narrow_cast<std::uint8_t>(
+          ((66 * red + 129 * green + 25 * blue + 128) >> 8) + 16);
+      uPlane[index] = gsl::narrow_cast<std::uint8_t>(
+          ((-38 * red - 74 * green + 112 * blue + 128) >> 8) + 128);
+      vPlane[index] = gsl::narrow_cast<std::uint8_t>(
+          ((112 * red - 94 * green - 18 * blue + 128) >> 8) + 128);
+    }
+  }
+
+  m_stream << "FRAME\n";
+  m_stream.write(reinterpret_cast<char const *>(m_streamFrame.data()),
+                 gsl::narrow<std::streamsize>(m_streamFrame.size()));
+  if (m_stream) {
+    ++m_capturedFrames;
+  } else {
+    ++m_skippedFrames;
+  }
+}
@@ -0,0 +1,162 @@
+/**
+ * @file abcgOpenGLFrameCapture.hpp
+ * @brief Header file of abcg::OpenGLFrameCapture.
+ *
+ * Declaration of abcg::OpenGLFrameCapture.
+ *
+ * This file is part of ABCg (https://github.com/hbatagelo/abcg).
+ *
+ * @copyright (c) 2021--2023 Harlen Batagelo. All rights reserved.
+ * This project is released under the MIT License.
+ */
+
+#ifndef ABCG_OPENGL_FRAME_CAPTURE_HPP_
+#define ABCG_OPENGL_FRAME_CAPTURE_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "abcgExternal.hpp"
+#include "abcgOpenGLFunction.hpp"
+
+namespace abcg {
+enum class FrameCaptureFormat;
+struct FrameCaptureSettings;
+class OpenGLFrameCapture;
+} // namespace abcg
+
+/**
+ * @brief Enumeration of output formats of abcg::OpenGLFrameCapture.
+ */
+enum class abcg::FrameCaptureFormat {
+  /** @brief One PNG file per frame. */
+  PNG,
+  /** @brief One file per frame with the tightly packed RGBA pixels, top row
+   * first. */
+  Raw,
+  /** @brief A single YUV4MPEG2 stream (4:4:4, BT.601) with all frames.
+   *
+   * The stream can be encoded to video with tools such as `ffmpeg -i
+   * capture.y4m capture.mp4`.
+   */
+  Y4M
+};
+
+/**
+ * @brief Configuration settings of abcg::OpenGLFrameCapture.
+ */
+struct abcg::FrameCaptureSettings {
+  /** @brief Output format. */
+  FrameCaptureFormat format{FrameCaptureFormat::PNG};
+  /** @brief Output path.
+   *
+   * For PNG and raw output, this is a format string in which `{}` is replaced
+   * with the frame index, e.g., `frame{:05d}.png`. For Y4M output, this is the
+   * path of the stream file.
+   */
+  std::string path{"frame{:05d}.png"};
+  /** @brief Number of pixel pack buffers in the readback ring.
+   *
+   * A frame is mapped when its buffer is reused, `bufferCount` captures
+   * after it is read, so that the transfer does not stall the pipeline. The
+   * remaining frames are mapped when the capture is destroyed. Minimum is 2.
+   */
+  int bufferCount{3};
+  /** @brief Maximum number of frames waiting to be encoded.
+   *
+   * If the encoder thread falls behind, abcg::OpenGLFrameCapture::capture
+   * blocks until a frame is encoded.
+   */
+  int maxQueuedFrames{8};
+  /** @brief Frame rate written to the header of Y4M streams. */
+  int frameRate{60};
+};
+
+/**
+ * @brief Captures rendered frames asynchronously.
+ *
+ * Frames are read into a ring of pixel pack buffers, each one guarded by a
+ * fence. A buffer is mapped only when it is reused a few frames later, by
+ * which time the transfer has usually finished. The pixels are then copied to
+ * memory and handed to a worker thread that flips and encodes them.
+ *
+ * On WebAssembly, where buffer mapping and threads are not available, the
+ * frames are read and encoded synchronously.
+ *
+ * @remark Objects of this type cannot be copied or copy-constructed.
+ */
+class abcg::OpenGLFrameCapture {
+public:
+  /**
+   * @brief Default constructor.
+   */
+  OpenGLFrameCapture() = default;
+  OpenGLFrameCapture(OpenGLFrameCapture const &) = delete;
+  OpenGLFrameCapture(OpenGLFrameCapture &&) = delete;
+  OpenGLFrameCapture &operator=(OpenGLFrameCapture const &) = delete;
+  OpenGLFrameCapture &operator=(OpenGLFrameCapture &&) = delete;
+  /**
+   * @brief Destructor. Stops the worker thread if it is still running.
+   */
+  ~OpenGLFrameCapture();
+
+  void create(FrameCaptureSettings const &settings);
+  void destroy();
+
+  void capture(GLuint framebuffer, GLenum readBuffer, glm::ivec2 const &size);
+
+  [[nodiscard]] bool isActive() const noexcept;
+  [[nodiscard]] std::size_t getCapturedFrames() const noexcept;
+  [[nodiscard]] std::size_t getSkippedFrames() const noexcept;
+
+private:
+  struct Slot {
+    GLuint buffer{};
+    GLsync fence{};
+    glm::ivec2 size{};
+    std::size_t frameIndex{};
+  };
+
+  struct Job {
+    std::vector<std::byte> pixels;
+    glm::ivec2 size{};
+    std::size_t frameIndex{};
+  };
+
+  void readBack(Slot &slot);
+  void enqueue(Job job);
+  void workerLoop();
+  void encode(Job &job);
+  void writeY4M(Job const &job);
+
+  FrameCaptureSettings m_settings;
+  std::vector<Slot> m_slots;
+  std::size_t m_nextSlot{};
+  std::size_t m_frameIndex{};
+  bool m_active{};
+
+  std::thread m_worker;
+  std::mutex m_mutex;
+  std::condition_variable m_jobAvailable;
+  std::condition_variable m_jobDone;
+  std::deque<Job> m_jobs;
+  std::vector<std::vector<std::byte>> m_freeBuffers;
+  bool m_stopWorker{};
+  std::atomic<std::size_t> m_capturedFrames{};
+  std::atomic<std::size_t> m_skippedFrames{};
+
+  // Accessed only by the worker thread while it is running
+  std::ofstream m_stream;
+  glm::ivec2 m_streamSize{};
+  std::vector<std::uint8_t> m_streamFrame;
+};
+
+#endif
@@ -0,0 +1,603 @@
+/**
+ * @file abcgOpenGLFrameGraph.cpp
+ * @brief Definition of abcg::OpenGLFrameGraph members.
+ *
+ * This file is part of ABCg (https://github.com/hbatagelo/abcg).
+ *
+ * @copyright (c) 2021--2023 Harlen Batagelo. All rights reserved.
+ * This project is released under the MIT License.
+ */
+
+#include "abcgOpenGLFrameGraph.hpp"
+
+#include <algorithm>
+#include <array>
+
+#include <cppitertools/itertools.hpp>
+#include <fmt/core.h>
+
+#include "abcgException.hpp"
+
+namespace {
+struct TextureFormat {
+  GLenum internalFormat;
+  GLenum format;
+  GLenum type;
+  std::size_t bytesPerPixel;
+};
+
+// Formats of transient textures, with the format and type passed to
+// glTexImage2D
+constexpr std::array textureFormats{
+    TextureFormat{GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 4},
+    TextureFormat{GL_SRGB8_ALPHA8, GL_RGBA, GL_UNSIGNED_BYTE, 4},
+    TextureFormat{GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, 8},
+    TextureFormat{GL_RGBA32F, GL_RGBA, GL_FLOAT, 16},
+    TextureFormat{GL_R11F_G11F_B10F, GL_RGB, GL_UNSIGNED_INT_10F_11F_11F_REV,
+                  4},
+    TextureFormat{GL_RG16F, GL_RG, GL_HALF_FLOAT, 4},
+    TextureFormat{GL_R8, GL_RED, GL_UNSIGNED_BYTE, 1},
+    TextureFormat{GL_R16F, GL_RED, GL_HALF_FLOAT, 2},
+    TextureFormat{GL_R32F, GL_RED, GL_FLOAT, 4},
+    TextureFormat{GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT,
+                  4},
+    TextureFormat{GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT, 4},
+    TextureFormat{GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL,
+                  GL_UNSIGNED_INT_24_8, 4}};
+
+TextureFormat const &getTextureFormat(GLenum internalFormat) {
+  auto const *const format{std::ranges::find(
+      textureFormats, internalFormat, &TextureFormat::internalFormat)};
+  if (format == textureFormats.end()) {
+    throw abcg::RuntimeError(fmt::format(
+        "Unsupported format of transient texture: {:#x}", internalFormat));
+  }
+  return *format;
+}
+
+bool isDepthFormat(TextureFormat const &format) {
+  return format.format == GL_DEPTH_COMPONENT ||
+         format.format == GL_DEPTH_STENCIL;
+}
+} // namespace
+
+/**
+ * @brief Adds a pass to the current frame.
+ *
+ * @param name Name of the pass, used in error messages.
+ * @param setup Function called immediately to declare the resources of the
+ * pass with the abcg::OpenGLFrameGraph::PassBuilder passed to it.
+ * @param execute Function called by abcg::OpenGLFrameGraph::execute to render
+ * the pass, unless the pass is culled. The attachments of the pass are bound
+ * when it is called.
+ */
+void abcg::OpenGLFrameGraph::addPass(
+    std::string name, std::function<void(PassBuilder &)> const &setup,
+    std::function<void()> execute) {
+  auto &pass{m_passes.emplace_back()};
+  pass.name = std::move(name);
+  pass.execute = std::move(execute);
+  PassBuilder builder{*this, m_passes.size() - 1};
+  setup(builder);
+}
+
+/**
+ * @brief Imports a color texture owned by the application into the current
+ * frame.
+ *
+ * The texture must remain valid until the end of
+ * abcg::OpenGLFrameGraph::execute.
+ *
+ * @param name Name of the resource, used in error messages.
+ * @param texture Name of the texture object.
+ * @param size Size of the texture, in pixels.
+ *
+ * @return Handle of the resource.
+ */
+abcg::OpenGLFrameGraph::Resource
+abcg::OpenGLFrameGraph::importTexture(std::string name, GLuint texture,
+                                      glm::ivec2 const &size) {
+  m_resources.push_back({.name = std::move(name),
+                         .type = ResourceType::Texture,
+                         .info = {.size = size},
+                         .texture = texture});
+  return m_resources.size() - 1;
+}
+
+/**
+ * @brief Imports a framebuffer owned by the application, such as the window
+ * framebuffer, into the current frame.
+ *
+ * A pass that writes the framebuffer cannot write other attachments, and is
+ * never culled.
+ *
+ * @param name Name of the resource, used in error messages.
+ * @param framebuffer Name of the framebuffer object.
+ * @param size Size of the framebuffer, in pixels.
+ *
+ * @return Handle of the resource.
+ */
+abcg::OpenGLFrameGraph::Resource
+abcg::OpenGLFrameGraph::importFramebuffer(std::string name, GLuint framebuffer,
+                                          glm::ivec2 const &size) {
+  m_resources.push_back({.name = std::move(name),
+                         .type = ResourceType::Framebuffer,
+                         .info = {.size = size},
+                         .framebuffer = framebuffer});
+  return m_resources.size() - 1;
+}
+
+/**
+ * @brief Runs the passes of the current frame.
+ *
+ * The passes whose results are not used are culled, the remaining passes are
+ * sorted, the transient textures are taken from the pool, and the passes are
+ * run. The passes and resources of the frame are then cleared, and the
+ * textures of the pool that were not used are released.
+ *
+ * @throw abcg::RuntimeError if a pass reads a transient texture that no pass
+ * writes, if the passes depend on each other in a cycle, or if an attachment
+ * cannot be created.
+ */
+void abcg::OpenGLFrameGraph::execute() {
+  auto const clear{gsl::finally([this] {
+    m_passes.clear();
+    m_resources.clear();
+  })};
+
+  for (auto const index : compile()) {
+    auto const &pass{m_passes.at(index)};
+
+#if !defined(__EMSCRIPTEN__)
+    // Make image stores of the previous passes visible to this pass
+    if (std::ranges::any_of(pass.reads, [this](Resource resource) {
+          return m_resources.at(resource).imageWrite;
+        })) {
+      glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT |
+                      GL_SHADER_IMAGE_ACCESS_BARRIER_BIT |
+                      GL_FRAMEBUFFER_BARRIER_BIT);
+    }
+#endif
+
+    bindFramebuffer(pass);
+    if (pass.execute) {
+      pass.execute();
+    }
+  }
+
+  releaseUnused();
+}
+
+/**
+ * @brief Releases the textures and framebuffer objects of the pool.
+ */
+void abcg::OpenGLFrameGraph::destroy() {
+  for (auto const &[attachments, framebuffer] : m_framebuffers) {
+    glDeleteFramebuffers(1, &framebuffer);
+  }
+  m_framebuffers.clear();
+  for (auto const &texture : m_pool) {
+    glDeleteTextures(1, &texture.texture);
+  }
+  m_pool.clear();
+  m_passes.clear();
+  m_resources.clear();
+}
+
+/**
+ * @brief Returns the texture of a resource.
+ *
+ * For transient textures, this is valid only while the passes are run by
+ * abcg::OpenGLFrameGraph::execute.
+ *
+ * @param resource Handle of the resource.
+ *
+ * @return Name of the texture object, or zero for imported framebuffers.
+ */
+GLuint abcg::OpenGLFrameGraph::getTexture(Resource resource) const {
+  return m_resources.at(resource).texture;
+}
+
+/**
+ * @brief Returns the memory used by the textures of the pool.
+ *
+ * @return Size of the textures, in bytes.
+ */
+std::size_t abcg::OpenGLFrameGraph::getMemoryUsage() const noexcept {
+  std::size_t bytes{};
+  for (auto const &texture : m_pool) {
+    auto const *const format{
+        std::ranges::find(textureFormats, texture.info.internalFormat,
+                          &TextureFormat::internalFormat)};
+    bytes += gsl::narrow_cast<std::size_t>(texture.info.size.x) *
+             gsl::narrow_cast<std::size_t>(texture.info.size.y) *
+             format->bytesPerPixel;
+  }
+  return bytes;
+}
+
+// Returns the passes to run, in order
+std::vector<std::size_t> abcg::OpenGLFrameGraph::compile() {
+  for (auto const &pass : m_passes) {
+    for (auto const resource : pass.reads) {
+      auto const &node{m_resources.at(resource)};
+      if (node.type == ResourceType::Transient && node.producer == none) {
+        throw abcg::RuntimeError(fmt::format(
+            "Frame graph pass \"{}\" reads \"{}\", which no pass writes",
+            pass.name, node.name));
+      }
+    }
+  }
+
+  cull();
+  auto order{sort()};
+  allocate(order);
+  return order;
+}
+
+// Culls the passes whose outputs are not read, and then the passes that
+// only fed them
+void abcg::OpenGLFrameGraph::cull() {
+  for (auto &pass : m_passes) {
+    pass.refCount = pass.writes.size() + pass.imageWrites.size();
+    for (auto const resource : pass.reads) {
+      ++m_resources.at(resource).readers;
+    }
+  }
+
+  // Resources read by no pass at all. The ones left unread by a culled pass
+  // are added as it is culled, so that no resource is counted twice
+  std::vector<Resource> unread;
+  for (auto const resource : iter::range(m_resources.size())) {
+    if (m_resources.at(resource).readers == 0) {
+      unread.push_back(resource);
+    }
+  }
+
+  auto const cullPass{[this, &unread](PassNode &pass) {
+    pass.culled = true;
+    for (auto const resource : pass.reads) {
+      if (--m_resources.at(resource).readers == 0) {
+        unread.push_back(resource);
+      }
+    }
+  }};
+
+  for (auto &pass : m_passes) {
+    if (!pass.sideEffects && pass.refCount == 0) {
+      cullPass(pass);
+    }
+  }
+
+  while (!unread.empty()) {
+    auto const producer{m_resources.at(unread.back()).producer};
+    unread.pop_back();
+    if (producer == none)
+      continue;
+    auto &pass{m_passes.at(producer)};
+    if (!pass.sideEffects && !pass.culled && --pass.refCount == 0) {
+      cullPass(pass);
+    }
+  }
+}
+
+// Sorts the passes that are not culled so that each pass follows the
+// producers of the resources it reads. Among the passes that are ready, the
+// first one added is taken
+std::vector<std::size_t> abcg::OpenGLFrameGraph::sort() const {
+  auto const count{gsl::narrow_cast<std::size_t>(std::ranges::count_if(
+      m_passes, [](PassNode const &pass) { return !pass.culled; }))};
+
+  std::vector<std::size_t> order;
+  order.reserve(count);
+  std::vector<bool> scheduled(m_passes.size());
+  auto const isReady{[this, &scheduled](std::size_t index) {
+    auto const &pass{m_passes.at(index)};
+    return !pass.culled && !scheduled.at(index) &&
+           std::ranges::all_of(pass.reads, [&](Resource resource) {
+             auto const producer{m_resources.at(resource).producer};
+             return producer == none || producer == index ||
+                    scheduled.at(producer);
+           });
+  }};
+
+  while (order.size() < count) {
+    auto next{none};
+    for (auto const index : iter::range(m_passes.size())) {
+      if (isReady(index)) {
+        next = index;
+        break;
+      }
+    }
+    if (next == none) {
+      throw abcg::RuntimeError("Frame graph passes depend on each other");
+    }
+    scheduled.at(next) = true;
+    order.push_back(next);
+  }
+  return order;
+}
+
+// Assigns pooled textures to the transient resources. A texture is acquired
+// by the pass that writes it and released after the last pass that uses it
+void abcg::OpenGLFrameGraph::allocate(std::vector<std::size_t> const &order) {
+  std::vector<std::size_t> lastUse(m_resources.size(), none);
+  for (auto const position : iter::range(order.size())) {
+    auto const &pass{m_passes.at(order.at(position))};
+    for (auto const *resources : {&pass.reads, &pass.writes,
+                                  &pass.imageWrites}) {
+      for (auto const resource : *resources) {
+        lastUse.at(resource) = position;
+      }
+    }
+  }
+
+  for (auto const position : iter::range(order.size())) {
+    auto const &pass{m_passes.at(order.at(position))};
+    for (auto const *resources : {&pass.writes, &pass.imageWrites}) {
+      for (auto const resource : *resources) {
+        auto &node{m_resources.at(resource)};
+        if (node.type == ResourceType::Transient) {
+          node.texture = acquire(node.info);
+        }
+      }
+    }
+
+    for (auto const *resources : {&pass.reads, &pass.writes,
+                                  &pass.imageWrites}) {
+      for (auto const resource : *resources) {
+        auto const &node{m_resources.at(resource)};
+        if (node.type != ResourceType::Transient ||
+            lastUse.at(resource) != position)
+          continue;
+        auto const texture{std::ranges::find(m_pool, node.texture,
+                                             &PooledTexture::texture)};
+        texture->inUse = false;
+      }
+    }
+  }
+}
+
+// Returns a texture of the pool that is not in use, or creates one
+GLuint abcg::OpenGLFrameGraph::acquire(OpenGLTransientTextureInfo const &info) {
+  auto const pooled{
+      std::ranges::find_if(m_pool, [&info](PooledTexture const &texture) {
+        return !texture.inUse && texture.info == info;
+      })};
+  if (pooled != m_pool.end()) {
+    pooled->inUse = true;
+    pooled->used = true;
+    return pooled->texture;
+  }
+
+  auto const &format{getTextureFormat(info.internalFormat)};
+  auto const filter{isDepthFormat(format) ? GL_NEAREST : GL_LINEAR};
+
+  // Keep the texture binding of the caller
+  GLint textureBinding{};
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &textureBinding);
+  GLuint texture{};
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, gsl::narrow<GLint>(info.internalFormat),
+               info.size.x, info.size.y, 0, format.format, format.type,
+               nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, gsl::narrow<GLuint>(textureBinding));
+
+  m_pool.push_back(
+      {.texture = texture, .info = info, .inUse = true, .used = true});
+  return texture;
+}
+
+// Binds the attachments written by a pass and sets the viewport to their size
+void abcg::OpenGLFrameGraph::bindFramebuffer(PassNode const &pass) {
+  if (pass.writes.empty())
+    return;
+
+  auto const &first{m_resources.at(pass.writes.front())};
+  if (first.type == ResourceType::Framebuffer) {
+    glBindFramebuffer(GL_FRAMEBUFFER, first.framebuffer);
+    glViewport(0, 0, first.info.size.x, first.info.size.y);
+    return;
+  }
+
+  std::vector<GLuint> attachments;
+  GLuint depthTexture{};
+  GLenum depthAttachment{GL_DEPTH_ATTACHMENT};
+  for (auto const resource : pass.writes) {
+    auto const &node{m_resources.at(resource)};
+    auto const &format{getTextureFormat(node.info.internalFormat)};
+    if (isDepthFormat(format)) {
+      depthTexture = node.texture;
+      if (format.format == GL_DEPTH_STENCIL) {
+        depthAttachment = GL_DEPTH_STENCIL_ATTACHMENT;
+      }
+    } else {
+      attachments.push_back(node.texture);
+    }
+  }
+  auto const colorCount{attachments.size()};
+  attachments.push_back(depthTexture);
+
+  auto [framebuffer, inserted]{m_framebuffers.try_emplace(attachments, 0)};
+  if (!inserted) {
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer->second);
+  } else {
+    glGenFramebuffers(1, &framebuffer->second);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer->second);
+
+    std::vector<GLenum> drawBuffers;
+    for (auto const index : iter::range(colorCount)) {
+      auto const attachment{GL_COLOR_ATTACHMENT0 +
+                            gsl::narrow<GLenum>(index)};
+      glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D,
+                             attachments.at(index), 0);
+      drawBuffers.push_back(attachment);
+    }
+    if (depthTexture != 0) {
+      glFramebufferTexture2D(GL_FRAMEBUFFER, depthAttachment, GL_TEXTURE_2D,
+                             depthTexture, 0);
+    }
+    // Depth-only passes have no draw buffers
+    if (drawBuffers.empty()) {
+      drawBuffers.push_back(GL_NONE);
+    }
+    glDrawBuffers(gsl::narrow<GLsizei>(drawBuffers.size()),
+                  drawBuffers.data());
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+      throw abcg::RuntimeError(fmt::format(
+          "Failed to create framebuffer of frame graph pass \"{}\"",
+          pass.name));
+    }
+  }
+
+  glViewport(0, 0, first.info.size.x, first.info.size.y);
+}
+
+// Releases the textures of the pool that were not used in this frame, and the
+// framebuffer objects to which they were attached
+void abcg::OpenGLFrameGraph::releaseUnused() {
+  for (auto const &texture : m_pool) {
+    if (texture.used)
+      continue;
+    for (auto framebuffer{m_framebuffers.begin()};
+         framebuffer != m_framebuffers.end();) {
+      if (std::ranges::find(framebuffer->first, texture.texture) !=
+          framebuffer->first.end()) {
+        glDeleteFramebuffers(1, &framebuffer->second);
+        framebuffer = m_framebuffers.erase(framebuffer);
+      } else {
+        ++framebuffer;
+      }
+    }
+    glDeleteTextures(1, &texture.texture);
+  }
+  std::erase_if(m_pool, [](PooledTexture const &texture) {
+    return !texture.used;
+  });
+  for (auto &texture : m_pool) {
+    texture.used = false;
+  }
+}
+
+/**
+ * @brief Declares a transient texture.
+ *
+ * The texture must be written by exactly one pass, which need not be this
+ * one.
+ *
+ * @param name Name of the resource, used in error messages.
+ * @param info Size and format of the texture.
+ *
+ * @return Handle of the resource.
+ *
+ * @throw abcg::RuntimeError if the format is not supported.
+ */
+abcg::OpenGLFrameGraph::Resource abcg::OpenGLFrameGraph::PassBuilder::create(
+    std::string name, OpenGLTransientTextureInfo const &info) {
+  // Fail at the declaration rather than at the allocation
+  getTextureFormat(info.internalFormat);
+  m_graph.m_resources.push_back({.name = std::move(name),
+                                 .type = ResourceType::Transient,
+                                 .info = info});
+  return m_graph.m_resources.size() - 1;
+}
+
+/**
+ * @brief Declares that the pass reads a resource.
+ *
+ * The pass runs after the pass that writes the resource.
+ *
+ * @param resource Handle of the resource.
+ *
+ * @return Handle of the resource.
+ */
+abcg::OpenGLFrameGraph::Resource
+abcg::OpenGLFrameGraph::PassBuilder::read(Resource resource) {
+  m_graph.m_passes.at(m_pass).reads.push_back(resource);
+  return resource;
+}
+
+/**
+ * @brief Declares that the pass writes a resource as an attachment.
+ *
+ * Color attachments are bound in the order they are declared. Writing an
+ * imported resource gives the pass side effects.
+ *
+ * @param resource Handle of the resource.
+ *
+ * @return Handle of the resource.
+ *
+ * @throw abcg::RuntimeError if the resource is already written by another
+ * pass, or if an imported framebuffer is written together with other
+ * attachments.
+ */
+abcg::OpenGLFrameGraph::Resource
+abcg::OpenGLFrameGraph::PassBuilder::write(Resource resource) {
+  auto &node{m_graph.m_resources.at(resource)};
+  auto &pass{m_graph.m_passes.at(m_pass)};
+  if (node.producer != none) {
+    throw abcg::RuntimeError(
+        fmt::format("Frame graph resource \"{}\" is written by two passes",
+                    node.name));
+  }
+
+  auto const writesFramebuffer{[this](Resource written) {
+    return m_graph.m_resources.at(written).type == ResourceType::Framebuffer;
+  }};
+  if (!pass.writes.empty() && (node.type == ResourceType::Framebuffer ||
+                               std::ranges::any_of(pass.writes,
+                                                   writesFramebuffer))) {
+    throw abcg::RuntimeError(fmt::format(
+        "Frame graph pass \"{}\" writes a framebuffer with other attachments",
+        pass.name));
+  }
+
+  node.producer = m_pass;
+  pass.sideEffects = pass.sideEffects || node.type != ResourceType::Transient;
+  pass.writes.push_back(resource);
+  return resource;
+}
+
+/**
+ * @brief Declares that the pass writes a texture with image stores.
+ *
+ * The texture is not attached. The pass binds it with glBindImageTexture, and
+ * the passes that read it run after a memory barrier.
+ *
+ * @param resource Handle of the resource.
+ *
+ * @return Handle of the resource.
+ *
+ * @throw abcg::RuntimeError if the resource is already written by another
+ * pass, or if it is an imported framebuffer.
+ */
+abcg::OpenGLFrameGraph::Resource
+abcg::OpenGLFrameGraph::PassBuilder::writeImage(Resource resource) {
+  auto &node{m_graph.m_resources.at(resource)};
+  auto &pass{m_graph.m_passes.at(m_pass)};
+  if (node.producer != none || node.type == ResourceType::Framebuffer) {
+    throw abcg::RuntimeError(fmt::format(
+        "Frame graph resource \"{}\" cannot be written by pass \"{}\"",
+        node.name, pass.name));
+  }
+
+  node.producer = m_pass;
+  node.imageWrite = true;
+  pass.sideEffects = pass.sideEffects || node.type != ResourceType::Transient;
+  pass.imageWrites.push_back(resource);
+  return resource;
+}
+
+/**
+ * @brief Keeps the pass from being culled, e.g., if it writes buffers or
+ * queries not tracked by the frame graph.
+ */
+void abcg::OpenGLFrameGraph::PassBuilder::setSideEffects() noexcept {
+  m_graph.m_passes[m_pass].sideEffects = true;
+}
@@ -0,0 +1,184 @@
+/**
+ * @file abcgOpenGLFrameGraph.hpp
+ * @brief Header file of abcg::OpenGLFrameGraph.
+ *
+ * Declaration of abcg::OpenGLTransientTextureInfo and abcg::OpenGLFrameGraph.
+ *
+ * This file is part of ABCg (https://github.com/hbatagelo/abcg).
+ *
+ * @copyright (c) 2021--2023 Harlen Batagelo. All rights reserved.
+ * This project is released under the MIT License.
+ */
+
+#ifndef ABCG_OPENGL_FRAME_GRAPH_HPP_
+#define ABCG_OPENGL_FRAME_GRAPH_HPP_
+
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "abcgExternal.hpp"
+#include "abcgOpenGLFunction.hpp"
+
+namespace abcg {
+struct OpenGLTransientTextureInfo;
+class OpenGLFrameGraph;
+} // namespace abcg
+
+/**
+ * @brief Description of a transient texture of an abcg::OpenGLFrameGraph.
+ */
+struct abcg::OpenGLTransientTextureInfo {
+  /** @brief Size of the texture, in pixels. */
+  glm::ivec2 size{};
+  /** @brief Sized internal format, such as `GL_RGBA8` or
+   * `GL_DEPTH_COMPONENT24`. Textures with depth formats are attached as depth
+   * attachments. */
+  GLenum internalFormat{GL_RGBA8};
+
+  friend bool operator==(OpenGLTransientTextureInfo const &,
+                         OpenGLTransientTextureInfo const &) = default;
+};
+
+/**
+ * @brief Graph of the render passes of a frame.
+ *
+ * Each frame, the passes are declared with the resources they read and write:
+ * transient textures, which live only during the frame, and imported textures
+ * and framebuffers, such as the window framebuffer. Passes are then run in an
+ * order in which each pass follows the passes that write the resources it
+ * reads. Passes whose results are not read by any other pass are culled,
+ * unless they write an imported resource or are marked as having side
+ * effects.
+ *
+ * Transient textures are taken from a pool kept across frames, and a texture
+ * is given back to the pool after the last pass that uses it, so that
+ * textures whose lifetimes do not overlap share the same memory. Textures of
+ * the pool not used in a frame are released, so that the pool follows changes
+ * of the window size without explicit resize handling.
+ *
+ * Before each pass, its attachments are bound to a framebuffer object, which
+ * is cached, and the viewport is set to the size of the first attachment.
+ * Textures written with image stores are made visible to the passes that read
+ * them with a memory barrier.
+ *
+ * @code
+ * abcg::OpenGLFrameGraph::Resource blurred{};
+ * frameGraph.addPass(
+ *     "Blur",
+ *     [&](auto &builder) {
+ *       builder.read(scene);
+ *       blurred = builder.write(builder.create("Blurred", {.size = size}));
+ *     },
+ *     [&] { drawBlur(frameGraph.getTexture(scene)); });
+ * frameGraph.addPass(
+ *     "Composite",
+ *     [&](auto &builder) {
+ *       builder.read(blurred);
+ *       builder.write(window);
+ *     },
+ *     [&] { drawComposite(frameGraph.getTexture(blurred)); });
+ * frameGraph.execute();
+ * @endcode
+ */
+class abcg::OpenGLFrameGraph {
+public:
+  /** @brief Handle of a resource of the current frame. */
+  using Resource = std::size_t;
+
+  class PassBuilder;
+
+  void addPass(std::string name,
+               std::function<void(PassBuilder &)> const &setup,
+               std::function<void()> execute);
+  Resource importTexture(std::string name, GLuint texture,
+                         glm::ivec2 const &size);
+  Resource importFramebuffer(std::string name, GLuint framebuffer,
+                             glm::ivec2 const &size);
+
+  void execute();
+  void destroy();
+
+  [[nodiscard]] GLuint getTexture(Resource resource) const;
+  [[nodiscard]] std::size_t getMemoryUsage() const noexcept;
+
+private:
+  static constexpr std::size_t none{std::numeric_limits<std::size_t>::max()};
+
+  enum class ResourceType { Transient, Texture, Framebuffer };
+
+  struct ResourceNode {
+    std::string name;
+    ResourceType type{};
+    OpenGLTransientTextureInfo info;
+    GLuint texture{};
+    GLuint framebuffer{};
+    std::size_t producer{none};
+    bool imageWrite{};
+    // Number of passes not culled that read this resource
+    std::size_t readers{};
+  };
+
+  struct PassNode {
+    std::string name;
+    std::function<void()> execute;
+    std::vector<Resource> reads;
+    // Written as attachments, in the order of the draw buffers
+    std::vector<Resource> writes;
+    std::vector<Resource> imageWrites;
+    bool sideEffects{};
+    bool culled{};
+    // Number of resources written by this pass that are still read
+    std::size_t refCount{};
+  };
+
+  struct PooledTexture {
+    GLuint texture{};
+    OpenGLTransientTextureInfo info;
+    bool inUse{};
+    bool used{};
+  };
+
+  [[nodiscard]] std::vector<std::size_t> compile();
+  void cull();
+  [[nodiscard]] std::vector<std::size_t> sort() const;
+  void allocate(std::vector<std::size_t> const &order);
+  [[nodiscard]] GLuint acquire(OpenGLTransientTextureInfo const &info);
+  void bindFramebuffer(PassNode const &pass);
+  void releaseUnused();
+
+  std::vector<ResourceNode> m_resources;
+  std::vector<PassNode> m_passes;
+  std::vector<PooledTexture> m_pool;
+  // Framebuffer objects keyed by their color attachments, followed by the
+  // depth attachment or zero
+  std::map<std::vector<GLuint>, GLuint> m_framebuffers;
+};
+
+/**
+ * @brief Declares the resources of a pass of an abcg::OpenGLFrameGraph.
+ *
+ * An object of this type is passed to the setup function of
+ * abcg::OpenGLFrameGraph::addPass.
+ */
+class abcg::OpenGLFrameGraph::PassBuilder {
+public:
+  Resource create(std::string name, OpenGLTransientTextureInfo const &info);
+  Resource read(Resource resource);
+  Resource write(Resource resource);
+  Resource writeImage(Resource resource);
+  void setSideEffects() noexcept;
+
+private:
+  friend class OpenGLFrameGraph;
+  PassBuilder(OpenGLFrameGraph &graph, std::size_t pass) noexcept
+      : m_graph{graph}, m_pass{pass} {}
+
+  OpenGLFrameGraph &m_graph;
+  std::size_t m_pass{};
+};
+
+#endif
@@ -12,6 +12,191 @@
 #include "abcgOpenGLError.hpp"
 
 #if !defined(NDEBUG) && !defined(__EMSCRIPTEN__) && !defined(__APPLE__)
+#include <fmt/core.h>
+#include <gsl/gsl>
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <unordered_set>
+
+namespace {
+
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+std::atomic<bool> synchronousDebugOutput{};
+
+std::string_view getSourceString(GLenum source) {
+  switch (source) {
+  case GL_DEBUG_SOURCE_API:
+    return "API";
+  case GL_DEBUG_SOURCE_WINDOW_SYSTEM:
+    return "window system";
+  case GL_DEBUG_SOURCE_SHADER_COMPILER:
+    return "shader compiler";
+  case GL_DEBUG_SOURCE_THIRD_PARTY:
+    return "third party";
+  case GL_DEBUG_SOURCE_APPLICATION:
+    return "application";
+  default:
+    return "other";
+  }
+}
+
+std::string_view getTypeString(GLenum type) {
+  switch (type) {
+  case GL_DEBUG_TYPE_ERROR:
+    return "error";
+  case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR:
+    return "deprecated behavior";
+  case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:
+    return "undefined behavior";
+  case GL_DEBUG_TYPE_PORTABILITY:
+    return "portability";
+  case GL_DEBUG_TYPE_PERFORMANCE:
+    return "performance";
+  default:
+    return "other";
+  }
+}
+
+std::string_view getSeverityString(GLenum severity) {
+  switch (severity) {
+  case GL_DEBUG_SEVERITY_HIGH:
+    return "high";
+  case GL_DEBUG_SEVERITY_MEDIUM:
+    return "medium";
+  case GL_DEBUG_SEVERITY_LOW:
+    return "low";
+  default:
+    return "notification";
+  }
+}
+
+void GLAPIENTRY debugMessageCallback(GLenum source, GLenum type, GLuint id,
+                                     GLenum severity, GLsizei length,
+                                     GLchar const *message,
+                                     void const * /*userParam*/) {
+  std::string_view const text{
+      message, length < 0 ? std::strlen(message)
+                          : gsl::narrow_cast<std::size_t>(length)};
+
+  // A synchronous callback runs in the thread that issued the call, so the
+  // state of that thread can be used. Errors are thrown by abcg::endGLCall
+  // after the call returns, since exceptions must not cross the driver.
+  auto const synchronous{synchronousDebugOutput.load()};
+  auto &state{abcg::glCallState};
+  if (synchronous && state.inCall && type == GL_DEBUG_TYPE_ERROR) {
+    if (state.error.empty()) {
+      state.error = text;
+    }
+    return;
+  }
+
+  // Other messages are printed only once
+  static std::mutex reportedMutex;
+  static std::unordered_set<GLuint> reportedIDs;
+  {
+    std::scoped_lock const lock{reportedMutex};
+    if (!reportedIDs.insert(id).second)
+      return;
+  }
+
+  std::string location;
+  if (synchronous && state.inCall) {
+    location = fmt::format(" in {}:{}, {}", state.location.file_name(),
+                           state.location.line(),
+                           state.location.function_name());
+  }
+  fmt::print(stderr, "OpenGL {} ({} severity, {}) {}: {}{}\n",
+             getTypeString(type), getSeverityString(severity),
+             getSourceString(source), id, text, location);
+}
+
+} // namespace
+
+/**
+ * @brief Enables the reporting of OpenGL errors with `KHR_debug` output.
+ *
+ * Installs a debug message callback and disables the `glGetError` checks of
+ * the function wrappers of the calling thread, so that the checks do not issue
+ * OpenGL commands. Notifications are ignored.
+ *
+ * If the output is synchronous, the callback is called during the function
+ * call that generated the message, and errors are thrown as abcg::OpenGLError
+ * with the source location of the call when the call returns. Other messages
+ * are printed once to the standard error with the source location of the
+ * call.
+ *
+ * If the output is asynchronous, the driver is free to call the callback from
+ * any thread at any time, which has lower overhead. Errors and other messages
+ * are printed once to the standard error, without the source location, and no
+ * exception is thrown.
+ *
+ * This must be called after the OpenGL context is created and made current.
+ *
+ * @param synchronous Whether the debug output is synchronous.
+ *
+ * @return `true` if the debug output is enabled, or `false` if `KHR_debug` is
+ * not supported or the context is not a debug context. In that case, errors
+ * are still checked with `glGetError`.
+ */
+bool abcg::enableGLDebugOutput(bool synchronous) {
+  if (!GLEW_VERSION_4_3 && !GLEW_KHR_debug)
+    return false;
+
+  // Messages are not guaranteed to be generated in non-debug contexts
+  GLint contextFlags{};
+  ::glGetIntegerv(GL_CONTEXT_FLAGS, &contextFlags);
+  if ((gsl::narrow_cast<GLuint>(contextFlags) & GL_CONTEXT_FLAG_DEBUG_BIT) ==
+      0)
+    return false;
+
+  synchronousDebugOutput = synchronous;
+  ::glEnable(GL_DEBUG_OUTPUT);
+  if (synchronous) {
+    ::glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+  } else {
+    ::glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+  }
+  ::glDebugMessageCallback(debugMessageCallback, nullptr);
+  ::glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr,
+                          GL_TRUE);
+  ::glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE,
+                          GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr,
+                          GL_FALSE);
+
+  glCallState = {};
+  glCallState.debugOutput = true;
+  return true;
+}
+
+/**
+ * @brief Restores the `glGetError` checks of the function wrappers of the
+ * calling thread.
+ *
+ * This must be called before the OpenGL context is destroyed.
+ */
+void abcg::disableGLDebugOutput() {
+  if (!glCallState.debugOutput)
+    return;
+  ::glDebugMessageCallback(nullptr, nullptr);
+  ::glDisable(GL_DEBUG_OUTPUT);
+  glCallState = {};
+}
+
+/**
+ * @brief Throws the error reported by the debug message callback during the
+ * last function call.
+ *
+ * @throw abcg::Exception::OpenGLError.
+ */
+void abcg::throwGLDebugError() {
+  auto const message{std::move(glCallState.error)};
+  glCallState.error.clear();
+  throw abcg::OpenGLError(fmt::format("AFTER function call: {}", message),
+                          ::glGetError(), glCallState.location);
+}
+
 /**
  * @brief Checks OpenGL error status and throws on error with a log message.
  *
@@ -28,6 +28,7 @@ using source_location = std::source_location;
 #endif
 #endif
 
+#include <string>
 #include <string_view>
 #include <type_traits>
 
@@ -45,10 +46,75 @@ namespace abcg {
 
 void checkGLError(source_location const &sourceLocation,
                   std::string_view appendString);
+bool enableGLDebugOutput(bool synchronous);
+void disableGLDebugOutput();
+[[noreturn]] void throwGLDebugError();
+
+/**
+ * @brief State of the OpenGL function calls of the current thread.
+ *
+ * When `KHR_debug` output is enabled, the source location of each call is
+ * recorded so that the debug message callback can report it, and the errors
+ * reported by a synchronous callback are stored to be thrown when the call
+ * returns.
+ */
+struct GLCallState {
+  /** @brief Whether errors are reported by the debug message callback instead
+   * of `glGetError`. */
+  bool debugOutput{};
+  /** @brief Whether a function wrapper is calling an OpenGL function. */
+  bool inCall{};
+  /** @brief Source location of the current or last call. */
+  source_location location{};
+  /** @brief Error reported during the current call, if any. */
+  std::string error;
+};
+
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+inline thread_local GLCallState glCallState{};
+
+/**
+ * @brief Prepares for an OpenGL function call.
+ *
+ * Checks for pending errors with `glGetError`, or records the source location
+ * if errors are reported by the debug message callback.
+ *
+ * @param sourceLocation Information about the source code, used for logging.
+ */
+inline void beginGLCall(source_location const &sourceLocation) {
+  if (!glCallState.debugOutput) {
+    checkGLError(sourceLocation, "BEFORE function call");
+    return;
+  }
+  glCallState.location = sourceLocation;
+  glCallState.inCall = true;
+}
+
+/**
+ * @brief Checks for errors of an OpenGL function call.
+ *
+ * @param sourceLocation Information about the source code, used for logging.
+ *
+ * @throw abcg::OpenGLError if the call generated an error.
+ */
+inline void endGLCall(source_location const &sourceLocation) {
+  if (!glCallState.debugOutput) {
+    checkGLError(sourceLocation, "AFTER function call");
+    return;
+  }
+  glCallState.inCall = false;
+  if (!glCallState.error.empty()) [[unlikely]] {
+    throwGLDebugError();
+  }
+}
 
 /**
  * @brief Checks for OpenGL errors before and after a function call.
  *
+ * Errors are checked with `glGetError` before and after the call, unless
+ * `KHR_debug` output is enabled with abcg::enableGLDebugOutput. In that case,
+ * no OpenGL command is issued for the checks.
+ *
  * @tparam TFun Function typename.
  * @tparam TArgs Variadic arguments typename.
  *
@@ -61,16 +127,16 @@ void checkGLError(source_location const &sourceLocation,
 template <typename TFun, typename... TArgs>
 auto callGL(source_location const &sourceLocation, TFun &&function,
             TArgs &&...args) {
-  checkGLError(sourceLocation, "BEFORE function call");
+  beginGLCall(sourceLocation);
   if constexpr (!std::is_void_v<std::invoke_result_t<TFun, TArgs...>>) {
     // Specialization for functions that do not return void
     auto &&res{std::forward<TFun>(function)(std::forward<TArgs>(args)...)};
-    checkGLError(sourceLocation, "AFTER function call");
+    endGLCall(sourceLocation);
     return res;
   }
   // Specialization for functions that return void
   std::forward<TFun>(function)(std::forward<TArgs>(args)...);
-  checkGLError(sourceLocation, "AFTER function call");
+  endGLCall(sourceLocation);
 }
 
 #else
@@ -1479,6 +1545,90 @@ inline void glGetDoublev(
   callGL(sourceLocation, ::glGetDoublev, pname, params);
 }
 #endif
+
+#if !defined(__EMSCRIPTEN__)
+
+// OpenGL 3.3+ function definitions (ARB_timer_query)
+
+inline void glQueryCounter(
+    GLuint id, GLenum target,
+    source_location const &sourceLocation = source_location::current()) {
+  callGL(sourceLocation, ::glQueryCounter, id, target);
+}
+inline void glGetQueryObjectui64v(
+    GLuint id, GLenum pname, GLuint64 *params,
+    source_location const &sourceLocation = source_location::current()) {
+  callGL(sourceLocation, ::glGetQueryObjectui64v, id, pname, params);
+}
+
+// OpenGL 1.5+ function definitions
+
+inline void glGetBufferSubData(
+    GLenum target, GLintptr offset, GLsizeiptr size, void *data,
+    source_location const &sourceLocation = source_location::current()) {
+  callGL(sourceLocation, ::glGetBufferSubData, target, offset, size, data);
+}
+
+// OpenGL 4.2+ function definitions (ARB_shader_image_load_store)
+
+inline void glMemoryBarrier(
+    GLbitfield barriers,
+    source_location const &sourceLocation = source_location::current()) {
+  callGL(sourceLocation, ::glMemoryBarrier, barriers);
+}
+
+// OpenGL 4.3+ function definitions (ARB_compute_shader,
+// ARB_multi_draw_indirect)
+
+inline void glDispatchCompute(
+    GLuint numGroupsX, GLuint numGroupsY, GLuint numGroupsZ,
+    source_location const &sourceLocation = source_location::current()) {
+  callGL(sourceLocation, ::glDispatchCompute, numGroupsX, numGroupsY,
+         numGroupsZ);
+}
+inline void glMultiDrawElementsIndirect(
+    GLenum mode, GLenum type, void const *indirect, GLsizei drawcount,
+    GLsizei stride,
+    source_location const &sourceLocation = source_location::current()) {
+  callGL(sourceLocation, ::glMultiDrawElementsIndirect, mode, type, indirect,
+         drawcount, stride);
+}
+
+// OpenGL 1.4+ function definitions
+
+inline void glMultiDrawElements(
+    GLenum mode, GLsizei const *count, GLenum type, void const *const *indices,
+    GLsizei drawcount,
+    source_location const &sourceLocation = source_location::current()) {
+  callGL(sourceLocation, ::glMultiDrawElements, mode, count, type, indices,
+         drawcount);
+}
+
+// OpenGL 4.4+ function definitions (ARB_buffer_storage)
+
+inline void glBufferStorage(
+    GLenum target, GLsizeiptr size, void const *data, GLbitfield flags,
+    source_location const &sourceLocation = source_location::current()) {
+  callGL(sourceLocation, ::glBufferStorage, target, size, data, flags);
+}
+
+// OpenGL 4.3+ function definitions (KHR_debug)
+
+inline void glPushDebugGroup(
+    GLenum source, GLuint id, GLsizei length, GLchar const *message,
+    source_location const &sourceLocation = source_location::current()) {
+  callGL(sourceLocation, ::glPushDebugGroup, source, id, length, message);
+}
+inline void glPopDebugGroup(
+    source_location const &sourceLocation = source_location::current()) {
+  callGL(sourceLocation, ::glPopDebugGroup);
+}
+inline void glObjectLabel(
+    GLenum identifier, GLuint name, GLsizei length, GLchar const *label,
+    source_location const &sourceLocation = source_location::current()) {
+  callGL(sourceLocation, ::glObjectLabel, identifier, name, length, label);
+}
+#endif
 // NOLINTEND(readability-identifier-length)
 
 } // namespace abcg
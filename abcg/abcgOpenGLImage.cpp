@@ -16,6 +16,7 @@
 #include <gsl/gsl>
 
 #include "abcgException.hpp"
+#include "abcgTrace.hpp"
 
 /**
  * @brief Creates an OpenGL 2D texture from an image loaded from a filesystem
@@ -28,6 +29,7 @@
  * @return ID of the texture, as generated by glGenTextures.
  */
 GLuint abcg::loadOpenGLTexture(OpenGLTextureCreateInfo const &createInfo) {
+  TraceScope const scope{"loadOpenGLTexture", "asset"};
   GLuint textureID{};
 
   if (SDL_Surface *const surface{IMG_Load(createInfo.path.data())}) {
@@ -99,6 +101,7 @@ GLuint abcg::loadOpenGLTexture(OpenGLTextureCreateInfo const &createInfo) {
  * @return ID of the texture, as generated by glGenTextures.
  */
 GLuint abcg::loadOpenGLCubemap(OpenGLCubemapCreateInfo const &createInfo) {
+  TraceScope const scope{"loadOpenGLCubemap", "asset"};
   GLuint textureID{};
   glGenTextures(1, &textureID);
   glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
@@ -160,4 +163,118 @@ GLuint abcg::loadOpenGLCubemap(OpenGLCubemapCreateInfo const &createInfo) {
   }
 
   return textureID;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Creates an OpenGL 2D array texture from a set of images loaded from
+ * filesystem paths, one per layer.
+ *
+ * The images are converted to RGBA. By design, images of a different size
+ * than the first one are scaled to its size with `SDL_BlitScaled`, so that
+ * materials with maps of different resolutions can still share the texture.
+ * Mismatched maps lose detail or are magnified; use maps of the same size to
+ * avoid it.
+ *
+ * @param createInfo Texture creation settings.
+ *
+ * @throw abcg::RuntimeError if there are no paths or if any image could not be
+ * loaded, converted or scaled.
+ *
+ * @return ID of the texture, as generated by glGenTextures.
+ */
+GLuint abcg::loadOpenGLTextureArray(
+    OpenGLTextureArrayCreateInfo const &createInfo) {
+  TraceScope const scope{"loadOpenGLTextureArray", "asset"};
+  if (createInfo.paths.empty()) {
+    throw abcg::RuntimeError("Failed to create texture array without layers");
+  }
+
+  GLuint textureID{};
+  glGenTextures(1, &textureID);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+
+  // Releases the texture before an error is thrown
+  auto const deleteTexture{[&textureID] {
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glDeleteTextures(1, &textureID);
+  }};
+
+  auto width{0};
+  auto height{0};
+  for (auto &&[index, path] : iter::enumerate(createInfo.paths)) {
+    SDL_Surface *const surface{IMG_Load(path.data())};
+    if (surface == nullptr) {
+      deleteTexture();
+      throw abcg::RuntimeError(
+          fmt::format("Failed to load texture file {}", path));
+    }
+
+    // Enforce RGBA
+    SDL_Surface *formattedSurface{
+        SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA32, 0)};
+    SDL_FreeSurface(surface);
+    if (formattedSurface == nullptr) {
+      deleteTexture();
+      throw abcg::RuntimeError(
+          fmt::format("Failed to convert texture file {}", path));
+    }
+
+    // The first layer sets the size of the texture
+    if (index == 0) {
+      width = formattedSurface->w;
+      height = formattedSurface->h;
+      glTexImage3D(GL_TEXTURE_2D_ARRAY, 0,
+                   createInfo.sRGBToLinear ? GL_SRGB8_ALPHA8 : GL_RGBA8,
+                   width, height,
+                   gsl::narrow<GLsizei>(createInfo.paths.size()), 0, GL_RGBA,
+                   GL_UNSIGNED_BYTE, nullptr);
+    } else if (formattedSurface->w != width || formattedSurface->h != height) {
+      SDL_Surface *const scaledSurface{SDL_CreateRGBSurfaceWithFormat(
+          0, width, height, 32, SDL_PIXELFORMAT_RGBA32)};
+      SDL_SetSurfaceBlendMode(formattedSurface, SDL_BLENDMODE_NONE);
+      auto const scaled{scaledSurface != nullptr &&
+                        SDL_BlitScaled(formattedSurface, nullptr,
+                                       scaledSurface, nullptr) == 0};
+      SDL_FreeSurface(formattedSurface);
+      if (!scaled) {
+        SDL_FreeSurface(scaledSurface);
+        deleteTexture();
+        throw abcg::RuntimeError(
+            fmt::format("Failed to scale texture file {}", path));
+      }
+      formattedSurface = scaledSurface;
+    }
+
+    // Flip upside down
+    if (createInfo.flipUpsideDown) {
+      flipVertically(*formattedSurface);
+    }
+
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, gsl::narrow<GLint>(index),
+                    width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE,
+                    formattedSurface->pixels);
+
+    SDL_FreeSurface(formattedSurface);
+  }
+
+  // Set texture filtering
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  // Generate the mipmap levels
+  if (createInfo.generateMipmaps) {
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+    // Override minifying filtering
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                    GL_LINEAR_MIPMAP_LINEAR);
+  }
+
+  // Set texture wrapping
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+  return textureID;
+}
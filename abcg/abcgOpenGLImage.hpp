@@ -15,15 +15,19 @@
 
 #include <array>
 #include <string_view>
+#include <vector>
 
 namespace abcg {
 struct OpenGLTextureCreateInfo;
 struct OpenGLCubemapCreateInfo;
+struct OpenGLTextureArrayCreateInfo;
 
 [[nodiscard]] GLuint
 loadOpenGLTexture(OpenGLTextureCreateInfo const &createInfo);
 [[nodiscard]] GLuint
 loadOpenGLCubemap(OpenGLCubemapCreateInfo const &createInfo);
+[[nodiscard]] GLuint
+loadOpenGLTextureArray(OpenGLTextureArrayCreateInfo const &createInfo);
 } // namespace abcg
 
 /**
@@ -55,4 +59,23 @@ struct abcg::OpenGLCubemapCreateInfo {
   bool rightHandedSystem{true};
 };
 
+/**
+ * @brief Configuration settings for creating a 2D array texture for OpenGL.
+ */
+struct abcg::OpenGLTextureArrayCreateInfo {
+  /** @brief Paths to the image files (PNG or JPEG) of the layers, in order.
+   *
+   * Images of a different size than the first one are scaled to its size
+   * (see abcg::loadOpenGLTextureArray).
+   */
+  std::vector<std::string_view> paths{};
+  /** @brief Whether to generate mipmap levels. */
+  bool generateMipmaps{true};
+  /** @brief Whether to flip the images upside down. */
+  bool flipUpsideDown{true};
+  /** @brief Whether to apply gamma decoding (expansion) to convert images in
+   * sRGB space to linear space. */
+  bool sRGBToLinear{false};
+};
+
 #endif
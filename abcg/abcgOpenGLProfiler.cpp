@@ -0,0 +1,307 @@
+/**
+ * @file abcgOpenGLProfiler.cpp
+ * @brief Definition of abcg::OpenGLProfiler and abcg::OpenGLProfileScope
+ * members.
+ *
+ * This file is part of ABCg (https://github.com/hbatagelo/abcg).
+ *
+ * @copyright (c) 2021--2023 Harlen Batagelo. All rights reserved.
+ * This project is released under the MIT License.
+ */
+
+#include "abcgOpenGLProfiler.hpp"
+
+#include "abcgExternal.hpp"
+
+/**
+ * @brief Checks the support for timer queries and debug groups.
+ *
+ * This must be called after the OpenGL context is created.
+ */
+void abcg::OpenGLProfiler::create() {
+#if !defined(__EMSCRIPTEN__)
+  // Timestamp queries are not available in OpenGL ES
+  m_timerQueries = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+  m_debugGroups = GLEW_VERSION_4_3 || GLEW_KHR_debug;
+#endif
+}
+
+/**
+ * @brief Releases the query objects.
+ */
+void abcg::OpenGLProfiler::destroy() {
+  for (auto &frame : m_frames) {
+    if (!frame.queries.empty()) {
+      glDeleteQueries(gsl::narrow<GLsizei>(frame.queries.size()),
+                      frame.queries.data());
+    }
+    frame = {};
+  }
+  m_openScopes.clear();
+  m_results.clear();
+  m_averages.clear();
+  m_inFrame = false;
+}
+
+/**
+ * @brief Enables or disables profiling.
+ *
+ * When disabled, scope markers have no effect.
+ *
+ * @param enabled Whether to enable profiling.
+ */
+void abcg::OpenGLProfiler::setEnabled(bool enabled) noexcept {
+  m_enabled = enabled;
+}
+
+/**
+ * @brief Returns whether profiling is enabled.
+ *
+ * @return `true` if profiling is enabled.
+ */
+bool abcg::OpenGLProfiler::isEnabled() const noexcept { return m_enabled; }
+
+/**
+ * @brief Returns whether GPU times are measured.
+ *
+ * @return `true` if timestamp queries are supported by the OpenGL context.
+ */
+bool abcg::OpenGLProfiler::hasGPUTimers() const noexcept {
+  return m_timerQueries;
+}
+
+/**
+ * @brief Starts a new frame.
+ *
+ * Reads the results of the frame that used the same query pool, if they are
+ * available, and opens the root scope of the frame.
+ */
+void abcg::OpenGLProfiler::beginFrame() {
+  if (!m_enabled || m_inFrame)
+    return;
+
+  m_currentFrame = (m_currentFrame + 1) % m_frames.size();
+  auto &frame{m_frames.at(m_currentFrame)};
+  collect(frame);
+  frame.scopes.clear();
+  frame.usedQueries = 0;
+
+  m_openScopes.clear();
+  m_inFrame = true;
+  beginScope("Frame");
+}
+
+/**
+ * @brief Ends the current frame, closing the scopes that are still open.
+ */
+void abcg::OpenGLProfiler::endFrame() {
+  if (!m_inFrame)
+    return;
+
+  while (!m_openScopes.empty()) {
+    endScope();
+  }
+  m_frames.at(m_currentFrame).pending = true;
+  m_inFrame = false;
+}
+
+/**
+ * @brief Opens a scope nested in the current scope.
+ *
+ * Prefer abcg::OpenGLProfileScope, which closes the scope automatically.
+ *
+ * @param name Name of the scope. Must be a null-terminated string that
+ * outlives the profiler, such as a string literal.
+ *
+ * @return `true` if the scope was opened, or `false` if profiling is disabled
+ * or there is no current frame.
+ */
+bool abcg::OpenGLProfiler::beginScope(char const *name) {
+  if (!m_inFrame)
+    return false;
+
+  auto &frame{m_frames.at(m_currentFrame)};
+  Scope scope;
+  scope.name = name;
+  scope.depth = gsl::narrow<int>(m_openScopes.size());
+
+#if !defined(__EMSCRIPTEN__)
+  if (m_debugGroups) {
+    glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+  }
+  if (m_timerQueries) {
+    scope.beginQuery = acquireQuery(frame);
+    glQueryCounter(scope.beginQuery, GL_TIMESTAMP);
+  }
+#endif
+
+  m_openScopes.push_back(frame.scopes.size());
+  frame.scopes.push_back(scope);
+  frame.scopes.back().cpuTimer.restart();
+  return true;
+}
+
+/**
+ * @brief Closes the innermost open scope.
+ */
+void abcg::OpenGLProfiler::endScope() {
+  if (m_openScopes.empty())
+    return;
+
+  auto &frame{m_frames.at(m_currentFrame)};
+  auto &scope{frame.scopes.at(m_openScopes.back())};
+  m_openScopes.pop_back();
+
+  scope.cpuTime = scope.cpuTimer.elapsed();
+
+#if !defined(__EMSCRIPTEN__)
+  if (m_timerQueries) {
+    scope.endQuery = acquireQuery(frame);
+    glQueryCounter(scope.endQuery, GL_TIMESTAMP);
+  }
+  if (m_debugGroups) {
+    glPopDebugGroup();
+  }
+#endif
+}
+
+/**
+ * @brief Returns the smoothed timings of the last frame with results.
+ *
+ * The scopes are listed in the order they were opened.
+ *
+ * @return Timings of each scope.
+ */
+std::vector<abcg::ProfileResult> const &
+abcg::OpenGLProfiler::getResults() const noexcept {
+  return m_results;
+}
+
+/**
+ * @brief Shows the CPU and GPU times of each scope in a Dear ImGui window.
+ *
+ * This must be called between `ImGui::NewFrame` and `ImGui::Render`.
+ * abcg::OpenGLWindow::onPaintUI calls it if the profiler is enabled.
+ */
+void abcg::OpenGLProfiler::showOverlay() const {
+  if (!m_enabled)
+    return;
+
+  auto const &displaySize{ImGui::GetIO().DisplaySize};
+  ImGui::SetNextWindowPos(ImVec2(displaySize.x - 5, 5), ImGuiCond_Always,
+                          ImVec2(1, 0));
+  ImGui::SetNextWindowBgAlpha(0.75f);
+  ImGui::Begin("Profiler", nullptr,
+               ImGuiWindowFlags_NoDecoration |
+                   ImGuiWindowFlags_AlwaysAutoResize |
+                   ImGuiWindowFlags_NoInputs |
+                   ImGuiWindowFlags_NoBringToFrontOnFocus |
+                   ImGuiWindowFlags_NoFocusOnAppearing);
+
+  if (ImGui::BeginTable("Scopes", 3, ImGuiTableFlags_SizingFixedFit)) {
+    ImGui::TableSetupColumn("Scope");
+    ImGui::TableSetupColumn("CPU ms");
+    ImGui::TableSetupColumn("GPU ms");
+    ImGui::TableHeadersRow();
+
+    for (auto const &result : m_results) {
+      ImGui::TableNextRow();
+      ImGui::TableSetColumnIndex(0);
+      auto const name{fmt::format(
+          "{:{}}{}", "", gsl::narrow<std::size_t>(result.depth) * 2,
+          result.name)};
+      ImGui::TextUnformatted(name.c_str());
+      ImGui::TableSetColumnIndex(1);
+      ImGui::TextUnformatted(fmt::format("{:.3f}", result.cpuTime).c_str());
+      ImGui::TableSetColumnIndex(2);
+      ImGui::TextUnformatted(
+          result.gpuTime < 0.0 ? "n/a"
+                               : fmt::format("{:.3f}", result.gpuTime).c_str());
+    }
+    ImGui::EndTable();
+  }
+
+  ImGui::End();
+}
+
+GLuint abcg::OpenGLProfiler::acquireQuery(Frame &frame) {
+  if (frame.usedQueries == frame.queries.size()) {
+    GLuint query{};
+    glGenQueries(1, &query);
+    frame.queries.push_back(query);
+  }
+  return frame.queries.at(frame.usedQueries++);
+}
+
+void abcg::OpenGLProfiler::collect(Frame &frame) {
+  if (!frame.pending)
+    return;
+  frame.pending = false;
+
+  // Queries complete in order, so the last one tells if all are available.
+  // If not, the GPU results of this frame are dropped instead of waiting.
+  auto gpuResultsAvailable{false};
+#if !defined(__EMSCRIPTEN__)
+  if (m_timerQueries && frame.usedQueries > 0) {
+    GLuint available{};
+    glGetQueryObjectuiv(frame.queries.at(frame.usedQueries - 1),
+                        GL_QUERY_RESULT_AVAILABLE, &available);
+    gpuResultsAvailable = available == GL_TRUE;
+  }
+#endif
+
+  // Weight of the newest sample in the exponential moving averages
+  auto const smoothing{0.1};
+
+  m_results.clear();
+  for (auto const &scope : frame.scopes) {
+    auto const cpuTime{scope.cpuTime * 1000.0};
+    auto gpuTime{-1.0};
+#if !defined(__EMSCRIPTEN__)
+    if (gpuResultsAvailable) {
+      GLuint64 begin{};
+      GLuint64 end{};
+      glGetQueryObjectui64v(scope.beginQuery, GL_QUERY_RESULT, &begin);
+      glGetQueryObjectui64v(scope.endQuery, GL_QUERY_RESULT, &end);
+      gpuTime = gsl::narrow_cast<double>(end - begin) * 1.0e-6;
+    }
+#endif
+
+    auto [iter, inserted]{m_averages.try_emplace(scope.name, cpuTime, gpuTime)};
+    auto &[cpuAverage, gpuAverage]{iter->second};
+    if (!inserted) {
+      cpuAverage += (cpuTime - cpuAverage) * smoothing;
+      if (gpuTime >= 0.0) {
+        gpuAverage = gpuAverage < 0.0
+                         ? gpuTime
+                         : gpuAverage + (gpuTime - gpuAverage) * smoothing;
+      }
+    }
+
+    m_results.push_back({.name = scope.name,
+                         .depth = scope.depth,
+                         .cpuTime = cpuAverage,
+                         .gpuTime = m_timerQueries ? gpuAverage : -1.0});
+  }
+}
+
+/**
+ * @brief Opens a profiled scope.
+ *
+ * @param profiler Profiler that measures the scope.
+ * @param name Name of the scope. Must be a null-terminated string that
+ * outlives the profiler, such as a string literal.
+ */
+abcg::OpenGLProfileScope::OpenGLProfileScope(OpenGLProfiler &profiler,
+                                             char const *name)
+    : m_profiler{profiler}, m_traceScope{name, "phase"},
+      m_active{profiler.beginScope(name)} {}
+
+/**
+ * @brief Closes the profiled scope.
+ */
+abcg::OpenGLProfileScope::~OpenGLProfileScope() {
+  if (m_active) {
+    m_profiler.endScope();
+  }
+}
@@ -0,0 +1,143 @@
+/**
+ * @file abcgOpenGLProfiler.hpp
+ * @brief Header file of abcg::OpenGLProfiler and abcg::OpenGLProfileScope.
+ *
+ * Declaration of abcg::OpenGLProfiler and abcg::OpenGLProfileScope.
+ *
+ * This file is part of ABCg (https://github.com/hbatagelo/abcg).
+ *
+ * @copyright (c) 2021--2023 Harlen Batagelo. All rights reserved.
+ * This project is released under the MIT License.
+ */
+
+#ifndef ABCG_OPENGL_PROFILER_HPP_
+#define ABCG_OPENGL_PROFILER_HPP_
+
+#include <array>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "abcgOpenGLFunction.hpp"
+#include "abcgTimer.hpp"
+#include "abcgTrace.hpp"
+
+namespace abcg {
+struct ProfileResult;
+class OpenGLProfiler;
+class OpenGLProfileScope;
+} // namespace abcg
+
+/**
+ * @brief Timing of a profiled scope.
+ *
+ * @sa abcg::OpenGLProfiler::getResults.
+ */
+struct abcg::ProfileResult {
+  /** @brief Name of the scope. */
+  std::string_view name{};
+  /** @brief Nesting level of the scope, starting from zero. */
+  int depth{};
+  /** @brief Smoothed CPU time, in milliseconds. */
+  double cpuTime{};
+  /** @brief Smoothed GPU time, in milliseconds, or a negative value if GPU
+   * timer queries are not supported. */
+  double gpuTime{-1.0};
+};
+
+/**
+ * @brief Measures CPU and GPU times of nested scopes of a frame.
+ *
+ * GPU times are measured with `GL_TIMESTAMP` queries issued with
+ * `glQueryCounter`, which, unlike `GL_TIME_ELAPSED` queries, can be nested.
+ * Queries are recorded into two pools used in alternate frames, and the
+ * results of a pool are read only if they are already available when the pool
+ * is reused, so the CPU never waits for the GPU. When `KHR_debug` is
+ * supported, each scope is also pushed as a debug group, so that it shows up
+ * in tools such as RenderDoc.
+ *
+ * abcg::OpenGLWindow owns a profiler that measures the phases of its frames.
+ * Use abcg::OpenGLProfileScope to measure additional scopes.
+ *
+ * @sa abcg::OpenGLWindow::getProfiler.
+ */
+class abcg::OpenGLProfiler {
+public:
+  void create();
+  void destroy();
+
+  void setEnabled(bool enabled) noexcept;
+  [[nodiscard]] bool isEnabled() const noexcept;
+  [[nodiscard]] bool hasGPUTimers() const noexcept;
+
+  void beginFrame();
+  void endFrame();
+  bool beginScope(char const *name);
+  void endScope();
+
+  [[nodiscard]] std::vector<ProfileResult> const &getResults() const noexcept;
+  void showOverlay() const;
+
+private:
+  struct Scope {
+    char const *name{};
+    int depth{};
+    Timer cpuTimer;
+    double cpuTime{};
+    GLuint beginQuery{};
+    GLuint endQuery{};
+  };
+
+  struct Frame {
+    std::vector<Scope> scopes;
+    std::vector<GLuint> queries;
+    std::size_t usedQueries{};
+    bool pending{};
+  };
+
+  [[nodiscard]] GLuint acquireQuery(Frame &frame);
+  void collect(Frame &frame);
+
+  std::array<Frame, 2> m_frames{};
+  std::size_t m_currentFrame{};
+  std::vector<std::size_t> m_openScopes;
+  std::vector<ProfileResult> m_results;
+  std::unordered_map<std::string_view, std::pair<double, double>> m_averages;
+
+  bool m_enabled{};
+  bool m_inFrame{};
+  bool m_timerQueries{};
+  bool m_debugGroups{};
+};
+
+/**
+ * @brief RAII marker of a profiled scope.
+ *
+ * The scope is also recorded as an event of the `phase` category when
+ * abcg::Tracer is recording.
+ *
+ * @code
+ * {
+ *   abcg::OpenGLProfileScope const scope{getProfiler(), "Shadow pass"};
+ *   renderShadows();
+ * }
+ * @endcode
+ *
+ * @remark Objects of this type cannot be copied or moved.
+ */
+class abcg::OpenGLProfileScope {
+public:
+  OpenGLProfileScope(OpenGLProfiler &profiler, char const *name);
+  OpenGLProfileScope(OpenGLProfileScope const &) = delete;
+  OpenGLProfileScope(OpenGLProfileScope &&) = delete;
+  OpenGLProfileScope &operator=(OpenGLProfileScope const &) = delete;
+  OpenGLProfileScope &operator=(OpenGLProfileScope &&) = delete;
+  ~OpenGLProfileScope();
+
+private:
+  OpenGLProfiler &m_profiler;
+  TraceScope m_traceScope;
+  bool m_active{};
+};
+
+#endif
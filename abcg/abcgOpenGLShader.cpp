@@ -20,6 +20,7 @@
 #include <vector>
 
 #include "abcgException.hpp"
+#include "abcgTrace.hpp"
 
 namespace {
 void printShaderInfoLog(GLuint const shader, std::string_view prefix) {
@@ -159,6 +160,8 @@ void deleteShaders(std::vector<abcg::OpenGLShader> const &shaderIDs) {
 GLuint
 abcg::createOpenGLProgram(std::vector<ShaderSource> const &pathsOrSources,
                           bool throwOnError) {
+  TraceScope const scope{"createOpenGLProgram", "asset"};
+
   std::vector<ShaderSource> sources;
   sources.reserve(pathsOrSources.size());
   for (auto const &pathOrSource : pathsOrSources) {
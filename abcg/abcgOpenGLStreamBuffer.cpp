@@ -0,0 +1,324 @@
+/**
+ * @file abcgOpenGLStreamBuffer.cpp
+ * @brief Definition of abcg::OpenGLStreamBuffer members.
+ *
+ * This file is part of ABCg (https://github.com/hbatagelo/abcg).
+ *
+ * @copyright (c) 2021--2023 Harlen Batagelo. All rights reserved.
+ * This project is released under the MIT License.
+ */
+
+#include "abcgOpenGLStreamBuffer.hpp"
+
+#include <fmt/core.h>
+#include <gsl/gsl>
+
+#include <algorithm>
+
+#include "abcgException.hpp"
+
+namespace {
+// Regions start at multiples of this alignment, which is at least the offset
+// alignment of uniform and storage buffers on most implementations
+constexpr GLsizeiptr regionAlignment{256};
+
+constexpr GLsizeiptr alignUp(GLsizeiptr value, GLsizeiptr alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+} // namespace
+
+/**
+ * @brief Creates the buffer object.
+ *
+ * This must be called after the OpenGL context is created. The persistent
+ * mapping is used if `GL_ARB_buffer_storage` is supported.
+ *
+ * @param regionSize Number of bytes that can be allocated in each frame. It
+ * is rounded up to a multiple of 256.
+ * @param regionCount Number of regions, i.e., the number of frames whose data
+ * can be in use by the GPU at the same time.
+ */
+void abcg::OpenGLStreamBuffer::create(GLsizeiptr regionSize,
+                                      int regionCount) {
+  destroy();
+
+#if !defined(__EMSCRIPTEN__)
+  m_persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+#endif
+
+  m_regionSize = alignUp(std::max(regionSize, GLsizeiptr{1}),
+                         regionAlignment);
+  m_regions.resize(gsl::narrow<std::size_t>(std::max(regionCount, 1)));
+  createBuffer();
+}
+
+/**
+ * @brief Creates a buffer object large enough for all regions.
+ */
+void abcg::OpenGLStreamBuffer::createBuffer() {
+  auto const bufferSize{m_regionSize *
+                        gsl::narrow<GLsizeiptr>(m_regions.size())};
+
+  glGenBuffers(1, &m_buffer);
+  // GL_COPY_WRITE_BUFFER is not used for drawing, so binding to it does not
+  // disturb the state of the caller
+  glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+#if !defined(__EMSCRIPTEN__)
+  if (m_persistent) {
+    GLbitfield const flags{GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+                           GL_MAP_COHERENT_BIT};
+    glBufferStorage(GL_COPY_WRITE_BUFFER, bufferSize, nullptr, flags);
+    m_mappedData = static_cast<std::byte *>(
+        glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, bufferSize, flags));
+    if (m_mappedData == nullptr) {
+      glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+      throw abcg::RuntimeError("Failed to map stream buffer");
+    }
+  } else {
+    glBufferData(GL_COPY_WRITE_BUFFER, bufferSize, nullptr, GL_STREAM_DRAW);
+  }
+#else
+  glBufferData(GL_COPY_WRITE_BUFFER, bufferSize, nullptr, GL_STREAM_DRAW);
+  m_clientData.resize(gsl::narrow<std::size_t>(m_regionSize));
+#endif
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  m_currentRegion = 0;
+  m_head = 0;
+}
+
+/**
+ * @brief Waits for the GPU and releases the buffer object.
+ */
+void abcg::OpenGLStreamBuffer::destroy() {
+  if (m_buffer == 0)
+    return;
+
+  if (m_pending.data != nullptr) {
+    flush();
+  }
+  for (auto &region : m_regions) {
+    waitRegion(region);
+  }
+  if (m_mappedData != nullptr) {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    m_mappedData = nullptr;
+  }
+  glDeleteBuffers(1, &m_buffer);
+
+  m_buffer = 0;
+  m_regionSize = 0;
+  m_regions.clear();
+  m_clientData.clear();
+  m_inFrame = false;
+}
+
+/**
+ * @brief Returns whether the buffer object was created.
+ *
+ * @return `true` if create was called and destroy was not called after it.
+ */
+bool abcg::OpenGLStreamBuffer::isCreated() const noexcept {
+  return m_buffer != 0;
+}
+
+/**
+ * @brief Returns whether the buffer is persistently mapped.
+ *
+ * @return `true` if the allocations are written directly to the buffer
+ * memory.
+ */
+bool abcg::OpenGLStreamBuffer::isPersistent() const noexcept {
+  return m_persistent;
+}
+
+/**
+ * @brief Returns the buffer object.
+ *
+ * The buffer object changes when the regions grow.
+ *
+ * @return Name of the buffer object.
+ */
+GLuint abcg::OpenGLStreamBuffer::getBuffer() const noexcept {
+  return m_buffer;
+}
+
+/**
+ * @brief Returns the number of bytes that can be allocated in each frame.
+ *
+ * @return Size of each region, in bytes.
+ */
+GLsizeiptr abcg::OpenGLStreamBuffer::getRegionSize() const noexcept {
+  return m_regionSize;
+}
+
+/**
+ * @brief Grows the regions to at least the given size.
+ *
+ * If the regions must grow, this waits for the GPU to finish with all of them
+ * and replaces the buffer object with a larger one, at least twice as large
+ * as the previous one. This must be called outside of a frame.
+ *
+ * @param regionSize Number of bytes that must fit in each region.
+ */
+void abcg::OpenGLStreamBuffer::reserve(GLsizeiptr regionSize) {
+  if (regionSize <= m_regionSize)
+    return;
+  if (m_inFrame) {
+    throw abcg::RuntimeError("Stream buffer cannot grow during a frame");
+  }
+
+  auto const regionCount{gsl::narrow<int>(m_regions.size())};
+  auto const newSize{std::max(regionSize, m_regionSize * 2)};
+  create(newSize, regionCount);
+}
+
+/**
+ * @brief Starts writing to the next region.
+ *
+ * Waits until the GPU is no longer reading the region, which happens only if
+ * the region was used by a frame that is still in flight.
+ */
+void abcg::OpenGLStreamBuffer::beginFrame() {
+  if (m_buffer == 0 || m_inFrame)
+    return;
+
+  m_currentRegion = (m_currentRegion + 1) % m_regions.size();
+  waitRegion(m_regions.at(m_currentRegion));
+  m_head = gsl::narrow<GLintptr>(m_currentRegion) * m_regionSize;
+  m_inFrame = true;
+}
+
+/**
+ * @brief Allocates a range of the current region.
+ *
+ * With the persistent mapping, the data can be written until the GPU
+ * commands that read it are issued. Otherwise, it must be written before the
+ * next call to allocate or flush.
+ *
+ * @param size Size of the range, in bytes.
+ * @param alignment Alignment of the offset of the range, in bytes, such as
+ * the value of `GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT` for uniform buffers. Must
+ * be a divisor of 256.
+ *
+ * @return Pointer to the range and its location in the buffer.
+ *
+ * @throw abcg::RuntimeError if there is no current frame or the range does
+ * not fit in the rest of the region.
+ */
+abcg::OpenGLStreamAllocation
+abcg::OpenGLStreamBuffer::allocate(GLsizeiptr size, GLsizeiptr alignment) {
+  if (!m_inFrame) {
+    throw abcg::RuntimeError("Stream buffer allocation outside of a frame");
+  }
+
+  auto const offset{alignUp(m_head, std::max(alignment, GLsizeiptr{1}))};
+  auto const regionEnd{(gsl::narrow<GLintptr>(m_currentRegion) + 1) *
+                       m_regionSize};
+  if (offset + size > regionEnd) {
+    throw abcg::RuntimeError(
+        fmt::format("Stream buffer region of {} bytes is full", m_regionSize));
+  }
+  m_head = offset + size;
+
+  OpenGLStreamAllocation allocation{
+      .buffer = m_buffer, .offset = offset, .size = size};
+  if (m_persistent) {
+    allocation.data = m_mappedData + offset;
+    return allocation;
+  }
+
+  // Only one range can be mapped at a time
+  if (m_pending.data != nullptr) {
+    flush();
+  }
+#if !defined(__EMSCRIPTEN__)
+  // The fence of the region guarantees that the GPU is not reading it
+  glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+  allocation.data = glMapBufferRange(
+      GL_COPY_WRITE_BUFFER, offset, size,
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+          GL_MAP_UNSYNCHRONIZED_BIT);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  if (allocation.data == nullptr) {
+    throw abcg::RuntimeError("Failed to map stream buffer range");
+  }
+#else
+  allocation.data = m_clientData.data() + (offset % m_regionSize);
+#endif
+  m_pending = allocation;
+  return allocation;
+}
+
+/**
+ * @brief Makes the data written to the allocations available to the GPU.
+ *
+ * This must be called after the data is written and before the GPU commands
+ * that read it. With the persistent mapping, this does nothing, since the
+ * mapping is coherent.
+ */
+void abcg::OpenGLStreamBuffer::flush() {
+  if (m_pending.data == nullptr)
+    return;
+
+  glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+#if !defined(__EMSCRIPTEN__)
+  glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+#else
+  glBufferSubData(GL_COPY_WRITE_BUFFER, m_pending.offset, m_pending.size,
+                  m_pending.data);
+#endif
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  m_pending = {};
+}
+
+/**
+ * @brief Ends the current frame.
+ *
+ * Flushes the data and inserts a fence that is signaled when the GPU
+ * finishes the commands issued so far, which include the ones that read the
+ * current region.
+ */
+void abcg::OpenGLStreamBuffer::endFrame() {
+  if (!m_inFrame)
+    return;
+
+  flush();
+#if !defined(__EMSCRIPTEN__)
+  auto &region{m_regions.at(m_currentRegion)};
+  region.fence = abcg::glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#endif
+  m_inFrame = false;
+}
+
+/**
+ * @brief Waits for the fence of a region and releases it.
+ *
+ * @param region Region to wait for.
+ *
+ * @throw abcg::RuntimeError if the wait fails.
+ */
+void abcg::OpenGLStreamBuffer::waitRegion(Region &region) {
+  if (region.fence == nullptr)
+    return;
+
+  // Flush the commands on the first try, so that the fence is signaled even if
+  // nothing else flushes them
+  constexpr GLuint64 timeout{1'000'000'000};
+  GLbitfield flags{GL_SYNC_FLUSH_COMMANDS_BIT};
+  for (;;) {
+    auto const status{abcg::glClientWaitSync(region.fence, flags, timeout)};
+    if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+      break;
+    if (status == GL_WAIT_FAILED) {
+      abcg::glDeleteSync(region.fence);
+      region.fence = nullptr;
+      throw abcg::RuntimeError("Failed to wait for stream buffer region");
+    }
+    flags = 0;
+  }
+  abcg::glDeleteSync(region.fence);
+  region.fence = nullptr;
+}
@@ -0,0 +1,111 @@
+/**
+ * @file abcgOpenGLStreamBuffer.hpp
+ * @brief Header file of abcg::OpenGLStreamBuffer.
+ *
+ * Declaration of abcg::OpenGLStreamBuffer and abcg::OpenGLStreamAllocation.
+ *
+ * This file is part of ABCg (https://github.com/hbatagelo/abcg).
+ *
+ * @copyright (c) 2021--2023 Harlen Batagelo. All rights reserved.
+ * This project is released under the MIT License.
+ */
+
+#ifndef ABCG_OPENGL_STREAM_BUFFER_HPP_
+#define ABCG_OPENGL_STREAM_BUFFER_HPP_
+
+#include <cstddef>
+#include <vector>
+
+#include "abcgOpenGLFunction.hpp"
+
+namespace abcg {
+struct OpenGLStreamAllocation;
+class OpenGLStreamBuffer;
+} // namespace abcg
+
+/**
+ * @brief Range of an abcg::OpenGLStreamBuffer that can be written by the CPU.
+ *
+ * @sa abcg::OpenGLStreamBuffer::allocate.
+ */
+struct abcg::OpenGLStreamAllocation {
+  /** @brief Pointer to the first byte of the range. */
+  void *data{};
+  /** @brief Buffer object that contains the range. */
+  GLuint buffer{};
+  /** @brief Offset of the range from the start of the buffer, in bytes. */
+  GLintptr offset{};
+  /** @brief Size of the range, in bytes. */
+  GLsizeiptr size{};
+};
+
+/**
+ * @brief Ring buffer for data written by the CPU once per frame.
+ *
+ * The buffer is divided into regions, one per frame in flight. Each frame
+ * writes into the next region, with as many aligned sub-allocations as it
+ * needs, and a fence marks the point after which the GPU no longer reads it.
+ * The region is written again only after its fence is signaled, so the CPU
+ * never overwrites data that is still in use, and never waits for the GPU
+ * unless it is more frames behind than there are regions.
+ *
+ * When `GL_ARB_buffer_storage` is supported (OpenGL 4.4+), the whole buffer is
+ * mapped once with `GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT`, so the data
+ * is written directly to memory read by the GPU without any call to the
+ * driver. Otherwise, each allocation is mapped with `glMapBufferRange` and
+ * `GL_MAP_UNSYNCHRONIZED_BIT`, which the fences make safe. On WebGL, where
+ * buffers cannot be mapped, the allocations are written to client memory and
+ * uploaded with `glBufferSubData`.
+ *
+ * @code
+ * streamBuffer.reserve(size);
+ * streamBuffer.beginFrame();
+ * auto const allocation{streamBuffer.allocate(size)};
+ * std::memcpy(allocation.data, vertices.data(), size);
+ * streamBuffer.flush();
+ * // Draw with the data at allocation.offset of allocation.buffer
+ * streamBuffer.endFrame();
+ * @endcode
+ */
+class abcg::OpenGLStreamBuffer {
+public:
+  void create(GLsizeiptr regionSize, int regionCount = 3);
+  void destroy();
+
+  [[nodiscard]] bool isCreated() const noexcept;
+  [[nodiscard]] bool isPersistent() const noexcept;
+  [[nodiscard]] GLuint getBuffer() const noexcept;
+  [[nodiscard]] GLsizeiptr getRegionSize() const noexcept;
+
+  void reserve(GLsizeiptr regionSize);
+  void beginFrame();
+  [[nodiscard]] OpenGLStreamAllocation allocate(GLsizeiptr size,
+                                                GLsizeiptr alignment = 16);
+  void flush();
+  void endFrame();
+
+private:
+  struct Region {
+    GLsync fence{};
+  };
+
+  void createBuffer();
+  void waitRegion(Region &region);
+
+  GLuint m_buffer{};
+  GLsizeiptr m_regionSize{};
+  std::vector<Region> m_regions;
+  std::size_t m_currentRegion{};
+  // Offset of the next allocation, from the start of the buffer
+  GLintptr m_head{};
+  bool m_inFrame{};
+  bool m_persistent{};
+
+  // Base pointer of the persistent mapping
+  std::byte *m_mappedData{};
+  // Allocation that must be unmapped or uploaded by flush
+  OpenGLStreamAllocation m_pending{};
+  std::vector<std::byte> m_clientData;
+};
+
+#endif
@@ -15,8 +15,13 @@
 #include <imgui_impl_opengl3.h>
 #include <imgui_impl_sdl2.h>
 
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+
 #include "abcgEmbeddedFonts.hpp"
 #include "abcgException.hpp"
+#include "abcgImage.hpp"
 #include "abcgWindow.hpp"
 
 /**
@@ -44,6 +49,173 @@ void abcg::OpenGLWindow::setOpenGLSettings(
   m_openGLSettings = openGLSettings;
 }
 
+/**
+ * @brief Returns the configuration settings of the headless mode.
+ *
+ * @returns Reference to the abcg::OpenGLHeadlessSettings structure.
+ */
+abcg::OpenGLHeadlessSettings const &
+abcg::OpenGLWindow::getHeadlessSettings() const noexcept {
+  return m_headlessSettings;
+}
+
+/**
+ * @brief Sets the configuration settings of the headless mode.
+ *
+ * This function will have no effect if called after the creation of the
+ * window.
+ *
+ * On Linux, if headless mode is enabled and no X11 or Wayland display is
+ * available, SDL is set to use its offscreen video driver, which creates the
+ * OpenGL context through EGL (e.g., with Mesa llvmpipe). This must be called
+ * before abcg::Application::run for the video driver to take effect.
+ *
+ * @param headlessSettings Headless mode settings.
+ *
+ * @throw abcg::RuntimeError if headless mode is enabled with a frame count
+ * less than 1.
+ */
+void abcg::OpenGLWindow::setHeadlessSettings(
+    OpenGLHeadlessSettings const &headlessSettings) {
+  if (abcg::Window::getSDLWindow() != nullptr)
+    return;
+  // Otherwise the application would never exit
+  if (headlessSettings.enabled && headlessSettings.frameCount < 1) {
+    throw abcg::RuntimeError(fmt::format(
+        "Invalid headless frame count {}", headlessSettings.frameCount));
+  }
+  m_headlessSettings = headlessSettings;
+
+#if defined(__linux__) && SDL_VERSION_ATLEAST(2, 0, 22)
+  // NOLINTBEGIN(concurrency-mt-unsafe)
+  if (m_headlessSettings.enabled && std::getenv("DISPLAY") == nullptr &&
+      std::getenv("WAYLAND_DISPLAY") == nullptr) {
+    SDL_SetHint(SDL_HINT_VIDEODRIVER, "offscreen");
+  }
+  // NOLINTEND(concurrency-mt-unsafe)
+#endif
+}
+
+/**
+ * @brief Returns the configuration settings of dynamic resolution scaling.
+ *
+ * @returns Reference to the abcg::DynamicResolutionSettings structure.
+ */
+abcg::DynamicResolutionSettings const &
+abcg::OpenGLWindow::getDynamicResolutionSettings() const noexcept {
+  return m_dynamicResolution.getSettings();
+}
+
+/**
+ * @brief Sets the configuration settings of dynamic resolution scaling.
+ *
+ * When dynamic resolution is enabled, abcg::OpenGLWindow::onPaint renders to
+ * an offscreen target whose size is scaled to keep the GPU frame time within
+ * the budget, and which is then upscaled to the window. The UI is rendered
+ * after the upscale, at the resolution of the window. See
+ * abcg::OpenGLDynamicResolution.
+ *
+ * If enabled before the window is created, the window is created without
+ * multisampling, which is done in the offscreen target instead. Once enabled,
+ * the offscreen target is kept even if dynamic resolution is disabled, in
+ * which case its scale is 1.
+ *
+ * @param dynamicResolutionSettings Dynamic resolution settings.
+ */
+void abcg::OpenGLWindow::setDynamicResolutionSettings(
+    DynamicResolutionSettings const &dynamicResolutionSettings) noexcept {
+  m_dynamicResolution.setSettings(dynamicResolutionSettings);
+}
+
+/**
+ * @brief Returns the anti-aliasing settings of the scene.
+ *
+ * @returns Reference to the abcg::OpenGLAntiAliasingSettings structure.
+ */
+abcg::OpenGLAntiAliasingSettings const &
+abcg::OpenGLWindow::getAntiAliasingSettings() const noexcept {
+  return m_dynamicResolution.getAntiAliasingSettings();
+}
+
+/**
+ * @brief Sets the anti-aliasing settings of the scene.
+ *
+ * The scene is rendered to the offscreen target of dynamic resolution
+ * scaling, at scale 1 if dynamic resolution is disabled, so that the method
+ * and the number of samples can change at runtime. With
+ * abcg::OpenGLAntiAliasing::FXAA, the target is single-sampled and FXAA is
+ * applied before the UI is rendered.
+ *
+ * If set before the window is created, the window is created without
+ * multisampling and abcg::OpenGLSettings::samples is ignored. Otherwise, the
+ * anti-aliasing settings default to abcg::OpenGLSettings::samples, done by
+ * the window itself.
+ *
+ * @param antiAliasingSettings Anti-aliasing settings.
+ */
+void abcg::OpenGLWindow::setAntiAliasingSettings(
+    OpenGLAntiAliasingSettings const &antiAliasingSettings) noexcept {
+  m_dynamicResolution.setAntiAliasingSettings(antiAliasingSettings);
+  m_sceneTargetRequested = true;
+}
+
+/**
+ * @brief Access to the dynamic resolution target, for its current scale and
+ * frame time.
+ *
+ * @return Reference to the dynamic resolution target of this window.
+ */
+abcg::OpenGLDynamicResolution const &
+abcg::OpenGLWindow::getDynamicResolution() const noexcept {
+  return m_dynamicResolution;
+}
+
+/**
+ * @brief Returns the framebuffer object to which the scene is rendered.
+ *
+ * This is the default framebuffer (zero), except in headless mode, where the
+ * frames are rendered to an offscreen framebuffer object, and with dynamic
+ * resolution, where abcg::OpenGLWindow::onPaint renders to a scaled
+ * offscreen target. Bind this instead of zero when restoring the window
+ * framebuffer after rendering to a texture.
+ *
+ * @returns Name of the framebuffer object.
+ */
+GLuint abcg::OpenGLWindow::getFramebuffer() const noexcept {
+  return m_dynamicResolution.isCreated() ? m_dynamicResolution.getFramebuffer()
+                                         : m_headlessFBO;
+}
+
+/**
+ * @brief Returns the size of the framebuffer to which the scene is rendered.
+ *
+ * This is the window size, except with dynamic resolution, where it is the
+ * size of the scaled target of the current frame. Use this for the viewport
+ * in abcg::OpenGLWindow::onPaint, and the window size passed to
+ * abcg::OpenGLWindow::onResize for the aspect ratio and for the UI.
+ *
+ * @returns Render size, in pixels.
+ */
+glm::ivec2 abcg::OpenGLWindow::getRenderSize() const {
+  return m_dynamicResolution.isCreated() ? m_dynamicResolution.getRenderSize()
+                                         : getWindowSize();
+}
+
+/**
+ * @brief Access to the frame profiler.
+ *
+ * The profiler is disabled by default. When enabled, it measures the CPU and
+ * GPU times of abcg::OpenGLWindow::onUpdate, abcg::OpenGLWindow::onPaintUI,
+ * abcg::OpenGLWindow::onPaint, the rendering of the UI and the buffer swap,
+ * and the default abcg::OpenGLWindow::onPaintUI shows the results in an
+ * overlay. Use abcg::OpenGLProfileScope to measure nested scopes.
+ *
+ * @return Reference to the profiler of this window.
+ */
+abcg::OpenGLProfiler &abcg::OpenGLWindow::getProfiler() noexcept {
+  return m_profiler;
+}
+
 /**
  * @brief Takes a snapshot of the screen and saves it to a file.
  *
@@ -57,8 +229,19 @@ void abcg::OpenGLWindow::saveScreenshotPNG(std::string_view filename) const {
 
   auto const numPixels{gsl::narrow<std::size_t>(size.x * size.y * channels)};
   std::vector<unsigned char> pixels(numPixels);
-  glReadBuffer(m_openGLSettings.doubleBuffering ? GL_BACK : GL_FRONT);
+  if (m_headlessSettings.enabled) {
+    // Read from the resolved color buffer if multisampling is enabled
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_headlessResolveFBO != 0
+                                               ? m_headlessResolveFBO
+                                               : m_headlessFBO);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+  } else {
+    glReadBuffer(m_openGLSettings.doubleBuffering ? GL_BACK : GL_FRONT);
+  }
   glReadPixels(0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+  if (m_headlessSettings.enabled) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_headlessFBO);
+  }
 
   // Flip upside down
   for (auto const line : iter::range(size.y / 2)) {
@@ -76,6 +259,49 @@ void abcg::OpenGLWindow::saveScreenshotPNG(std::string_view filename) const {
   }
 }
 
+/**
+ * @brief Starts capturing every frame rendered to the window.
+ *
+ * Frames are read back asynchronously and encoded on a separate thread, so
+ * that the capture does not stall the rendering loop (see
+ * abcg::OpenGLFrameCapture). This must be called after the OpenGL context is
+ * created, e.g., in abcg::OpenGLWindow::onCreate or in an event handler.
+ *
+ * @param settings Capture settings.
+ */
+void abcg::OpenGLWindow::startFrameCapture(
+    FrameCaptureSettings const &settings) {
+  if (!m_frameCapture) {
+    m_frameCapture = std::make_unique<OpenGLFrameCapture>();
+  }
+  m_frameCapture->create(settings);
+}
+
+/**
+ * @brief Stops capturing frames.
+ *
+ * Blocks until the frames still in flight are encoded.
+ */
+void abcg::OpenGLWindow::stopFrameCapture() {
+  if (m_frameCapture) {
+    m_frameCapture->destroy();
+    fmt::print("Frame capture..: {} frames written, {} skipped\n",
+               m_frameCapture->getCapturedFrames(),
+               m_frameCapture->getSkippedFrames());
+    m_frameCapture.reset();
+  }
+}
+
+/**
+ * @brief Returns whether frames are being captured.
+ *
+ * @return `true` if abcg::OpenGLWindow::startFrameCapture was called and
+ * abcg::OpenGLWindow::stopFrameCapture was not called afterwards.
+ */
+bool abcg::OpenGLWindow::isCapturingFrames() const noexcept {
+  return m_frameCapture && m_frameCapture->isActive();
+}
+
 /**
  * @brief Custom event handler.
  *
@@ -128,6 +354,10 @@ void abcg::OpenGLWindow::onPaint() {
  * Override it for custom behavior. By default, it shows a FPS counter if
  * abcg::WindowSettings::showFPS is set to `true`, and a toggle fullscreen
  * button if abcg::WindowSettings::showFullscreenButton is set to `true`.
+ *
+ * The FPS counter is shown in an ImGui window named "FPS", which is resized
+ * to fit its contents. An override can add its own statistics to it by
+ * calling `ImGui::Begin("FPS")` after calling this function.
  */
 void abcg::OpenGLWindow::onPaintUI() {
   // FPS counter
@@ -149,7 +379,8 @@ void abcg::OpenGLWindow::onPaintUI() {
     ImGui::Begin("FPS", nullptr,
                  ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoInputs |
                      ImGuiWindowFlags_NoBringToFrontOnFocus |
-                     ImGuiWindowFlags_NoFocusOnAppearing);
+                     ImGuiWindowFlags_NoFocusOnAppearing |
+                     ImGuiWindowFlags_AlwaysAutoResize);
     auto const label{fmt::format("avg {:.1f} FPS", fps)};
     ImGui::PlotLines("", frames.data(), gsl::narrow<int>(frames.size()),
                      gsl::narrow<int>(offset), label.c_str(), 0.0f,
@@ -159,6 +390,9 @@ void abcg::OpenGLWindow::onPaintUI() {
     ImGui::End();
   }
 
+  // CPU and GPU times of the frame phases
+  m_profiler.showOverlay();
+
   // Fullscreen button
   if (abcg::Window::getWindowSettings().showFullscreenButton) {
 #if defined(__EMSCRIPTEN__)
@@ -296,22 +530,34 @@ void abcg::OpenGLWindow::create() {
   m_GLSLVersion =
       fmt::format("#version {:d}{:02d}", majorVersion, minorVersion * 10);
 
+  // Debug contexts are required for KHR_debug output
+  auto const debugContextFlag{
+#if !defined(NDEBUG) && !defined(__EMSCRIPTEN__) && !defined(__APPLE__)
+      m_openGLSettings.debugOutput != OpenGLDebugOutput::GetError
+          ? SDL_GL_CONTEXT_DEBUG_FLAG
+          : 0
+#else
+      0
+#endif
+  };
+
   switch (profile) {
   case OpenGLProfile::Core:
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS,
-                        SDL_GL_CONTEXT_FORWARD_COMPATIBLE_FLAG);
+                        SDL_GL_CONTEXT_FORWARD_COMPATIBLE_FLAG |
+                            debugContextFlag);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK,
                         SDL_GL_CONTEXT_PROFILE_CORE);
     m_GLSLVersion += " core";
     break;
   case OpenGLProfile::Compatibility:
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, 0);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, debugContextFlag);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK,
                         SDL_GL_CONTEXT_PROFILE_COMPATIBILITY);
     m_GLSLVersion += " compatibility";
     break;
   case OpenGLProfile::ES:
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, 0);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, debugContextFlag);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_ES);
     m_GLSLVersion += " es";
     break;
@@ -324,7 +570,11 @@ void abcg::OpenGLWindow::create() {
   SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, m_openGLSettings.depthBufferSize);
   SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, m_openGLSettings.stencilBufferSize);
 
-  if (m_openGLSettings.samples > 0) {
+  if (m_headlessSettings.enabled || m_dynamicResolution.getSettings().enabled ||
+      m_sceneTargetRequested) {
+    // Multisampling is done in the offscreen framebuffer
+    SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 0);
+  } else if (m_openGLSettings.samples > 0) {
     // Enable multisampling
     SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 1);
     // Can be 2, 4, 8 or 16
@@ -334,8 +584,13 @@ void abcg::OpenGLWindow::create() {
   }
 
   // Create window with graphics context
+  auto const windowFlags{m_headlessSettings.enabled
+                             ? static_cast<SDL_WindowFlags>(SDL_WINDOW_OPENGL |
+                                                            SDL_WINDOW_HIDDEN)
+                             : SDL_WINDOW_OPENGL};
   while (true) {
-    if (!createSDLWindow(SDL_WINDOW_OPENGL) && m_openGLSettings.samples > 0) {
+    if (!createSDLWindow(windowFlags) && m_openGLSettings.samples > 0 &&
+        !m_headlessSettings.enabled) {
       // Try again, but this time with multisampling disabled
       m_openGLSettings.samples = 0;
       SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, 0);
@@ -346,12 +601,34 @@ void abcg::OpenGLWindow::create() {
     }
   }
 
+  // Used if the offscreen target is created by dynamic resolution scaling
+  if (!m_sceneTargetRequested) {
+    m_dynamicResolution.setAntiAliasingSettings(
+        {.method = m_openGLSettings.samples > 0 ? OpenGLAntiAliasing::MSAA
+                                                : OpenGLAntiAliasing::None,
+         .samples = m_openGLSettings.samples});
+  }
+
   if (abcg::Window::getSDLWindow() == nullptr) {
     throw abcg::SDLError("SDL_CreateWindow failed");
   }
 
   // Create OpenGL context
   m_GLContext = SDL_GL_CreateContext(abcg::Window::getSDLWindow());
+  if (m_GLContext == nullptr && profile != OpenGLProfile::ES &&
+      majorVersion > 3) {
+    // Try again with the minimum version. The application can check the
+    // version of the context to enable optional features
+    fmt::print("Warning: OpenGL {}.{} requested but not supported!\n",
+               majorVersion, minorVersion);
+    majorVersion = 3;
+    minorVersion = 3;
+    m_GLSLVersion = "#version 330" +
+                    m_GLSLVersion.substr(m_GLSLVersion.rfind(' '));
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, majorVersion);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, minorVersion);
+    m_GLContext = SDL_GL_CreateContext(abcg::Window::getSDLWindow());
+  }
   if (m_GLContext == nullptr) {
     throw abcg::SDLError("SDL_GL_CreateContext failed");
   }
@@ -361,7 +638,15 @@ void abcg::OpenGLWindow::create() {
 #endif
 
 #if !defined(__EMSCRIPTEN__)
-  if (auto const err{glewInit()}; GLEW_OK != err) {
+  auto err{glewInit()};
+#if defined(GLEW_ERROR_NO_GLX_DISPLAY)
+  // GLEW built for GLX fails on EGL contexts after the core entry points have
+  // been loaded
+  if (err == GLEW_ERROR_NO_GLX_DISPLAY && m_headlessSettings.enabled) {
+    err = GLEW_OK;
+  }
+#endif
+  if (GLEW_OK != err) {
     throw abcg::Exception{
         fmt::format("Failed to initialize OpenGL loader: {}",
                     reinterpret_cast<char const *>(glewGetErrorString(err)))};
@@ -380,6 +665,18 @@ void abcg::OpenGLWindow::create() {
       "GLSL version...: {}\n",
       reinterpret_cast<char const *>(glGetString(GL_SHADING_LANGUAGE_VERSION)));
 
+#if !defined(NDEBUG) && !defined(__EMSCRIPTEN__) && !defined(__APPLE__)
+  if (auto const debugOutput{m_openGLSettings.debugOutput};
+      debugOutput != OpenGLDebugOutput::GetError &&
+      enableGLDebugOutput(debugOutput == OpenGLDebugOutput::Synchronous)) {
+    fmt::print("Error checking.: KHR_debug ({})\n",
+               debugOutput == OpenGLDebugOutput::Synchronous ? "synchronous"
+                                                              : "asynchronous");
+  } else {
+    fmt::print("Error checking.: glGetError\n");
+  }
+#endif
+
   // Print out extensions
   // GLint numExtensions{};
   // glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
@@ -419,17 +716,47 @@ void abcg::OpenGLWindow::create() {
     throw abcg::RuntimeError("Failed to load font file");
   }
 
+  if (m_headlessSettings.enabled) {
+    createHeadlessFramebuffer();
+    abcg::Window::setFixedDeltaTime(m_headlessSettings.fixedDeltaTime);
+  }
+
+  m_profiler.create();
+
   onCreate();
 
   onResize(getWindowSize());
 }
 
 void abcg::OpenGLWindow::paint() {
-  onUpdate();
+  auto const headless{m_headlessSettings.enabled};
 
-  if (m_hidden || m_minimized)
+  // Waiting for the quit event
+  if (headless && m_headlessFrame >= m_headlessSettings.frameCount)
     return;
 
+  if (headless) {
+    m_headlessFrameTimer.restart();
+  }
+
+  // Keep rendering in on-demand mode while frames are being recorded or
+  // measured
+  if (headless || isCapturingFrames() || m_profiler.isEnabled()) {
+    abcg::Window::requestRedraw();
+  }
+
+  m_profiler.beginFrame();
+
+  {
+    OpenGLProfileScope const scope{m_profiler, "onUpdate"};
+    onUpdate();
+  }
+
+  if (!headless && (m_hidden || m_minimized)) {
+    m_profiler.endFrame();
+    return;
+  }
+
   SDL_GL_MakeCurrent(abcg::Window::getSDLWindow(), m_GLContext);
 
 #if defined(__EMSCRIPTEN__)
@@ -443,42 +770,300 @@ void abcg::OpenGLWindow::paint() {
   }
 #endif
 
-  ImGui_ImplOpenGL3_NewFrame();
-  ImGui_ImplSDL2_NewFrame();
-  ImGui::NewFrame();
+  {
+    OpenGLProfileScope const scope{m_profiler, "onPaintUI"};
+    ImGui_ImplOpenGL3_NewFrame();
+    ImGui_ImplSDL2_NewFrame();
+    ImGui::NewFrame();
+
+    onPaintUI();
+
+    ImGui::Render();
+  }
 
-  onPaintUI();
+  if ((m_dynamicResolution.getSettings().enabled || m_sceneTargetRequested) &&
+      !m_dynamicResolution.isCreated()) {
+    m_dynamicResolution.create(m_GLSLVersion, m_openGLSettings.depthBufferSize,
+                               m_openGLSettings.stencilBufferSize);
+  }
 
-  ImGui::Render();
+  if (m_dynamicResolution.isCreated()) {
+    m_dynamicResolution.beginFrame(getWindowSize());
+  } else if (headless) {
+    glBindFramebuffer(GL_FRAMEBUFFER, m_headlessFBO);
+  }
 
-  onPaint();
+  {
+    OpenGLProfileScope const scope{m_profiler, "onPaint"};
+    onPaint();
+  }
 
-  ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-  if (m_openGLSettings.doubleBuffering) {
-    SDL_GL_SwapWindow(abcg::Window::getSDLWindow());
-  } else {
-    glFinish();
+  // The UI is rendered at the window resolution
+  if (m_dynamicResolution.isCreated()) {
+    OpenGLProfileScope const scope{m_profiler, "Upscale"};
+    m_dynamicResolution.endFrame(m_headlessFBO);
+  } else if (headless) {
+    glBindFramebuffer(GL_FRAMEBUFFER, m_headlessFBO);
+  }
+
+  {
+    OpenGLProfileScope const scope{m_profiler, "ImGui"};
+    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+  }
+
+  if (headless) {
+    finishHeadlessFrame();
+  }
+
+  if (isCapturingFrames()) {
+    OpenGLProfileScope const scope{m_profiler, "Capture"};
+    if (headless) {
+      m_frameCapture->capture(m_headlessResolveFBO != 0 ? m_headlessResolveFBO
+                                                        : m_headlessFBO,
+                              GL_COLOR_ATTACHMENT0, getWindowSize());
+    } else {
+      m_frameCapture->capture(
+          0, m_openGLSettings.doubleBuffering ? GL_BACK : GL_FRONT,
+          getWindowSize());
+    }
+  }
+
+  if (!headless) {
+    OpenGLProfileScope const scope{m_profiler, "Swap"};
+    if (m_openGLSettings.doubleBuffering) {
+      SDL_GL_SwapWindow(abcg::Window::getSDLWindow());
+    } else {
+      glFinish();
+    }
   }
+
+  m_profiler.endFrame();
 }
 
 void abcg::OpenGLWindow::destroy() {
   onDestroy();
 
+  m_profiler.destroy();
+  m_dynamicResolution.destroy();
+  stopFrameCapture();
+  destroyHeadlessFramebuffer();
+
   if (ImGui::GetCurrentContext() != nullptr) {
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplSDL2_Shutdown();
     ImGui::DestroyContext();
   }
   if (m_GLContext != nullptr) {
+#if !defined(NDEBUG) && !defined(__EMSCRIPTEN__) && !defined(__APPLE__)
+    disableGLDebugOutput();
+#endif
     SDL_GL_DeleteContext(m_GLContext);
     m_GLContext = nullptr;
   }
 }
 
 [[nodiscard]] glm::ivec2 abcg::OpenGLWindow::getWindowSize() const {
+  if (m_headlessSettings.enabled) {
+    auto const &windowSettings{abcg::Window::getWindowSettings()};
+    return {windowSettings.width, windowSettings.height};
+  }
+
   glm::ivec2 size{};
   if (auto *window{abcg::Window::getSDLWindow()}; window != nullptr) {
     SDL_GL_GetDrawableSize(window, &size.x, &size.y);
   }
   return size;
 }
+
+void abcg::OpenGLWindow::createHeadlessFramebuffer() {
+  auto const size{getWindowSize()};
+
+  GLint maxSamples{};
+  glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+  auto const samples{std::min(m_openGLSettings.samples, maxSamples)};
+
+  auto const createRenderbuffer{[&size](GLsizei renderbufferSamples,
+                                        GLenum internalFormat) {
+    GLuint renderbuffer{};
+    glGenRenderbuffers(1, &renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, renderbufferSamples,
+                                     internalFormat, size.x, size.y);
+    return renderbuffer;
+  }};
+
+  auto const checkStatus{[]() {
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+      throw abcg::RuntimeError("Failed to create headless framebuffer");
+    }
+  }};
+
+  glGenFramebuffers(1, &m_headlessFBO);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_headlessFBO);
+
+  m_headlessColorRBO = createRenderbuffer(samples, GL_RGBA8);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_RENDERBUFFER, m_headlessColorRBO);
+
+  if (m_openGLSettings.depthBufferSize > 0 ||
+      m_openGLSettings.stencilBufferSize > 0) {
+    auto const hasStencil{m_openGLSettings.stencilBufferSize > 0};
+    m_headlessDepthRBO = createRenderbuffer(
+        samples, hasStencil ? GL_DEPTH24_STENCIL8 : GL_DEPTH_COMPONENT24);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER,
+                              hasStencil ? GL_DEPTH_STENCIL_ATTACHMENT
+                                         : GL_DEPTH_ATTACHMENT,
+                              GL_RENDERBUFFER, m_headlessDepthRBO);
+  }
+  checkStatus();
+
+  // Single-sampled framebuffer for reading back multisampled frames
+  if (samples > 0) {
+    glGenFramebuffers(1, &m_headlessResolveFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_headlessResolveFBO);
+    m_headlessResolveRBO = createRenderbuffer(0, GL_RGBA8);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                              GL_RENDERBUFFER, m_headlessResolveRBO);
+    checkStatus();
+  }
+
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_headlessFBO);
+
+  m_headlessFrame = 0;
+  m_headlessFrameTimes.clear();
+  m_headlessMismatchedFrames = 0;
+  m_headlessFrameTimes.reserve(gsl::narrow<std::size_t>(
+      std::max(m_headlessSettings.frameCount, 0)));
+
+  fmt::print("Headless mode..: {}x{}, {} samples, {} frames\n", size.x, size.y,
+             samples, m_headlessSettings.frameCount);
+}
+
+void abcg::OpenGLWindow::destroyHeadlessFramebuffer() {
+  if (m_headlessFBO == 0)
+    return;
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  for (auto *renderbuffer :
+       {&m_headlessColorRBO, &m_headlessDepthRBO, &m_headlessResolveRBO}) {
+    glDeleteRenderbuffers(1, renderbuffer);
+    *renderbuffer = 0;
+  }
+  for (auto *framebuffer : {&m_headlessFBO, &m_headlessResolveFBO}) {
+    glDeleteFramebuffers(1, framebuffer);
+    *framebuffer = 0;
+  }
+}
+
+void abcg::OpenGLWindow::finishHeadlessFrame() {
+  if (m_headlessResolveFBO != 0) {
+    auto const size{getWindowSize()};
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_headlessFBO);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_headlessResolveFBO);
+    glBlitFramebuffer(0, 0, size.x, size.y, 0, 0, size.x, size.y,
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_headlessFBO);
+  }
+
+  // Wait for the GPU so that the frame time includes the rendering time
+  glFinish();
+
+  auto const frameTime{m_headlessFrameTimer.elapsed()};
+  auto const frameIndex{m_headlessFrame++};
+  if (frameIndex >= m_headlessSettings.warmupFrames) {
+    m_headlessFrameTimes.push_back(frameTime);
+  }
+
+  auto const isLastFrame{m_headlessFrame >= m_headlessSettings.frameCount};
+  auto const captureInterval{m_headlessSettings.captureInterval};
+  if (!m_headlessSettings.framePath.empty() &&
+      (isLastFrame ||
+       (captureInterval > 0 && frameIndex % captureInterval == 0))) {
+    auto const path{
+        fmt::format(fmt::runtime(m_headlessSettings.framePath), frameIndex)};
+    saveScreenshotPNG(path);
+
+    if (!m_headlessSettings.referencePath.empty()) {
+      auto const referencePath{fmt::format(
+          fmt::runtime(m_headlessSettings.referencePath), frameIndex)};
+      auto const difference{compareImages(
+          path, referencePath, m_headlessSettings.referenceTolerance)};
+      fmt::print("Frame {}: {} of {} pixels differ from {} (max error {}, "
+                 "RMS {:.3f})\n",
+                 frameIndex, difference.differentPixels,
+                 difference.totalPixels, referencePath, difference.maxError,
+                 difference.rmsError);
+      if (!difference.matches()) {
+        ++m_headlessMismatchedFrames;
+      }
+    }
+  }
+
+  if (isLastFrame) {
+    printHeadlessStats();
+    if (m_headlessMismatchedFrames > 0) {
+      throw abcg::RuntimeError(
+          fmt::format("{} headless frames differ from their references",
+                      m_headlessMismatchedFrames));
+    }
+
+    SDL_Event quitEvent{};
+    quitEvent.type = SDL_QUIT;
+    SDL_PushEvent(&quitEvent);
+  }
+}
+
+void abcg::OpenGLWindow::printHeadlessStats() const {
+  if (m_headlessFrameTimes.empty()) {
+    fmt::print("Headless mode..: no frames measured\n");
+    return;
+  }
+
+  auto sorted{m_headlessFrameTimes};
+  std::sort(sorted.begin(), sorted.end());
+
+  // Nearest-rank percentile, in milliseconds
+  auto const percentile{[&sorted](double fraction) {
+    auto const rank{std::ceil(fraction * gsl::narrow<double>(sorted.size()))};
+    auto const index{
+        std::max<std::size_t>(gsl::narrow_cast<std::size_t>(rank), 1) - 1};
+    return sorted.at(index) * 1000.0;
+  }};
+
+  auto sum{0.0};
+  for (auto const frameTime : sorted) {
+    sum += frameTime;
+  }
+  auto const mean{sum / gsl::narrow<double>(sorted.size()) * 1000.0};
+  auto const min{sorted.front() * 1000.0};
+  auto const max{sorted.back() * 1000.0};
+  auto const p50{percentile(0.50)};
+  auto const p95{percentile(0.95)};
+  auto const p99{percentile(0.99)};
+  auto const fps{1000.0 / mean};
+
+  fmt::print("Frame time (ms): min {:.3f}, mean {:.3f}, p50 {:.3f}, "
+             "p95 {:.3f}, p99 {:.3f}, max {:.3f} ({} frames, {:.1f} FPS)\n",
+             min, mean, p50, p95, p99, max, sorted.size(), fps);
+
+  if (auto const &path{m_headlessSettings.statsPath}; !path.empty()) {
+    std::ofstream stream(path);
+    if (!stream) {
+      throw abcg::RuntimeError(
+          fmt::format("Failed to write frame statistics to {}", path));
+    }
+    auto const size{getWindowSize()};
+    stream << fmt::format(
+        "{{\n"
+        "  \"width\": {},\n"
+        "  \"height\": {},\n"
+        "  \"frames\": {},\n"
+        "  \"frameTimeMs\": {{\"min\": {:.4f}, \"mean\": {:.4f}, "
+        "\"p50\": {:.4f}, \"p95\": {:.4f}, \"p99\": {:.4f}, "
+        "\"max\": {:.4f}}},\n"
+        "  \"fps\": {:.2f}\n"
+        "}}\n",
+        size.x, size.y, sorted.size(), min, mean, p50, p95, p99, max, fps);
+  }
+}
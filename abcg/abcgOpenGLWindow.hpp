@@ -13,16 +13,23 @@
 #ifndef ABCG_OPENGL_WINDOW_HPP_
 #define ABCG_OPENGL_WINDOW_HPP_
 
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "abcgExternal.hpp"
+#include "abcgOpenGLDynamicResolution.hpp"
+#include "abcgOpenGLFrameCapture.hpp"
 #include "abcgOpenGLFunction.hpp"
+#include "abcgOpenGLProfiler.hpp"
 #include "abcgWindow.hpp"
 
 namespace abcg {
+enum class OpenGLDebugOutput;
 enum class OpenGLProfile;
 class OpenGLWindow;
 struct OpenGLSettings;
+struct OpenGLHeadlessSettings;
 } // namespace abcg
 
 /**
@@ -48,6 +55,38 @@ enum class abcg::OpenGLProfile {
   ES
 };
 
+/**
+ * @brief Enumeration of methods for checking OpenGL errors in debug builds.
+ *
+ * In release builds, and on WebAssembly and macOS, the OpenGL function
+ * wrappers do not check for errors.
+ *
+ * @sa abcg::OpenGLSettings.
+ * @sa abcg::enableGLDebugOutput.
+ */
+enum class abcg::OpenGLDebugOutput {
+  /** @brief `KHR_debug` output with a synchronous callback.
+   *
+   * Errors are thrown as abcg::OpenGLError with the source location of the
+   * call that generated them. Falls back to abcg::OpenGLDebugOutput::GetError
+   * if `KHR_debug` is not supported.
+   */
+  Synchronous,
+  /** @brief `KHR_debug` output with an asynchronous callback.
+   *
+   * Errors are printed to the standard error, without the source location,
+   * and are not thrown. This has the lowest overhead. Falls back to
+   * abcg::OpenGLDebugOutput::GetError if `KHR_debug` is not supported.
+   */
+  Asynchronous,
+  /** @brief `glGetError` before and after each call.
+   *
+   * Errors are thrown as abcg::OpenGLError with the source location of the
+   * call that generated them.
+   */
+  GetError
+};
+
 /**
  * @brief Configuration settings for creating an OpenGL context.
  *
@@ -61,7 +100,11 @@ enum class abcg::OpenGLProfile {
 struct abcg::OpenGLSettings {
   /** @brief Type of OpenGL context. */
   OpenGLProfile profile{OpenGLProfile::Core};
-  /** @brief OpenGL context major version. */
+  /** @brief OpenGL context major version.
+   *
+   * If a core or compatibility context of version 4.x cannot be created, a
+   * 3.3 context is created instead.
+   */
   int majorVersion{3};
   /** @brief OpenGL context minor version. */
   int minorVersion{3};
@@ -77,6 +120,62 @@ struct abcg::OpenGLSettings {
   bool vSync{false};
   /** @brief Whether the output is double buffered. */
   bool doubleBuffering{true};
+  /** @brief Method for checking OpenGL errors in debug builds. */
+  OpenGLDebugOutput debugOutput{OpenGLDebugOutput::Synchronous};
+};
+
+/**
+ * @brief Configuration settings for running an OpenGL window offscreen.
+ *
+ * In headless mode, the SDL window is hidden and the frames are rendered to a
+ * framebuffer object of size abcg::WindowSettings::width x
+ * abcg::WindowSettings::height. The application exits after a fixed number of
+ * frames, and the frame time statistics are printed to the standard output.
+ *
+ * These settings must be set before calling `abcg::Application::run`.
+ *
+ * @sa abcg::OpenGLWindow::getHeadlessSettings.
+ * @sa abcg::OpenGLWindow::setHeadlessSettings.
+ * @sa abcg::compareImages for comparing saved frames with reference images.
+ */
+struct abcg::OpenGLHeadlessSettings {
+  /** @brief Whether to render offscreen instead of to a visible window. */
+  bool enabled{false};
+  /** @brief Number of frames to render before the application exits. Must be
+   * at least 1. */
+  int frameCount{300};
+  /** @brief Number of initial frames that are not included in the frame time
+   * statistics. */
+  int warmupFrames{10};
+  /** @brief Time step returned by abcg::Window::getDeltaTime, in seconds.
+   *
+   * A fixed time step makes the rendered frames independent of the rendering
+   * speed. If zero, the actual time between frames is used.
+   */
+  double fixedDeltaTime{1.0 / 60.0};
+  /** @brief Path of the PNG files where frames are saved.
+   *
+   * This is a format string in which `{}` is replaced with the frame index,
+   * e.g., `frame{:04d}.png`. If empty, no frames are saved.
+   */
+  std::string framePath{};
+  /** @brief Interval, in frames, between saved frames. If zero, only the last
+   * frame is saved. */
+  int captureInterval{0};
+  /** @brief Path of the reference PNG files that the saved frames are
+   * compared with, using abcg::compareImages.
+   *
+   * Same format as framePath. If empty, the frames are not compared. After
+   * the last frame, abcg::RuntimeError is thrown if any saved frame differs
+   * from its reference.
+   */
+  std::string referencePath{};
+  /** @brief Maximum absolute difference per channel for a pixel of a saved
+   * frame to match its reference. */
+  int referenceTolerance{0};
+  /** @brief Path of a JSON file where the frame time statistics are written.
+   * If empty, the statistics are only printed to the standard output. */
+  std::string statsPath{};
 };
 
 /**
@@ -100,7 +199,26 @@ class abcg::OpenGLWindow : public Window {
 public:
   [[nodiscard]] OpenGLSettings const &getOpenGLSettings() const noexcept;
   void setOpenGLSettings(OpenGLSettings const &openGLSettings) noexcept;
+  [[nodiscard]] OpenGLHeadlessSettings const &
+  getHeadlessSettings() const noexcept;
+  void setHeadlessSettings(OpenGLHeadlessSettings const &headlessSettings);
+  [[nodiscard]] DynamicResolutionSettings const &
+  getDynamicResolutionSettings() const noexcept;
+  void setDynamicResolutionSettings(
+      DynamicResolutionSettings const &dynamicResolutionSettings) noexcept;
+  [[nodiscard]] OpenGLAntiAliasingSettings const &
+  getAntiAliasingSettings() const noexcept;
+  void setAntiAliasingSettings(
+      OpenGLAntiAliasingSettings const &antiAliasingSettings) noexcept;
+  [[nodiscard]] OpenGLDynamicResolution const &
+  getDynamicResolution() const noexcept;
+  [[nodiscard]] GLuint getFramebuffer() const noexcept;
+  [[nodiscard]] glm::ivec2 getRenderSize() const;
+  [[nodiscard]] OpenGLProfiler &getProfiler() noexcept;
   void saveScreenshotPNG(std::string_view filename) const;
+  void startFrameCapture(FrameCaptureSettings const &settings);
+  void stopFrameCapture();
+  [[nodiscard]] bool isCapturingFrames() const noexcept;
 
 protected:
   virtual void onEvent(SDL_Event const &event);
@@ -118,11 +236,34 @@ private:
   void destroy() final;
   [[nodiscard]] glm::ivec2 getWindowSize() const final;
 
+  void createHeadlessFramebuffer();
+  void destroyHeadlessFramebuffer();
+  void finishHeadlessFrame();
+  void printHeadlessStats() const;
+
   OpenGLSettings m_openGLSettings;
+  OpenGLHeadlessSettings m_headlessSettings;
   std::string m_GLSLVersion;
   SDL_GLContext m_GLContext{};
   bool m_hidden{};
   bool m_minimized{};
+
+  GLuint m_headlessFBO{};
+  GLuint m_headlessResolveFBO{};
+  GLuint m_headlessColorRBO{};
+  GLuint m_headlessDepthRBO{};
+  GLuint m_headlessResolveRBO{};
+  int m_headlessFrame{};
+  Timer m_headlessFrameTimer;
+  std::vector<double> m_headlessFrameTimes;
+  int m_headlessMismatchedFrames{};
+
+  std::unique_ptr<OpenGLFrameCapture> m_frameCapture;
+  OpenGLProfiler m_profiler;
+  OpenGLDynamicResolution m_dynamicResolution;
+  // Whether the scene is rendered to the offscreen target of
+  // m_dynamicResolution even if dynamic resolution is disabled
+  bool m_sceneTargetRequested{};
 };
 
 #endif
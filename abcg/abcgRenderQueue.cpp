@@ -0,0 +1,254 @@
+/**
+ * @file abcgRenderQueue.cpp
+ * @brief Definition of abcg::RenderKey and abcg::RenderQueue members.
+ *
+ * This file is part of ABCg (https://github.com/hbatagelo/abcg).
+ *
+ * @copyright (c) 2021--2023 Harlen Batagelo. All rights reserved.
+ * This project is released under the MIT License.
+ */
+
+#include "abcgRenderQueue.hpp"
+
+#include <gsl/gsl>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <utility>
+
+#include "abcgTrace.hpp"
+
+namespace {
+constexpr std::uint64_t passBits{4};
+constexpr std::uint64_t programBits{8};
+constexpr std::uint64_t materialBits{12};
+constexpr std::uint64_t textureBits{12};
+constexpr std::uint64_t depthBits{24};
+constexpr std::uint64_t stateBits{programBits + materialBits + textureBits};
+
+constexpr std::uint64_t mask(std::uint64_t bits) { return (1ULL << bits) - 1; }
+
+// Shifts of the fields when the draws with the same state are sorted from
+// front to back
+constexpr std::uint64_t orderShift{0};
+constexpr std::uint64_t depthShift{4};
+constexpr std::uint64_t textureShift{depthShift + depthBits};
+constexpr std::uint64_t materialShift{textureShift + textureBits};
+constexpr std::uint64_t programShift{materialShift + materialBits};
+constexpr std::uint64_t passShift{programShift + programBits};
+static_assert(passShift + passBits == 64);
+
+// Shifts of the depth and of the state when sorted from back to front, with
+// the depth right after the pass
+constexpr std::uint64_t backToFrontStateShift{depthShift};
+constexpr std::uint64_t backToFrontDepthShift{depthShift + stateBits};
+
+constexpr std::size_t radixBits{8};
+constexpr std::size_t radixSize{1U << radixBits};
+
+// Flags of the state that differs between two keys
+std::uint8_t stateChanges(abcg::RenderKey const &previous,
+                          abcg::RenderKey const &current) {
+  std::uint8_t changes{};
+  if (previous.pass != current.pass)
+    changes |= abcg::RenderPacket::passChange;
+  if (previous.program != current.program)
+    changes |= abcg::RenderPacket::programChange;
+  if (previous.material != current.material)
+    changes |= abcg::RenderPacket::materialChange;
+  if (previous.texture != current.texture)
+    changes |= abcg::RenderPacket::textureChange;
+  return changes;
+}
+
+constexpr std::uint8_t allChanges{
+    abcg::RenderPacket::passChange | abcg::RenderPacket::programChange |
+    abcg::RenderPacket::materialChange | abcg::RenderPacket::textureChange};
+
+// Number of program, material and texture changes
+std::size_t countStateChanges(std::uint8_t changes) {
+  constexpr std::uint8_t stateMask{allChanges &
+                                   ~abcg::RenderPacket::passChange};
+  return gsl::narrow_cast<std::size_t>(
+      std::popcount(static_cast<unsigned>(changes & stateMask)));
+}
+} // namespace
+
+/**
+ * @brief Packs the fields into a sort key.
+ *
+ * @return 64-bit key.
+ */
+std::uint64_t abcg::RenderKey::encode() const noexcept {
+  auto const quantizedDepth{static_cast<std::uint64_t>(
+      std::lround(std::clamp(depth, 0.0f, 1.0f) *
+                  gsl::narrow_cast<float>(mask(depthBits))))};
+  auto const state{
+      (std::uint64_t{program} & mask(programBits))
+          << (materialBits + textureBits) |
+      (std::uint64_t{material} & mask(materialBits)) << textureBits |
+      (std::uint64_t{texture} & mask(textureBits))};
+
+  auto key{(std::uint64_t{pass} & mask(passBits)) << passShift};
+  if (backToFront) {
+    key |= (mask(depthBits) - quantizedDepth) << backToFrontDepthShift;
+    key |= state << backToFrontStateShift;
+    key |= 1ULL << orderShift;
+  } else {
+    key |= state << textureShift;
+    key |= quantizedDepth << depthShift;
+  }
+  return key;
+}
+
+/**
+ * @brief Unpacks the fields of a sort key.
+ *
+ * @param key 64-bit key returned by abcg::RenderKey::encode.
+ *
+ * @return Fields of the key. The depth is quantized.
+ */
+abcg::RenderKey abcg::RenderKey::decode(std::uint64_t key) noexcept {
+  RenderKey fields;
+  fields.backToFront = ((key >> orderShift) & 1U) != 0;
+
+  std::uint64_t state{};
+  std::uint64_t quantizedDepth{};
+  if (fields.backToFront) {
+    state = (key >> backToFrontStateShift) & mask(stateBits);
+    quantizedDepth =
+        mask(depthBits) - ((key >> backToFrontDepthShift) & mask(depthBits));
+  } else {
+    state = (key >> textureShift) & mask(stateBits);
+    quantizedDepth = (key >> depthShift) & mask(depthBits);
+  }
+
+  fields.pass =
+      gsl::narrow_cast<std::uint32_t>((key >> passShift) & mask(passBits));
+  fields.program = gsl::narrow_cast<std::uint32_t>(
+      (state >> (materialBits + textureBits)) & mask(programBits));
+  fields.material = gsl::narrow_cast<std::uint32_t>(
+      (state >> textureBits) & mask(materialBits));
+  fields.texture =
+      gsl::narrow_cast<std::uint32_t>(state & mask(textureBits));
+  fields.depth = gsl::narrow_cast<float>(quantizedDepth) /
+                 gsl::narrow_cast<float>(mask(depthBits));
+  return fields;
+}
+
+/**
+ * @brief Removes all packets.
+ */
+void abcg::RenderQueue::clear() noexcept {
+  m_packets.clear();
+  m_statistics = {};
+  m_lastKey = 0;
+}
+
+/**
+ * @brief Reserves memory for a number of packets.
+ *
+ * @param count Number of packets.
+ */
+void abcg::RenderQueue::reserve(std::size_t count) {
+  m_packets.reserve(count);
+  m_scratch.reserve(count);
+}
+
+/**
+ * @brief Records a draw.
+ *
+ * @param key Fields of the sort key.
+ * @param payload Value that identifies the draw.
+ */
+void abcg::RenderQueue::push(RenderKey const &key, std::uint32_t payload) {
+  auto const encodedKey{key.encode()};
+  auto const changes{
+      m_packets.empty()
+          ? allChanges
+          : stateChanges(RenderKey::decode(m_lastKey),
+                         RenderKey::decode(encodedKey))};
+  m_statistics.unsortedStateChanges += countStateChanges(changes);
+  ++m_statistics.packets;
+
+  m_packets.push_back({.key = encodedKey, .payload = payload});
+  m_lastKey = encodedKey;
+}
+
+/**
+ * @brief Sorts the packets by key and sets the state changes of each one.
+ *
+ * The sort is stable, so packets with the same key keep the order in which
+ * they were recorded.
+ */
+void abcg::RenderQueue::sort() {
+  abcg::TraceScope const traceScope{"RenderQueue::sort", "render"};
+
+  if (m_packets.empty())
+    return;
+
+  // Histograms of all digits in a single pass over the keys
+  constexpr std::size_t digitCount{64 / radixBits};
+  std::array<std::array<std::size_t, radixSize>, digitCount> histograms{};
+  for (auto const &packet : m_packets) {
+    for (std::size_t digit{}; digit < digitCount; ++digit) {
+      ++histograms.at(digit).at((packet.key >> (digit * radixBits)) &
+                                (radixSize - 1));
+    }
+  }
+
+  m_scratch.resize(m_packets.size());
+  for (std::size_t digit{}; digit < digitCount; ++digit) {
+    auto &histogram{histograms.at(digit)};
+    // All keys have the same digit
+    if (std::ranges::find(histogram, m_packets.size()) != histogram.end())
+      continue;
+
+    std::size_t offset{};
+    for (auto &count : histogram) {
+      offset += std::exchange(count, offset);
+    }
+    for (auto const &packet : m_packets) {
+      auto &position{
+          histogram.at((packet.key >> (digit * radixBits)) & (radixSize - 1))};
+      m_scratch.at(position++) = packet;
+    }
+    m_packets.swap(m_scratch);
+  }
+
+  // State changes in the sorted order
+  m_statistics.stateChanges = 0;
+  RenderKey previous;
+  for (auto &packet : m_packets) {
+    auto const current{RenderKey::decode(packet.key)};
+    packet.changes = &packet == &m_packets.front()
+                         ? allChanges
+                         : stateChanges(previous, current);
+    m_statistics.stateChanges += countStateChanges(packet.changes);
+    previous = current;
+  }
+}
+
+/**
+ * @brief Returns the packets.
+ *
+ * @return Packets in the order they were recorded, or in key order after
+ * sort.
+ */
+std::span<abcg::RenderPacket const>
+abcg::RenderQueue::getPackets() const noexcept {
+  return m_packets;
+}
+
+/**
+ * @brief Returns the number of packets and state changes.
+ *
+ * @return Statistics of the packets recorded since the last call to clear.
+ * The state changes in the sorted order are updated by sort.
+ */
+abcg::RenderQueueStatistics const &
+abcg::RenderQueue::getStatistics() const noexcept {
+  return m_statistics;
+}
@@ -0,0 +1,153 @@
+/**
+ * @file abcgRenderQueue.hpp
+ * @brief Header file of abcg::RenderQueue.
+ *
+ * Declaration of abcg::RenderKey, abcg::RenderPacket and abcg::RenderQueue.
+ *
+ * This file is part of ABCg (https://github.com/hbatagelo/abcg).
+ *
+ * @copyright (c) 2021--2023 Harlen Batagelo. All rights reserved.
+ * This project is released under the MIT License.
+ */
+
+#ifndef ABCG_RENDER_QUEUE_HPP_
+#define ABCG_RENDER_QUEUE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace abcg {
+struct RenderKey;
+struct RenderPacket;
+struct RenderQueueStatistics;
+class RenderQueue;
+} // namespace abcg
+
+/**
+ * @brief Fields of the sort key of a draw.
+ *
+ * The fields are packed into 64 bits, from the most to the least significant:
+ *
+ * | Field    | Bits |
+ * |----------|------|
+ * | pass     | 4    |
+ * | program  | 8    |
+ * | material | 12   |
+ * | texture  | 12   |
+ * | depth    | 24   |
+ * | unused   | 3    |
+ * | order    | 1    |
+ *
+ * Sorting by this key groups the draws of each pass by program, material and
+ * texture, in this order, and sorts the draws with the same state from front
+ * to back. If `backToFront` is set, as needed for blending, the depth is
+ * inverted and moved right after the pass, so the draws of the pass are
+ * sorted by depth alone, from back to front.
+ *
+ * Programs, materials and textures are identified by small indices chosen by
+ * the application, not by the names of the OpenGL objects. Values that do not
+ * fit in their fields are truncated.
+ */
+struct abcg::RenderKey {
+  /** @brief Pass, such as the depth pre-pass or the opaque pass. */
+  std::uint32_t pass{};
+  /** @brief Index of the program. */
+  std::uint32_t program{};
+  /** @brief Index of the material. */
+  std::uint32_t material{};
+  /** @brief Index of the texture. */
+  std::uint32_t texture{};
+  /** @brief Normalized depth, from 0 (near) to 1 (far). */
+  float depth{};
+  /** @brief Whether the pass is sorted from back to front. */
+  bool backToFront{};
+
+  [[nodiscard]] std::uint64_t encode() const noexcept;
+  [[nodiscard]] static RenderKey decode(std::uint64_t key) noexcept;
+};
+
+/**
+ * @brief Draw recorded in an abcg::RenderQueue.
+ */
+struct abcg::RenderPacket {
+  /** @brief Flag of `changes` set when the pass changes. */
+  static constexpr std::uint8_t passChange{1U << 0U};
+  /** @brief Flag of `changes` set when the program changes. */
+  static constexpr std::uint8_t programChange{1U << 1U};
+  /** @brief Flag of `changes` set when the material changes. */
+  static constexpr std::uint8_t materialChange{1U << 2U};
+  /** @brief Flag of `changes` set when the texture changes. */
+  static constexpr std::uint8_t textureChange{1U << 3U};
+
+  /** @brief Sort key, as returned by abcg::RenderKey::encode. */
+  std::uint64_t key{};
+  /** @brief Value chosen by the application to identify the draw, such as
+   * the index of an object. */
+  std::uint32_t payload{};
+  /** @brief Flags of the state that differs from the previous packet. Set by
+   * abcg::RenderQueue::sort. */
+  std::uint8_t changes{};
+};
+
+/**
+ * @brief Number of state changes of the packets of an abcg::RenderQueue.
+ *
+ * A state change is a change of program, material or texture from one packet
+ * to the next. The first packet changes all of them.
+ */
+struct abcg::RenderQueueStatistics {
+  /** @brief Number of packets. */
+  std::size_t packets{};
+  /** @brief State changes in the sorted order. */
+  std::size_t stateChanges{};
+  /** @brief State changes in the order the packets were recorded. */
+  std::size_t unsortedStateChanges{};
+};
+
+/**
+ * @brief List of draws sorted to reduce state changes.
+ *
+ * Draws are recorded as packets with a 64-bit key (see abcg::RenderKey) and
+ * a payload that identifies them. After sort, the packets are in key order and
+ * each one has the flags of the state that changes from the previous one, so
+ * that the application binds only what changes:
+ *
+ * @code
+ * renderQueue.clear();
+ * for (auto const index : iter::range(objects.size())) {
+ *   renderQueue.push({.program = 0, .texture = objects[index].texture,
+ *                     .depth = depth(index)}, index);
+ * }
+ * renderQueue.sort();
+ * for (auto const &packet : renderQueue.getPackets()) {
+ *   if ((packet.changes & abcg::RenderPacket::textureChange) != 0) {
+ *     bindTexture(abcg::RenderKey::decode(packet.key).texture);
+ *   }
+ *   draw(objects[packet.payload]);
+ * }
+ * @endcode
+ *
+ * The packets are sorted with a least-significant-digit radix sort, which
+ * skips the digits that are the same in all keys.
+ */
+class abcg::RenderQueue {
+public:
+  void clear() noexcept;
+  void reserve(std::size_t count);
+  void push(RenderKey const &key, std::uint32_t payload);
+  void sort();
+
+  [[nodiscard]] std::span<RenderPacket const> getPackets() const noexcept;
+  [[nodiscard]] RenderQueueStatistics const &getStatistics() const noexcept;
+
+private:
+  std::vector<RenderPacket> m_packets;
+  std::vector<RenderPacket> m_scratch;
+  RenderQueueStatistics m_statistics;
+  // Key of the last recorded packet, for the unsorted state changes
+  std::uint64_t m_lastKey{};
+};
+
+#endif
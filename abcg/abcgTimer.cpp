@@ -34,4 +34,17 @@ double abcg::Timer::restart() {
   start = now;
 
   return elapsed;
-}
\ No newline at end of file
+}
+/**
+ * @brief Starts measuring the time spent in the current scope.
+ *
+ * @param accumulator Variable the elapsed time, in seconds, is added to when
+ * the object is destroyed.
+ */
+abcg::ScopedTimer::ScopedTimer(double &accumulator) noexcept
+    : m_accumulator{accumulator} {}
+
+/**
+ * @brief Adds the elapsed time to the accumulator.
+ */
+abcg::ScopedTimer::~ScopedTimer() { m_accumulator += m_timer.elapsed(); }
@@ -15,6 +15,7 @@
 
 namespace abcg {
 class Timer;
+class ScopedTimer;
 } // namespace abcg
 
 /**
@@ -32,4 +33,34 @@ private:
   clock::time_point start{clock::now()};
 };
 
+/**
+ * @brief Measures the time spent in a scope.
+ *
+ * The elapsed time, in seconds, is added to a given variable when the object
+ * goes out of scope.
+ *
+ * @code
+ * double updateTime{};
+ * {
+ *   abcg::ScopedTimer const timer{updateTime};
+ *   update();
+ * }
+ * @endcode
+ *
+ * @remark Objects of this type cannot be copied or moved.
+ */
+class abcg::ScopedTimer {
+public:
+  explicit ScopedTimer(double &accumulator) noexcept;
+  ScopedTimer(ScopedTimer const &) = delete;
+  ScopedTimer(ScopedTimer &&) = delete;
+  ScopedTimer &operator=(ScopedTimer const &) = delete;
+  ScopedTimer &operator=(ScopedTimer &&) = delete;
+  ~ScopedTimer();
+
+private:
+  double &m_accumulator;
+  Timer m_timer;
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,464 @@
+/**
+ * @file abcgTrace.cpp
+ * @brief Definition of abcg::Tracer and abcg::TraceScope members.
+ *
+ * This file is part of ABCg (https://github.com/hbatagelo/abcg).
+ *
+ * @copyright (c) 2021--2023 Harlen Batagelo. All rights reserved.
+ * This project is released under the MIT License.
+ */
+
+#include "abcgTrace.hpp"
+
+#include <fmt/format.h>
+#include <gsl/gsl>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "abcgException.hpp"
+
+namespace {
+
+struct Event {
+  char const *name{};
+  char const *category{};
+  std::int64_t start{};
+  std::int64_t duration{};
+  double value{};
+  char phase{};
+};
+
+// Number of events of each thread that can be pending. Must be a power of two
+constexpr std::size_t bufferCapacity{16384};
+
+// Single-producer, single-consumer ring of events of a thread. Only the owner
+// thread writes events and advances the head; only the thread holding the
+// file lock reads events and advances the tail.
+struct ThreadBuffer {
+  std::vector<Event> events = std::vector<Event>(bufferCapacity);
+  std::atomic<std::size_t> head{};
+  std::atomic<std::size_t> tail{};
+  std::atomic<std::size_t> droppedEvents{};
+  std::atomic<char const *> name{};
+  int id{};
+  // Name already written to the trace. Accessed with the file lock held
+  char const *writtenName{};
+};
+
+struct TraceState {
+  TraceState() = default;
+  TraceState(TraceState const &) = delete;
+  TraceState(TraceState &&) = delete;
+  TraceState &operator=(TraceState const &) = delete;
+  TraceState &operator=(TraceState &&) = delete;
+  ~TraceState();
+
+  std::atomic<bool> recording{};
+
+  std::mutex registryMutex;
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+
+  std::mutex fileMutex;
+  std::ofstream stream;
+  std::string path;
+  bool firstEvent{};
+  std::vector<double> frameTimes;
+
+  std::mutex flusherMutex;
+  std::condition_variable wakeFlusher;
+  std::thread flusher;
+  bool stopFlusher{};
+};
+
+TraceState &getState() {
+  static TraceState state;
+  return state;
+}
+
+std::shared_ptr<ThreadBuffer> registerThread() {
+  auto &state{getState()};
+  auto buffer{std::make_shared<ThreadBuffer>()};
+  std::scoped_lock const lock{state.registryMutex};
+  buffer->id = gsl::narrow<int>(state.buffers.size()) + 1;
+  state.buffers.push_back(buffer);
+  return buffer;
+}
+
+ThreadBuffer *getThreadBuffer() noexcept {
+  thread_local std::shared_ptr<ThreadBuffer> buffer;
+  if (!buffer) {
+    try {
+      buffer = registerThread();
+    } catch (...) {
+      return nullptr;
+    }
+  }
+  return buffer.get();
+}
+
+void push(Event const &event) noexcept {
+  auto *const buffer{getThreadBuffer()};
+  if (buffer == nullptr)
+    return;
+
+  auto const head{buffer->head.load(std::memory_order_relaxed)};
+  auto const tail{buffer->tail.load(std::memory_order_acquire)};
+  if (head - tail == bufferCapacity) {
+    buffer->droppedEvents.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  buffer->events[head & (bufferCapacity - 1)] = event;
+  buffer->head.store(head + 1, std::memory_order_release);
+}
+
+std::string escape(std::string_view text) {
+  std::string escaped;
+  escaped.reserve(text.size());
+  for (auto const character : text) {
+    if (character == '"' || character == '\\') {
+      escaped.push_back('\\');
+    }
+    escaped.push_back(character);
+  }
+  return escaped;
+}
+
+// Must be called with the file lock held
+void writeEvent(TraceState &state, std::string_view json) {
+  state.stream << (state.firstEvent ? "\n" : ",\n") << json;
+  state.firstEvent = false;
+}
+
+// Must be called with the file lock held
+void writeThreadName(TraceState &state, ThreadBuffer &buffer) {
+  auto const *const name{buffer.name.load(std::memory_order_acquire)};
+  if (name == nullptr || name == buffer.writtenName)
+    return;
+  writeEvent(state, fmt::format(R"({{"name":"thread_name","ph":"M","pid":1,)"
+                                R"("tid":{},"args":{{"name":"{}"}}}})",
+                                buffer.id, escape(name)));
+  buffer.writtenName = name;
+}
+
+// Must be called with the file lock held
+void drain(TraceState &state, ThreadBuffer &buffer) {
+  writeThreadName(state, buffer);
+
+  auto tail{buffer.tail.load(std::memory_order_relaxed)};
+  auto const head{buffer.head.load(std::memory_order_acquire)};
+  for (; tail != head; ++tail) {
+    auto const &event{buffer.events[tail & (bufferCapacity - 1)]};
+    auto const timestamp{gsl::narrow_cast<double>(event.start) * 1.0e-3};
+    if (event.phase == 'C') {
+      writeEvent(state, fmt::format(R"({{"name":"{}","ph":"C","ts":{:.3f},)"
+                                    R"("pid":1,"tid":{},)"
+                                    R"("args":{{"value":{}}}}})",
+                                    escape(event.name), timestamp, buffer.id,
+                                    event.value));
+    } else {
+      auto const duration{gsl::narrow_cast<double>(event.duration) * 1.0e-3};
+      writeEvent(state, fmt::format(R"({{"name":"{}","cat":"{}","ph":"X",)"
+                                    R"("ts":{:.3f},"dur":{:.3f},)"
+                                    R"("pid":1,"tid":{}}})",
+                                    escape(event.name), escape(event.category),
+                                    timestamp, duration, buffer.id));
+      if (std::strcmp(event.category, "frame") == 0) {
+        state.frameTimes.push_back(duration * 1.0e-3);
+      }
+    }
+  }
+  buffer.tail.store(tail, std::memory_order_release);
+}
+
+std::vector<std::shared_ptr<ThreadBuffer>> getBuffers(TraceState &state) {
+  std::scoped_lock const lock{state.registryMutex};
+  return state.buffers;
+}
+
+void flusherLoop(TraceState &state) {
+  std::unique_lock lock{state.flusherMutex};
+  while (!state.stopFlusher) {
+    state.wakeFlusher.wait_for(lock, std::chrono::milliseconds(100));
+    lock.unlock();
+    abcg::Tracer::flush();
+    lock.lock();
+  }
+}
+
+void writeSummary(TraceState const &state, std::size_t droppedEvents) {
+  auto const summaryPath{
+      std::filesystem::path{state.path}.replace_extension().string() +
+      ".summary.json"};
+
+  std::ofstream stream(summaryPath);
+  if (!stream) {
+    fmt::print(stderr, "Failed to write trace summary {}\n", summaryPath);
+    return;
+  }
+
+  if (state.frameTimes.empty()) {
+    stream << fmt::format("{{\n  \"frames\": 0,\n  \"droppedEvents\": {}\n}}\n",
+                          droppedEvents);
+    return;
+  }
+
+  auto sorted{state.frameTimes};
+  std::sort(sorted.begin(), sorted.end());
+
+  // Nearest-rank percentile, in milliseconds
+  auto const percentile{[&sorted](double fraction) {
+    auto const rank{std::ceil(fraction * gsl::narrow<double>(sorted.size()))};
+    auto const index{
+        std::max<std::size_t>(gsl::narrow_cast<std::size_t>(rank), 1) - 1};
+    return sorted.at(index);
+  }};
+
+  auto const mean{std::accumulate(sorted.begin(), sorted.end(), 0.0) /
+                  gsl::narrow<double>(sorted.size())};
+  auto const p50{percentile(0.50)};
+  auto const p95{percentile(0.95)};
+  auto const p99{percentile(0.99)};
+
+  fmt::print("Trace frame time (ms): p50 {:.3f}, p95 {:.3f}, p99 {:.3f} "
+             "({} frames)\n",
+             p50, p95, p99, sorted.size());
+
+  stream << fmt::format(
+      "{{\n"
+      "  \"frames\": {},\n"
+      "  \"frameTimeMs\": {{\"min\": {:.4f}, \"mean\": {:.4f}, "
+      "\"p50\": {:.4f}, \"p95\": {:.4f}, \"p99\": {:.4f}, "
+      "\"max\": {:.4f}}},\n"
+      "  \"droppedEvents\": {}\n"
+      "}}\n",
+      sorted.size(), sorted.front(), mean, p50, p95, p99, sorted.back(),
+      droppedEvents);
+}
+
+void stopRecording(TraceState &state) {
+  if (!state.recording.exchange(false))
+    return;
+
+  if (state.flusher.joinable()) {
+    {
+      std::scoped_lock const lock{state.flusherMutex};
+      state.stopFlusher = true;
+    }
+    state.wakeFlusher.notify_one();
+    state.flusher.join();
+  }
+
+  abcg::Tracer::flush();
+
+  std::scoped_lock const lock{state.fileMutex};
+  state.stream << "\n],\"displayTimeUnit\":\"ms\"}\n";
+  state.stream.close();
+
+  std::size_t droppedEvents{};
+  for (auto const &buffer : getBuffers(state)) {
+    droppedEvents += buffer->droppedEvents.exchange(0);
+  }
+  if (droppedEvents > 0) {
+    fmt::print(stderr, "Trace dropped {} events\n", droppedEvents);
+  }
+
+  writeSummary(state, droppedEvents);
+  state.frameTimes.clear();
+}
+
+TraceState::~TraceState() {
+  // Finish the trace if the application did not stop it, e.g., due to an
+  // exception
+  try {
+    stopRecording(*this);
+  } catch (...) {
+  }
+}
+
+} // namespace
+
+/**
+ * @brief Starts recording events to a trace file.
+ *
+ * Does nothing if a trace is already being recorded.
+ *
+ * @param path Path of the trace file.
+ *
+ * @throw abcg::RuntimeError if the file could not be created.
+ */
+void abcg::Tracer::start(std::string const &path) {
+  auto &state{getState()};
+  if (state.recording)
+    return;
+
+  {
+    std::scoped_lock const lock{state.fileMutex};
+    state.stream.open(path);
+    if (!state.stream) {
+      throw abcg::RuntimeError(
+          fmt::format("Failed to create trace file {}", path));
+    }
+    state.path = path;
+    state.firstEvent = true;
+    state.frameTimes.clear();
+    state.stream << R"({"traceEvents":[)";
+
+    // Discard events left from a previous recording
+    for (auto const &buffer : getBuffers(state)) {
+      buffer->tail.store(buffer->head.load(std::memory_order_acquire),
+                         std::memory_order_release);
+      buffer->droppedEvents = 0;
+      buffer->writtenName = nullptr;
+    }
+  }
+
+  state.recording = true;
+
+#if !defined(__EMSCRIPTEN__)
+  state.stopFlusher = false;
+  state.flusher = std::thread(flusherLoop, std::ref(state));
+#endif
+}
+
+/**
+ * @brief Stops recording and writes the summary of frame times.
+ *
+ * The summary is written to a file with the name of the trace file and
+ * extension `.summary.json`. It contains the minimum, mean, maximum, and the
+ * 50th, 95th and 99th percentiles of the durations, in milliseconds, of the
+ * events of the `frame` category.
+ *
+ * Does nothing if no trace is being recorded.
+ */
+void abcg::Tracer::stop() { stopRecording(getState()); }
+
+/**
+ * @brief Writes the pending events of all threads to the trace file.
+ *
+ * This is called periodically by the background thread.
+ */
+void abcg::Tracer::flush() {
+  auto &state{getState()};
+  std::scoped_lock const lock{state.fileMutex};
+  if (!state.stream.is_open())
+    return;
+  for (auto const &buffer : getBuffers(state)) {
+    drain(state, *buffer);
+  }
+}
+
+/**
+ * @brief Returns whether a trace is being recorded.
+ *
+ * @return `true` if events are being recorded.
+ */
+bool abcg::Tracer::isRecording() noexcept {
+  return getState().recording.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Returns the time used to timestamp events.
+ *
+ * @return Time, in nanoseconds, elapsed since the first call to this function.
+ */
+std::int64_t abcg::Tracer::now() noexcept {
+  using clock = std::chrono::steady_clock;
+  static auto const epoch{clock::now()};
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() -
+                                                              epoch)
+      .count();
+}
+
+/**
+ * @brief Records an event with a duration.
+ *
+ * @param name Name of the event. Must be a null-terminated string that
+ * outlives the recording, such as a string literal.
+ * @param category Category of the event, with the same lifetime requirements
+ * of @a name. Events of the `frame` category are used in the summary of frame
+ * times.
+ * @param start Start time, as returned by abcg::Tracer::now.
+ * @param end End time, as returned by abcg::Tracer::now.
+ */
+void abcg::Tracer::complete(char const *name, char const *category,
+                            std::int64_t start, std::int64_t end) noexcept {
+  if (!isRecording())
+    return;
+  push({.name = name,
+        .category = category,
+        .start = start,
+        .duration = end - start,
+        .value = {},
+        .phase = 'X'});
+}
+
+/**
+ * @brief Records the current value of a counter.
+ *
+ * Counters are shown as graphs in the trace viewer.
+ *
+ * @param name Name of the counter. Must be a null-terminated string that
+ * outlives the recording, such as a string literal.
+ * @param value Value of the counter.
+ */
+void abcg::Tracer::counter(char const *name, double value) noexcept {
+  if (!isRecording())
+    return;
+  push({.name = name,
+        .category = "counter",
+        .start = now(),
+        .duration = {},
+        .value = value,
+        .phase = 'C'});
+}
+
+/**
+ * @brief Sets the name shown in the trace for the calling thread.
+ *
+ * @param name Name of the thread. Must be a null-terminated string that
+ * outlives the recording, such as a string literal.
+ */
+void abcg::Tracer::setThreadName(char const *name) noexcept {
+  if (auto *const buffer{getThreadBuffer()}) {
+    buffer->name.store(name, std::memory_order_release);
+  }
+}
+
+/**
+ * @brief Opens a traced scope.
+ *
+ * @param name Name of the scope. Must be a null-terminated string that
+ * outlives the recording, such as a string literal.
+ * @param category Category of the scope, with the same lifetime requirements
+ * of @a name.
+ */
+abcg::TraceScope::TraceScope(char const *name, char const *category) noexcept
+    : m_name{name}, m_category{category} {
+  if (Tracer::isRecording()) {
+    m_start = Tracer::now();
+  }
+}
+
+/**
+ * @brief Closes the traced scope and records its duration.
+ */
+abcg::TraceScope::~TraceScope() {
+  if (m_start >= 0) {
+    Tracer::complete(m_name, m_category, m_start, Tracer::now());
+  }
+}
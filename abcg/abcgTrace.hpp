@@ -0,0 +1,90 @@
+/**
+ * @file abcgTrace.hpp
+ * @brief Header file of abcg::Tracer and abcg::TraceScope.
+ *
+ * Declaration of abcg::Tracer and abcg::TraceScope.
+ *
+ * This file is part of ABCg (https://github.com/hbatagelo/abcg).
+ *
+ * @copyright (c) 2021--2023 Harlen Batagelo. All rights reserved.
+ * This project is released under the MIT License.
+ */
+
+#ifndef ABCG_TRACE_HPP_
+#define ABCG_TRACE_HPP_
+
+#include <cstdint>
+#include <string>
+
+namespace abcg {
+class Tracer;
+class TraceScope;
+} // namespace abcg
+
+/**
+ * @brief Records timed events to a Chrome trace file.
+ *
+ * The trace is written in the Chrome trace event JSON format, which can be
+ * opened in `chrome://tracing` or in the Perfetto UI (https://ui.perfetto.dev).
+ *
+ * Each thread writes its events to its own single-producer ring buffer without
+ * taking locks. A background thread periodically drains the buffers to the
+ * file. If a buffer fills up before it is drained, new events of that thread
+ * are dropped and counted.
+ *
+ * When recording stops, a summary with the percentiles of the durations of
+ * the events of the `frame` category is written next to the trace file.
+ *
+ * abcg::Application starts and stops the recording when the program is
+ * launched with `--trace`.
+ *
+ * @remark On WebAssembly, there is no background thread and the buffers are
+ * drained by abcg::Tracer::flush, which abcg::Application calls every frame.
+ */
+class abcg::Tracer {
+public:
+  static void start(std::string const &path);
+  static void stop();
+  static void flush();
+
+  [[nodiscard]] static bool isRecording() noexcept;
+  [[nodiscard]] static std::int64_t now() noexcept;
+
+  static void complete(char const *name, char const *category,
+                       std::int64_t start, std::int64_t end) noexcept;
+  static void counter(char const *name, double value) noexcept;
+  static void setThreadName(char const *name) noexcept;
+};
+
+/**
+ * @brief RAII marker of a traced scope.
+ *
+ * Records a complete event with the duration of the scope if abcg::Tracer is
+ * recording when the scope is opened.
+ *
+ * @code
+ * {
+ *   abcg::TraceScope const scope{"loadModel", "asset"};
+ *   loadModel(path);
+ * }
+ * @endcode
+ *
+ * @remark Objects of this type cannot be copied or moved.
+ */
+class abcg::TraceScope {
+public:
+  explicit TraceScope(char const *name,
+                      char const *category = "scope") noexcept;
+  TraceScope(TraceScope const &) = delete;
+  TraceScope(TraceScope &&) = delete;
+  TraceScope &operator=(TraceScope const &) = delete;
+  TraceScope &operator=(TraceScope &&) = delete;
+  ~TraceScope();
+
+private:
+  char const *m_name{};
+  char const *m_category{};
+  std::int64_t m_start{-1};
+};
+
+#endif
@@ -15,6 +15,7 @@
 #include <set>
 
 #include "abcgException.hpp"
+#include "abcgVulkanUploader.hpp"
 
 void abcg::VulkanBuffer::create(VulkanDevice const &device,
                                 VulkanBufferCreateInfo const &createInfo) {
@@ -27,6 +28,17 @@ void abcg::VulkanBuffer::create(VulkanDevice const &device,
     if (createInfo.data.has_value()) {
       loadData(createInfo.data.value(), createInfo.size);
     }
+  } else if (createInfo.data.has_value() && createInfo.uploader != nullptr) {
+    // Exclusive, so that the uploader can transfer its ownership from the
+    // transfer queue to the graphics queue
+    std::tie(m_buffer, m_deviceMemory) =
+        createBuffer(device, createInfo.size,
+                     createInfo.usage | vk::BufferUsageFlagBits::eTransferDst,
+                     vk::MemoryPropertyFlagBits::eDeviceLocal, false);
+
+    // The copy is executed by the transfer queue at the next flush
+    createInfo.uploader->uploadBuffer(m_buffer, createInfo.data.value(),
+                                      createInfo.size);
   } else if (createInfo.data.has_value()) {
     // Use a staging buffer for mapping, and a device local buffer as the final
     // destination
@@ -86,7 +98,7 @@ void abcg::VulkanBuffer::loadData(gsl::not_null<void const *> data,
 
 std::pair<vk::Buffer, vk::DeviceMemory> abcg::VulkanBuffer::createBuffer(
     VulkanDevice const &device, vk::DeviceSize size, vk::BufferUsageFlags usage,
-    vk::MemoryPropertyFlags properties) const {
+    vk::MemoryPropertyFlags properties, bool concurrent) const {
   auto const &physicalDevice{device.getPhysicalDevice()};
   auto const &queuesFamilies{physicalDevice.getQueuesFamilies()};
 
@@ -100,13 +112,15 @@ std::pair<vk::Buffer, vk::DeviceMemory> abcg::VulkanBuffer::createBuffer(
   auto const separateTransferQueue{
       queuesFamilies.graphics.value_or(VK_QUEUE_FAMILY_IGNORED) !=
       queuesFamilies.transfer.value_or(VK_QUEUE_FAMILY_IGNORED)};
+  auto const sharingMode{concurrent && separateTransferQueue
+                             ? vk::SharingMode::eConcurrent
+                             : vk::SharingMode::eExclusive};
 
   // Create buffer object
   auto buffer{m_device.createBuffer(
       {.size = size,
        .usage = usage,
-       .sharingMode = separateTransferQueue ? vk::SharingMode::eConcurrent
-                                            : vk::SharingMode::eExclusive,
+       .sharingMode = sharingMode,
        .queueFamilyIndexCount =
            gsl::narrow<uint32_t>(queueFamilyIndices.size()),
        .pQueueFamilyIndices = queueFamilyIndices.data()})};
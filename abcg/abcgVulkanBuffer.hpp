@@ -14,6 +14,7 @@
 #define ABCG_VULKAN_BUFFER_HPP_
 
 #include "abcgVulkanDevice.hpp"
+#include "abcgVulkanUploader.hpp"
 
 #include <gsl/pointers>
 
@@ -30,6 +31,11 @@ struct abcg::VulkanBufferCreateInfo {
   vk::BufferUsageFlags usage{};
   vk::MemoryPropertyFlags properties{};
   std::optional<gsl::not_null<void const *>> data{};
+  /** @brief If set, device local data is uploaded asynchronously through this
+   * uploader instead of blocking until the copy is finished. The buffer is
+   * then owned by one queue family at a time, and must not be used before
+   * the upload is complete (see abcg::VulkanUploader::isComplete). */
+  VulkanUploader *uploader{};
 };
 
 /**
@@ -53,8 +59,8 @@ public:
 private:
   [[nodiscard]] std::pair<vk::Buffer, vk::DeviceMemory>
   createBuffer(VulkanDevice const &device, vk::DeviceSize size,
-               vk::BufferUsageFlags usage,
-               vk::MemoryPropertyFlags properties) const;
+               vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties,
+               bool concurrent = true) const;
 
   vk::Buffer m_buffer;
   vk::DeviceMemory m_deviceMemory;
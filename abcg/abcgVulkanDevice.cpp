@@ -156,13 +156,19 @@ void abcg::VulkanDevice::withCommandBuffer(
   commandBuffer.end();
 
   // Queue command buffer
+  auto const fence{m_device.createFence({})};
   queue->submit({{.commandBufferCount = 1, .pCommandBuffers = &commandBuffer}},
-                vk::Fence{});
+                fence);
 
-  // Wait until completion
-  queue->waitIdle();
+  // Wait until completion of this submission only, instead of draining the
+  // whole queue
+  while (vk::Result::eTimeout ==
+         m_device.waitForFences(fence, VK_TRUE,
+                                std::numeric_limits<uint64_t>::max()))
+    ;
 
   // Cleanup
+  m_device.destroyFence(fence);
   m_device.freeCommandBuffers(*commandPool, {commandBuffer});
 }
 
@@ -18,8 +18,23 @@
 
 #include "abcgException.hpp"
 
+/**
+ * @brief Creates a sampled image from an image file.
+ *
+ * @param device Vulkan device.
+ * @param path Path to the image file (PNG or JPEG).
+ * @param generateMipmaps Whether to generate the mipmap levels.
+ * @param uploader If set, the texels are uploaded asynchronously through this
+ * uploader, and the mipmap levels are generated by the graphics queue once
+ * the image is acquired. The image must not be used before the upload is
+ * complete (see abcg::VulkanUploader::isComplete). Otherwise, this blocks
+ * until the image is ready.
+ *
+ * @throw abcg::RuntimeError if the image file could not be loaded.
+ */
 void abcg::VulkanImage::create(VulkanDevice const &device,
-                               std::string_view path, bool generateMipmaps) {
+                               std::string_view path, bool generateMipmaps,
+                               VulkanUploader *uploader) {
   m_device = static_cast<vk::Device>(device);
 
   // Load the bitmap
@@ -40,17 +55,6 @@ void abcg::VulkanImage::create(VulkanDevice const &device,
                     1;
     }
 
-    // Create staging buffer
-    abcg::VulkanBuffer stagingBuffer{};
-    stagingBuffer.create(
-        device, {.size = imageSize,
-                 .usage = vk::BufferUsageFlagBits::eTransferSrc,
-                 .properties = vk::MemoryPropertyFlagBits::eHostVisible |
-                               vk::MemoryPropertyFlagBits::eHostCoherent,
-                 .data = formattedSurface->pixels});
-
-    SDL_FreeSurface(formattedSurface);
-
     // TODO: Look for other formats if RGBA8 is not supported
     auto const imageFormat{vk::Format::eR8G8B8A8Srgb};
 
@@ -72,42 +76,84 @@ void abcg::VulkanImage::create(VulkanDevice const &device,
          .initialLayout = vk::ImageLayout::eUndefined},
         vk::MemoryPropertyFlagBits::eDeviceLocal);
 
-    transitionImageLayout(device, vk::ImageLayout::eUndefined,
-                          vk::ImageLayout::eTransferDstOptimal,
-                          {.aspectMask = vk::ImageAspectFlagBits::eColor,
-                           .levelCount = m_mipLevels,
-                           .layerCount = 1});
-
-    vk::BufferImageCopy const region{
-        .imageSubresource = {.aspectMask = vk::ImageAspectFlagBits::eColor,
-                             .layerCount = 1},
-        .imageExtent = {texWidth, texHeight, 1}};
-
-    // Execute the layout transition
-    device.withCommandBuffer(
-        [&stagingBuffer, this,
-         &region](vk::CommandBuffer const &commandBuffer) {
-          commandBuffer.copyBufferToImage(
-              static_cast<vk::Buffer>(stagingBuffer), m_image,
-              vk::ImageLayout::eTransferDstOptimal, region);
-        },
-        vk::QueueFlagBits::eTransfer);
-
-    // Generate the mipmap levels
-    if (m_mipLevels > 1) {
-      // Transitioned to vk::ImageLayout::eShaderReadOnlyOptimal while
-      // generating the mipmaps
-      createMipmaps(device, m_image, imageFormat, texWidth, texHeight,
-                    m_mipLevels);
+    if (uploader != nullptr) {
+      if (m_mipLevels > 1) {
+        checkLinearBlitting(device, imageFormat);
+      }
+
+      // Copied to the staging ring before uploadImage returns. Every level is
+      // left as a transfer destination for the mipmap generation, which
+      // transitions them to vk::ImageLayout::eShaderReadOnlyOptimal
+      VulkanImageUploadInfo uploadInfo{
+          .image = m_image,
+          .data = formattedSurface->pixels,
+          .size = imageSize,
+          .extent = {texWidth, texHeight, 1},
+          .subresourceRange = {.aspectMask = vk::ImageAspectFlagBits::eColor,
+                               .levelCount = m_mipLevels,
+                               .layerCount = 1},
+          .finalLayout = m_mipLevels > 1
+                             ? vk::ImageLayout::eTransferDstOptimal
+                             : vk::ImageLayout::eShaderReadOnlyOptimal};
+      if (m_mipLevels > 1) {
+        uploadInfo.onAcquire = [image = m_image, texWidth, texHeight,
+                                mipLevels = m_mipLevels](
+                                   vk::CommandBuffer const &commandBuffer) {
+          recordMipmaps(commandBuffer, image, texWidth, texHeight, mipLevels);
+        };
+      }
+      uploader->uploadImage(uploadInfo);
+
+      SDL_FreeSurface(formattedSurface);
     } else {
-      transitionImageLayout(device, vk::ImageLayout::eTransferDstOptimal,
-                            vk::ImageLayout::eReadOnlyOptimal,
+      // Create staging buffer
+      abcg::VulkanBuffer stagingBuffer{};
+      stagingBuffer.create(
+          device, {.size = imageSize,
+                   .usage = vk::BufferUsageFlagBits::eTransferSrc,
+                   .properties = vk::MemoryPropertyFlagBits::eHostVisible |
+                                 vk::MemoryPropertyFlagBits::eHostCoherent,
+                   .data = formattedSurface->pixels});
+
+      SDL_FreeSurface(formattedSurface);
+
+      transitionImageLayout(device, vk::ImageLayout::eUndefined,
+                            vk::ImageLayout::eTransferDstOptimal,
                             {.aspectMask = vk::ImageAspectFlagBits::eColor,
                              .levelCount = m_mipLevels,
                              .layerCount = 1});
-    }
 
-    stagingBuffer.destroy();
+      vk::BufferImageCopy const region{
+          .imageSubresource = {.aspectMask = vk::ImageAspectFlagBits::eColor,
+                               .layerCount = 1},
+          .imageExtent = {texWidth, texHeight, 1}};
+
+      // Execute the layout transition
+      device.withCommandBuffer(
+          [&stagingBuffer, this,
+           &region](vk::CommandBuffer const &commandBuffer) {
+            commandBuffer.copyBufferToImage(
+                static_cast<vk::Buffer>(stagingBuffer), m_image,
+                vk::ImageLayout::eTransferDstOptimal, region);
+          },
+          vk::QueueFlagBits::eTransfer);
+
+      // Generate the mipmap levels
+      if (m_mipLevels > 1) {
+        // Transitioned to vk::ImageLayout::eShaderReadOnlyOptimal while
+        // generating the mipmaps
+        createMipmaps(device, m_image, imageFormat, texWidth, texHeight,
+                      m_mipLevels);
+      } else {
+        transitionImageLayout(device, vk::ImageLayout::eTransferDstOptimal,
+                              vk::ImageLayout::eReadOnlyOptimal,
+                              {.aspectMask = vk::ImageAspectFlagBits::eColor,
+                               .levelCount = m_mipLevels,
+                               .layerCount = 1});
+      }
+
+      stagingBuffer.destroy();
+    }
 
     // Create image view
     m_imageView = m_device.createImageView(
@@ -338,6 +384,17 @@ void abcg::VulkanImage::createMipmaps(VulkanDevice const &device,
                                       vk::Image image, vk::Format imageFormat,
                                       uint32_t texWidth, uint32_t texHeight,
                                       uint32_t mipLevels) {
+  checkLinearBlitting(device, imageFormat);
+
+  device.withCommandBuffer(
+      [&](vk::CommandBuffer const &commandBuffer) {
+        recordMipmaps(commandBuffer, image, texWidth, texHeight, mipLevels);
+      },
+      vk::QueueFlagBits::eGraphics);
+}
+
+void abcg::VulkanImage::checkLinearBlitting(VulkanDevice const &device,
+                                            vk::Format imageFormat) {
   // Check if image format supports linear blitting
   vk::FormatProperties const formatProperties{
       static_cast<vk::PhysicalDevice>(device.getPhysicalDevice())
@@ -349,79 +406,79 @@ void abcg::VulkanImage::createMipmaps(VulkanDevice const &device,
     throw abcg::RuntimeError(
         "Texture image format does not support linear blitting");
   }
+}
 
-  device.withCommandBuffer(
-      [&](vk::CommandBuffer const &commandBuffer) {
-        vk::ImageMemoryBarrier barrier{
-            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .image = image,
-            .subresourceRange = {.aspectMask = vk::ImageAspectFlagBits::eColor,
-                                 .levelCount = 1,
-                                 .baseArrayLayer = 0,
-                                 .layerCount = 1}};
-
-        auto mipWidth{gsl::narrow<int32_t>(texWidth)};
-        auto mipHeight{gsl::narrow<int32_t>(texHeight)};
-
-        for (auto const mipLevel : iter::range(1U, mipLevels)) {
-          barrier.subresourceRange.baseMipLevel = mipLevel - 1;
-          barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
-          barrier.newLayout = vk::ImageLayout::eTransferSrcOptimal;
-          barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-          barrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
-
-          commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
-                                        vk::PipelineStageFlagBits::eTransfer,
-                                        vk::DependencyFlagBits{}, {}, {},
-                                        {{barrier}});
-
-          vk::ImageBlit blit{};
-          blit.srcOffsets[0] = vk::Offset3D{0, 0, 0};
-          blit.srcOffsets[1] = vk::Offset3D{mipWidth, mipHeight, 1};
-          blit.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-          blit.srcSubresource.mipLevel = mipLevel - 1;
-          blit.srcSubresource.baseArrayLayer = 0;
-          blit.srcSubresource.layerCount = 1;
-          blit.dstOffsets[0] = vk::Offset3D{0, 0, 0};
-          blit.dstOffsets[1] =
-              vk::Offset3D{mipWidth > 1 ? mipWidth / 2 : 1,
-                           mipHeight > 1 ? mipHeight / 2 : 1, 1};
-          blit.dstSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-          blit.dstSubresource.mipLevel = mipLevel;
-          blit.dstSubresource.baseArrayLayer = 0;
-          blit.dstSubresource.layerCount = 1;
-
-          commandBuffer.blitImage(image, vk::ImageLayout::eTransferSrcOptimal,
-                                  image, vk::ImageLayout::eTransferDstOptimal,
-                                  {blit}, vk::Filter::eLinear);
-
-          barrier.oldLayout = vk::ImageLayout::eTransferSrcOptimal;
-          barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-          barrier.srcAccessMask = vk::AccessFlagBits::eTransferRead;
-          barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
-
-          commandBuffer.pipelineBarrier(
-              vk::PipelineStageFlagBits::eTransfer,
-              vk::PipelineStageFlagBits::eFragmentShader,
-              vk::DependencyFlagBits{}, {}, {}, {barrier});
-
-          if (mipWidth > 1)
-            mipWidth /= 2;
-          if (mipHeight > 1)
-            mipHeight /= 2;
-        }
-
-        barrier.subresourceRange.baseMipLevel = mipLevels - 1;
-        barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
-        barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-        barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-        barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
-
-        commandBuffer.pipelineBarrier(
-            vk::PipelineStageFlagBits::eTransfer,
-            vk::PipelineStageFlagBits::eFragmentShader,
-            vk::DependencyFlagBits{}, {}, {}, {barrier});
-      },
-      vk::QueueFlagBits::eGraphics);
+// Records the generation of the mipmap levels from the base level. Every level
+// must be in vk::ImageLayout::eTransferDstOptimal, and is left in
+// vk::ImageLayout::eShaderReadOnlyOptimal
+void abcg::VulkanImage::recordMipmaps(vk::CommandBuffer const &commandBuffer,
+                                      vk::Image image, uint32_t texWidth,
+                                      uint32_t texHeight, uint32_t mipLevels) {
+  vk::ImageMemoryBarrier barrier{
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = image,
+      .subresourceRange = {.aspectMask = vk::ImageAspectFlagBits::eColor,
+                           .levelCount = 1,
+                           .baseArrayLayer = 0,
+                           .layerCount = 1}};
+
+  auto mipWidth{gsl::narrow<int32_t>(texWidth)};
+  auto mipHeight{gsl::narrow<int32_t>(texHeight)};
+
+  for (auto const mipLevel : iter::range(1U, mipLevels)) {
+    barrier.subresourceRange.baseMipLevel = mipLevel - 1;
+    barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+    barrier.newLayout = vk::ImageLayout::eTransferSrcOptimal;
+    barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+    barrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
+
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                  vk::PipelineStageFlagBits::eTransfer,
+                                  vk::DependencyFlagBits{}, {}, {},
+                                  {{barrier}});
+
+    vk::ImageBlit blit{};
+    blit.srcOffsets[0] = vk::Offset3D{0, 0, 0};
+    blit.srcOffsets[1] = vk::Offset3D{mipWidth, mipHeight, 1};
+    blit.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+    blit.srcSubresource.mipLevel = mipLevel - 1;
+    blit.srcSubresource.baseArrayLayer = 0;
+    blit.srcSubresource.layerCount = 1;
+    blit.dstOffsets[0] = vk::Offset3D{0, 0, 0};
+    blit.dstOffsets[1] = vk::Offset3D{mipWidth > 1 ? mipWidth / 2 : 1,
+                                      mipHeight > 1 ? mipHeight / 2 : 1, 1};
+    blit.dstSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+    blit.dstSubresource.mipLevel = mipLevel;
+    blit.dstSubresource.baseArrayLayer = 0;
+    blit.dstSubresource.layerCount = 1;
+
+    commandBuffer.blitImage(image, vk::ImageLayout::eTransferSrcOptimal, image,
+                            vk::ImageLayout::eTransferDstOptimal, {blit},
+                            vk::Filter::eLinear);
+
+    barrier.oldLayout = vk::ImageLayout::eTransferSrcOptimal;
+    barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+    barrier.srcAccessMask = vk::AccessFlagBits::eTransferRead;
+    barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                  vk::PipelineStageFlagBits::eFragmentShader,
+                                  vk::DependencyFlagBits{}, {}, {}, {barrier});
+
+    if (mipWidth > 1)
+      mipWidth /= 2;
+    if (mipHeight > 1)
+      mipHeight /= 2;
+  }
+
+  barrier.subresourceRange.baseMipLevel = mipLevels - 1;
+  barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+  barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+  barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+  barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+
+  commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                vk::PipelineStageFlagBits::eFragmentShader,
+                                vk::DependencyFlagBits{}, {}, {}, {barrier});
 }
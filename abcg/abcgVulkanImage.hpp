@@ -14,6 +14,7 @@
 #define ABCG_VULKAN_IMAGE_HPP_
 
 #include "abcgVulkanDevice.hpp"
+#include "abcgVulkanUploader.hpp"
 
 #include <gsl/pointers>
 
@@ -40,7 +41,7 @@ struct abcg::VulkanImageCreateInfo {
 class abcg::VulkanImage {
 public:
   void create(VulkanDevice const &device, std::string_view path,
-              bool generateMipmaps = true);
+              bool generateMipmaps = true, VulkanUploader *uploader = nullptr);
   void create(VulkanDevice const &device,
               VulkanImageCreateInfo const &createInfo);
   void destroy();
@@ -68,6 +69,11 @@ private:
   static void createMipmaps(VulkanDevice const &device, vk::Image image,
                             vk::Format imageFormat, uint32_t texWidth,
                             uint32_t texHeight, uint32_t mipLevels);
+  static void checkLinearBlitting(VulkanDevice const &device,
+                                  vk::Format imageFormat);
+  static void recordMipmaps(vk::CommandBuffer const &commandBuffer,
+                            vk::Image image, uint32_t texWidth,
+                            uint32_t texHeight, uint32_t mipLevels);
 
   vk::Image m_image;
   vk::DeviceMemory m_deviceMemory;
@@ -166,6 +166,9 @@ void abcg::VulkanPhysicalDevice::checkQueueFamily(
 
 void abcg::VulkanPhysicalDevice::findQueueFamilies(
     bool useSeparateTransferQueue) {
+  // Start over for each candidate device, as the fallback below fills in the
+  // transfer queue
+  m_queuesFamilies = {};
   uint32_t queueFamilyIndex{};
   for (auto const &properties : m_physicalDevice.getQueueFamilyProperties()) {
     checkQueueFamily(properties, queueFamilyIndex, useSeparateTransferQueue);
@@ -177,8 +180,10 @@ void abcg::VulkanPhysicalDevice::findQueueFamilies(
     throw abcg::RuntimeError(
         "Device does not have a graphics or present queue");
   }
-  if (useSeparateTransferQueue && !m_queuesFamilies.transfer.has_value()) {
-    throw abcg::RuntimeError("Device does not have a separate transfer queue");
+  // Without a separate transfer queue, transfers share the graphics queue and
+  // need no ownership transfer
+  if (!m_queuesFamilies.transfer.has_value()) {
+    m_queuesFamilies.transfer = m_queuesFamilies.graphics;
   }
 }
 
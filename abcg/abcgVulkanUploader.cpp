@@ -0,0 +1,581 @@
+/**
+ * @file abcgVulkanUploader.cpp
+ * @brief Definition of abcg::VulkanUploader
+ *
+ * This file is part of ABCg (https://github.com/hbatagelo/abcg).
+ *
+ * @copyright (c) 2021--2023 Harlen Batagelo. All rights reserved.
+ * This project is released under the MIT License.
+ */
+
+#include "abcgVulkanUploader.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#include <gsl/gsl>
+
+#include "abcgException.hpp"
+
+namespace {
+// Accesses of the graphics queue that may read the uploaded data, or write
+// to it after the upload (e.g., mipmap generation)
+constexpr vk::AccessFlags uploadDstAccessMask{
+    vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead |
+    vk::AccessFlagBits::eUniformRead | vk::AccessFlagBits::eShaderRead |
+    vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite};
+} // namespace
+
+/**
+ * @brief Creates the staging ring buffer and the command pools used for
+ * uploads.
+ *
+ * @param device Vulkan device.
+ * @param stagingSize Size of the staging ring buffer, in bytes. Uploads larger
+ * than this size use a dedicated staging buffer released with their batch.
+ */
+void abcg::VulkanUploader::create(VulkanDevice const &device,
+                                  vk::DeviceSize stagingSize) {
+  m_device = device;
+  auto const &vkDevice{static_cast<vk::Device>(m_device)};
+  auto const &queuesFamilies{
+      m_device.getPhysicalDevice().getQueuesFamilies()};
+
+  m_graphicsFamily = queuesFamilies.graphics.value_or(0);
+  m_transferFamily = queuesFamilies.transfer.value_or(m_graphicsFamily);
+  m_ownershipTransfer = m_transferFamily != m_graphicsFamily;
+
+  // Command buffers are reset individually when their batch is retired
+  m_transferPool = vkDevice.createCommandPool(
+      {.flags = vk::CommandPoolCreateFlagBits::eTransient |
+                vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+       .queueFamilyIndex = m_transferFamily});
+  m_graphicsPool = vkDevice.createCommandPool(
+      {.flags = vk::CommandPoolCreateFlagBits::eTransient |
+                vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+       .queueFamilyIndex = m_graphicsFamily});
+
+  auto const &limits{
+      static_cast<vk::PhysicalDevice>(m_device.getPhysicalDevice())
+          .getProperties()
+          .limits};
+  m_stagingAlignment =
+      std::max<vk::DeviceSize>(16, limits.optimalBufferCopyOffsetAlignment);
+
+  m_stagingSize = stagingSize;
+  std::tie(m_stagingBuffer, m_stagingMemory) = createHostBuffer(m_stagingSize);
+  m_stagingData = static_cast<std::byte *>(
+      vkDevice.mapMemory(m_stagingMemory, vk::DeviceSize{0}, m_stagingSize));
+  m_stagingHead = 0;
+  m_stagingTail = 0;
+}
+
+/**
+ * @brief Waits for all pending uploads and releases the uploader resources.
+ */
+void abcg::VulkanUploader::destroy() {
+  auto const &vkDevice{static_cast<vk::Device>(m_device)};
+  if (!vkDevice)
+    return;
+
+  if (m_isRecording) {
+    wait(flush());
+  }
+  while (!m_inFlight.empty()) {
+    retireBatches(true);
+  }
+  submitAcquires();
+
+  for (auto const &submission : m_acquireSubmissions) {
+    while (vk::Result::eTimeout ==
+           vkDevice.waitForFences(submission.fence, VK_TRUE,
+                                  std::numeric_limits<uint64_t>::max()))
+      ;
+    vkDevice.destroyFence(submission.fence);
+    for (auto const &semaphore : submission.semaphores) {
+      vkDevice.destroySemaphore(semaphore);
+    }
+  }
+  m_acquireSubmissions.clear();
+
+  for (auto const &fence : m_freeFences) {
+    vkDevice.destroyFence(fence);
+  }
+  m_freeFences.clear();
+  for (auto const &semaphore : m_freeSemaphores) {
+    vkDevice.destroySemaphore(semaphore);
+  }
+  m_freeSemaphores.clear();
+
+  vkDevice.unmapMemory(m_stagingMemory);
+  vkDevice.destroyBuffer(m_stagingBuffer);
+  vkDevice.freeMemory(m_stagingMemory);
+  m_stagingData = nullptr;
+
+  vkDevice.destroyCommandPool(m_graphicsPool);
+  vkDevice.destroyCommandPool(m_transferPool);
+}
+
+/**
+ * @brief Records the upload of data to a buffer.
+ *
+ * The data is copied to the staging ring buffer before this function returns.
+ * The copy to the buffer is executed by the transfer queue after the next call
+ * to abcg::VulkanUploader::flush. If the transfer queue is from a different
+ * family than the graphics queue, the ownership of the written range is then
+ * transferred to the graphics queue in abcg::VulkanUploader::poll.
+ *
+ * @param buffer Destination buffer. Must have been created with
+ * `vk::BufferUsageFlagBits::eTransferDst` and `vk::SharingMode::eExclusive`,
+ * and must not be in use by the graphics queue.
+ * @param data Pointer to the beginning of the data.
+ * @param size Size of the data to be copied, in bytes.
+ * @param offset Offset from the beginning of the destination buffer.
+ */
+void abcg::VulkanUploader::uploadBuffer(vk::Buffer const &buffer,
+                                        gsl::not_null<void const *> data,
+                                        vk::DeviceSize size,
+                                        vk::DeviceSize offset) {
+  auto const [stagingBuffer, stagingOffset]{allocateStaging(size, data)};
+
+  auto const &commandBuffer{getRecordingCommandBuffer()};
+  commandBuffer.copyBuffer(
+      stagingBuffer, buffer,
+      {{.srcOffset = stagingOffset, .dstOffset = offset, .size = size}});
+
+  if (!m_ownershipTransfer)
+    return;
+
+  // Release barrier. The acquire barrier must match it, except for the access
+  // masks
+  vk::BufferMemoryBarrier barrier{
+      .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+      .dstAccessMask = vk::AccessFlagBits::eNone,
+      .srcQueueFamilyIndex = m_transferFamily,
+      .dstQueueFamilyIndex = m_graphicsFamily,
+      .buffer = buffer,
+      .offset = offset,
+      .size = size};
+  commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                vk::PipelineStageFlagBits::eBottomOfPipe,
+                                vk::DependencyFlags{}, nullptr, barrier,
+                                nullptr);
+
+  barrier.srcAccessMask = vk::AccessFlagBits::eNone;
+  barrier.dstAccessMask = uploadDstAccessMask;
+  m_recording.bufferAcquires.push_back(barrier);
+}
+
+/**
+ * @brief Records the upload of texel data to the base mip level of an image.
+ *
+ * The image is transitioned from `vk::ImageLayout::eUndefined` to
+ * `vk::ImageLayout::eTransferDstOptimal`, written, and then transitioned to
+ * the final layout. If the transfer queue is from a different family than the
+ * graphics queue, the ownership of the image is transferred to the graphics
+ * queue in abcg::VulkanUploader::poll.
+ *
+ * @param uploadInfo Upload description.
+ */
+void abcg::VulkanUploader::uploadImage(
+    VulkanImageUploadInfo const &uploadInfo) {
+  auto const [stagingBuffer, stagingOffset]{
+      allocateStaging(uploadInfo.size, uploadInfo.data)};
+
+  auto const &commandBuffer{getRecordingCommandBuffer()};
+
+  // Undefined -> transfer destination
+  commandBuffer.pipelineBarrier(
+      vk::PipelineStageFlagBits::eTopOfPipe,
+      vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags{}, nullptr,
+      nullptr,
+      vk::ImageMemoryBarrier{
+          .srcAccessMask = vk::AccessFlagBits::eNone,
+          .dstAccessMask = vk::AccessFlagBits::eTransferWrite,
+          .oldLayout = vk::ImageLayout::eUndefined,
+          .newLayout = vk::ImageLayout::eTransferDstOptimal,
+          .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+          .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+          .image = uploadInfo.image,
+          .subresourceRange = uploadInfo.subresourceRange});
+
+  commandBuffer.copyBufferToImage(
+      stagingBuffer, uploadInfo.image, vk::ImageLayout::eTransferDstOptimal,
+      vk::BufferImageCopy{
+          .bufferOffset = stagingOffset,
+          .imageSubresource = {.aspectMask =
+                                   uploadInfo.subresourceRange.aspectMask,
+                               .mipLevel =
+                                   uploadInfo.subresourceRange.baseMipLevel,
+                               .baseArrayLayer =
+                                   uploadInfo.subresourceRange.baseArrayLayer,
+                               .layerCount =
+                                   uploadInfo.subresourceRange.layerCount},
+          .imageExtent = uploadInfo.extent});
+
+  auto const ownershipTransfer{m_ownershipTransfer};
+
+  // Release barrier. If there is no ownership transfer, this is a regular
+  // layout transition and there is nothing left to acquire.
+  vk::ImageMemoryBarrier barrier{
+      .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+      .dstAccessMask = ownershipTransfer ? vk::AccessFlags{}
+                                         : uploadDstAccessMask,
+      .oldLayout = vk::ImageLayout::eTransferDstOptimal,
+      .newLayout = uploadInfo.finalLayout,
+      .srcQueueFamilyIndex =
+          ownershipTransfer ? m_transferFamily : VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex =
+          ownershipTransfer ? m_graphicsFamily : VK_QUEUE_FAMILY_IGNORED,
+      .image = uploadInfo.image,
+      .subresourceRange = uploadInfo.subresourceRange};
+
+  commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                ownershipTransfer
+                                    ? vk::PipelineStageFlagBits::eBottomOfPipe
+                                    : vk::PipelineStageFlagBits::eAllCommands,
+                                vk::DependencyFlags{}, nullptr, nullptr,
+                                barrier);
+
+  if (ownershipTransfer || uploadInfo.onAcquire) {
+    // The acquire barrier must match the release barrier, except for the
+    // access masks
+    barrier.srcAccessMask = vk::AccessFlagBits::eNone;
+    barrier.dstAccessMask = uploadDstAccessMask;
+    m_recording.acquires.push_back(
+        {.barrier = ownershipTransfer ? barrier : vk::ImageMemoryBarrier{},
+         .onAcquire = uploadInfo.onAcquire});
+  }
+}
+
+/**
+ * @brief Submits the uploads recorded so far to the transfer queue.
+ *
+ * This function does not wait for the transfer to finish. If there is an
+ * ownership transfer, the batch signals a semaphore that is waited on by the
+ * acquire operations submitted in abcg::VulkanUploader::poll.
+ *
+ * @return Ticket that identifies the submitted batch. Use it with
+ * abcg::VulkanUploader::isComplete or abcg::VulkanUploader::wait.
+ */
+uint64_t abcg::VulkanUploader::flush() {
+  if (!m_isRecording)
+    return m_completedTicket;
+
+  if (!m_ownershipTransfer) {
+    // Both queues are the same, so this orders the copies before the commands
+    // submitted afterwards
+    m_recording.commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer,
+        vk::PipelineStageFlagBits::eAllCommands, vk::DependencyFlags{},
+        vk::MemoryBarrier{.srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+                          .dstAccessMask = uploadDstAccessMask},
+        nullptr, nullptr);
+  }
+
+  m_recording.commandBuffer.end();
+  m_recording.fence = createFence();
+  m_recording.stagingEnd = m_stagingHead;
+
+  vk::SubmitInfo submitInfo{.commandBufferCount = 1,
+                            .pCommandBuffers = &m_recording.commandBuffer};
+  if (m_ownershipTransfer) {
+    m_recording.semaphore = createSemaphore();
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &m_recording.semaphore;
+  }
+  m_device.getQueues().transfer.submit(submitInfo, m_recording.fence);
+
+  auto const ticket{m_recording.ticket};
+  m_inFlight.push_back(std::move(m_recording));
+  m_recording = {};
+  m_isRecording = false;
+
+  return ticket;
+}
+
+/**
+ * @brief Releases the resources of finished batches and submits the queue
+ * family acquire operations of their buffers and images to the graphics
+ * queue.
+ *
+ * This never blocks and should be called once per frame, before the frame
+ * command buffers are submitted. abcg::VulkanWindow does this automatically.
+ */
+void abcg::VulkanUploader::poll() {
+  retireBatches(false);
+  submitAcquires();
+}
+
+/**
+ * @brief Blocks until the batch identified by a ticket has been executed.
+ *
+ * If the ticket refers to the batch currently being recorded, the batch is
+ * flushed first.
+ *
+ * @param ticket Ticket returned by abcg::VulkanUploader::flush or
+ * abcg::VulkanUploader::getPendingTicket.
+ */
+void abcg::VulkanUploader::wait(uint64_t ticket) {
+  if (m_isRecording && ticket >= m_recording.ticket) {
+    flush();
+  }
+  while (m_completedTicket < ticket && !m_inFlight.empty()) {
+    retireBatches(true);
+  }
+  submitAcquires();
+}
+
+/**
+ * @brief Checks whether a batch of uploads is ready to be used by the graphics
+ * queue.
+ *
+ * @param ticket Ticket returned by abcg::VulkanUploader::flush or
+ * abcg::VulkanUploader::getPendingTicket.
+ *
+ * @return `true` if the batch has been executed and its acquire operations, if
+ * any, have been submitted to the graphics queue.
+ */
+bool abcg::VulkanUploader::isComplete(uint64_t ticket) {
+  poll();
+  return m_completedTicket >= ticket;
+}
+
+/**
+ * @brief Returns the ticket of the batch currently being recorded.
+ *
+ * @return Ticket that will be returned by the next call to
+ * abcg::VulkanUploader::flush.
+ */
+uint64_t abcg::VulkanUploader::getPendingTicket() const noexcept {
+  return m_isRecording ? m_recording.ticket : m_nextTicket;
+}
+
+std::pair<vk::Buffer, vk::DeviceSize>
+abcg::VulkanUploader::allocateStaging(vk::DeviceSize size, void const *data) {
+  if (size > m_stagingSize) {
+    // Too large for the ring: use a dedicated buffer released with the batch
+    auto const &vkDevice{static_cast<vk::Device>(m_device)};
+    auto [buffer, memory]{createHostBuffer(size)};
+    auto *mappedData{vkDevice.mapMemory(memory, vk::DeviceSize{0}, size)};
+    memcpy(mappedData, data, size);
+    vkDevice.unmapMemory(memory);
+    static_cast<void>(getRecordingCommandBuffer());
+    m_recording.dedicatedStaging.emplace_back(buffer, memory);
+    return {buffer, vk::DeviceSize{0}};
+  }
+
+  auto const alignUp{[this](uint64_t value) {
+    return (value + m_stagingAlignment - 1) / m_stagingAlignment *
+           m_stagingAlignment;
+  }};
+
+  while (true) {
+    auto const position{m_stagingHead % m_stagingSize};
+    auto offset{alignUp(position)};
+    auto newHead{m_stagingHead + (offset - position) + size};
+    if (offset + size > m_stagingSize) {
+      // Wrap around to the beginning of the ring
+      offset = 0;
+      newHead = m_stagingHead + (m_stagingSize - position) + size;
+    }
+
+    if (newHead - m_stagingTail <= m_stagingSize) {
+      m_stagingHead = newHead;
+      memcpy(std::next(m_stagingData, gsl::narrow<std::ptrdiff_t>(offset)),
+             data, size);
+      static_cast<void>(getRecordingCommandBuffer());
+      return {m_stagingBuffer, offset};
+    }
+
+    // Not enough space. Wait for the oldest batch, flushing the current one if
+    // it is the only one holding the ring.
+    if (m_inFlight.empty()) {
+      if (!m_isRecording) {
+        // Ring is empty but fragmented: restart from the beginning
+        m_stagingHead = m_stagingTail = 0;
+        continue;
+      }
+      flush();
+    }
+    retireBatches(true);
+  }
+}
+
+std::pair<vk::Buffer, vk::DeviceMemory>
+abcg::VulkanUploader::createHostBuffer(vk::DeviceSize size) const {
+  auto const &vkDevice{static_cast<vk::Device>(m_device)};
+
+  auto buffer{vkDevice.createBuffer(
+      {.size = size,
+       .usage = vk::BufferUsageFlagBits::eTransferSrc,
+       .sharingMode = vk::SharingMode::eExclusive})};
+
+  auto const memoryRequirements{vkDevice.getBufferMemoryRequirements(buffer)};
+  auto const memoryType{m_device.getPhysicalDevice().findMemoryType(
+      memoryRequirements.memoryTypeBits,
+      vk::MemoryPropertyFlagBits::eHostVisible |
+          vk::MemoryPropertyFlagBits::eHostCoherent)};
+  if (!memoryType.has_value()) {
+    throw abcg::RuntimeError("Failed to find suitable memory type");
+  }
+  auto memory{
+      vkDevice.allocateMemory({.allocationSize = memoryRequirements.size,
+                               .memoryTypeIndex = memoryType.value()})};
+  vkDevice.bindBufferMemory(buffer, memory, 0);
+
+  return {buffer, memory};
+}
+
+vk::CommandBuffer const &abcg::VulkanUploader::getRecordingCommandBuffer() {
+  if (!m_isRecording) {
+    m_recording.ticket = m_nextTicket++;
+    m_recording.commandBuffer =
+        static_cast<vk::Device>(m_device)
+            .allocateCommandBuffers(
+                {.commandPool = m_transferPool,
+                 .level = vk::CommandBufferLevel::ePrimary,
+                 .commandBufferCount = 1})
+            .front();
+    m_recording.commandBuffer.begin(
+        {.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+    m_isRecording = true;
+  }
+  return m_recording.commandBuffer;
+}
+
+vk::Fence abcg::VulkanUploader::createFence() {
+  if (m_freeFences.empty()) {
+    return static_cast<vk::Device>(m_device).createFence({});
+  }
+  auto const fence{m_freeFences.back()};
+  m_freeFences.pop_back();
+  return fence;
+}
+
+vk::Semaphore abcg::VulkanUploader::createSemaphore() {
+  if (m_freeSemaphores.empty()) {
+    return static_cast<vk::Device>(m_device).createSemaphore({});
+  }
+  auto const semaphore{m_freeSemaphores.back()};
+  m_freeSemaphores.pop_back();
+  return semaphore;
+}
+
+void abcg::VulkanUploader::retireBatches(bool waitOldest) {
+  auto const &vkDevice{static_cast<vk::Device>(m_device)};
+
+  while (!m_inFlight.empty()) {
+    auto &batch{m_inFlight.front()};
+
+    if (waitOldest) {
+      while (vk::Result::eTimeout ==
+             vkDevice.waitForFences(batch.fence, VK_TRUE,
+                                    std::numeric_limits<uint64_t>::max()))
+        ;
+      waitOldest = false;
+    } else if (vkDevice.getFenceStatus(batch.fence) != vk::Result::eSuccess) {
+      break;
+    }
+
+    for (auto const &[buffer, memory] : batch.dedicatedStaging) {
+      vkDevice.destroyBuffer(buffer);
+      vkDevice.freeMemory(memory);
+    }
+    vkDevice.freeCommandBuffers(m_transferPool, batch.commandBuffer);
+    vkDevice.resetFences(batch.fence);
+    m_freeFences.push_back(batch.fence);
+
+    std::move(batch.bufferAcquires.begin(), batch.bufferAcquires.end(),
+              std::back_inserter(m_readyBufferAcquires));
+    std::move(batch.acquires.begin(), batch.acquires.end(),
+              std::back_inserter(m_readyAcquires));
+    if (batch.semaphore) {
+      m_readySemaphores.push_back(batch.semaphore);
+    }
+
+    m_stagingTail = batch.stagingEnd;
+    m_completedTicket = batch.ticket;
+    m_inFlight.pop_front();
+  }
+
+  // Release command buffers of acquire submissions that have finished
+  std::erase_if(m_acquireSubmissions, [&](AcquireSubmission const &submission) {
+    if (vkDevice.getFenceStatus(submission.fence) != vk::Result::eSuccess) {
+      return false;
+    }
+    vkDevice.freeCommandBuffers(m_graphicsPool, submission.commandBuffer);
+    vkDevice.resetFences(submission.fence);
+    m_freeFences.push_back(submission.fence);
+    // Their wait operations are done, so they are unsignaled again
+    m_freeSemaphores.insert(m_freeSemaphores.end(),
+                            submission.semaphores.begin(),
+                            submission.semaphores.end());
+    return true;
+  });
+}
+
+void abcg::VulkanUploader::submitAcquires() {
+  // Every semaphore must be waited on before it is signaled again
+  if (m_readyAcquires.empty() && m_readySemaphores.empty())
+    return;
+
+  auto const &vkDevice{static_cast<vk::Device>(m_device)};
+
+  AcquireSubmission submission{
+      .commandBuffer = vkDevice
+                           .allocateCommandBuffers(
+                               {.commandPool = m_graphicsPool,
+                                .level = vk::CommandBufferLevel::ePrimary,
+                                .commandBufferCount = 1})
+                           .front(),
+      .fence = createFence()};
+
+  submission.commandBuffer.begin(
+      {.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+
+  // The release operations have already completed (their fences were
+  // signaled), so waiting for their semaphores does not stall the queue. The
+  // wait makes the transferred data visible to the acquire operations, which
+  // are ordered before the commands of the next frames, submitted later to the
+  // same queue.
+  std::vector<vk::ImageMemoryBarrier> imageAcquires;
+  for (auto const &acquire : m_readyAcquires) {
+    if (acquire.barrier.image) {
+      imageAcquires.push_back(acquire.barrier);
+    }
+  }
+  if (!m_readyBufferAcquires.empty() || !imageAcquires.empty()) {
+    submission.commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eAllCommands,
+        vk::PipelineStageFlagBits::eAllCommands, vk::DependencyFlags{},
+        nullptr, m_readyBufferAcquires, imageAcquires);
+  }
+  for (auto const &acquire : m_readyAcquires) {
+    if (acquire.onAcquire) {
+      acquire.onAcquire(submission.commandBuffer);
+    }
+  }
+  m_readyBufferAcquires.clear();
+  m_readyAcquires.clear();
+
+  submission.commandBuffer.end();
+
+  submission.semaphores = std::move(m_readySemaphores);
+  m_readySemaphores.clear();
+  std::vector<vk::PipelineStageFlags> const waitStages(
+      submission.semaphores.size(), vk::PipelineStageFlagBits::eAllCommands);
+
+  m_device.getQueues().graphics.submit(
+      vk::SubmitInfo{
+          .waitSemaphoreCount =
+              gsl::narrow<uint32_t>(submission.semaphores.size()),
+          .pWaitSemaphores = submission.semaphores.data(),
+          .pWaitDstStageMask = waitStages.data(),
+          .commandBufferCount = 1,
+          .pCommandBuffers = &submission.commandBuffer},
+      submission.fence);
+
+  m_acquireSubmissions.push_back(std::move(submission));
+}
@@ -0,0 +1,159 @@
+/**
+ * @file abcgVulkanUploader.hpp
+ * @brief Header file of abcg::VulkanUploader
+ *
+ * Declaration of abcg::VulkanUploader
+ *
+ * This file is part of ABCg (https://github.com/hbatagelo/abcg).
+ *
+ * @copyright (c) 2021--2023 Harlen Batagelo. All rights reserved.
+ * This project is released under the MIT License.
+ */
+
+#ifndef ABCG_VULKAN_UPLOADER_HPP_
+#define ABCG_VULKAN_UPLOADER_HPP_
+
+#include "abcgVulkanDevice.hpp"
+
+#include <deque>
+#include <functional>
+
+#include <gsl/pointers>
+
+namespace abcg {
+struct VulkanImageUploadInfo;
+class VulkanUploader;
+} // namespace abcg
+
+/**
+ * @brief Description of an image upload for abcg::VulkanUploader::uploadImage.
+ */
+struct abcg::VulkanImageUploadInfo {
+  /** @brief Destination image. Must have been created with
+   * `vk::ImageUsageFlagBits::eTransferDst`. */
+  vk::Image image{};
+  /** @brief Pointer to the tightly packed texel data of the first mip level. */
+  void const *data{};
+  /** @brief Size of the texel data, in bytes. */
+  vk::DeviceSize size{};
+  /** @brief Extent of the first mip level. */
+  vk::Extent3D extent{};
+  /** @brief Subresources to be transitioned and transferred to the graphics
+   * queue. Only the base mip level is written. */
+  vk::ImageSubresourceRange subresourceRange{
+      .aspectMask = vk::ImageAspectFlagBits::eColor,
+      .levelCount = 1,
+      .layerCount = 1};
+  /** @brief Layout of the image once it is acquired by the graphics queue. */
+  vk::ImageLayout finalLayout{vk::ImageLayout::eShaderReadOnlyOptimal};
+  /** @brief Optional commands to be recorded on the graphics queue right after
+   * the image is acquired (e.g., mipmap generation). */
+  std::function<void(vk::CommandBuffer const &)> onAcquire{};
+};
+
+/**
+ * @brief Batches resource uploads on the transfer queue.
+ *
+ * The uploader owns a persistently mapped, host-coherent staging buffer that
+ * is used as a ring buffer. Copies are recorded into a command buffer of the
+ * transfer queue and submitted in batches by abcg::VulkanUploader::flush. Each
+ * batch is signaled by a fence, so that the CPU never waits for a transfer to
+ * finish unless the ring buffer is full or abcg::VulkanUploader::wait is
+ * called.
+ *
+ * When the transfer queue and the graphics queue belong to different
+ * families, each batch releases the ownership of its buffers and images and
+ * signals a semaphore. Once the batch is finished, abcg::VulkanUploader::poll
+ * submits to the graphics queue a command buffer that waits for the semaphore
+ * and acquires the resources, before the commands of the next frame. When
+ * both queues are the same, each batch ends with a pipeline barrier that
+ * makes the transferred data visible to the commands submitted after it.
+ *
+ * A resource can be used by the graphics queue once the ticket of its batch
+ * is complete (see abcg::VulkanUploader::isComplete).
+ *
+ * @remark abcg::VulkanWindow creates an uploader and polls it before every
+ * frame. It can be accessed with abcg::VulkanWindow::getUploader.
+ */
+class abcg::VulkanUploader {
+public:
+  void create(VulkanDevice const &device,
+              vk::DeviceSize stagingSize = 32UL * 1024UL * 1024UL);
+  void destroy();
+
+  void uploadBuffer(vk::Buffer const &buffer, gsl::not_null<void const *> data,
+                    vk::DeviceSize size, vk::DeviceSize offset = 0UL);
+  void uploadImage(VulkanImageUploadInfo const &uploadInfo);
+
+  uint64_t flush();
+  void poll();
+  void wait(uint64_t ticket);
+
+  [[nodiscard]] bool isComplete(uint64_t ticket);
+  [[nodiscard]] uint64_t getPendingTicket() const noexcept;
+
+private:
+  struct PendingAcquire {
+    vk::ImageMemoryBarrier barrier{};
+    std::function<void(vk::CommandBuffer const &)> onAcquire{};
+  };
+
+  struct Batch {
+    uint64_t ticket{};
+    vk::CommandBuffer commandBuffer;
+    vk::Fence fence;
+    // Signaled for the acquire operations, if there is an ownership transfer
+    vk::Semaphore semaphore;
+    uint64_t stagingEnd{};
+    std::vector<std::pair<vk::Buffer, vk::DeviceMemory>> dedicatedStaging;
+    std::vector<vk::BufferMemoryBarrier> bufferAcquires;
+    std::vector<PendingAcquire> acquires;
+  };
+
+  struct AcquireSubmission {
+    vk::CommandBuffer commandBuffer;
+    vk::Fence fence;
+    std::vector<vk::Semaphore> semaphores;
+  };
+
+  [[nodiscard]] std::pair<vk::Buffer, vk::DeviceSize>
+  allocateStaging(vk::DeviceSize size, void const *data);
+  [[nodiscard]] std::pair<vk::Buffer, vk::DeviceMemory>
+  createHostBuffer(vk::DeviceSize size) const;
+  [[nodiscard]] vk::CommandBuffer const &getRecordingCommandBuffer();
+  [[nodiscard]] vk::Fence createFence();
+  [[nodiscard]] vk::Semaphore createSemaphore();
+  void retireBatches(bool waitOldest);
+  void submitAcquires();
+
+  VulkanDevice m_device;
+  vk::CommandPool m_transferPool;
+  vk::CommandPool m_graphicsPool;
+  uint32_t m_transferFamily{};
+  uint32_t m_graphicsFamily{};
+  bool m_ownershipTransfer{};
+
+  vk::Buffer m_stagingBuffer;
+  vk::DeviceMemory m_stagingMemory;
+  std::byte *m_stagingData{};
+  vk::DeviceSize m_stagingSize{};
+  vk::DeviceSize m_stagingAlignment{16};
+  // Monotonic byte counters; (m_stagingHead - m_stagingTail) is in use
+  uint64_t m_stagingHead{};
+  uint64_t m_stagingTail{};
+
+  Batch m_recording;
+  bool m_isRecording{};
+  uint64_t m_nextTicket{1};
+  uint64_t m_completedTicket{};
+
+  std::deque<Batch> m_inFlight;
+  std::vector<vk::BufferMemoryBarrier> m_readyBufferAcquires;
+  std::vector<PendingAcquire> m_readyAcquires;
+  std::vector<vk::Semaphore> m_readySemaphores;
+  std::vector<AcquireSubmission> m_acquireSubmissions;
+  std::vector<vk::Fence> m_freeFences;
+  std::vector<vk::Semaphore> m_freeSemaphores;
+};
+
+#endif
@@ -110,6 +110,17 @@ abcg::VulkanSwapchain const &abcg::VulkanWindow::getSwapchain() const noexcept {
   return m_swapchain;
 }
 
+/**
+ * @brief Access to abcg::VulkanUploader.
+ *
+ * @return Uploader used for copying resources to device local memory
+ * asynchronously. Uploads are submitted by abcg::VulkanUploader::flush and are
+ * made visible to the graphics queue before the next frame is rendered.
+ */
+abcg::VulkanUploader &abcg::VulkanWindow::getUploader() noexcept {
+  return m_uploader;
+}
+
 /**
  * @brief Custom event handler.
  *
@@ -299,7 +310,7 @@ void abcg::VulkanWindow::create() {
 
   // Select physical device
   m_physicalDevice.create(m_instance, m_surface, m_deviceExtensions,
-                          sampleCount);
+                          sampleCount, m_vulkanSettings.separateTransferQueue);
 
   // Create logical device
   m_device.create(m_physicalDevice, m_deviceExtensions);
@@ -307,6 +318,9 @@ void abcg::VulkanWindow::create() {
   // Create swapchain
   m_swapchain.create(m_device, m_vulkanSettings, getWindowSize());
 
+  // Create uploader for asynchronous transfers
+  m_uploader.create(m_device);
+
   // Create descriptor pool
   std::vector<vk::DescriptorPoolSize> const poolSizes{
       {{vk::DescriptorType::eSampler, 100},
@@ -419,6 +433,10 @@ void abcg::VulkanWindow::paint() {
 
   ImGui::Render();
 
+  // Submit pending uploads and make finished ones visible to this frame
+  m_uploader.flush();
+  m_uploader.poll();
+
   m_swapchain.render([this](auto const &frame) { onPaint(frame); });
   m_swapchain.present();
 }
@@ -434,6 +452,7 @@ void abcg::VulkanWindow::destroy() {
 
   static_cast<vk::Device>(m_device).destroyDescriptorPool(m_UIdescriptorPool);
   m_swapchain.destroy();
+  m_uploader.destroy();
   m_device.destroy();
   m_physicalDevice.destroy();
   static_cast<vk::Instance>(m_instance).destroySurfaceKHR(m_surface);
@@ -17,6 +17,7 @@
 #include "abcgVulkanInstance.hpp"
 #include "abcgVulkanPhysicalDevice.hpp"
 #include "abcgVulkanSwapchain.hpp"
+#include "abcgVulkanUploader.hpp"
 #include "abcgWindow.hpp"
 
 namespace abcg {
@@ -57,6 +58,15 @@ struct abcg::VulkanSettings {
    * comes first.
    */
   bool vSync{false};
+
+  /** @brief Whether to prefer a dedicated transfer queue for uploads.
+   *
+   * If `true`, resources uploaded with abcg::VulkanUploader are copied on a
+   * queue family that supports transfer but not graphics operations, so that
+   * uploads can overlap with rendering. If no such queue family is available,
+   * the graphics queue is used.
+   */
+  bool separateTransferQueue{false};
 };
 
 /**
@@ -84,6 +94,7 @@ public:
   [[nodiscard]] VulkanPhysicalDevice const &getPhysicalDevice() const noexcept;
   [[nodiscard]] VulkanDevice const &getDevice() const noexcept;
   [[nodiscard]] VulkanSwapchain const &getSwapchain() const noexcept;
+  [[nodiscard]] VulkanUploader &getUploader() noexcept;
 
 protected:
   virtual void onEvent(SDL_Event const &event);
@@ -113,6 +124,7 @@ private:
   VulkanPhysicalDevice m_physicalDevice;
   VulkanDevice m_device;
   VulkanSwapchain m_swapchain;
+  VulkanUploader m_uploader;
   vk::SurfaceKHR m_surface;
   vk::DescriptorPool m_UIdescriptorPool;
   bool m_hidden{};
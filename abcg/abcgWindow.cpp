@@ -14,6 +14,8 @@
 
 #include <imgui_impl_sdl2.h>
 
+#include <algorithm>
+
 namespace {
 ImVec4 ColorAlpha(ImVec4 const &color, float const alpha) {
   return {color.x, color.y, color.z, alpha};
@@ -277,6 +279,33 @@ void abcg::Window::setEnableResizingEventWatcher(bool enabled) noexcept {
   m_enableResizingEventWatcher = enabled;
 }
 
+/**
+ * @brief Sets a constant value to be returned by abcg::Window::getDeltaTime.
+ *
+ * This makes the simulation independent of the actual frame rate, which is
+ * useful for reproducible output in benchmarks and image regression tests.
+ *
+ * @param deltaTime Time step, in seconds. If zero, the delta time is measured
+ * from the actual time between frames.
+ */
+void abcg::Window::setFixedDeltaTime(double deltaTime) noexcept {
+  m_fixedDeltaTime = deltaTime;
+}
+
+/**
+ * @brief Requests frames to be rendered when
+ * abcg::WindowSettings::renderOnDemand is `true`.
+ *
+ * This should be called from the main thread, for instance, in every update
+ * while an animation is running. It has no effect if frames are rendered
+ * continuously.
+ *
+ * @param frames Minimum number of frames to be rendered.
+ */
+void abcg::Window::requestRedraw(int frames) noexcept {
+  m_redrawFrames = std::max(m_redrawFrames, frames);
+}
+
 /**
  * @brief Toggles between fullscreen and windowed mode.
  */
@@ -314,9 +343,23 @@ void abcg::Window::toggleFullscreen() {
 #endif
 }
 
+bool abcg::Window::isRedrawPending() const noexcept {
+  return m_redrawFrames > 0;
+}
+
+void abcg::Window::resumeFromIdle() noexcept {
+  // Render at least one frame even if the wait timed out
+  requestRedraw();
+  m_resumingFromIdle = true;
+}
+
 void abcg::Window::templateHandleEvent(SDL_Event const &event, bool &done) {
   ImGui_ImplSDL2_ProcessEvent(&event);
 
+  // ImGui may take a few frames to settle after an input, e.g. to update the
+  // hovered items after the mouse moves
+  requestRedraw(3);
+
   if (event.window.windowID != m_windowID)
     return;
 
@@ -386,13 +429,27 @@ void abcg::Window::templateCreate() {
 
   create();
 
+  // The first frames are always rendered
+  requestRedraw(3);
+
   // Set up our own Dear ImGui style
   setupImGuiStyle(true, 1.0f);
 }
 
 void abcg::Window::templatePaint() {
-  // Cap to 480 Hz
-  if (m_deltaTime.elapsed() >= 1.0 / 480.0) {
+  m_redrawFrames = std::max(m_redrawFrames - 1, 0);
+
+  // Do not count the idle time as time between frames, otherwise animations
+  // would jump ahead when they start
+  if (m_resumingFromIdle) {
+    m_deltaTime.restart();
+    m_resumingFromIdle = false;
+  }
+
+  if (m_fixedDeltaTime > 0.0) {
+    m_lastDeltaTime = m_fixedDeltaTime;
+  } else if (m_deltaTime.elapsed() >= 1.0 / 480.0) {
+    // Cap to 480 Hz
     m_lastDeltaTime = m_deltaTime.restart();
   } else {
     m_lastDeltaTime = 0.0;
@@ -68,6 +68,33 @@ struct abcg::WindowSettings {
   std::string fullscreenElementID{"#canvas"};
   /** @brief String containing the window title. */
   std::string title{"ABCg Window"};
+  /** @brief Whether to render frames only when needed.
+   *
+   * If `true`, a frame is rendered only after an event, such as user input
+   * or a resize, or after a call to abcg::Window::requestRedraw. Otherwise,
+   * the application blocks waiting for events, and uses almost no CPU time.
+   *
+   * Windows that animate continuously should call
+   * abcg::Window::requestRedraw for every frame while the animation is
+   * active.
+   */
+  bool renderOnDemand{false};
+  /** @brief Maximum time to wait for events when rendering on demand, in
+   * seconds.
+   *
+   * A frame is rendered when the time runs out, so content that changes with
+   * time, such as a clock, is still refreshed. If negative, the application
+   * waits indefinitely.
+   */
+  double idleTimeout{1.0};
+  /** @brief Maximum frame rate, in frames per second, or zero for no limit.
+   *
+   * The application sleeps between frames and spins for the last
+   * milliseconds, so the frame pacing is more precise than with sleep alone.
+   * This is independent of vertical synchronization. On WebAssembly, the
+   * frame rate is controlled by the browser and this setting is ignored.
+   */
+  double maxFrameRate{0.0};
 };
 
 /**
@@ -159,9 +186,13 @@ protected:
 
   bool createSDLWindow(SDL_WindowFlags extraFlags);
   void setEnableResizingEventWatcher(bool enabled) noexcept;
+  void setFixedDeltaTime(double deltaTime) noexcept;
   void toggleFullscreen();
+  void requestRedraw(int frames = 1) noexcept;
 
 private:
+  [[nodiscard]] bool isRedrawPending() const noexcept;
+  void resumeFromIdle() noexcept;
   void templateHandleEvent(SDL_Event const &event, bool &done);
   void templateCreate();
   void templatePaint();
@@ -175,6 +206,11 @@ private:
   Timer m_deltaTime;
   Timer m_elapsedTime;
   double m_lastDeltaTime{};
+  double m_fixedDeltaTime{};
+
+  // Number of frames still to be rendered in on-demand mode
+  int m_redrawFrames{};
+  bool m_resumingFromIdle{};
 
   bool m_enableResizingEventWatcher{true};
 
@@ -0,0 +1,152 @@
+#include "benchmark.hpp"
+
+#include <fmt/core.h>
+#include <gsl/gsl>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <numeric>
+
+#include "abcgException.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Runs the body the given number of iterations and returns the elapsed time,
+// in nanoseconds
+double timeIterations(std::function<void()> const &body,
+                      std::size_t iterations) {
+  auto const start{Clock::now()};
+  for (std::size_t iteration{}; iteration < iterations; ++iteration) {
+    body();
+  }
+  return std::chrono::duration<double, std::nano>(Clock::now() - start)
+      .count();
+}
+
+std::string escape(std::string_view text) {
+  std::string escaped;
+  for (auto const character : text) {
+    if (character == '"' || character == '\\') {
+      escaped.push_back('\\');
+    }
+    escaped.push_back(character);
+  }
+  return escaped;
+}
+
+} // namespace
+
+void BenchmarkRunner::add(std::string name, BenchmarkSettings const &settings,
+                          std::function<void()> setup,
+                          std::function<void()> body) {
+  m_entries.push_back({.name = std::move(name),
+                       .settings = settings,
+                       .setup = std::move(setup),
+                       .body = std::move(body)});
+}
+
+void BenchmarkRunner::add(std::string name, BenchmarkSettings const &settings,
+                          std::function<void()> body) {
+  add(std::move(name), settings, [] {}, std::move(body));
+}
+
+std::vector<BenchmarkResult> BenchmarkRunner::run() const {
+  std::vector<BenchmarkResult> results;
+  fmt::print("{:<40} {:>10} {:>14} {:>14} {:>12}\n", "Benchmark", "Iters",
+             "Median (ns)", "Mean (ns)", "Stddev");
+  for (auto const &entry : m_entries) {
+    if (!m_filter.empty() && entry.name.find(m_filter) == std::string::npos)
+      continue;
+    auto const &result{results.emplace_back(run(entry, m_repetitionScale))};
+    fmt::print("{:<40} {:>10} {:>14.1f} {:>14.1f} {:>11.1f}%\n", result.name,
+               result.iterations, result.median, result.mean,
+               result.mean > 0.0 ? 100.0 * result.stddev / result.mean : 0.0);
+  }
+  return results;
+}
+
+BenchmarkResult BenchmarkRunner::run(Entry const &entry,
+                                     double repetitionScale) {
+  auto const &settings{entry.settings};
+  auto iterations{std::max<std::size_t>(settings.iterations, 1)};
+  auto const minTime{settings.minRepetitionTime * 1.0e9};
+
+  if (settings.iterations == 0) {
+    // Grow the iteration count until a repetition takes the minimum time
+    while (true) {
+      entry.setup();
+      auto const elapsed{timeIterations(entry.body, iterations)};
+      if (elapsed >= minTime)
+        break;
+      auto const scale{elapsed > 0.0 ? std::min(1.2 * minTime / elapsed, 10.0)
+                                     : 10.0};
+      iterations = gsl::narrow_cast<std::size_t>(
+          std::ceil(gsl::narrow_cast<double>(iterations) * scale));
+    }
+  }
+
+  for (int warmup{}; warmup < settings.warmupRepetitions; ++warmup) {
+    entry.setup();
+    timeIterations(entry.body, iterations);
+  }
+
+  auto const repetitions{std::max(
+      1, gsl::narrow_cast<int>(std::round(settings.repetitions *
+                                          repetitionScale)))};
+  std::vector<double> times;
+  times.reserve(gsl::narrow<std::size_t>(repetitions));
+  for (int repetition{}; repetition < repetitions; ++repetition) {
+    entry.setup();
+    times.push_back(timeIterations(entry.body, iterations) /
+                    gsl::narrow_cast<double>(iterations));
+  }
+
+  std::sort(times.begin(), times.end());
+  auto const count{gsl::narrow_cast<double>(times.size())};
+  auto const mean{std::accumulate(times.begin(), times.end(), 0.0) / count};
+  auto const variance{
+      std::accumulate(times.begin(), times.end(), 0.0,
+                      [mean](double sum, double time) {
+                        return sum + (time - mean) * (time - mean);
+                      }) /
+      std::max(count - 1.0, 1.0)};
+  auto const middle{times.size() / 2};
+  auto const median{times.size() % 2 == 1
+                        ? times.at(middle)
+                        : (times.at(middle - 1) + times.at(middle)) / 2.0};
+
+  return {.name = entry.name,
+          .iterations = iterations,
+          .repetitions = repetitions,
+          .min = times.front(),
+          .median = median,
+          .mean = mean,
+          .max = times.back(),
+          .stddev = std::sqrt(variance)};
+}
+
+void BenchmarkRunner::writeJSON(std::string const &path,
+                                std::vector<BenchmarkResult> const &results) {
+  std::ofstream stream(path);
+  if (!stream) {
+    throw abcg::RuntimeError(fmt::format("Failed to write {}", path));
+  }
+
+  stream << "{\n  \"benchmarks\": [";
+  auto first{true};
+  for (auto const &result : results) {
+    stream << (first ? "\n" : ",\n");
+    first = false;
+    stream << fmt::format(
+        "    {{\"name\": \"{}\", \"iterations\": {}, \"repetitions\": {}, "
+        "\"min_ns\": {:.3f}, \"median_ns\": {:.3f}, \"mean_ns\": {:.3f}, "
+        "\"max_ns\": {:.3f}, \"stddev_ns\": {:.3f}}}",
+        escape(result.name), result.iterations, result.repetitions, result.min,
+        result.median, result.mean, result.max, result.stddev);
+  }
+  stream << "\n  ]\n}\n";
+}
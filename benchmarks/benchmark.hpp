@@ -0,0 +1,78 @@
+#ifndef BENCHMARK_HPP_
+#define BENCHMARK_HPP_
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Minimal micro-benchmark harness.
+//
+// Each benchmark runs a number of untimed warmup repetitions followed by timed
+// repetitions. A repetition calls the setup function, which is not timed, and
+// then the body a number of iterations. Unless fixed, the number of iterations
+// is calibrated before warmup so that each repetition takes at least
+// `minRepetitionTime` seconds. Statistics are computed over the time per
+// iteration of each repetition.
+
+struct BenchmarkSettings {
+  int warmupRepetitions{2};
+  int repetitions{10};
+  // Zero to calibrate
+  std::size_t iterations{};
+  double minRepetitionTime{0.05};
+};
+
+struct BenchmarkResult {
+  std::string name;
+  std::size_t iterations{};
+  int repetitions{};
+  // Time per iteration, in nanoseconds
+  double min{};
+  double median{};
+  double mean{};
+  double max{};
+  double stddev{};
+};
+
+class BenchmarkRunner {
+public:
+  void add(std::string name, BenchmarkSettings const &settings,
+           std::function<void()> setup, std::function<void()> body);
+  void add(std::string name, BenchmarkSettings const &settings,
+           std::function<void()> body);
+
+  void setFilter(std::string_view filter) { m_filter = filter; }
+  void setRepetitionScale(double scale) { m_repetitionScale = scale; }
+
+  std::vector<BenchmarkResult> run() const;
+  static void writeJSON(std::string const &path,
+                        std::vector<BenchmarkResult> const &results);
+
+private:
+  struct Entry {
+    std::string name;
+    BenchmarkSettings settings;
+    std::function<void()> setup;
+    std::function<void()> body;
+  };
+
+  static BenchmarkResult run(Entry const &entry, double repetitionScale);
+
+  std::vector<Entry> m_entries;
+  std::string m_filter;
+  double m_repetitionScale{1.0};
+};
+
+// Prevents the compiler from optimizing away a value computed by a benchmark
+template <typename T> void doNotOptimize(T const &value) {
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : : "r,m"(value) : "memory");
+#else
+  static_cast<void>(*static_cast<char const volatile *>(
+      static_cast<void const *>(&value)));
+#endif
+}
+
+#endif
@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+"""Compares two JSON outputs of the benchmarks target.
+
+Usage: compare.py <baseline.json> <contender.json> [--threshold 0.05]
+
+Benchmarks are matched by name and compared by their median time per
+iteration. A benchmark is flagged as a regression if the contender is slower
+than the baseline by more than the threshold (a fraction of the baseline
+median) and by more than the combined standard deviations of both runs, so
+that noisy benchmarks are not flagged. Exits with status 1 if any regression is
+found.
+"""
+
+import argparse
+import json
+import math
+import sys
+
+
+def load(path):
+    with open(path, encoding="utf-8") as file:
+        return {entry["name"]: entry for entry in json.load(file)["benchmarks"]}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("contender")
+    parser.add_argument(
+        "--threshold",
+        type=float,
+        default=0.05,
+        help="relative slowdown flagged as a regression (default: 0.05)",
+    )
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    contender = load(args.contender)
+
+    print(f"{'Benchmark':<40} {'Baseline':>14} {'Contender':>14} {'Change':>9}")
+    regressions = []
+    for name, new in contender.items():
+        old = baseline.get(name)
+        if old is None:
+            print(f"{name:<40} {'-':>14} {new['median_ns']:>14.1f} {'new':>9}")
+            continue
+
+        change = new["median_ns"] / old["median_ns"] - 1.0
+        noise = math.hypot(old["stddev_ns"], new["stddev_ns"])
+        slowdown = new["median_ns"] - old["median_ns"]
+        flag = ""
+        if change > args.threshold and slowdown > noise:
+            flag = "  REGRESSION"
+            regressions.append(name)
+        elif change < -args.threshold and -slowdown > noise:
+            flag = "  improvement"
+        print(
+            f"{name:<40} {old['median_ns']:>14.1f} {new['median_ns']:>14.1f} "
+            f"{change:>+8.1%}{flag}"
+        )
+
+    for name in baseline.keys() - contender.keys():
+        print(f"{name:<40} {baseline[name]['median_ns']:>14.1f} {'-':>14} "
+              f"{'removed':>9}")
+
+    if regressions:
+        print(f"\n{len(regressions)} regression(s) above "
+              f"{args.threshold:.0%}: {', '.join(regressions)}")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
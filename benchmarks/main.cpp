@@ -0,0 +1,293 @@
+#include <fmt/core.h>
+
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "abcg.hpp"
+#include "abcgImage.hpp"
+#include "abcgImageKernels.hpp"
+#include "benchmark.hpp"
+#include "culling.hpp"
+#include "dices.hpp"
+#include "trackball.hpp"
+#include "transforms.hpp"
+
+// Gives the benchmarks access to the internals of Dices
+struct DicesBenchmark {
+  // Creates a reproducible set of dice
+  static void create(Dices &dices, int quantity) {
+    dices.m_randomEngine.seed(42);
+    dices.m_seed = 42;
+    dices.m_dices.clear();
+    dices.m_dices.reserve(gsl::narrow<std::size_t>(quantity));
+    for (int index{}; index < quantity; ++index) {
+      dices.m_dices.push_back(dices.inicializarDado());
+    }
+  }
+
+  static auto &getDices(Dices &dices) { return dices.m_dices; }
+  // Also sets the state at the start of the step, read by findContacts
+  static void setDices(Dices &dices, std::vector<Dices::Dice> const &states) {
+    dices.m_dices = states;
+    dices.m_previousDices = states;
+  }
+  static auto &getVertices(Dices &dices) { return dices.m_vertices; }
+
+  static void findContacts(Dices &dices) { dices.findContacts(); }
+  static void computeNormals(Dices &dices) { dices.computeNormals(); }
+  static void parseObj(Dices &dices, std::string_view path) {
+    dices.parseObj(path, true);
+  }
+};
+
+namespace {
+
+void addDicesBenchmarks(BenchmarkRunner &runner, std::string const &objPath) {
+  for (auto const quantity : {10, 1000, 100000}) {
+    // Dices::update compares each spinning die with the dice in the cells
+    // around it, which at the start are close to all of them
+    auto const large{quantity >= 100000};
+    BenchmarkSettings const updateSettings{
+        .warmupRepetitions = large ? 0 : 2,
+        .repetitions = large ? 1 : 10,
+        .iterations = large ? 1U : 0U,
+        .minRepetitionTime = 0.05};
+
+    auto dices{std::make_shared<Dices>()};
+    DicesBenchmark::create(*dices, quantity);
+    auto const initial{DicesBenchmark::getDices(*dices)};
+
+    auto const reset{[dices, initial] {
+      DicesBenchmark::setDices(*dices, initial);
+    }};
+
+    runner.add(fmt::format("Dices::update/{}", quantity), updateSettings,
+               reset, [dices] { dices->update(1.0f / 60.0f); });
+    runner.add(fmt::format("Dices::findContacts/{}", quantity),
+               updateSettings, reset,
+               [dices] { DicesBenchmark::findContacts(*dices); });
+  }
+
+  for (auto const quantity : {16, 1024}) {
+    auto dices{std::make_shared<Dices>()};
+    DicesBenchmark::create(*dices, quantity);
+    auto states{std::make_shared<std::vector<DiceState>>()};
+    dices->copyStates(*states);
+    auto transforms{
+        std::make_shared<std::vector<DiceTransform>>(states->size())};
+
+    glm::mat4 const base{glm::rotate(glm::mat4{1.0f}, 0.5f,
+                                     glm::normalize(glm::vec3{1.0f}))};
+    glm::mat4 const view{glm::lookAt(glm::vec3{0.0f, 0.0f, 5.0f},
+                                     glm::vec3{0.0f}, glm::vec3{0.0f, 1.0f,
+                                                                0.0f})};
+
+    runner.add(fmt::format("computeDiceTransforms/{}", quantity), {},
+               [=] {
+                 computeDiceTransforms(*states, base, view, 0.5f,
+                                       *transforms);
+                 doNotOptimize(transforms->front());
+               });
+    // The previous per-die glm code, for comparison
+    runner.add(fmt::format("computeDiceTransforms/glm/{}", quantity), {},
+               [=] {
+                 for (auto &&[state, transform] :
+                      iter::zip(*states, *transforms)) {
+                   auto model{glm::translate(base, state.position)};
+                   model = glm::scale(model, glm::vec3(0.5f));
+                   model *= glm::mat4_cast(state.orientation);
+                   transform.modelMatrix = model;
+                   transform.normalMatrix =
+                       glm::inverseTranspose(glm::mat3(view * model));
+                 }
+                 doNotOptimize(transforms->front());
+               });
+
+    computeDiceTransforms(*states, base, view, 0.5f, *transforms);
+    auto const frustum{extractFrustum(
+        glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 25.0f) *
+        view)};
+    auto visibility{
+        std::make_shared<std::vector<std::uint8_t>>(states->size())};
+    runner.add(fmt::format("cullDiceSpheres/{}", quantity), {},
+               [=] {
+                 doNotOptimize(cullDiceSpheres(*transforms,
+                                               {.radius = 1.0f}, frustum,
+                                               *visibility));
+               });
+  }
+
+  auto dices{std::make_shared<Dices>()};
+  DicesBenchmark::parseObj(*dices, objPath);
+
+  runner.add("Dices::loadObj", {}, [dices, objPath] {
+    DicesBenchmark::parseObj(*dices, objPath);
+  });
+  runner.add("Dices::computeNormals", {},
+             [dices] { DicesBenchmark::computeNormals(*dices); });
+  runner.add("Dices::standardize", {}, [dices] { dices->standardize(); });
+
+  auto const vertices{DicesBenchmark::getVertices(*dices)};
+  runner.add("std::hash<Vertex>", {}, [vertices] {
+    std::size_t hash{};
+    for (auto const &vertex : vertices) {
+      hash ^= std::hash<Vertex>{}(vertex);
+    }
+    doNotOptimize(hash);
+  });
+  runner.add("Vertex dedupe", {}, [vertices] {
+    std::unordered_map<Vertex, GLuint> indices;
+    for (auto const &vertex : vertices) {
+      indices.try_emplace(vertex, gsl::narrow<GLuint>(indices.size()));
+    }
+    doNotOptimize(indices.size());
+  });
+}
+
+void addImageBenchmarks(BenchmarkRunner &runner) {
+  for (auto const size : {256, 1024}) {
+    std::shared_ptr<SDL_Surface> surface{
+        SDL_CreateRGBSurfaceWithFormat(0, size, size, 32,
+                                       SDL_PIXELFORMAT_RGBA32),
+        SDL_FreeSurface};
+    if (!surface) {
+      throw abcg::SDLError("SDL_CreateRGBSurfaceWithFormat failed");
+    }
+
+    runner.add(fmt::format("abcg::flipVertically/{}", size), {},
+               [surface] { abcg::flipVertically(*surface); });
+    runner.add(fmt::format("abcg::flipHorizontally/{}", size), {},
+               [surface] { abcg::flipHorizontally(*surface); });
+  }
+
+  constexpr auto size{1024};
+  constexpr auto pixelCount{std::size_t{size} * size};
+  auto const rgb{std::make_shared<std::vector<std::byte>>(pixelCount * 3)};
+  auto const rgba{std::make_shared<std::vector<std::byte>>(pixelCount * 4)};
+  auto const mip{std::make_shared<std::vector<std::byte>>(pixelCount)};
+  auto const linear{std::make_shared<std::vector<float>>(pixelCount * 4)};
+  for (auto &&[index, value] : iter::enumerate(*rgba)) {
+    value = std::byte(index * 7 % 256);
+  }
+
+  abcg::ImageView const rgbView{rgb->data(), size, size, size * 3U, 3};
+  abcg::ImageView const rgbaView{rgba->data(), size, size, size * 4U, 4};
+  abcg::ImageView const mipView{mip->data(), size / 2, size / 2,
+                                size / 2 * 4U, 4};
+
+  runner.add("abcg::expandRGBToRGBA/1024", {}, [=] {
+    abcg::expandRGBToRGBA(rgbView, rgbaView);
+    doNotOptimize(rgba->front());
+  });
+  runner.add("abcg::convertSRGBToLinear/1024", {}, [=] {
+    abcg::convertSRGBToLinear(
+        {reinterpret_cast<std::uint8_t const *>(rgba->data()), rgba->size()},
+        *linear, 4);
+    doNotOptimize(linear->front());
+  });
+  runner.add("abcg::convertLinearToSRGB/1024", {}, [=] {
+    abcg::convertLinearToSRGB(
+        *linear, {reinterpret_cast<std::uint8_t *>(rgba->data()), rgba->size()},
+        4);
+    doNotOptimize(rgba->front());
+  });
+  for (auto const sRGB : {false, true}) {
+    auto const suffix{sRGB ? "sRGB/1024" : "1024"};
+    runner.add(fmt::format("abcg::downsampleImage/Box/{}", suffix), {}, [=] {
+      abcg::downsampleImage(rgbaView, mipView, abcg::MipFilter::Box, sRGB);
+      doNotOptimize(mip->front());
+    });
+    runner.add(fmt::format("abcg::downsampleImage/Kaiser/{}", suffix), {},
+               [=] {
+                 abcg::downsampleImage(rgbaView, mipView,
+                                       abcg::MipFilter::Kaiser, sRGB);
+                 doNotOptimize(mip->front());
+               });
+  }
+}
+
+void addUtilBenchmarks(BenchmarkRunner &runner) {
+  runner.add("abcg::hashCombine", {}, [] {
+    std::size_t hash{};
+    for (auto const index : iter::range<std::size_t>(1024)) {
+      hash ^= abcg::hashCombine(index, 0.5f * gsl::narrow_cast<float>(index),
+                                glm::vec3{gsl::narrow_cast<float>(index)});
+    }
+    doNotOptimize(hash);
+  });
+
+  // Keys with a few states and scattered depths, as recorded by the per-die
+  // path of the dice example
+  auto keys{std::make_shared<std::vector<abcg::RenderKey>>(4096)};
+  for (auto &&[index, key] : iter::enumerate(*keys)) {
+    key = {.program = gsl::narrow_cast<std::uint32_t>(index % 2),
+           .texture = gsl::narrow_cast<std::uint32_t>(index % 3),
+           .depth = gsl::narrow_cast<float>(index * 7919 % 4096) / 4096.0f};
+  }
+  auto renderQueue{std::make_shared<abcg::RenderQueue>()};
+  renderQueue->reserve(keys->size());
+  runner.add("abcg::RenderQueue::sort/4096", {}, [keys, renderQueue] {
+    renderQueue->clear();
+    for (auto &&[index, key] : iter::enumerate(*keys)) {
+      renderQueue->push(key, gsl::narrow_cast<std::uint32_t>(index));
+    }
+    renderQueue->sort();
+    doNotOptimize(renderQueue->getPackets().front());
+  });
+
+  auto trackBall{std::make_shared<TrackBall>()};
+  trackBall->setAxis(glm::normalize(glm::vec3{1.0f, 1.0f, 0.0f}));
+  trackBall->setVelocity(1.0f);
+  runner.add("TrackBall::getRotation", {}, [trackBall] {
+    doNotOptimize(trackBall->getRotation());
+  });
+
+  auto abcgTrackBall{std::make_shared<abcg::TrackBall>()};
+  abcgTrackBall->setAxis(glm::normalize(glm::vec3{1.0f, 1.0f, 0.0f}));
+  abcgTrackBall->setVelocity(0.001f);
+  runner.add("abcg::TrackBall::getRotation", {}, [abcgTrackBall] {
+    doNotOptimize(abcgTrackBall->getRotation());
+  });
+}
+
+} // namespace
+
+// Usage: benchmarks [--filter <substring>] [--json <path>] [--quick]
+int main(int argc, char **argv) {
+  try {
+    BenchmarkRunner runner;
+    std::string jsonPath;
+
+    std::span const args{argv, gsl::narrow<std::size_t>(argc)};
+    for (std::size_t index{1}; index < args.size(); ++index) {
+      std::string_view const option{args[index]};
+      if (option == "--quick") {
+        runner.setRepetitionScale(0.3);
+      } else if (option == "--filter" && index + 1 < args.size()) {
+        runner.setFilter(args[++index]);
+      } else if (option == "--json" && index + 1 < args.size()) {
+        jsonPath = args[++index];
+      } else {
+        fmt::print(stderr, "Unknown option {}\n", option);
+        return -1;
+      }
+    }
+
+    addDicesBenchmarks(runner, BENCHMARK_ASSETS_PATH "dice.obj");
+    addImageBenchmarks(runner);
+    addUtilBenchmarks(runner);
+
+    auto const results{runner.run()};
+    if (!jsonPath.empty()) {
+      BenchmarkRunner::writeJSON(jsonPath, results);
+      fmt::print("Results written to {}\n", jsonPath);
+    }
+  } catch (std::exception const &exception) {
+    fmt::print(stderr, "{}\n", exception.what());
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,6 @@
+#version 300 es
+
+precision mediump float;
+
+// Only the depth is written
+void main() {}
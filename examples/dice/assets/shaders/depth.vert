@@ -0,0 +1,19 @@
+#version 300 es
+
+// Position-only version of dice.vert for depth-only passes. gl_Position is
+// computed by the same expressions and is invariant in both shaders, so the
+// depth written here is exactly the depth of the main pass
+
+layout(location = 0) in vec3 inPosition;
+
+uniform mat4 modelMatrix;
+uniform mat4 viewMatrix;
+uniform mat4 projMatrix;
+
+invariant gl_Position;
+
+void main() {
+  vec3 P = (viewMatrix * modelMatrix * vec4(inPosition, 1.0)).xyz;
+
+  gl_Position = projMatrix * vec4(P, 1.0);
+}
@@ -0,0 +1,19 @@
+#version 300 es
+
+// Position-only version of dice_instanced.vert for depth-only passes
+
+layout(location = 0) in vec3 inPosition;
+
+// Per-instance model matrix, written by cull.comp
+layout(location = 3) in mat4 modelMatrix;
+
+uniform mat4 viewMatrix;
+uniform mat4 projMatrix;
+
+invariant gl_Position;
+
+void main() {
+  vec3 P = (viewMatrix * modelMatrix * vec4(inPosition, 1.0)).xyz;
+
+  gl_Position = projMatrix * vec4(P, 1.0);
+}
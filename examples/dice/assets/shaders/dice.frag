@@ -8,16 +8,26 @@ in vec3 fragV;
 in vec2 fragTexCoord;
 in vec3 fragPObj;
 in vec3 fragNObj;
+flat in uint fragMaterial;
 
 // Light properties
 uniform vec4 Ia, Id, Is;
 
-// Material properties
-uniform vec4 Ka, Kd, Ks;
-uniform float shininess;
+// Material properties, as Material in dices.hpp. The diffuse layer is -1 if
+// the material has no diffuse map
+struct Material {
+  vec4 Ka, Kd, Ks;
+  float shininess;
+  int diffuseLayer;
+};
 
-// Diffuse texture sampler
-uniform sampler2D diffuseTex;
+// Same size as Dices::maxMaterials
+layout(std140) uniform Materials {
+  Material materials[16];
+};
+
+// Diffuse maps of the materials, one per layer
+uniform mediump sampler2DArray diffuseTex;
 
 // Mapping mode
 // 0: triplanar; 1: cylindrical; 2: spherical; 3: from mesh
@@ -25,6 +35,8 @@ uniform int mappingMode;
 
 out vec4 outColor;
 
+Material material;
+
 // Blinn-Phong reflection model
 vec4 BlinnPhong(vec3 N, vec3 L, vec3 V, vec2 texCoord) {
   N = normalize(N);
@@ -39,15 +51,19 @@ vec4 BlinnPhong(vec3 N, vec3 L, vec3 V, vec2 texCoord) {
     V = normalize(V);
     vec3 H = normalize(L + V);
     float angle = max(dot(H, N), 0.0);
-    specular = pow(angle, shininess);
+    specular = pow(angle, material.shininess);
   }
 
-  vec4 map_Kd = texture(diffuseTex, texCoord);
+  // Sampled even without a map, so that the derivatives stay defined where
+  // the material changes
+  int layer = material.diffuseLayer;
+  vec4 texel = texture(diffuseTex, vec3(texCoord, float(max(layer, 0))));
+  vec4 map_Kd = layer < 0 ? vec4(1.0) : texel;
   vec4 map_Ka = map_Kd;
 
-  vec4 diffuseColor = map_Kd * Kd * Id * lambertian;
-  vec4 specularColor = Ks * Is * specular;
-  vec4 ambientColor = map_Ka * Ka * Ia;
+  vec4 diffuseColor = map_Kd * material.Kd * Id * lambertian;
+  vec4 specularColor = material.Ks * Is * specular;
+  vec4 ambientColor = map_Ka * material.Ka * Ia;
 
   return ambientColor + diffuseColor + specularColor;
 }
@@ -82,6 +98,7 @@ vec2 SphericalMapping(vec3 P) {
 }
 
 void main() {
+  material = materials[fragMaterial];
   vec4 color;
 
   if (mappingMode == 0) {
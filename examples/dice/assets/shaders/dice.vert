@@ -3,6 +3,8 @@
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec2 inTexCoord;
+// After the per-instance attributes of dice_instanced.vert
+layout(location = 10) in uint inMaterial;
 
 uniform mat4 modelMatrix;
 uniform mat4 viewMatrix;
@@ -17,6 +19,10 @@ out vec3 fragN;
 out vec2 fragTexCoord;
 out vec3 fragPObj;
 out vec3 fragNObj;
+flat out uint fragMaterial;
+
+// Same as in the depth pre-pass, whose depth is tested with GL_EQUAL
+invariant gl_Position;
 
 void main() {
   vec3 P = (viewMatrix * modelMatrix * vec4(inPosition, 1.0)).xyz;
@@ -29,6 +35,7 @@ void main() {
   fragTexCoord = inTexCoord;
   fragPObj = inPosition;
   fragNObj = inNormal;
+  fragMaterial = inMaterial;
 
   gl_Position = projMatrix * vec4(P, 1.0);
 }
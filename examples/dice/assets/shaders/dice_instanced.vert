@@ -0,0 +1,43 @@
+#version 300 es
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+layout(location = 2) in vec2 inTexCoord;
+// After the per-instance attributes of dice_instanced.vert
+layout(location = 10) in uint inMaterial;
+
+// Per-instance matrices, written by cull.comp
+layout(location = 3) in mat4 modelMatrix;
+layout(location = 7) in mat3 normalMatrix;
+
+uniform mat4 viewMatrix;
+uniform mat4 projMatrix;
+
+uniform vec4 lightDirWorldSpace;
+
+out vec3 fragV;
+out vec3 fragL;
+out vec3 fragN;
+out vec2 fragTexCoord;
+out vec3 fragPObj;
+out vec3 fragNObj;
+flat out uint fragMaterial;
+
+// Same as in the depth pre-pass, whose depth is tested with GL_EQUAL
+invariant gl_Position;
+
+void main() {
+  vec3 P = (viewMatrix * modelMatrix * vec4(inPosition, 1.0)).xyz;
+  vec3 N = normalMatrix * inNormal;
+  vec3 L = -(viewMatrix * lightDirWorldSpace).xyz;
+
+  fragL = L;
+  fragV = -P;
+  fragN = N;
+  fragTexCoord = inTexCoord;
+  fragPObj = inPosition;
+  fragNObj = inNormal;
+  fragMaterial = inMaterial;
+
+  gl_Position = projMatrix * vec4(P, 1.0);
+}
@@ -0,0 +1,38 @@
+#version 300 es
+
+precision highp float;
+
+// Previous level of the pyramid, as the base level of the texture
+uniform highp sampler2D depthTex;
+
+float fetch(ivec2 coord, ivec2 last) {
+  return texelFetch(depthTex, min(coord, last), 0).r;
+}
+
+void main() {
+  ivec2 size = textureSize(depthTex, 0);
+  ivec2 last = size - 1;
+  ivec2 coord = ivec2(gl_FragCoord.xy) * 2;
+
+  float depth = max(max(fetch(coord, last), fetch(coord + ivec2(1, 0), last)),
+                    max(fetch(coord + ivec2(0, 1), last),
+                        fetch(coord + ivec2(1, 1), last)));
+
+  // If the previous level has an odd size, its last column or row is merged
+  // into the last texel of this level
+  bool extraColumn = (size.x & 1) == 1 && coord.x + 2 == last.x;
+  bool extraRow = (size.y & 1) == 1 && coord.y + 2 == last.y;
+  if (extraColumn) {
+    depth = max(depth, max(fetch(coord + ivec2(2, 0), last),
+                           fetch(coord + ivec2(2, 1), last)));
+  }
+  if (extraRow) {
+    depth = max(depth, max(fetch(coord + ivec2(0, 2), last),
+                           fetch(coord + ivec2(1, 2), last)));
+  }
+  if (extraColumn && extraRow) {
+    depth = max(depth, fetch(coord + ivec2(2, 2), last));
+  }
+
+  gl_FragDepth = depth;
+}
@@ -0,0 +1,38 @@
+#version 300 es
+
+precision highp float;
+
+// Depth pyramid, with the farthest depth of each block in the coarser levels
+uniform highp sampler2D hiZTex;
+uniform int maxLevel;
+
+flat in vec4 fragRect;
+flat in float fragDepth;
+
+out vec4 outColor;
+
+void main() {
+  // Texels covered by the rectangle in the full-resolution level
+  ivec2 size = textureSize(hiZTex, 0);
+  ivec2 minTexel = clamp(ivec2(fragRect.xy * vec2(size)), ivec2(0), size - 1);
+  ivec2 maxTexel = clamp(ivec2(fragRect.zw * vec2(size)), ivec2(0), size - 1);
+
+  // Finest level in which the rectangle spans at most 2x2 texels. Texel t of
+  // level n covers the texels t * 2^n to (t + 1) * 2^n - 1 of level 0, and
+  // the last one also covers the remaining ones
+  ivec2 extent = maxTexel - minTexel + 1;
+  int level =
+      min(int(ceil(log2(float(max(extent.x, extent.y))))), maxLevel);
+  ivec2 last = textureSize(hiZTex, level) - 1;
+  minTexel = min(minTexel >> level, last);
+  maxTexel = min(maxTexel >> level, last);
+
+  float depth = max(
+      max(texelFetch(hiZTex, minTexel, level).r,
+          texelFetch(hiZTex, ivec2(maxTexel.x, minTexel.y), level).r),
+      max(texelFetch(hiZTex, ivec2(minTexel.x, maxTexel.y), level).r,
+          texelFetch(hiZTex, maxTexel, level).r));
+
+  // Visible unless the nearest point is behind everything drawn so far
+  outColor = vec4(fragDepth <= depth ? 1.0 : 0.0, 0.0, 0.0, 1.0);
+}
@@ -0,0 +1,24 @@
+#version 300 es
+
+// Minimum and maximum texture coordinates of the projected bounding box
+layout(location = 0) in vec4 inRect;
+// Nearest window-space depth of the bounding box
+layout(location = 1) in float inDepth;
+
+// Size of the result texture, in texels
+uniform ivec2 resultSize;
+
+flat out vec4 fragRect;
+flat out float fragDepth;
+
+// Each die writes its result to the texel at its index, in row-major order
+void main() {
+  ivec2 texel = ivec2(gl_VertexID % resultSize.x, gl_VertexID / resultSize.x);
+  vec2 position = (vec2(texel) + 0.5) / vec2(resultSize) * 2.0 - 1.0;
+
+  fragRect = inRect;
+  fragDepth = inDepth;
+
+  gl_Position = vec4(position, 0.0, 1.0);
+  gl_PointSize = 1.0;
+}
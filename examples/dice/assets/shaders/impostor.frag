@@ -0,0 +1,113 @@
+#version 300 es
+
+precision highp float;
+
+in vec3 fragV;
+in vec3 fragL;
+in vec4 fragFrameUV01;
+in vec4 fragFrameUV23;
+flat in vec4 fragFrames01;
+flat in vec4 fragFrames23;
+flat in vec4 fragWeights;
+flat in mat3 fragNormalMatrix;
+flat in vec4 fragToCamera;
+
+uniform mat4 projMatrix;
+
+// Light properties
+uniform vec4 Ia, Id, Is;
+
+// Material properties, as in dice.frag
+struct Material {
+  vec4 Ka, Kd, Ks;
+  float shininess;
+  int diffuseLayer;
+};
+
+layout(std140) uniform Materials {
+  Material materials[16];
+};
+
+// Atlas with the color and coverage, with the normal and depth, and with the
+// material of the mesh seen from each direction
+uniform sampler2D colorTex;
+uniform sampler2D normalDepthTex;
+uniform highp usampler2D materialTex;
+uniform float framesPerSide;
+// Size of a texel of a frame, relative to the frame
+uniform float frameTexelSize;
+
+out vec4 outColor;
+
+Material material;
+
+// Same as in dice.frag, with the color of the atlas as the diffuse map
+vec4 BlinnPhong(vec3 N, vec3 L, vec3 V, vec4 map_Kd) {
+  N = normalize(N);
+  L = normalize(L);
+
+  // Compute lambertian term
+  float lambertian = max(dot(N, L), 0.0);
+
+  // Compute specular term
+  float specular = 0.0;
+  if (lambertian > 0.0) {
+    V = normalize(V);
+    vec3 H = normalize(L + V);
+    float angle = max(dot(H, N), 0.0);
+    specular = pow(angle, material.shininess);
+  }
+
+  vec4 map_Ka = map_Kd;
+
+  vec4 diffuseColor = map_Kd * material.Kd * Id * lambertian;
+  vec4 specularColor = material.Ks * Is * specular;
+  vec4 ambientColor = map_Ka * material.Ka * Ia;
+
+  return ambientColor + diffuseColor + specularColor;
+}
+
+vec4 color = vec4(0.0);
+vec4 normalDepth = vec4(0.0);
+// Material of the frame with the largest weight of the covered ones
+uint materialIndex = 0u;
+float materialWeight = 0.0;
+
+// Adds a frame, clamped so that it does not read from its neighbors. The
+// texels outside the mesh have no color and no coverage, and a zero normal
+// and depth once decoded, so the sums are weighted by the coverage
+void addFrame(vec2 frame, vec2 uv, float weight) {
+  uv = clamp(uv, vec2(0.5 * frameTexelSize), vec2(1.0 - 0.5 * frameTexelSize));
+  vec2 texCoord = (frame + uv) / framesPerSide;
+  vec4 frameColor = texture(colorTex, texCoord);
+  color += frameColor * weight;
+  vec4 texel = texture(normalDepthTex, texCoord);
+  normalDepth += vec4(texel.xyz * 2.0 - 1.0, texel.w) * weight;
+
+  if (frameColor.a * weight > materialWeight) {
+    materialWeight = frameColor.a * weight;
+    ivec2 size = textureSize(materialTex, 0);
+    materialIndex = texelFetch(materialTex, ivec2(texCoord * vec2(size)), 0).r;
+  }
+}
+
+void main() {
+  addFrame(fragFrames01.xy, fragFrameUV01.xy, fragWeights.x);
+  addFrame(fragFrames01.zw, fragFrameUV01.zw, fragWeights.y);
+  addFrame(fragFrames23.xy, fragFrameUV23.xy, fragWeights.z);
+  addFrame(fragFrames23.zw, fragFrameUV23.zw, fragWeights.w);
+
+  float coverage = color.a;
+  if (coverage < 0.5) discard;
+
+  // The color is baked at half intensity
+  vec4 map_Kd = vec4(color.rgb / coverage * 2.0, 1.0);
+  vec3 N = fragNormalMatrix * normalDepth.xyz;
+  material = materials[materialIndex];
+  outColor = BlinnPhong(N, fragL, fragV, map_Kd);
+
+  // Moves the point on the quad to the surface of the mesh
+  float height = (normalDepth.w / coverage * 2.0 - 1.0) * fragToCamera.w;
+  vec4 position = projMatrix * vec4(-fragV + fragToCamera.xyz * height, 1.0);
+  gl_FragDepth = position.z / position.w * 0.5 + 0.5;
+}
@@ -0,0 +1,101 @@
+#version 300 es
+
+// Per-instance matrices, the same as in dice_instanced.vert
+layout(location = 3) in mat4 modelMatrix;
+layout(location = 7) in mat3 normalMatrix;
+
+uniform mat4 viewMatrix;
+uniform mat4 projMatrix;
+
+uniform vec4 lightDirWorldSpace;
+
+// Center and radius of the bounding sphere of the mesh, in model space
+uniform vec4 boundingSphere;
+// Number of frames along each side of the atlas
+uniform float framesPerSide;
+
+out vec3 fragV;
+out vec3 fragL;
+// Position in each of the four frames, relative to the frame
+out vec4 fragFrameUV01;
+out vec4 fragFrameUV23;
+// Lower-left corners of the four frames, in frames
+flat out vec4 fragFrames01;
+flat out vec4 fragFrames23;
+flat out vec4 fragWeights;
+flat out mat3 fragNormalMatrix;
+// Direction from the center to the camera and radius, in view space
+flat out vec4 fragToCamera;
+
+// Octahedral mapping of a unit vector to [0, 1]^2
+vec2 octEncode(vec3 d) {
+  d /= abs(d.x) + abs(d.y) + abs(d.z);
+  vec2 signs = vec2(d.x >= 0.0 ? 1.0 : -1.0, d.y >= 0.0 ? 1.0 : -1.0);
+  vec2 p = d.z >= 0.0 ? d.xy : (1.0 - abs(d.yx)) * signs;
+  return p * 0.5 + 0.5;
+}
+
+vec3 octDecode(vec2 p) {
+  p = p * 2.0 - 1.0;
+  vec3 d = vec3(p, 1.0 - abs(p.x) - abs(p.y));
+  if (d.z < 0.0) {
+    vec2 signs = vec2(d.x >= 0.0 ? 1.0 : -1.0, d.y >= 0.0 ? 1.0 : -1.0);
+    d.xy = (1.0 - abs(d.yx)) * signs;
+  }
+  return normalize(d);
+}
+
+// Position in the frame seen from direction d, as in Impostors::bake
+vec2 frameUV(vec2 frame, vec3 offset) {
+  vec3 d = octDecode(frame / (framesPerSide - 1.0));
+  vec3 up = abs(d.y) > 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(0.0, 1.0, 0.0);
+  vec3 right = normalize(cross(up, d));
+  up = cross(d, right);
+  return vec2(dot(offset, right), dot(offset, up)) / boundingSphere.w * 0.5 +
+         0.5;
+}
+
+void main() {
+  mat4 modelViewMatrix = viewMatrix * modelMatrix;
+  mat3 linear = mat3(modelViewMatrix);
+  // The model matrix is a rotation times a uniform scale, so its inverse is
+  // the transpose divided by the squared scale
+  float scale2 = dot(linear[0], linear[0]);
+  float radius = boundingSphere.w * sqrt(scale2);
+  vec3 center = (modelViewMatrix * vec4(boundingSphere.xyz, 1.0)).xyz;
+  vec3 toCamera = normalize(-center);
+
+  // Quad through the center, facing the camera, that covers the projected
+  // bounding sphere
+  vec3 right = normalize(cross(vec3(0.0, 1.0, 0.0), toCamera));
+  vec3 up = cross(toCamera, right);
+  float halfSize = radius * inversesqrt(max(1.0 - scale2 *
+      boundingSphere.w * boundingSphere.w / dot(center, center), 1e-4));
+  vec2 corner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1)) * 2.0 -
+                1.0;
+  vec3 P = center + (corner.x * right + corner.y * up) * halfSize;
+
+  // The four frames nearest to the direction of the camera in model space,
+  // weighted bilinearly on the octahedral grid
+  vec3 direction = normalize(transpose(linear) * toCamera);
+  vec2 grid = octEncode(direction) * (framesPerSide - 1.0);
+  vec2 base = min(floor(grid), vec2(framesPerSide - 2.0));
+  vec2 t = grid - base;
+  fragFrames01 = vec4(base, base + vec2(1.0, 0.0));
+  fragFrames23 = vec4(base + vec2(0.0, 1.0), base + vec2(1.0));
+  fragWeights = vec4((1.0 - t.x) * (1.0 - t.y), t.x * (1.0 - t.y),
+                     (1.0 - t.x) * t.y, t.x * t.y);
+
+  vec3 offset = transpose(linear) * (P - center) / scale2;
+  fragFrameUV01 = vec4(frameUV(fragFrames01.xy, offset),
+                       frameUV(fragFrames01.zw, offset));
+  fragFrameUV23 = vec4(frameUV(fragFrames23.xy, offset),
+                       frameUV(fragFrames23.zw, offset));
+
+  fragV = -P;
+  fragL = -(viewMatrix * lightDirWorldSpace).xyz;
+  fragNormalMatrix = normalMatrix;
+  fragToCamera = vec4(toCamera, radius);
+
+  gl_Position = projMatrix * vec4(P, 1.0);
+}
@@ -0,0 +1,19 @@
+#version 300 es
+
+precision highp float;
+
+in vec3 fragNObj;
+flat in uint fragMaterial;
+
+// Normal in model space, and height above the center of the bounding sphere
+// along the view direction, both mapped to [0, 1]
+layout(location = 0) out vec4 outNormalDepth;
+// Index of the material
+layout(location = 1) out uint outMaterial;
+
+void main() {
+  // The orthographic projection spans the bounding sphere along the view
+  // direction, from the nearest point at depth 0 to the farthest at depth 1
+  outNormalDepth = vec4(normalize(fragNObj) * 0.5 + 0.5, 1.0 - gl_FragCoord.z);
+  outMaterial = fragMaterial;
+}
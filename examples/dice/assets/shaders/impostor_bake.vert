@@ -0,0 +1,19 @@
+#version 300 es
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+// Same as in dice.vert
+layout(location = 10) in uint inMaterial;
+
+uniform mat4 viewMatrix;
+uniform mat4 projMatrix;
+
+out vec3 fragNObj;
+flat out uint fragMaterial;
+
+void main() {
+  fragNObj = inNormal;
+  fragMaterial = inMaterial;
+
+  gl_Position = projMatrix * viewMatrix * vec4(inPosition, 1.0);
+}
@@ -0,0 +1,131 @@
+#include "culling.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// Number of dice tested together, as in computeDiceTransforms. The loops over
+// the lanes have a fixed trip count and no branches, so the compiler turns
+// them into SIMD code
+constexpr std::size_t laneCount{8};
+using Lanes = std::array<float, laneCount>;
+using Vec3Lanes = std::array<Lanes, 3>;
+} // namespace
+
+Frustum extractFrustum(glm::mat4 const &viewProjMatrix) {
+  // Rows of the matrix. A point is inside the clip volume if
+  // -w <= x, y, z <= w, which gives one plane per inequality
+  auto const row{[&viewProjMatrix](glm::length_t index) {
+    return glm::vec4{viewProjMatrix[0][index], viewProjMatrix[1][index],
+                     viewProjMatrix[2][index], viewProjMatrix[3][index]};
+  }};
+
+  Frustum frustum{{
+      row(3) + row(0), // Left
+      row(3) - row(0), // Right
+      row(3) + row(1), // Bottom
+      row(3) - row(1), // Top
+      row(3) + row(2), // Near
+      row(3) - row(2), // Far
+  }};
+
+  for (auto &plane : frustum.planes) {
+    plane /= glm::length(glm::vec3{plane});
+  }
+  return frustum;
+}
+
+std::size_t cullDiceSpheres(std::span<DiceTransform const> transforms,
+                            BoundingSphere const &sphere,
+                            Frustum const &frustum,
+                            std::span<std::uint8_t> visibility) {
+  abcg::TraceScope const traceScope{"cullDiceSpheres", "dice"};
+
+  auto const count{std::min(transforms.size(), visibility.size())};
+  std::size_t visibleCount{};
+
+  for (std::size_t first{}; first < count; first += laneCount) {
+    auto const lanes{std::min(laneCount, count - first)};
+
+    // Gather the sphere centers in world space and the squared scales. Unused
+    // lanes are left zeroed, and their results are discarded
+    Vec3Lanes centers{};
+    Lanes squaredScales{};
+    for (std::size_t lane{}; lane < lanes; ++lane) {
+      auto const &modelMatrix{transforms[first + lane].modelMatrix};
+      auto const center{modelMatrix * glm::vec4{sphere.center, 1.0f}};
+      centers[0][lane] = center.x;
+      centers[1][lane] = center.y;
+      centers[2][lane] = center.z;
+      squaredScales[lane] = glm::dot(glm::vec3{modelMatrix[0]},
+                                     glm::vec3{modelMatrix[0]});
+    }
+
+    Lanes radii{};
+    for (std::size_t lane{}; lane < laneCount; ++lane) {
+      radii[lane] = std::sqrt(squaredScales[lane]) * sphere.radius;
+    }
+
+    // A sphere is culled if it is entirely behind any of the planes
+    std::array<bool, laneCount> inside{};
+    inside.fill(true);
+    for (auto const &plane : frustum.planes) {
+      for (std::size_t lane{}; lane < laneCount; ++lane) {
+        auto const distance{plane.x * centers[0][lane] +
+                            plane.y * centers[1][lane] +
+                            plane.z * centers[2][lane] + plane.w};
+        inside[lane] = inside[lane] && distance >= -radii[lane];
+      }
+    }
+
+    for (std::size_t lane{}; lane < lanes; ++lane) {
+      visibility[first + lane] = inside[lane] ? 1 : 0;
+      if (inside[lane])
+        ++visibleCount;
+    }
+  }
+
+  return visibleCount;
+}
+
+std::size_t cullMeshlets(std::span<Meshlet const> meshlets,
+                         Frustum const &frustum,
+                         glm::vec3 const &cameraPosition,
+                         std::vector<MeshLod> &ranges) {
+  std::size_t culledIndices{};
+  // Ranges of the previous dice are not merged with the ones of this die
+  auto const firstRange{ranges.size()};
+
+  for (auto const &meshlet : meshlets) {
+    auto const inside{std::ranges::all_of(
+        frustum.planes, [&meshlet](glm::vec4 const &plane) {
+          return glm::dot(glm::vec3{plane}, meshlet.center) + plane.w >=
+                 -meshlet.radius;
+        })};
+
+    // Every point p of the sphere is behind its triangles if the angle
+    // between the axis and p - cameraPosition is less than 90 degrees minus
+    // the half-angle of the cone
+    auto const toCenter{meshlet.center - cameraPosition};
+    auto const distance{glm::length(toCenter)};
+    auto const backfacing{glm::dot(toCenter, meshlet.coneAxis) >=
+                          meshlet.coneCutoff * (distance + meshlet.radius) +
+                              meshlet.radius};
+
+    if (!inside || backfacing) {
+      culledIndices += meshlet.indexCount;
+      continue;
+    }
+
+    if (ranges.size() > firstRange &&
+        ranges.back().firstIndex + ranges.back().indexCount ==
+            meshlet.firstIndex) {
+      ranges.back().indexCount += meshlet.indexCount;
+    } else {
+      ranges.push_back({.firstIndex = meshlet.firstIndex,
+                        .indexCount = meshlet.indexCount});
+    }
+  }
+
+  return culledIndices / 3;
+}
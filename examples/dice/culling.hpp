@@ -0,0 +1,50 @@
+#ifndef CULLING_HPP_
+#define CULLING_HPP_
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "abcg.hpp"
+#include "dices.hpp"
+#include "transforms.hpp"
+
+// Planes of a view frustum, with normals pointing inwards. A point p is inside
+// the half-space of a plane if dot(plane, vec4(p, 1)) >= 0
+struct Frustum {
+  std::array<glm::vec4, 6> planes{};
+};
+
+// Extracts the planes of the frustum of a projection * view matrix, in world
+// space. The planes are normalized, so that the dot products are distances
+Frustum extractFrustum(glm::mat4 const &viewProjMatrix);
+
+// Tests the bounding sphere of each die, given in model space and transformed
+// by its model matrix, against the frustum. Sets visibility[i] to 1 if die i
+// may be visible and to 0 otherwise, and returns the number of visible dice.
+//
+// The model matrices must be a rotation times a uniform scale followed by a
+// translation, as computed by computeDiceTransforms. The dice are processed in
+// blocks, with one die per SIMD lane.
+std::size_t cullDiceSpheres(std::span<DiceTransform const> transforms,
+                            BoundingSphere const &sphere,
+                            Frustum const &frustum,
+                            std::span<std::uint8_t> visibility);
+
+// Appends to ranges the index ranges of the meshlets of a die that may be
+// visible, merging the ones that are adjacent in the index buffer, and returns
+// the number of triangles culled. A meshlet is culled if its bounding sphere
+// is outside the frustum, or if all of its triangles face away from the
+// camera. Both the frustum and the camera position are given in model space,
+// as extracted from projMatrix * viewMatrix * modelMatrix.
+//
+// The backface test is conservative: the cone of the normals, widened by the
+// angle the bounding sphere subtends from the camera, must be entirely
+// behind the plane perpendicular to the view direction.
+std::size_t cullMeshlets(std::span<Meshlet const> meshlets,
+                         Frustum const &frustum,
+                         glm::vec3 const &cameraPosition,
+                         std::vector<MeshLod> &ranges);
+
+#endif
@@ -1,22 +1,81 @@
 #include "dices.hpp"
 #include <fmt/core.h>
 #include <tiny_obj_loader.h>
-#include <glm/gtx/fast_trigonometry.hpp>
+#include <glm/gtx/component_wise.hpp>
 #include <cppitertools/itertools.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <filesystem>
-#include <glm/gtx/hash.hpp>
+#include <limits>
+#include <numeric>
+#include <optional>
 #include <unordered_map>
 
-// Explicit specialization of std::hash for Vertex
-template <> struct std::hash<Vertex> {
-  size_t operator()(Vertex const &vertex) const noexcept {
-    auto const h1{std::hash<glm::vec3>()(vertex.position)};
-    auto const h2{std::hash<glm::vec3>()(vertex.normal)};
-    auto const h3{std::hash<glm::vec2>()(vertex.texCoord)};
-    return abcg::hashCombine(h1, h2, h3);
-  }
+namespace {
+// Largest meshlets, as in the usual limits of mesh shaders
+constexpr std::size_t maxMeshletVertices{64};
+constexpr std::size_t maxMeshletTriangles{124};
+
+// Stride of the elements of the Materials uniform block (std140)
+static_assert(sizeof(Material) == 64);
+
+struct DiceFace {
+  glm::vec3 normal;
+  int value;
 };
 
+// Outward normals of the faces of assets/dice.obj, in model space, and their
+// number of pips. The model is not aligned with the axes. Standardizing the
+// model only translates and scales it, so the normals are kept
+constexpr std::array<DiceFace, 6> diceFaces{{
+    {{+0.9445f, +0.3050f, -0.1223f}, 1},
+    {{+0.2145f, -0.3098f, +0.9263f}, 2},
+    {{-0.2468f, +0.8998f, +0.3597f}, 3},
+    {{+0.2446f, -0.8999f, -0.3610f}, 4},
+    {{-0.2161f, +0.3117f, -0.9253f}, 5},
+    {{-0.9454f, -0.3041f, +0.1176f}, 6},
+}};
+
+// Angular speeds are given per frame at this rate, as in the original
+// frame-based integration
+constexpr float referenceFrameRate{60.0f};
+
+// Squared distance between the centers of two dice in contact
+constexpr float contactDistance2{1.0f};
+// Half the side of the box that holds the dice
+constexpr float wallDistance{5.0f};
+
+// Cell of the contact grid of a die. Same as in sim_step.comp
+glm::ivec3 gridCell(glm::vec3 const &position) {
+  return glm::clamp(glm::ivec3{glm::floor(position - Dices::gridOrigin)},
+                    glm::ivec3{0}, glm::ivec3{Dices::gridCells - 1});
+}
+
+std::size_t cellIndex(glm::ivec3 const &cell) {
+  return gsl::narrow<std::size_t>(
+      cell.x + Dices::gridCells * (cell.y + Dices::gridCells * cell.z));
+}
+
+// PCG hash by Jarzynski and Olano, "Hash Functions for GPU Rendering" (2020)
+constexpr std::uint32_t pcgHash(std::uint32_t value) {
+  auto const state{value * 747796405U + 2891336453U};
+  auto const word{((state >> ((state >> 28U) + 4U)) ^ state) * 277803737U};
+  return (word >> 22U) ^ word;
+}
+
+// Uniform random number in [0, 1) given by a counter instead of a sequence.
+// Same as randomFloat in sim_step.comp
+float randomFloat(std::uint32_t seed, std::uint32_t index,
+                  std::uint32_t counter, std::uint32_t draw) {
+  auto hash{pcgHash(seed)};
+  hash = pcgHash(hash ^ index);
+  hash = pcgHash(hash ^ counter);
+  hash = pcgHash(hash ^ draw);
+  return static_cast<float>(hash >> 8U) * (1.0f / 16777216.0f);
+}
+} // namespace
+
 void Dices::computeNormals() {
   // Clear previous vertex normals
   for (auto &vertex : m_vertices) {
@@ -53,6 +112,8 @@ void Dices::createBuffers() {
   // Delete previous buffers
   abcg::glDeleteBuffers(1, &m_EBO);
   abcg::glDeleteBuffers(1, &m_VBO);
+  abcg::glDeleteBuffers(1, &m_positionVBO);
+  abcg::glDeleteVertexArrays(1, &m_depthVAO);
 
   // VBO
   abcg::glGenBuffers(1, &m_VBO);
@@ -69,17 +130,86 @@ void Dices::createBuffers() {
                      sizeof(m_indices.at(0)) * m_indices.size(),
                      m_indices.data(), GL_STATIC_DRAW);
   abcg::glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+  // Positions alone, so that depth-only passes fetch a third of the data
+  std::vector<glm::vec3> positions(m_vertices.size());
+  for (auto &&[position, vertex] : iter::zip(positions, m_vertices)) {
+    position = vertex.position;
+  }
+  abcg::glGenBuffers(1, &m_positionVBO);
+  abcg::glBindBuffer(GL_ARRAY_BUFFER, m_positionVBO);
+  abcg::glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * positions.size(),
+                     positions.data(), GL_STATIC_DRAW);
+
+  abcg::glGenVertexArrays(1, &m_depthVAO);
+  abcg::glBindVertexArray(m_depthVAO);
+  abcg::glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+  abcg::glEnableVertexAttribArray(0);
+  abcg::glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3),
+                              nullptr);
+  abcg::glBindVertexArray(0);
+  abcg::glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-void Dices::loadDiffuseTexture(std::string_view path) {
-  if (!std::filesystem::exists(path))
-    return;
+void Dices::setDiffuseTexture(std::string_view path) {
+  m_defaultDiffuseTexturePath = path;
+}
+
+void Dices::loadObj(std::string_view path, bool standardize) {
+  abcg::TraceScope const scope{"Dices::loadObj", "asset"};
 
+  parseObj(path, standardize);
+  createMaterials();
+  createBuffers();
+}
+
+// Packs the diffuse maps into the layers of a texture array, each file once,
+// and uploads the constants of the materials to a uniform buffer. All the
+// submeshes are then drawn with the same texture and buffer bound
+void Dices::createMaterials() {
   abcg::glDeleteTextures(1, &m_diffuseTexture);
-  m_diffuseTexture = abcg::loadOpenGLTexture({.path = path});
+  abcg::glDeleteBuffers(1, &m_materialUBO);
+  m_diffuseTexture = 0;
+
+  std::vector<std::string_view> layers;
+  auto const findLayer{[&layers](std::string_view path) -> GLint {
+    if (path.empty() || !std::filesystem::exists(path))
+      return -1;
+    auto const it{std::ranges::find(layers, path)};
+    if (it == layers.end()) {
+      layers.push_back(path);
+      return gsl::narrow<GLint>(layers.size() - 1);
+    }
+    return gsl::narrow<GLint>(std::distance(layers.begin(), it));
+  }};
+  for (auto &&[material, path] :
+       iter::zip(m_materials, m_diffuseTexturePaths)) {
+    material.diffuseLayer = findLayer(path);
+    if (material.diffuseLayer < 0)
+      material.diffuseLayer = findLayer(m_defaultDiffuseTexturePath);
+  }
+
+  // No mipmaps, as the minification filter of the maps is linear
+  if (!layers.empty()) {
+    m_diffuseTexture = abcg::loadOpenGLTextureArray(
+        {.paths = layers, .generateMipmaps = false});
+  }
+
+  // The block always has maxMaterials elements
+  std::vector<Material> materials(maxMaterials);
+  std::ranges::copy(m_materials, materials.begin());
+  abcg::glGenBuffers(1, &m_materialUBO);
+  abcg::glBindBuffer(GL_UNIFORM_BUFFER, m_materialUBO);
+  abcg::glBufferData(
+      GL_UNIFORM_BUFFER,
+      gsl::narrow<GLsizeiptr>(sizeof(Material) * materials.size()),
+      materials.data(), GL_STATIC_DRAW);
+  abcg::glBindBuffer(GL_UNIFORM_BUFFER, 0);
 }
 
-void Dices::loadObj(std::string_view path, bool standardize) {
+// Reads the mesh and materials without creating OpenGL objects. The triangles
+// are grouped by material into submeshes
+void Dices::parseObj(std::string_view path, bool standardize) {
   auto const basePath{std::filesystem::path{path}.parent_path().string() + "/"};
 
   tinyobj::ObjReaderConfig readerConfig;
@@ -103,6 +233,13 @@ void Dices::loadObj(std::string_view path, bool standardize) {
   auto const &shapes{reader.GetShapes()};
   auto const &materials{reader.GetMaterials()};
 
+  // One more material for the faces without any
+  if (materials.size() >= maxMaterials) {
+    throw abcg::RuntimeError(fmt::format(
+        "Failed to load model {} ({} materials, at most {} are supported)",
+        path, materials.size(), maxMaterials - 1));
+  }
+
   m_vertices.clear();
   m_indices.clear();
 
@@ -112,6 +249,9 @@ void Dices::loadObj(std::string_view path, bool standardize) {
   // A key:value map with key=Vertex and value=index
   std::unordered_map<Vertex, GLuint> hash{};
 
+  // Indices of the triangles of each material
+  std::vector<std::vector<GLuint>> submeshIndices(materials.size() + 1);
+
   // Loop over shapes
   for (auto const &shape : shapes) {
     // Loop over indices
@@ -119,6 +259,12 @@ void Dices::loadObj(std::string_view path, bool standardize) {
       // Access to vertex
       auto const index{shape.mesh.indices.at(offset)};
 
+      // Material of the face, the default one if there is none
+      auto const materialId{shape.mesh.material_ids.at(offset / 3)};
+      auto const material{materialId < 0
+                              ? materials.size()
+                              : gsl::narrow<std::size_t>(materialId)};
+
       // Position
       auto const startIndex{3 * index.vertex_index};
       glm::vec3 position{attrib.vertices.at(startIndex + 0),
@@ -144,8 +290,10 @@ void Dices::loadObj(std::string_view path, bool standardize) {
                     attrib.texcoords.at(texCoordsStartIndex + 1)};
       }
 
-      Vertex const vertex{
-          .position = position, .normal = normal, .texCoord = texCoord};
+      Vertex const vertex{.position = position,
+                          .normal = normal,
+                          .texCoord = texCoord,
+                          .material = gsl::narrow<GLuint>(material)};
 
       // If hash doesn't contain this vertex
       if (!hash.contains(vertex)) {
@@ -155,59 +303,341 @@ void Dices::loadObj(std::string_view path, bool standardize) {
         m_vertices.push_back(vertex);
       }
 
-      m_indices.push_back(hash[vertex]);
+      submeshIndices.at(material).push_back(hash[vertex]);
     }
   }
 
-  // Use properties of first material, if available
-  if (!materials.empty()) {
-    auto const &mat{materials.at(0)}; // First material
-    m_Ka = {mat.ambient[0], mat.ambient[1], mat.ambient[2], 1};
-    m_Kd = {mat.diffuse[0], mat.diffuse[1], mat.diffuse[2], 1};
-    m_Ks = {mat.specular[0], mat.specular[1], mat.specular[2], 1};
-    m_shininess = mat.shininess;
-
-    if (!mat.diffuse_texname.empty())
-      loadDiffuseTexture(basePath + mat.diffuse_texname);
-  } else {
-    // Default values
-    m_Ka = {0.1f, 0.1f, 0.1f, 1.0f};
-    m_Kd = {0.7f, 0.7f, 0.7f, 1.0f};
-    m_Ks = {1.0f, 1.0f, 1.0f, 1.0f};
-    m_shininess = 25.0f;
+  // Materials of the model, and the default values for the faces without any
+  m_materials.clear();
+  m_diffuseTexturePaths.clear();
+  for (auto const &mat : materials) {
+    m_materials.push_back(
+        {.Ka = {mat.ambient[0], mat.ambient[1], mat.ambient[2], 1},
+         .Kd = {mat.diffuse[0], mat.diffuse[1], mat.diffuse[2], 1},
+         .Ks = {mat.specular[0], mat.specular[1], mat.specular[2], 1},
+         .shininess = mat.shininess});
+    m_diffuseTexturePaths.push_back(
+        mat.diffuse_texname.empty() ? "" : basePath + mat.diffuse_texname);
+  }
+  m_materials.emplace_back();
+  m_diffuseTexturePaths.emplace_back();
+
+  // Submeshes in the order of the materials
+  m_submeshes.clear();
+  for (auto &&[material, indices] : iter::enumerate(submeshIndices)) {
+    if (indices.empty())
+      continue;
+    m_submeshes.push_back(
+        {.firstIndex = gsl::narrow<GLuint>(m_indices.size()),
+         .indexCount = gsl::narrow<GLuint>(indices.size()),
+         .material = gsl::narrow<GLuint>(material)});
+    m_indices.insert(m_indices.end(), indices.begin(), indices.end());
   }
 
   if (standardize) {
     Dices::standardize();
   }
+  computeBounds();
 
   if (!m_hasNormals) {
     computeNormals();
   }
 
-  createBuffers();
+  buildMeshlets();
+  buildLods();
 }
 
-void Dices::render(int numTriangles) const {
-  abcg::glBindVertexArray(m_VAO);
+// Appends coarser copies of the mesh, made by vertex clustering: the
+// vertices in each cell of a grid are merged into their average, and the
+// triangles that collapse are dropped. Only vertices of the same material are
+// merged, so that the submeshes keep their edges. The full mesh stays at the
+// start of the buffers, so it is drawn as before
+void Dices::buildLods() {
+  abcg::TraceScope const scope{"Dices::buildLods", "asset"};
+
+  auto const fullIndexCount{m_indices.size()};
+  auto const fullVertexCount{m_vertices.size()};
+  m_lods = {{.firstIndex = 0,
+             .indexCount = gsl::narrow<GLuint>(fullIndexCount)}};
+  if (fullVertexCount == 0)
+    return;
+
+  glm::vec3 max(std::numeric_limits<float>::lowest());
+  glm::vec3 min(std::numeric_limits<float>::max());
+  for (auto const &vertex : m_vertices) {
+    max = glm::max(max, vertex.position);
+    min = glm::min(min, vertex.position);
+  }
+
+  // Number of cells along the largest side of the bounding box
+  for (auto const gridSize : {24.0f, 10.0f}) {
+    auto const cellSize{glm::compMax(max - min) / gridSize};
+
+    std::unordered_map<glm::ivec4, GLuint> cells;
+    std::vector<GLuint> remap(fullVertexCount);
+    std::vector<int> counts;
+    auto const firstVertex{m_vertices.size()};
+
+    for (auto const index : iter::range(fullVertexCount)) {
+      auto const vertex{m_vertices[index]};
+      glm::ivec4 const cell{glm::floor((vertex.position - min) / cellSize),
+                            vertex.material};
+      auto [it, inserted]{cells.try_emplace(
+          cell, gsl::narrow<GLuint>(m_vertices.size()))};
+      if (inserted) {
+        m_vertices.push_back({.material = vertex.material});
+        counts.push_back(0);
+      }
+      auto &cluster{m_vertices[it->second]};
+      cluster.position += vertex.position;
+      cluster.normal += vertex.normal;
+      cluster.texCoord += vertex.texCoord;
+      ++counts[it->second - firstVertex];
+      remap[index] = it->second;
+    }
+
+    for (auto const index : iter::range(counts.size())) {
+      auto &cluster{m_vertices[firstVertex + index]};
+      auto const count{gsl::narrow<float>(counts[index])};
+      cluster.position /= count;
+      cluster.texCoord /= count;
+      if (glm::length(cluster.normal) > 0.0f)
+        cluster.normal = glm::normalize(cluster.normal);
+    }
+
+    MeshLod lod{.firstIndex = gsl::narrow<GLuint>(m_indices.size())};
+    for (auto const offset : iter::range<std::size_t>(0, fullIndexCount, 3)) {
+      auto const a{remap[m_indices[offset + 0]]};
+      auto const b{remap[m_indices[offset + 1]]};
+      auto const c{remap[m_indices[offset + 2]]};
+      if (a == b || b == c || c == a)
+        continue;
+      m_indices.insert(m_indices.end(), {a, b, c});
+    }
+    lod.indexCount =
+        gsl::narrow<GLuint>(m_indices.size()) - lod.firstIndex;
+    m_lods.push_back(lod);
+  }
+}
+
+// Reorders the triangles of the full-detail mesh into meshlets, grown
+// greedily from a seed triangle: the next triangle is the one adjacent to the
+// meshlet that adds the fewest vertices, and then the nearest to its center,
+// until it reaches the limits of vertices or triangles or runs out of
+// neighbors. A meshlet does not cross the end of its submesh, so the submeshes
+// keep their ranges. Must be called before buildLods, which appends to the
+// indices
+void Dices::buildMeshlets() {
+  abcg::TraceScope const scope{"Dices::buildMeshlets", "asset"};
+
+  m_meshlets.clear();
+  auto const triangleCount{m_indices.size() / 3};
+  auto const position{[this](GLuint index) {
+    return m_vertices[index].position;
+  }};
+  auto const centroid{[&](std::size_t triangle) {
+    return (position(m_indices[triangle * 3 + 0]) +
+            position(m_indices[triangle * 3 + 1]) +
+            position(m_indices[triangle * 3 + 2])) /
+           3.0f;
+  }};
+
+  // Triangles that use each vertex, in compressed rows
+  std::vector<std::size_t> adjacencyOffsets(m_vertices.size() + 1);
+  for (auto const index : m_indices) {
+    ++adjacencyOffsets[index + 1];
+  }
+  for (auto const vertex : iter::range(m_vertices.size())) {
+    adjacencyOffsets[vertex + 1] += adjacencyOffsets[vertex];
+  }
+  std::vector<std::size_t> adjacency(m_indices.size());
+  {
+    auto next{adjacencyOffsets};
+    for (auto const offset : iter::range(m_indices.size())) {
+      adjacency[next[m_indices[offset]]++] = offset / 3;
+    }
+  }
+
+  std::vector<bool> used(triangleCount);
+  // Meshlet that last used each vertex, plus one
+  std::vector<std::size_t> vertexMeshlet(m_vertices.size());
+  std::vector<std::size_t> candidates;
+  std::vector<GLuint> indices;
+  indices.reserve(m_indices.size());
+
+  // End of the submesh of the seed, in triangles. The seeds are taken in
+  // order, so the triangles of the previous submeshes are all used
+  std::size_t submeshEnd{};
+  auto nextSubmesh{m_submeshes.begin()};
+
+  for (auto const seed : iter::range(triangleCount)) {
+    if (used[seed])
+      continue;
+    while (seed >= submeshEnd && nextSubmesh != m_submeshes.end()) {
+      submeshEnd = (nextSubmesh->firstIndex + nextSubmesh->indexCount) / 3;
+      ++nextSubmesh;
+    }
+
+    auto const meshletId{m_meshlets.size() + 1};
+    Meshlet meshlet{.firstIndex = gsl::narrow<GLuint>(indices.size())};
+    std::size_t vertexCount{};
+    std::size_t meshletTriangles{};
+    glm::vec3 centroidSum{};
+
+    auto const newVertices{[&](std::size_t triangle) {
+      std::size_t count{};
+      for (auto const corner : iter::range<std::size_t>(3)) {
+        if (vertexMeshlet[m_indices[triangle * 3 + corner]] != meshletId)
+          ++count;
+      }
+      return count;
+    }};
+    auto const add{[&](std::size_t triangle) {
+      used[triangle] = true;
+      ++meshletTriangles;
+      centroidSum += centroid(triangle);
+      for (auto const corner : iter::range<std::size_t>(3)) {
+        auto const vertex{m_indices[triangle * 3 + corner]};
+        indices.push_back(vertex);
+        if (vertexMeshlet[vertex] == meshletId)
+          continue;
+        vertexMeshlet[vertex] = meshletId;
+        ++vertexCount;
+        auto const first{adjacency.begin() +
+                         gsl::narrow<std::ptrdiff_t>(adjacencyOffsets[vertex])};
+        auto const last{adjacency.begin() + gsl::narrow<std::ptrdiff_t>(
+                                                adjacencyOffsets[vertex + 1])};
+        candidates.insert(candidates.end(), first, last);
+      }
+    }};
+
+    candidates.clear();
+    add(seed);
+    while (meshletTriangles < maxMeshletTriangles) {
+      std::erase_if(candidates,
+                    [&used](auto triangle) { return used[triangle]; });
+
+      auto const center{centroidSum / gsl::narrow<float>(meshletTriangles)};
+      std::optional<std::size_t> best;
+      std::size_t bestNewVertices{};
+      float bestDistance{};
+      for (auto const triangle : candidates) {
+        if (triangle >= submeshEnd)
+          continue;
+        auto const count{newVertices(triangle)};
+        if (vertexCount + count > maxMeshletVertices)
+          continue;
+        auto const distance{glm::distance(centroid(triangle), center)};
+        if (!best || count < bestNewVertices ||
+            (count == bestNewVertices && distance < bestDistance)) {
+          best = triangle;
+          bestNewVertices = count;
+          bestDistance = distance;
+        }
+      }
+      if (!best)
+        break;
+      add(*best);
+    }
 
+    meshlet.indexCount =
+        gsl::narrow<GLuint>(indices.size()) - meshlet.firstIndex;
+    m_meshlets.push_back(meshlet);
+  }
+  m_indices = std::move(indices);
+
+  // Bounding spheres centered on the bounding boxes, and normal cones around
+  // the area-weighted average of the face normals
+  for (auto &meshlet : m_meshlets) {
+    std::span const meshletIndices{m_indices.data() + meshlet.firstIndex,
+                                   meshlet.indexCount};
+
+    glm::vec3 max(std::numeric_limits<float>::lowest());
+    glm::vec3 min(std::numeric_limits<float>::max());
+    for (auto const index : meshletIndices) {
+      max = glm::max(max, position(index));
+      min = glm::min(min, position(index));
+    }
+    meshlet.center = (min + max) / 2.0f;
+    meshlet.radius = 0.0f;
+    for (auto const index : meshletIndices) {
+      meshlet.radius = std::max(meshlet.radius,
+                                glm::distance(meshlet.center, position(index)));
+    }
+
+    std::vector<glm::vec3> normals;
+    glm::vec3 axis{};
+    for (auto const offset :
+         iter::range<std::size_t>(0, meshletIndices.size(), 3)) {
+      auto const a{position(meshletIndices[offset + 0])};
+      auto const b{position(meshletIndices[offset + 1])};
+      auto const c{position(meshletIndices[offset + 2])};
+      auto const normal{glm::cross(b - a, c - a)};
+      axis += normal;
+      // Degenerate triangles are never rasterized
+      if (glm::length(normal) > 0.0f)
+        normals.push_back(glm::normalize(normal));
+    }
+    meshlet.coneCutoff = 1.0f;
+    if (glm::length(axis) == 0.0f)
+      continue;
+    meshlet.coneAxis = glm::normalize(axis);
+    auto minDot{1.0f};
+    for (auto const &normal : normals) {
+      minDot = std::min(minDot, glm::dot(meshlet.coneAxis, normal));
+    }
+    if (minDot > 0.0f)
+      meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+  }
+}
+
+// The filtering and wrapping of the maps are set by loadOpenGLTextureArray
+void Dices::bindMaterials() const {
   abcg::glActiveTexture(GL_TEXTURE0);
-  abcg::glBindTexture(GL_TEXTURE_2D, m_diffuseTexture);
+  abcg::glBindTexture(GL_TEXTURE_2D_ARRAY, m_diffuseTexture);
+  abcg::glBindBufferBase(GL_UNIFORM_BUFFER, materialBinding, m_materialUBO);
+}
+
+void Dices::render(int numTriangles) const {
+  bind();
+  draw(numTriangles);
+  abcg::glBindVertexArray(0);
+}
 
-  // Set minification and magnification parameters
-  abcg::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  abcg::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+void Dices::bind() const {
+  abcg::glBindVertexArray(m_VAO);
+  bindMaterials();
+}
 
-  // Set texture wrapping parameters
-  abcg::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  abcg::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+void Dices::bindDepth() const { abcg::glBindVertexArray(m_depthVAO); }
 
-  auto const numIndices{(numTriangles < 0) ? m_indices.size()
+void Dices::draw(int numTriangles) const {
+  auto const numIndices{(numTriangles < 0) ? m_lods.front().indexCount
                                            : numTriangles * 3};
 
   abcg::glDrawElements(GL_TRIANGLES, numIndices, GL_UNSIGNED_INT, nullptr);
+}
 
-  abcg::glBindVertexArray(0);
+void Dices::draw(std::span<MeshLod const> ranges) {
+#if !defined(__EMSCRIPTEN__)
+  // Submit all ranges at once where glMultiDrawElements is available
+  m_drawCounts.clear();
+  m_drawOffsets.clear();
+  for (auto const &range : ranges) {
+    m_drawCounts.push_back(gsl::narrow<GLsizei>(range.indexCount));
+    m_drawOffsets.push_back(
+        reinterpret_cast<void const *>(range.firstIndex * sizeof(GLuint)));
+  }
+  abcg::glMultiDrawElements(GL_TRIANGLES, m_drawCounts.data(),
+                            GL_UNSIGNED_INT, m_drawOffsets.data(),
+                            gsl::narrow<GLsizei>(m_drawCounts.size()));
+#else
+  for (auto const &range : ranges) {
+    abcg::glDrawElements(
+        GL_TRIANGLES, gsl::narrow<GLsizei>(range.indexCount), GL_UNSIGNED_INT,
+        reinterpret_cast<void *>(range.firstIndex * sizeof(GLuint)));
+  }
+#endif
 }
 
 void Dices::setupVAO(GLuint program) {
@@ -250,6 +680,16 @@ void Dices::setupVAO(GLuint program) {
                                 reinterpret_cast<void *>(offset));
   }
 
+  auto const materialAttribute{
+      abcg::glGetAttribLocation(program, "inMaterial")};
+  if (materialAttribute >= 0) {
+    abcg::glEnableVertexAttribArray(materialAttribute);
+    auto const offset{offsetof(Vertex, material)};
+    abcg::glVertexAttribIPointer(materialAttribute, 1, GL_UNSIGNED_INT,
+                                 sizeof(Vertex),
+                                 reinterpret_cast<void *>(offset));
+  }
+
   // End of binding
   abcg::glBindBuffer(GL_ARRAY_BUFFER, 0);
   abcg::glBindVertexArray(0);
@@ -274,16 +714,40 @@ void Dices::standardize() {
   }
 }
 
+// Centers the sphere in the bounding box of the mesh, as in standardize. After
+// standardization, the center is the origin and the radius is at most 1
+void Dices::computeBounds() {
+  glm::vec3 max(std::numeric_limits<float>::lowest());
+  glm::vec3 min(std::numeric_limits<float>::max());
+  for (auto const &vertex : m_vertices) {
+    max = glm::max(max, vertex.position);
+    min = glm::min(min, vertex.position);
+  }
+
+  m_boundingBox = {.min = min, .max = max};
+  m_boundingSphere = {.center = (min + max) / 2.0f, .radius = 0.0f};
+  for (auto const &vertex : m_vertices) {
+    m_boundingSphere.radius =
+        std::max(m_boundingSphere.radius,
+                 glm::distance(vertex.position, m_boundingSphere.center));
+  }
+}
+
 void Dices::destroy(){
   abcg::glDeleteTextures(1, &m_diffuseTexture);
+  abcg::glDeleteBuffers(1, &m_materialUBO);
   abcg::glDeleteBuffers(1, &m_EBO);
   abcg::glDeleteBuffers(1, &m_VBO);
+  abcg::glDeleteBuffers(1, &m_positionVBO);
   abcg::glDeleteVertexArrays(1, &m_VAO);
+  abcg::glDeleteVertexArrays(1, &m_depthVAO);
 }
 
 void Dices::create(int quantity){
   auto seed{std::chrono::steady_clock::now().time_since_epoch().count()};
   m_randomEngine.seed(seed);
+  m_seed = static_cast<std::uint32_t>(seed);
+  m_stepCount = 0;
 
   m_dices.clear();
   m_dices.resize(quantity);
@@ -313,88 +777,215 @@ void Dices::jogarDado(Dice &dice) {
   dice.dadoGirando = true;
 }
 
+void Dices::roll() {
+  for (auto &dice : m_dices) {
+    jogarDado(dice);
+  }
+}
+
+void Dices::copyStates(std::vector<DiceState> &states) const {
+  states.resize(m_dices.size());
+  for (auto const index : iter::range(m_dices.size())) {
+    states[index] = {.position = m_dices[index].position,
+                     .orientation = m_dices[index].orientation};
+  }
+}
+
+bool Dices::isRolling() const {
+  return std::ranges::any_of(m_dices,
+                             [](auto const &dice) { return dice.dadoGirando; });
+}
+
+// Returns the number of pips of the face that points up (+y). The up vector is
+// brought to model space, so that it is compared with each face normal by a
+// single dot product
+int Dices::getFaceUp(glm::quat const &orientation) {
+  auto const up{glm::conjugate(orientation) * glm::vec3{0.0f, 1.0f, 0.0f}};
+  return std::ranges::max(diceFaces, {}, [&up](auto const &face) {
+           return glm::dot(face.normal, up);
+         }).value;
+}
+
+// Collisions are checked against the state at the start of the step, so that
+// the result does not depend on the order of the dice. Nothing collides while
+// every die rests, so that state is only kept while some die spins. The
+// compute shader in sim_step.comp does the same step, one die per invocation
 void Dices::update(float deltaTime) {
-  
-  for(auto &dice : m_dices) {
+  abcg::TraceScope const scope{"Dices::update", "dice"};
+
+  ++m_stepCount;
+
+  // Time spent in collision checks, summed over all dice
+  double collisionTime{};
+  int spinningDice{};
+
+  auto const rolling{isRolling()};
+  if (rolling) {
+    abcg::ScopedTimer const timer{collisionTime};
+    m_previousDices = m_dices;
+    findContacts();
+  }
+
+  for (auto &&[index, dice] : iter::enumerate(m_dices)) {
+    auto const wasSpinning{dice.dadoGirando};
 
     dice.spinSpeed -= dice.decayRate * deltaTime;
     dice.spinSpeed = std::max(dice.spinSpeed, 0.0f);
 
-    if(dice.dadoGirando)
+    if (rolling) {
+      abcg::ScopedTimer const timer{collisionTime};
+      checkCollisions(index);
+    }
+
+    if(wasSpinning)
     {
-      checkCollisions(dice);
+      ++spinningDice;
 
       dice.timeLeft -= deltaTime;
 
-      for (auto const i: iter::range<int>(dice.DoRotateAxis.length()) )
-      {
-        if(dice.DoRotateAxis[i]) 
-          dice.rotationAngle[i] = glm::wrapAngle(dice.rotationAngle[i] + glm::radians(dice.spinSpeed) * dice.timeLeft);
+      dice.angularVelocity = dice.spinAxis * glm::radians(dice.spinSpeed) *
+                             dice.timeLeft * referenceFrameRate;
+      integrateOrientation(dice, deltaTime);
 
-        if(dice.DoTranslateAxis[i] != 0)
-          dice.position[i] = dice.position[i] + dice.spinSpeed * dice.timeLeft * dice.DoTranslateAxis[i] * 0.0025f;   
-      }
+      // Also given per frame at the reference rate, as the spin speed
+      auto const distance{dice.spinSpeed * dice.timeLeft * 0.0025f *
+                          deltaTime * referenceFrameRate};
+      dice.position += distance * glm::vec3{dice.DoTranslateAxis};
 
     }
 
     if(dice.dadoGirando && dice.timeLeft <= 0){
       dice.dadoGirando = false;
+      dice.angularVelocity = glm::vec3{0.0f};
     }
   }
+
+  abcg::Tracer::counter("Dices::checkCollisions (ms)", collisionTime * 1000.0);
+  abcg::Tracer::counter("Spinning dice", spinningDice);
 }
 
 void Dices::alterarSpin(Dice &dice) {
   std::uniform_real_distribution<float> fdist(1.0f, 5.0f);
   dice.timeLeft = fdist(m_randomEngine);
-  dice.DoRotateAxis = {0, 0, 0};
+  dice.spinAxis = {0.0f, 0.0f, 0.0f};
   std::uniform_int_distribution<int> idist(0,2);
-  dice.DoRotateAxis[idist(m_randomEngine)] = 1;
+  dice.spinAxis[idist(m_randomEngine)] = 1.0f;
 }
 
-void Dices::checkCollisions(Dice &current_dice){
-  bool has_colision{false};
+// Spin given in a collision, about a random axis of the model
+void Dices::alterarSpin(Dice &dice, std::uint32_t index) const {
+  auto const random{[this, index](std::uint32_t draw) {
+    return randomFloat(m_seed, index, m_stepCount, draw);
+  }};
+  dice.timeLeft = 1.0f + 4.0f * random(0);
 
-  for(auto &dice : m_dices) {
-
-    if(&dice == &current_dice) continue;
+  dice.spinAxis = {0.0f, 0.0f, 0.0f};
+  dice.spinAxis[std::min(static_cast<int>(random(1) * 3.0f), 2)] = 1.0f;
+}
 
-    const auto distance{
-      glm::distance(dice.position, current_dice.position)};
+// Rotates the die by its angular velocity during deltaTime. The rotation of
+// the step is exact for a constant velocity, and the result is normalized so
+// that rounding errors do not accumulate over long runs
+void Dices::integrateOrientation(Dice &dice, float deltaTime) {
+  auto const step{dice.angularVelocity * deltaTime};
+  auto const angle{glm::length(step)};
+  if (angle <= 0.0f)
+    return;
 
-    if (distance > 1.0f) continue;
+  // The velocity is in model space, so the step is applied on the right
+  auto const rotation{glm::angleAxis(angle, step / angle)};
+  dice.orientation = glm::normalize(dice.orientation * rotation);
+}
 
-    if(!current_dice.dadoColidindo) {
-      current_dice.dadoColidindo = true;
-      current_dice.DoTranslateAxis *= -1;
-      has_colision = true;
-    }
+// Finds the contacts of the spinning dice at the start of the step. The dice
+// are sorted into the cells of the grid by a counting sort, as in
+// sim_grid.comp and sim_scan.comp, so that each spinning die is only compared
+// with the dice in the 27 cells around it. A resting die only reacts to the
+// spinning dice it touches, so its contacts are found from their side
+void Dices::findContacts() {
+  abcg::TraceScope const scope{"Dices::findContacts", "dice"};
+
+  constexpr auto cellCount{
+      static_cast<std::size_t>(gridCells * gridCells * gridCells)};
+  m_cellStarts.assign(cellCount + 1, 0);
+  for (auto const &dice : m_previousDices) {
+    ++m_cellStarts[cellIndex(gridCell(dice.position))];
+  }
+  // Each count becomes the end of its cell, which is filled backwards until it
+  // is the start
+  std::inclusive_scan(m_cellStarts.begin(), m_cellStarts.end(),
+                      m_cellStarts.begin());
+  m_sortedDice.resize(m_previousDices.size());
+  for (auto &&[index, dice] : iter::enumerate(m_previousDices)) {
+    m_sortedDice[--m_cellStarts[cellIndex(gridCell(dice.position))]] = index;
+  }
 
-    if(!dice.dadoColidindo) {
-      dice.dadoColidindo = true;
-      dice.DoTranslateAxis = current_dice.DoTranslateAxis * (-1);
-      alterarSpin(dice);
-      dice.dadoGirando = true;
+  m_contacts.assign(m_previousDices.size(), {});
+  for (auto &&[index, dice] : iter::enumerate(m_previousDices)) {
+    if (!dice.dadoGirando)
+      continue;
+
+    auto const first{glm::max(gridCell(dice.position) - 1, 0)};
+    auto const last{glm::min(gridCell(dice.position) + 1, gridCells - 1)};
+    for (auto const z : iter::range(first.z, last.z + 1)) {
+      for (auto const y : iter::range(first.y, last.y + 1)) {
+        for (auto const x : iter::range(first.x, last.x + 1)) {
+          auto const cell{cellIndex({x, y, z})};
+          for (auto const slot :
+               iter::range(m_cellStarts[cell], m_cellStarts[cell + 1])) {
+            auto const otherIndex{m_sortedDice[slot]};
+            if (otherIndex == index)
+              continue;
+
+            auto const offset{m_previousDices[otherIndex].position -
+                              dice.position};
+            if (glm::dot(offset, offset) > contactDistance2)
+              continue;
+
+            m_contacts[index].any = true;
+            auto &spinning{m_contacts[otherIndex].spinning};
+            spinning = std::min(spinning, index);
+          }
+        }
+      }
     }
   }
-  
-  if(!has_colision)
-  {
-    current_dice.dadoColidindo = false;
-  }
+}
 
-  for (auto const i: iter::range<int>(current_dice.position.length()) )
-  {
-    if(current_dice.position[i] > 5.0f){
-      current_dice.DoTranslateAxis[i] = -1;
-      has_colision = true;
+// Updates the direction and the spin of a die after its contacts with the
+// other dice and with the walls
+void Dices::checkCollisions(std::size_t index) {
+  auto &dice{m_dices[index]};
+  auto const &previous{m_previousDices[index]};
+  auto const &contact{m_contacts[index]};
+
+  auto hasCollision{false};
+  if (previous.dadoGirando) {
+    // A spinning die bounces back at the first step of a contact
+    if (contact.any && !previous.dadoColidindo) {
+      dice.DoTranslateAxis *= -1;
+      hasCollision = true;
     }
-    else if(current_dice.position[i] < -5.0f){
-      current_dice.DoTranslateAxis[i] = 1;
-      has_colision = true;
+    dice.dadoColidindo = hasCollision;
+
+    for (auto const i : iter::range(dice.position.length())) {
+      if (dice.position[i] > wallDistance) {
+        dice.DoTranslateAxis[i] = -1;
+        hasCollision = true;
+      } else if (dice.position[i] < -wallDistance) {
+        dice.DoTranslateAxis[i] = 1;
+        hasCollision = true;
+      }
     }
+  } else if (contact.spinning != noDice && !previous.dadoColidindo) {
+    // A resting die is pushed along the direction of the die that hits it
+    dice.dadoColidindo = true;
+    dice.DoTranslateAxis = m_previousDices[contact.spinning].DoTranslateAxis;
+    dice.dadoGirando = true;
+    hasCollision = true;
   }
-  
-  if(has_colision){
-    alterarSpin(current_dice);
+
+  if (hasCollision) {
+    alterarSpin(dice, gsl::narrow<std::uint32_t>(index));
   }
 }
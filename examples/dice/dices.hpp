@@ -2,77 +2,248 @@
 #define DICES_HPP_
 
 #include "abcgOpenGL.hpp"
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtx/hash.hpp>
+#include <cstdint>
+#include <limits>
 #include <random>
 #include <list>
+#include <span>
 
 class Window;
+class GpuCulling;
+class GpuSimulation;
+struct DicesBenchmark;
 
 struct Vertex {
   glm::vec3 position{};
   glm::vec3 normal{};
   glm::vec2 texCoord{};
-  glm::vec4 Ka;
-  glm::vec4 Kd;
-  glm::vec4 Ks;
-  float shininess;
+  // Index of the material in Dices::getMaterials
+  GLuint material{};
 
   friend bool operator==(Vertex const &, Vertex const &) = default;
 };
 
+// Explicit specialization of std::hash for Vertex
+template <> struct std::hash<Vertex> {
+  size_t operator()(Vertex const &vertex) const noexcept {
+    auto const h1{std::hash<glm::vec3>()(vertex.position)};
+    auto const h2{std::hash<glm::vec3>()(vertex.normal)};
+    auto const h3{std::hash<glm::vec2>()(vertex.texCoord)};
+    return abcg::hashCombine(h1, h2, h3);
+  }
+};
+
+// State of a die that is needed for rendering
+struct DiceState {
+  glm::vec3 position{};
+  glm::quat orientation{1.0f, 0.0f, 0.0f, 0.0f};
+};
+
+// Constants of a material, laid out as an element of the Materials uniform
+// block of dice.frag (std140)
+struct alignas(16) Material {
+  glm::vec4 Ka{0.1f, 0.1f, 0.1f, 1.0f};
+  glm::vec4 Kd{0.7f, 0.7f, 0.7f, 1.0f};
+  glm::vec4 Ks{1.0f, 1.0f, 1.0f, 1.0f};
+  float shininess{25.0f};
+  // Layer of the diffuse map in the texture array, or -1 if there is none
+  GLint diffuseLayer{-1};
+};
+
+// Range of the full-detail mesh in the index buffer drawn with one material
+struct Submesh {
+  GLuint firstIndex{};
+  GLuint indexCount{};
+  GLuint material{};
+};
+
+// Range of the index buffer with one level of detail of the mesh
+struct MeshLod {
+  GLuint firstIndex{};
+  GLuint indexCount{};
+};
+
+// Cluster of triangles of the full-detail mesh, contiguous in the index
+// buffer, with the bounds used to cull it as a whole
+struct Meshlet {
+  GLuint firstIndex{};
+  GLuint indexCount{};
+  // Sphere that encloses the vertices, in model space
+  glm::vec3 center{};
+  float radius{};
+  // Cone that contains the face normals: the axis, and the sine of the largest
+  // angle between the axis and a normal. The sine is 1 if the normals do not
+  // fit in a hemisphere, as the triangles never all face away together
+  glm::vec3 coneAxis{};
+  float coneCutoff{1.0f};
+};
+
+// Sphere that encloses the mesh, in model space
+struct BoundingSphere {
+  glm::vec3 center{};
+  float radius{};
+};
+
+// Axis-aligned box that encloses the mesh, in model space
+struct BoundingBox {
+  glm::vec3 min{};
+  glm::vec3 max{};
+};
+
 class Dices {
   public:
+    // Largest number of materials of a model. Same as the size of the
+    // Materials uniform block in the shaders
+    static constexpr std::size_t maxMaterials{16};
+    // Binding point of the Materials uniform block, the default of every
+    // program
+    static constexpr GLuint materialBinding{0};
+    // Uniform grid over the box of the dice, in which the contacts are found.
+    // Its cells are as large as the contact distance. Dice outside of it are
+    // put in the cells of its border
+    static constexpr int gridCells{12};
+    static constexpr float gridOrigin{-6.0f};
+
     void create(int quantity);
     void destroy();
-    void loadDiffuseTexture(std::string_view path);
+    // Sets the diffuse map of the materials without one of their own, used
+    // from the next call to loadObj
+    void setDiffuseTexture(std::string_view path);
     void loadObj(std::string_view path, bool standardize = true);
     void render(int numTriangles = -1) const;
+    // Same as render, split for drawing many dice with the same state: bind
+    // once, then draw each die with its own uniform variables
+    void bind() const;
+    // Binds the diffuse maps to texture unit 0 and the constants of the
+    // materials to materialBinding. Done by bind
+    void bindMaterials() const;
+    void draw(int numTriangles = -1) const;
+    // Same as draw, but with the given ranges of the index buffer only, such
+    // as the meshlets that pass cullMeshlets
+    void draw(std::span<MeshLod const> ranges);
+    // Binds the position-only vertex array, for depth-only passes, instead of
+    // the one of bind
+    void bindDepth() const;
     void setupVAO(GLuint program);
     void update(float deltaTime);
+    void roll();
+    void copyStates(std::vector<DiceState> &states) const;
     void standardize();
 
+  // Number of triangles of the full-detail mesh
   [[nodiscard]] int getNumTriangles() const {
-    return gsl::narrow<int>(m_indices.size()) / 3;
+    return gsl::narrow<int>(m_lods.front().indexCount) / 3;
+  }
+
+  // Levels of detail, from the full mesh to the coarsest one
+  [[nodiscard]] std::vector<MeshLod> const &getLods() const { return m_lods; }
+
+  // Meshlets of the full-detail mesh, which together cover its index range
+  [[nodiscard]] std::vector<Meshlet> const &getMeshlets() const {
+    return m_meshlets;
+  }
+
+  // Materials of the model, with a default one for the faces without any
+  [[nodiscard]] std::vector<Material> const &getMaterials() const {
+    return m_materials;
+  }
+
+  // Ranges of the full-detail mesh with each material, in the order of the
+  // materials. The meshlets and the levels of detail keep the triangles of
+  // a submesh together
+  [[nodiscard]] std::vector<Submesh> const &getSubmeshes() const {
+    return m_submeshes;
   }
 
-  [[nodiscard]] glm::vec4 getKa() const { return m_Ka; }
-  [[nodiscard]] glm::vec4 getKd() const { return m_Kd; }
-  [[nodiscard]] glm::vec4 getKs() const { return m_Ks; }
-  [[nodiscard]] float getShininess() const { return m_shininess; }
+  [[nodiscard]] BoundingSphere const &getBoundingSphere() const {
+    return m_boundingSphere;
+  }
+  [[nodiscard]] BoundingBox const &getBoundingBox() const {
+    return m_boundingBox;
+  }
 
   [[nodiscard]] bool isUVMapped() const { return m_hasTexCoords; }
+  [[nodiscard]] bool isRolling() const;
+
+  [[nodiscard]] static int getFaceUp(glm::quat const &orientation);
 
   private:
     friend Window;
+    friend GpuCulling;
+    friend GpuSimulation;
+    friend DicesBenchmark;
 
     GLuint m_VAO{};
     GLuint m_VBO{};
     GLuint m_EBO{};
+    // Tightly packed positions at location 0, sharing the EBO
+    GLuint m_positionVBO{};
+    GLuint m_depthVAO{};
 
     struct Dice {
-      glm::mat4 modelMatrix{1.0f};
       glm::vec3 position{0.0f};
-      glm::vec3 rotationAngle{};
+      // Rotation from the model space to the world space
+      glm::quat orientation{1.0f, 0.0f, 0.0f, 0.0f};
+      // Unit axis of rotation, in model space
+      glm::vec3 spinAxis{1.0f, 0.0f, 0.0f};
+      // In radians per second, in model space
+      glm::vec3 angularVelocity{};
       float timeLeft{0.0f};
       float spinSpeed{4.0f};
       float decayRate{0.2f};
       bool dadoGirando{false};
       bool dadoColidindo{false};
-      glm::ivec3 DoRotateAxis{};
       glm::ivec3 DoTranslateAxis{};
     };
 
-    glm::vec4 m_Ka{};
-    glm::vec4 m_Kd{};
-    glm::vec4 m_Ks{};
-    float m_shininess{};
+    static constexpr std::size_t noDice{
+        std::numeric_limits<std::size_t>::max()};
+
+    // Contacts of a die at the start of the step
+    struct Contact {
+      // Whether it touches another die. Only found for spinning dice
+      bool any{false};
+      // Lowest index of the spinning dice it touches, or noDice
+      std::size_t spinning{noDice};
+    };
+
+    std::vector<Material> m_materials;
+    std::vector<Submesh> m_submeshes;
+    // Path of the diffuse map of each material, and of the default one
+    std::vector<std::string> m_diffuseTexturePaths;
+    std::string m_defaultDiffuseTexturePath;
+    // Diffuse maps of the materials, one per layer
     GLuint m_diffuseTexture{};
+    GLuint m_materialUBO{};
 
     std::vector<Dice> m_dices;
 
     std::default_random_engine m_randomEngine;
+    // Key of the random spins given in collisions, which depend only on the
+    // seed, the die and the step, so that they are the same on the GPU
+    std::uint32_t m_seed{};
+    std::uint32_t m_stepCount{};
+    // State at the start of the current step
+    std::vector<Dice> m_previousDices;
+    std::vector<Contact> m_contacts;
+    // Dice sorted by the cell of the grid they are in, and the first index of
+    // each cell in m_sortedDice, followed by the number of dice
+    std::vector<std::size_t> m_sortedDice;
+    std::vector<std::size_t> m_cellStarts;
 
     std::vector<Vertex> m_vertices;
     std::vector<GLuint> m_indices;
+    std::vector<MeshLod> m_lods{{}};
+    std::vector<Meshlet> m_meshlets;
+    // Counts and offsets of the ranges of the last draw of ranges, kept to
+    // avoid allocating them in every draw
+    std::vector<GLsizei> m_drawCounts;
+    std::vector<void const *> m_drawOffsets;
+
+    BoundingSphere m_boundingSphere{};
+    BoundingBox m_boundingBox{};
 
     bool m_hasNormals{false};
     bool m_hasTexCoords{false};
@@ -80,9 +251,17 @@ class Dices {
     Dice inicializarDado();
     void jogarDado(Dice &);
     void alterarSpin(Dice&);
-    void checkCollisions(Dice&);
+    void alterarSpin(Dice &dice, std::uint32_t index) const;
+    static void integrateOrientation(Dice &dice, float deltaTime);
+    void findContacts();
+    void checkCollisions(std::size_t index);
+    void buildLods();
+    void buildMeshlets();
+    void computeBounds();
     void computeNormals();
     void createBuffers();
+    void createMaterials();
+    void parseObj(std::string_view path, bool standardize);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,486 @@
+#include "gpuculling.hpp"
+
+#include <cppitertools/itertools.hpp>
+
+#include "culling.hpp"
+
+#if !defined(__EMSCRIPTEN__)
+
+namespace {
+// Bindings of the storage buffers in cull.comp
+constexpr GLuint stateBinding{0};
+constexpr GLuint instanceBinding{1};
+constexpr GLuint commandBinding{2};
+
+// Locations of the per-instance attributes in dice_instanced.vert. A mat4
+// takes four locations and a mat3 takes three
+constexpr GLuint modelMatrixLocation{3};
+constexpr GLuint normalMatrixLocation{7};
+// Location of the per-vertex material, after the per-instance attributes
+constexpr GLuint materialLocation{10};
+
+constexpr GLuint workGroupSize{64};
+} // namespace
+
+bool GpuCulling::isSupported() {
+  return GLEW_VERSION_4_3 ||
+         (GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object &&
+          GLEW_ARB_multi_draw_indirect);
+}
+
+void GpuCulling::create(Dices const &dices, Impostors const &impostors,
+                        std::string const &shadersPath) {
+  destroy();
+
+  m_cullProgram = abcg::createOpenGLProgram(
+      {{.source = shadersPath + "cull.comp",
+        .stage = abcg::ShaderStage::Compute}});
+  m_renderProgram = abcg::createOpenGLProgram(
+      {{.source = shadersPath + "dice_instanced.vert",
+        .stage = abcg::ShaderStage::Vertex},
+       {.source = shadersPath + "dice.frag",
+        .stage = abcg::ShaderStage::Fragment}});
+  m_depthProgram = abcg::createOpenGLProgram(
+      {{.source = shadersPath + "depth_instanced.vert",
+        .stage = abcg::ShaderStage::Vertex},
+       {.source = shadersPath + "depth.frag",
+        .stage = abcg::ShaderStage::Fragment}});
+
+  auto const location{[this](char const *name) {
+    return abcg::glGetUniformLocation(m_cullProgram, name);
+  }};
+  m_diceCountLoc = location("diceCount");
+  m_instanceCapacityLoc = location("instanceCapacity");
+  m_baseMatrixLoc = location("baseMatrix");
+  m_viewMatrixLoc = location("viewMatrix");
+  m_normalBaseMatrixLoc = location("normalBaseMatrix");
+  m_scaleLoc = location("scale");
+  m_projScaleLoc = location("projScale");
+  m_frustumPlanesLoc = location("frustumPlanes");
+  m_boundingSphereLoc = location("boundingSphere");
+  m_lodThresholdsLoc = location("lodThresholds");
+  m_lodCountLoc = location("lodCount");
+  m_impostorThresholdLoc = location("impostorThreshold");
+
+  m_lods = dices.getLods();
+  m_boundingSphere = dices.getBoundingSphere();
+  m_commands.resize(m_lods.size() + 1);
+  m_readbackCommands.resize(m_commands.size());
+
+  GLint storageAlignment{};
+  abcg::glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT,
+                      &storageAlignment);
+  m_storageAlignment = storageAlignment;
+  // Grows with the number of dice
+  m_stateStream.create(gsl::narrow<GLsizeiptr>(sizeof(GpuDiceState) * 1024));
+
+  abcg::glGenBuffers(1, &m_instanceBuffer);
+  abcg::glGenBuffers(1, &m_commandBuffer);
+
+  abcg::glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+  abcg::glBufferData(GL_DRAW_INDIRECT_BUFFER,
+                     gsl::narrow<GLsizeiptr>(sizeof(DrawCommand) *
+                                             m_commands.size()),
+                     nullptr, GL_DYNAMIC_DRAW);
+  abcg::glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+  abcg::glGenBuffers(1, &m_readbackBuffer);
+  abcg::glBindBuffer(GL_COPY_WRITE_BUFFER, m_readbackBuffer);
+  abcg::glBufferData(GL_COPY_WRITE_BUFFER,
+                     gsl::narrow<GLsizeiptr>(sizeof(DrawCommand) *
+                                             m_commands.size() *
+                                             readbackLatency),
+                     nullptr, GL_STREAM_READ);
+  abcg::glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  setupVAO(dices);
+  setupDepthVAO(dices);
+  setupImpostorVAO(impostors);
+}
+
+void GpuCulling::destroy() {
+  abcg::glDeleteProgram(m_cullProgram);
+  abcg::glDeleteProgram(m_renderProgram);
+  abcg::glDeleteProgram(m_depthProgram);
+  m_stateStream.destroy();
+  abcg::glDeleteVertexArrays(1, &m_VAO);
+  abcg::glDeleteVertexArrays(1, &m_depthVAO);
+  abcg::glDeleteVertexArrays(1, &m_impostorVAO);
+  abcg::glDeleteBuffers(1, &m_instanceBuffer);
+  abcg::glDeleteBuffers(1, &m_commandBuffer);
+  abcg::glDeleteBuffers(1, &m_readbackBuffer);
+  for (auto &fence : m_readbackFences) {
+    abcg::glDeleteSync(fence);
+    fence = nullptr;
+  }
+
+  m_cullProgram = 0;
+  m_renderProgram = 0;
+  m_depthProgram = 0;
+  m_VAO = 0;
+  m_depthVAO = 0;
+  m_impostorVAO = 0;
+  m_instanceBuffer = 0;
+  m_commandBuffer = 0;
+  m_readbackBuffer = 0;
+  m_readbackIndex = 0;
+  m_visibleCount = 0;
+  m_impostorCount = 0;
+  m_instanceCapacity = 0;
+}
+
+void GpuCulling::setupVAO(Dices const &dices) {
+  abcg::glGenVertexArrays(1, &m_VAO);
+  abcg::glBindVertexArray(m_VAO);
+
+  abcg::glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, dices.m_EBO);
+
+  // Per-vertex attributes, at the locations of dice_instanced.vert
+  abcg::glBindBuffer(GL_ARRAY_BUFFER, dices.m_VBO);
+  abcg::glEnableVertexAttribArray(0);
+  abcg::glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                              nullptr);
+  abcg::glEnableVertexAttribArray(1);
+  abcg::glVertexAttribPointer(
+      1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+      reinterpret_cast<void *>(offsetof(Vertex, normal)));
+  abcg::glEnableVertexAttribArray(2);
+  abcg::glVertexAttribPointer(
+      2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+      reinterpret_cast<void *>(offsetof(Vertex, texCoord)));
+  abcg::glEnableVertexAttribArray(materialLocation);
+  abcg::glVertexAttribIPointer(
+      materialLocation, 1, GL_UNSIGNED_INT, sizeof(Vertex),
+      reinterpret_cast<void *>(offsetof(Vertex, material)));
+
+  // Per-instance attributes, one location per matrix column
+  abcg::glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+  for (auto const column : iter::range<GLuint>(4)) {
+    auto const offset{offsetof(GpuInstance, modelMatrix) +
+                      column * sizeof(glm::vec4)};
+    abcg::glEnableVertexAttribArray(modelMatrixLocation + column);
+    abcg::glVertexAttribPointer(modelMatrixLocation + column, 4, GL_FLOAT,
+                                GL_FALSE, sizeof(GpuInstance),
+                                reinterpret_cast<void *>(offset));
+    abcg::glVertexAttribDivisor(modelMatrixLocation + column, 1);
+  }
+  for (auto const column : iter::range<GLuint>(3)) {
+    auto const offset{offsetof(GpuInstance, normalMatrix) +
+                      column * sizeof(glm::vec4)};
+    abcg::glEnableVertexAttribArray(normalMatrixLocation + column);
+    abcg::glVertexAttribPointer(normalMatrixLocation + column, 3, GL_FLOAT,
+                                GL_FALSE, sizeof(GpuInstance),
+                                reinterpret_cast<void *>(offset));
+    abcg::glVertexAttribDivisor(normalMatrixLocation + column, 1);
+  }
+
+  abcg::glBindBuffer(GL_ARRAY_BUFFER, 0);
+  abcg::glBindVertexArray(0);
+}
+
+// Same as setupVAO, but with the positions alone and the model matrices
+void GpuCulling::setupDepthVAO(Dices const &dices) {
+  abcg::glGenVertexArrays(1, &m_depthVAO);
+  abcg::glBindVertexArray(m_depthVAO);
+
+  abcg::glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, dices.m_EBO);
+
+  abcg::glBindBuffer(GL_ARRAY_BUFFER, dices.m_positionVBO);
+  abcg::glEnableVertexAttribArray(0);
+  abcg::glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3),
+                              nullptr);
+
+  abcg::glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+  for (auto const column : iter::range<GLuint>(4)) {
+    auto const offset{offsetof(GpuInstance, modelMatrix) +
+                      column * sizeof(glm::vec4)};
+    abcg::glEnableVertexAttribArray(modelMatrixLocation + column);
+    abcg::glVertexAttribPointer(modelMatrixLocation + column, 4, GL_FLOAT,
+                                GL_FALSE, sizeof(GpuInstance),
+                                reinterpret_cast<void *>(offset));
+    abcg::glVertexAttribDivisor(modelMatrixLocation + column, 1);
+  }
+
+  abcg::glBindBuffer(GL_ARRAY_BUFFER, 0);
+  abcg::glBindVertexArray(0);
+}
+
+// Same as setupVAO, but with the quad of the impostors and the instances of
+// their list
+void GpuCulling::setupImpostorVAO(Impostors const &impostors) {
+  abcg::glGenVertexArrays(1, &m_impostorVAO);
+  abcg::glBindVertexArray(m_impostorVAO);
+
+  abcg::glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, impostors.getIndexBuffer());
+
+  abcg::glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+  for (auto const column : iter::range<GLuint>(4)) {
+    auto const offset{offsetof(GpuInstance, modelMatrix) +
+                      column * sizeof(glm::vec4)};
+    abcg::glEnableVertexAttribArray(modelMatrixLocation + column);
+    abcg::glVertexAttribPointer(modelMatrixLocation + column, 4, GL_FLOAT,
+                                GL_FALSE, sizeof(GpuInstance),
+                                reinterpret_cast<void *>(offset));
+    abcg::glVertexAttribDivisor(modelMatrixLocation + column, 1);
+  }
+  for (auto const column : iter::range<GLuint>(3)) {
+    auto const offset{offsetof(GpuInstance, normalMatrix) +
+                      column * sizeof(glm::vec4)};
+    abcg::glEnableVertexAttribArray(normalMatrixLocation + column);
+    abcg::glVertexAttribPointer(normalMatrixLocation + column, 3, GL_FLOAT,
+                                GL_FALSE, sizeof(GpuInstance),
+                                reinterpret_cast<void *>(offset));
+    abcg::glVertexAttribDivisor(normalMatrixLocation + column, 1);
+  }
+
+  abcg::glBindBuffer(GL_ARRAY_BUFFER, 0);
+  abcg::glBindVertexArray(0);
+}
+
+void GpuCulling::cull(std::span<DiceState const> dices,
+                      glm::mat4 const &baseMatrix,
+                      glm::mat4 const &viewMatrix,
+                      glm::mat4 const &projMatrix, float scale) {
+  abcg::TraceScope const traceScope{"GpuCulling::uploadStates", "dice"};
+
+  if (dices.empty()) {
+    cullRange(0, 0, 0, baseMatrix, viewMatrix, projMatrix, scale);
+    return;
+  }
+
+  // The states are written directly to the memory read by the GPU, in a
+  // region that the previous frames are no longer using
+  auto const size{
+      gsl::narrow<GLsizeiptr>(sizeof(GpuDiceState) * dices.size())};
+  m_stateStream.reserve(size);
+  m_stateStream.beginFrame();
+  auto const allocation{m_stateStream.allocate(size, m_storageAlignment)};
+  std::span const states{static_cast<GpuDiceState *>(allocation.data),
+                         dices.size()};
+  for (auto &&[state, dice] : iter::zip(states, dices)) {
+    state = {.position = glm::vec4{dice.position, 1.0f},
+             .orientation = glm::vec4{dice.orientation.x, dice.orientation.y,
+                                      dice.orientation.z,
+                                      dice.orientation.w}};
+  }
+  m_stateStream.flush();
+
+  cullRange(allocation.buffer, allocation.offset, dices.size(), baseMatrix,
+            viewMatrix, projMatrix, scale);
+  m_stateStream.endFrame();
+}
+
+void GpuCulling::cull(GLuint stateBuffer, std::size_t diceCount,
+                      glm::mat4 const &baseMatrix,
+                      glm::mat4 const &viewMatrix,
+                      glm::mat4 const &projMatrix, float scale) {
+  cullRange(stateBuffer, 0, diceCount, baseMatrix, viewMatrix, projMatrix,
+            scale);
+}
+
+void GpuCulling::cullRange(GLuint stateBuffer, GLintptr stateOffset,
+                           std::size_t diceCount, glm::mat4 const &baseMatrix,
+                           glm::mat4 const &viewMatrix,
+                           glm::mat4 const &projMatrix, float scale) {
+  abcg::TraceScope const traceScope{"GpuCulling::cull", "dice"};
+
+  // Every die may end up in any level of detail, or be an impostor
+  if (m_instanceCapacity < diceCount) {
+    m_instanceCapacity = diceCount;
+    abcg::glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_instanceBuffer);
+    abcg::glBufferData(GL_SHADER_STORAGE_BUFFER,
+                       gsl::narrow<GLsizeiptr>(sizeof(GpuInstance) *
+                                               m_instanceCapacity *
+                                               m_commands.size()),
+                       nullptr, GL_DYNAMIC_DRAW);
+  }
+  abcg::glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  // Reset the instance counts
+  for (auto &&[index, command, lod] :
+       iter::zip(iter::range(m_lods.size()), m_commands, m_lods)) {
+    command = {.count = lod.indexCount,
+               .instanceCount = 0,
+               .firstIndex = lod.firstIndex,
+               .baseVertex = 0,
+               .baseInstance = gsl::narrow<GLuint>(index * m_instanceCapacity)};
+  }
+  m_commands.back() = {
+      .count = gsl::narrow<GLuint>(Impostors::getIndexCount()),
+      .instanceCount = 0,
+      .firstIndex = 0,
+      .baseVertex = 0,
+      .baseInstance = gsl::narrow<GLuint>(m_lods.size() * m_instanceCapacity)};
+  abcg::glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+  abcg::glBufferSubData(
+      GL_DRAW_INDIRECT_BUFFER, 0,
+      gsl::narrow<GLsizeiptr>(sizeof(DrawCommand) * m_commands.size()),
+      m_commands.data());
+  abcg::glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+  if (diceCount == 0) {
+    readBackCounts();
+    return;
+  }
+
+  auto const frustum{extractFrustum(projMatrix * viewMatrix)};
+  // The inverse transpose of a rotation is the rotation itself
+  glm::mat3 const normalBaseMatrix{glm::mat3{viewMatrix} *
+                                   glm::mat3{baseMatrix}};
+  glm::vec4 const boundingSphere{m_boundingSphere.center,
+                                 m_boundingSphere.radius};
+
+  abcg::glUseProgram(m_cullProgram);
+  abcg::glUniform1ui(m_diceCountLoc, gsl::narrow<GLuint>(diceCount));
+  abcg::glUniform1ui(m_instanceCapacityLoc,
+                     gsl::narrow<GLuint>(m_instanceCapacity));
+  abcg::glUniformMatrix4fv(m_baseMatrixLoc, 1, GL_FALSE, &baseMatrix[0][0]);
+  abcg::glUniformMatrix4fv(m_viewMatrixLoc, 1, GL_FALSE, &viewMatrix[0][0]);
+  abcg::glUniformMatrix3fv(m_normalBaseMatrixLoc, 1, GL_FALSE,
+                           &normalBaseMatrix[0][0]);
+  abcg::glUniform1f(m_scaleLoc, scale);
+  // Half the viewport height divided by the distance, in NDC units
+  abcg::glUniform1f(m_projScaleLoc, projMatrix[1][1]);
+  abcg::glUniform4fv(m_frustumPlanesLoc,
+                     gsl::narrow<GLsizei>(frustum.planes.size()),
+                     &frustum.planes[0].x);
+  abcg::glUniform4fv(m_boundingSphereLoc, 1, &boundingSphere.x);
+  abcg::glUniform2f(m_lodThresholdsLoc, lodThresholds[0], lodThresholds[1]);
+  abcg::glUniform1ui(m_lodCountLoc, gsl::narrow<GLuint>(m_lods.size()));
+  abcg::glUniform1f(m_impostorThresholdLoc,
+                    m_impostorsEnabled ? Impostors::sizeThreshold : 0.0f);
+
+  abcg::glBindBufferRange(
+      GL_SHADER_STORAGE_BUFFER, stateBinding, stateBuffer, stateOffset,
+      gsl::narrow<GLsizeiptr>(sizeof(GpuDiceState) * diceCount));
+  abcg::glBindBufferBase(GL_SHADER_STORAGE_BUFFER, instanceBinding,
+                         m_instanceBuffer);
+  abcg::glBindBufferBase(GL_SHADER_STORAGE_BUFFER, commandBinding,
+                         m_commandBuffer);
+
+  auto const groupCount{
+      (gsl::narrow<GLuint>(diceCount) + workGroupSize - 1) / workGroupSize};
+  abcg::glDispatchCompute(groupCount, 1, 1);
+
+  // The instances are read as vertex attributes and the commands as indirect
+  // draw parameters
+  abcg::glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT |
+                        GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+  abcg::glUseProgram(0);
+
+  readBackCounts();
+}
+
+void GpuCulling::render(Dices const &dices) const {
+  abcg::glBindVertexArray(m_VAO);
+  dices.bindMaterials();
+
+  abcg::glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+  abcg::glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr,
+                                    gsl::narrow<GLsizei>(m_lods.size()), 0);
+  abcg::glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+  abcg::glBindVertexArray(0);
+}
+
+void GpuCulling::renderDepth() const {
+  abcg::glBindVertexArray(m_depthVAO);
+
+  abcg::glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+  abcg::glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr,
+                                    gsl::narrow<GLsizei>(m_lods.size()), 0);
+  abcg::glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+  abcg::glBindVertexArray(0);
+}
+
+void GpuCulling::renderImpostors() const {
+  abcg::glBindVertexArray(m_impostorVAO);
+
+  abcg::glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+  abcg::glMultiDrawElementsIndirect(
+      GL_TRIANGLES, GL_UNSIGNED_INT,
+      reinterpret_cast<void *>(sizeof(DrawCommand) * m_lods.size()), 1, 0);
+  abcg::glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+  abcg::glBindVertexArray(0);
+}
+
+// Copies the commands of the cull just dispatched to the next region of the
+// readback buffer, and reads the counts of the cull that last used it if its
+// copy is done. Otherwise the counts are kept, so that this never stalls
+void GpuCulling::readBackCounts() {
+  auto const regionSize{
+      gsl::narrow<GLsizeiptr>(sizeof(DrawCommand) * m_commands.size())};
+  auto const regionOffset{regionSize *
+                          gsl::narrow<GLintptr>(m_readbackIndex)};
+  auto &fence{m_readbackFences.at(m_readbackIndex)};
+
+  abcg::glBindBuffer(GL_COPY_WRITE_BUFFER, m_readbackBuffer);
+  if (fence != nullptr) {
+    auto const status{abcg::glClientWaitSync(fence, 0, 0)};
+    if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+      abcg::glGetBufferSubData(GL_COPY_WRITE_BUFFER, regionOffset, regionSize,
+                               m_readbackCommands.data());
+      m_visibleCount = 0;
+      for (auto const &command : m_readbackCommands) {
+        m_visibleCount += command.instanceCount;
+      }
+      m_impostorCount = m_readbackCommands.back().instanceCount;
+    }
+    abcg::glDeleteSync(fence);
+  }
+
+  abcg::glBindBuffer(GL_COPY_READ_BUFFER, m_commandBuffer);
+  abcg::glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+                            regionOffset, regionSize);
+  abcg::glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  abcg::glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  fence = abcg::glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  m_readbackIndex = (m_readbackIndex + 1) % readbackLatency;
+}
+
+#else
+
+bool GpuCulling::isSupported() { return false; }
+
+void GpuCulling::create(Dices const & /*dices*/,
+                        Impostors const & /*impostors*/,
+                        std::string const & /*shadersPath*/) {}
+
+void GpuCulling::destroy() {}
+
+void GpuCulling::setupVAO(Dices const & /*dices*/) {}
+
+void GpuCulling::setupDepthVAO(Dices const & /*dices*/) {}
+
+void GpuCulling::setupImpostorVAO(Impostors const & /*impostors*/) {}
+
+void GpuCulling::cull(std::span<DiceState const> /*dices*/,
+                      glm::mat4 const & /*baseMatrix*/,
+                      glm::mat4 const & /*viewMatrix*/,
+                      glm::mat4 const & /*projMatrix*/, float /*scale*/) {}
+
+void GpuCulling::cull(GLuint /*stateBuffer*/, std::size_t /*diceCount*/,
+                      glm::mat4 const & /*baseMatrix*/,
+                      glm::mat4 const & /*viewMatrix*/,
+                      glm::mat4 const & /*projMatrix*/, float /*scale*/) {}
+
+void GpuCulling::cullRange(GLuint /*stateBuffer*/, GLintptr /*stateOffset*/,
+                           std::size_t /*diceCount*/,
+                           glm::mat4 const & /*baseMatrix*/,
+                           glm::mat4 const & /*viewMatrix*/,
+                           glm::mat4 const & /*projMatrix*/,
+                           float /*scale*/) {}
+
+void GpuCulling::render(Dices const & /*dices*/) const {}
+
+void GpuCulling::renderDepth() const {}
+
+void GpuCulling::renderImpostors() const {}
+
+void GpuCulling::readBackCounts() {}
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef GPUCULLING_HPP_
+#define GPUCULLING_HPP_
+
+#include <array>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "abcgOpenGL.hpp"
+#include "dices.hpp"
+#include "impostors.hpp"
+
+// GPU-driven rendering of the dice for OpenGL 4.3+.
+//
+// The states of the dice are written to a ring buffer, persistently mapped
+// where supported, and read as a shader storage buffer. A compute shader
+// computes the model and normal matrices of each die, culls its bounding
+// sphere against the view frustum, selects a level of detail from its
+// projected size, and appends it to the instance list of that level. The
+// instance counts are written directly to one DrawElementsIndirectCommand per
+// level, and everything is drawn by a single glMultiDrawElementsIndirect.
+// When impostors are enabled, the dice below Impostors::sizeThreshold are
+// appended to one more list instead, drawn as quads by one more command.
+//
+// The instance matrices are read as per-instance vertex attributes, offset by
+// the base instance of each command, so the vertex shader is the same as in
+// the per-die path except for where the matrices come from.
+class GpuCulling {
+public:
+  // Whether compute shaders, storage buffers and indirect draws are
+  // available. Always false on OpenGL ES and WebGL
+  [[nodiscard]] static bool isSupported();
+
+  void create(Dices const &dices, Impostors const &impostors,
+              std::string const &shadersPath);
+  void destroy();
+
+  [[nodiscard]] bool isCreated() const { return m_cullProgram != 0; }
+
+  // Program used by render, with the same uniform variables as the per-die
+  // program except for the model and normal matrices
+  [[nodiscard]] GLuint getRenderProgram() const { return m_renderProgram; }
+  // Program used by renderDepth, with the view and projection matrices only
+  [[nodiscard]] GLuint getDepthProgram() const { return m_depthProgram; }
+
+  // Whether the next cull moves the smallest dice to the impostor list
+  void setImpostorsEnabled(bool enabled) { m_impostorsEnabled = enabled; }
+
+  void cull(std::span<DiceState const> dices, glm::mat4 const &baseMatrix,
+            glm::mat4 const &viewMatrix, glm::mat4 const &projMatrix,
+            float scale);
+  // Same, but with the states already in a storage buffer, as written by
+  // GpuSimulation. Each state is a vec4 with the position and w = 1, and a
+  // vec4 with the orientation as (x, y, z, w)
+  void cull(GLuint stateBuffer, std::size_t diceCount,
+            glm::mat4 const &baseMatrix, glm::mat4 const &viewMatrix,
+            glm::mat4 const &projMatrix, float scale);
+  // The render program must be in use
+  void render(Dices const &dices) const;
+  // Draws the depth of the same dice as render, with the positions alone. The
+  // depth program must be in use
+  void renderDepth() const;
+  // Draws the dice of the impostor list. The program of the impostors must be
+  // in use and their atlas bound
+  void renderImpostors() const;
+
+  // Number of dice drawn, impostors included, and of dice drawn as
+  // impostors, as counted by a cull of readbackLatency frames before. They
+  // are read without waiting for the GPU, so they are for statistics only
+  [[nodiscard]] std::size_t getVisibleCount() const { return m_visibleCount; }
+  [[nodiscard]] std::size_t getImpostorCount() const {
+    return m_impostorCount;
+  }
+
+private:
+  // Same layout as DrawElementsIndirectCommand in the OpenGL specification
+  struct DrawCommand {
+    GLuint count{};
+    GLuint instanceCount{};
+    GLuint firstIndex{};
+    GLint baseVertex{};
+    GLuint baseInstance{};
+  };
+
+  // Same layouts as the std430 structures of the compute shader
+  struct GpuDiceState {
+    glm::vec4 position{};
+    glm::vec4 orientation{};
+  };
+  struct GpuInstance {
+    glm::mat4 modelMatrix{};
+    std::array<glm::vec4, 3> normalMatrix{};
+  };
+
+  // Radius of the projected bounding sphere, relative to half the viewport
+  // height, below which each coarser level of detail is used
+  static constexpr std::array lodThresholds{0.15f, 0.05f};
+  // Number of culls whose commands are copied for the CPU before the first
+  // one is read
+  static constexpr std::size_t readbackLatency{3};
+
+  GLuint m_cullProgram{};
+  GLuint m_renderProgram{};
+  GLuint m_depthProgram{};
+  GLuint m_VAO{};
+  GLuint m_depthVAO{};
+  GLuint m_impostorVAO{};
+  GLuint m_instanceBuffer{};
+  GLuint m_commandBuffer{};
+
+  GLint m_diceCountLoc{};
+  GLint m_instanceCapacityLoc{};
+  GLint m_baseMatrixLoc{};
+  GLint m_viewMatrixLoc{};
+  GLint m_normalBaseMatrixLoc{};
+  GLint m_scaleLoc{};
+  GLint m_projScaleLoc{};
+  GLint m_frustumPlanesLoc{};
+  GLint m_boundingSphereLoc{};
+  GLint m_lodThresholdsLoc{};
+  GLint m_lodCountLoc{};
+  GLint m_impostorThresholdLoc{};
+
+  std::vector<MeshLod> m_lods;
+  BoundingSphere m_boundingSphere{};
+  // Number of dice that fit in the instance list of each level of detail
+  std::size_t m_instanceCapacity{};
+  bool m_impostorsEnabled{true};
+
+  // States uploaded by the CPU, one region per frame in flight
+  abcg::OpenGLStreamBuffer m_stateStream;
+  GLsizeiptr m_storageAlignment{};
+  // One command per level of detail, followed by the one of the impostors
+  std::vector<DrawCommand> m_commands;
+
+  // Copies of the commands of the last culls, one region per cull, and the
+  // fences that are signaled when each copy is done
+  GLuint m_readbackBuffer{};
+  std::array<GLsync, readbackLatency> m_readbackFences{};
+  std::size_t m_readbackIndex{};
+  std::vector<DrawCommand> m_readbackCommands;
+  std::size_t m_visibleCount{};
+  std::size_t m_impostorCount{};
+
+  void setupVAO(Dices const &dices);
+  void setupDepthVAO(Dices const &dices);
+  void setupImpostorVAO(Impostors const &impostors);
+  void cullRange(GLuint stateBuffer, GLintptr stateOffset,
+                 std::size_t diceCount, glm::mat4 const &baseMatrix,
+                 glm::mat4 const &viewMatrix, glm::mat4 const &projMatrix,
+                 float scale);
+  void readBackCounts();
+};
+
+#endif
@@ -0,0 +1,410 @@
+#include "gpusimulation.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <cppitertools/itertools.hpp>
+
+#include "gpuculling.hpp"
+
+#if !defined(__EMSCRIPTEN__)
+
+namespace {
+// Bindings of the storage buffers in the sim_*.comp shaders
+constexpr GLuint previousBinding{0};
+constexpr GLuint nextBinding{1};
+constexpr GLuint renderStateBinding{2};
+constexpr GLuint cellBinding{3};
+constexpr GLuint cellOffsetBinding{4};
+constexpr GLuint sortedBinding{5};
+constexpr GLuint counterBinding{6};
+
+// Bits of GpuDice::flags
+constexpr GLuint spinningFlag{1};
+constexpr GLuint collidingFlag{2};
+
+constexpr GLuint workGroupSize{64};
+
+// Same layout as DiceState in cull.comp
+struct GpuRenderState {
+  glm::vec4 position{};
+  glm::vec4 orientation{};
+};
+
+// Largest difference between the GPU and the CPU that is not reported as a
+// mismatch. Both do the same operations, but may round them differently
+constexpr float validationTolerance{1e-4f};
+} // namespace
+
+bool GpuSimulation::isSupported() { return GpuCulling::isSupported(); }
+
+void GpuSimulation::create(std::string const &shadersPath) {
+  destroy();
+
+  auto const createProgram{[&shadersPath](char const *name) {
+    return abcg::createOpenGLProgram(
+        {{.source = shadersPath + name, .stage = abcg::ShaderStage::Compute}});
+  }};
+  m_gridProgram = createProgram("sim_grid.comp");
+  m_scanProgram = createProgram("sim_scan.comp");
+  m_stepProgram = createProgram("sim_step.comp");
+
+  m_gridDiceCountLoc = abcg::glGetUniformLocation(m_gridProgram, "diceCount");
+  m_gridScatterLoc = abcg::glGetUniformLocation(m_gridProgram, "scatter");
+  m_gridOriginLoc = abcg::glGetUniformLocation(m_gridProgram, "gridOrigin");
+  m_gridCellsLoc = abcg::glGetUniformLocation(m_gridProgram, "gridCells");
+  m_scanCellCountLoc = abcg::glGetUniformLocation(m_scanProgram, "cellCount");
+  m_stepDiceCountLoc = abcg::glGetUniformLocation(m_stepProgram, "diceCount");
+  m_stepDeltaTimeLoc = abcg::glGetUniformLocation(m_stepProgram, "deltaTime");
+  m_stepSeedLoc = abcg::glGetUniformLocation(m_stepProgram, "seed");
+  m_stepCountLoc = abcg::glGetUniformLocation(m_stepProgram, "stepCount");
+  m_stepRollLoc = abcg::glGetUniformLocation(m_stepProgram, "roll");
+  m_stepGridOriginLoc =
+      abcg::glGetUniformLocation(m_stepProgram, "gridOrigin");
+  m_stepGridCellsLoc = abcg::glGetUniformLocation(m_stepProgram, "gridCells");
+
+  abcg::glGenBuffers(gsl::narrow<GLsizei>(m_stateBuffers.size()),
+                     m_stateBuffers.data());
+  abcg::glGenBuffers(1, &m_renderStateBuffer);
+  abcg::glGenBuffers(1, &m_cellBuffer);
+  abcg::glGenBuffers(1, &m_cellOffsetBuffer);
+  abcg::glGenBuffers(1, &m_sortedBuffer);
+  abcg::glGenBuffers(1, &m_counterBuffer);
+
+  // The last cell holds the total count after the prefix sum
+  m_zeroCells.assign(cellCount + 1, 0);
+  abcg::glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_cellBuffer);
+  abcg::glBufferData(GL_SHADER_STORAGE_BUFFER,
+                     gsl::narrow<GLsizeiptr>(sizeof(GLuint) *
+                                             m_zeroCells.size()),
+                     nullptr, GL_DYNAMIC_DRAW);
+  abcg::glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_cellOffsetBuffer);
+  abcg::glBufferData(GL_SHADER_STORAGE_BUFFER,
+                     gsl::narrow<GLsizeiptr>(sizeof(GLuint) * cellCount),
+                     nullptr, GL_DYNAMIC_DRAW);
+  abcg::glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_counterBuffer);
+  abcg::glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), nullptr,
+                     GL_DYNAMIC_READ);
+  abcg::glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GpuSimulation::destroy() {
+  abcg::glDeleteProgram(m_gridProgram);
+  abcg::glDeleteProgram(m_scanProgram);
+  abcg::glDeleteProgram(m_stepProgram);
+  abcg::glDeleteBuffers(gsl::narrow<GLsizei>(m_stateBuffers.size()),
+                        m_stateBuffers.data());
+  abcg::glDeleteBuffers(1, &m_renderStateBuffer);
+  abcg::glDeleteBuffers(1, &m_cellBuffer);
+  abcg::glDeleteBuffers(1, &m_cellOffsetBuffer);
+  abcg::glDeleteBuffers(1, &m_sortedBuffer);
+  abcg::glDeleteBuffers(1, &m_counterBuffer);
+  if (m_fence != nullptr) {
+    abcg::glDeleteSync(m_fence);
+  }
+
+  m_gridProgram = 0;
+  m_scanProgram = 0;
+  m_stepProgram = 0;
+  m_stateBuffers = {};
+  m_renderStateBuffer = 0;
+  m_cellBuffer = 0;
+  m_cellOffsetBuffer = 0;
+  m_sortedBuffer = 0;
+  m_counterBuffer = 0;
+  m_fence = nullptr;
+  m_diceCount = 0;
+  m_current = 0;
+  m_rolling = false;
+}
+
+GpuSimulation::GpuDice GpuSimulation::toGpuDice(Dices::Dice const &dice) {
+  return {.positionTime = glm::vec4{dice.position, dice.timeLeft},
+          .orientation = glm::vec4{dice.orientation.x, dice.orientation.y,
+                                   dice.orientation.z, dice.orientation.w},
+          .spinAxisSpeed = glm::vec4{dice.spinAxis, dice.spinSpeed},
+          .translateAxis = dice.DoTranslateAxis,
+          .flags = (dice.dadoGirando ? spinningFlag : 0U) |
+                   (dice.dadoColidindo ? collidingFlag : 0U),
+          .decayRate = dice.decayRate};
+}
+
+Dices::Dice GpuSimulation::fromGpuDice(GpuDice const &dice) {
+  Dices::Dice result;
+  result.position = glm::vec3{dice.positionTime};
+  result.timeLeft = dice.positionTime.w;
+  result.orientation = glm::quat{dice.orientation.w, dice.orientation.x,
+                                 dice.orientation.y, dice.orientation.z};
+  result.spinAxis = glm::vec3{dice.spinAxisSpeed};
+  result.spinSpeed = dice.spinAxisSpeed.w;
+  result.DoTranslateAxis = dice.translateAxis;
+  result.dadoGirando = (dice.flags & spinningFlag) != 0;
+  result.dadoColidindo = (dice.flags & collidingFlag) != 0;
+  result.decayRate = dice.decayRate;
+  return result;
+}
+
+void GpuSimulation::upload(Dices const &dices) {
+  m_diceCount = dices.m_dices.size();
+  m_seed = dices.m_seed;
+  m_stepCount = dices.m_stepCount;
+  m_current = 0;
+
+  std::vector<GpuDice> states(m_diceCount);
+  std::vector<GpuRenderState> renderStates(m_diceCount);
+  for (auto &&[state, renderState, dice] :
+       iter::zip(states, renderStates, dices.m_dices)) {
+    state = toGpuDice(dice);
+    renderState = {.position = glm::vec4{dice.position, 1.0f},
+                   .orientation = state.orientation};
+  }
+
+  auto const upload{[](GLuint buffer, std::size_t size, void const *data) {
+    abcg::glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    abcg::glBufferData(GL_SHADER_STORAGE_BUFFER,
+                       gsl::narrow<GLsizeiptr>(size), data, GL_DYNAMIC_COPY);
+  }};
+  upload(m_stateBuffers[0], sizeof(GpuDice) * m_diceCount, states.data());
+  upload(m_stateBuffers[1], sizeof(GpuDice) * m_diceCount, nullptr);
+  upload(m_renderStateBuffer, sizeof(GpuRenderState) * m_diceCount,
+         renderStates.data());
+  upload(m_sortedBuffer, sizeof(GLuint) * m_diceCount, nullptr);
+  abcg::glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  if (m_fence != nullptr) {
+    abcg::glDeleteSync(m_fence);
+    m_fence = nullptr;
+  }
+  m_rolling = dices.isRolling();
+}
+
+void GpuSimulation::download(Dices &dices) const {
+  std::vector<GpuDice> states;
+  readDice(states);
+
+  dices.m_dices.resize(states.size());
+  for (auto &&[dice, state] : iter::zip(dices.m_dices, states)) {
+    dice = fromGpuDice(state);
+  }
+  dices.m_seed = m_seed;
+  dices.m_stepCount = m_stepCount;
+}
+
+void GpuSimulation::readDice(std::vector<GpuDice> &dice) const {
+  dice.resize(m_diceCount);
+  abcg::glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_stateBuffers.at(m_current));
+  abcg::glGetBufferSubData(
+      GL_SHADER_STORAGE_BUFFER, 0,
+      gsl::narrow<GLsizeiptr>(sizeof(GpuDice) * dice.size()), dice.data());
+  abcg::glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GpuSimulation::readStates(std::vector<DiceState> &states) const {
+  std::vector<GpuRenderState> renderStates(m_diceCount);
+  abcg::glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_renderStateBuffer);
+  abcg::glGetBufferSubData(
+      GL_SHADER_STORAGE_BUFFER, 0,
+      gsl::narrow<GLsizeiptr>(sizeof(GpuRenderState) * renderStates.size()),
+      renderStates.data());
+  abcg::glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  states.resize(renderStates.size());
+  for (auto &&[state, renderState] : iter::zip(states, renderStates)) {
+    state = {.position = glm::vec3{renderState.position},
+             .orientation = glm::quat{
+                 renderState.orientation.w, renderState.orientation.x,
+                 renderState.orientation.y, renderState.orientation.z}};
+  }
+}
+
+void GpuSimulation::roll() {
+  abcg::TraceScope const traceScope{"GpuSimulation::roll", "dice"};
+  dispatch(true, 0.0f);
+  m_rolling = true;
+}
+
+void GpuSimulation::step(float deltaTime) {
+  abcg::TraceScope const traceScope{"GpuSimulation::step", "dice"};
+  dispatch(false, deltaTime);
+}
+
+void GpuSimulation::dispatch(bool roll, float deltaTime) {
+  if (m_diceCount == 0)
+    return;
+
+  ++m_stepCount;
+  auto const previous{m_stateBuffers.at(m_current)};
+  auto const next{m_stateBuffers.at(1 - m_current)};
+  auto const diceCount{gsl::narrow<GLuint>(m_diceCount)};
+  auto const groupCount{(diceCount + workGroupSize - 1) / workGroupSize};
+
+  abcg::glBindBufferBase(GL_SHADER_STORAGE_BUFFER, previousBinding, previous);
+  abcg::glBindBufferBase(GL_SHADER_STORAGE_BUFFER, cellBinding, m_cellBuffer);
+  abcg::glBindBufferBase(GL_SHADER_STORAGE_BUFFER, cellOffsetBinding,
+                         m_cellOffsetBuffer);
+  abcg::glBindBufferBase(GL_SHADER_STORAGE_BUFFER, sortedBinding,
+                         m_sortedBuffer);
+
+  // Rolling does not look at the other dice
+  if (!roll) {
+    // Count the dice in each cell
+    abcg::glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_cellBuffer);
+    abcg::glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0,
+                          gsl::narrow<GLsizeiptr>(sizeof(GLuint) *
+                                                  m_zeroCells.size()),
+                          m_zeroCells.data());
+    abcg::glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    abcg::glUseProgram(m_gridProgram);
+    abcg::glUniform1ui(m_gridDiceCountLoc, diceCount);
+    abcg::glUniform1f(m_gridOriginLoc, Dices::gridOrigin);
+    abcg::glUniform1i(m_gridCellsLoc, Dices::gridCells);
+    abcg::glUniform1i(m_gridScatterLoc, 0);
+    abcg::glDispatchCompute(groupCount, 1, 1);
+    abcg::glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // First index of each cell in the sorted list
+    abcg::glUseProgram(m_scanProgram);
+    abcg::glUniform1ui(m_scanCellCountLoc, cellCount);
+    abcg::glDispatchCompute(1, 1, 1);
+    abcg::glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // Write the index of each die in the range of its cell
+    abcg::glUseProgram(m_gridProgram);
+    abcg::glUniform1i(m_gridScatterLoc, 1);
+    abcg::glDispatchCompute(groupCount, 1, 1);
+    abcg::glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+  }
+
+  GLuint const zero{};
+  abcg::glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_counterBuffer);
+  abcg::glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &zero);
+  abcg::glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  abcg::glUseProgram(m_stepProgram);
+  abcg::glUniform1ui(m_stepDiceCountLoc, diceCount);
+  abcg::glUniform1f(m_stepDeltaTimeLoc, deltaTime);
+  abcg::glUniform1ui(m_stepSeedLoc, m_seed);
+  abcg::glUniform1ui(m_stepCountLoc, m_stepCount);
+  abcg::glUniform1i(m_stepRollLoc, roll ? 1 : 0);
+  abcg::glUniform1f(m_stepGridOriginLoc, Dices::gridOrigin);
+  abcg::glUniform1i(m_stepGridCellsLoc, Dices::gridCells);
+  abcg::glBindBufferBase(GL_SHADER_STORAGE_BUFFER, nextBinding, next);
+  abcg::glBindBufferBase(GL_SHADER_STORAGE_BUFFER, renderStateBinding,
+                         m_renderStateBuffer);
+  abcg::glBindBufferBase(GL_SHADER_STORAGE_BUFFER, counterBinding,
+                         m_counterBuffer);
+  abcg::glDispatchCompute(groupCount, 1, 1);
+
+  // The render states are read by the culling pass, and everything may be
+  // read back
+  abcg::glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT |
+                        GL_BUFFER_UPDATE_BARRIER_BIT);
+  abcg::glUseProgram(0);
+
+  m_current = 1 - m_current;
+
+  if (m_fence != nullptr) {
+    abcg::glDeleteSync(m_fence);
+  }
+  m_fence = abcg::glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool GpuSimulation::isRolling() {
+  if (m_fence == nullptr)
+    return m_rolling;
+
+  if (auto const status{abcg::glClientWaitSync(m_fence, 0, 0)};
+      status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+    GLuint spinningDice{};
+    abcg::glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_counterBuffer);
+    abcg::glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint),
+                             &spinningDice);
+    abcg::glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    m_rolling = spinningDice > 0;
+
+    abcg::glDeleteSync(m_fence);
+    m_fence = nullptr;
+  }
+  return m_rolling;
+}
+
+GpuSimulation::Validation GpuSimulation::validate(Dices &dices, int steps,
+                                                  float deltaTime) {
+  abcg::TraceScope const traceScope{"GpuSimulation::validate", "dice"};
+
+  Validation validation;
+  std::vector<GpuDice> results;
+  for ([[maybe_unused]] auto const index : iter::range(steps)) {
+    upload(dices);
+    step(deltaTime);
+    dices.update(deltaTime);
+    readDice(results);
+
+    for (auto &&[result, dice] : iter::zip(results, dices.m_dices)) {
+      auto const expected{toGpuDice(dice)};
+      auto const maxDifference{[](glm::vec4 const &a, glm::vec4 const &b) {
+        auto const difference{glm::abs(a - b)};
+        return std::max(std::max(difference.x, difference.y),
+                        std::max(difference.z, difference.w));
+      }};
+
+      auto const positionError{maxDifference(
+          glm::vec4{glm::vec3{result.positionTime}, 0.0f},
+          glm::vec4{glm::vec3{expected.positionTime}, 0.0f})};
+      auto const orientationError{
+          maxDifference(result.orientation, expected.orientation)};
+      auto const timeError{
+          std::abs(result.positionTime.w - expected.positionTime.w)};
+      auto const spinError{
+          maxDifference(result.spinAxisSpeed, expected.spinAxisSpeed)};
+
+      validation.maxPositionError =
+          std::max(validation.maxPositionError, positionError);
+      validation.maxOrientationError =
+          std::max(validation.maxOrientationError, orientationError);
+      validation.maxTimeError = std::max(validation.maxTimeError, timeError);
+
+      if (result.flags != expected.flags ||
+          result.translateAxis != expected.translateAxis ||
+          std::max({positionError, orientationError, timeError, spinError}) >
+              validationTolerance) {
+        ++validation.mismatches;
+      }
+    }
+    ++validation.steps;
+  }
+  return validation;
+}
+
+#else
+
+bool GpuSimulation::isSupported() { return false; }
+
+void GpuSimulation::create(std::string const & /*shadersPath*/) {}
+
+void GpuSimulation::destroy() {}
+
+void GpuSimulation::upload(Dices const & /*dices*/) {}
+
+void GpuSimulation::download(Dices & /*dices*/) const {}
+
+void GpuSimulation::readDice(std::vector<GpuDice> & /*dice*/) const {}
+
+void GpuSimulation::readStates(std::vector<DiceState> & /*states*/) const {}
+
+void GpuSimulation::roll() {}
+
+void GpuSimulation::step(float /*deltaTime*/) {}
+
+void GpuSimulation::dispatch(bool /*roll*/, float /*deltaTime*/) {}
+
+bool GpuSimulation::isRolling() { return false; }
+
+GpuSimulation::Validation GpuSimulation::validate(Dices & /*dices*/,
+                                                  int /*steps*/,
+                                                  float /*deltaTime*/) {
+  return {};
+}
+
+#endif
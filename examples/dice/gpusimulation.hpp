@@ -0,0 +1,131 @@
+#ifndef GPUSIMULATION_HPP_
+#define GPUSIMULATION_HPP_
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "abcgOpenGL.hpp"
+#include "dices.hpp"
+
+// Simulation of the dice in compute shaders, for OpenGL 4.3+.
+//
+// The states of the dice live in two storage buffers, read and written
+// alternately. Each step sorts the dice into a uniform grid with cells as
+// large as the contact distance (counting sort: a count per cell, a prefix
+// sum, and a scatter of the indices), so that each die is tested only against
+// the dice in the 27 cells around it. The step itself is the same as
+// Dices::update, one die per invocation.
+//
+// Each step also writes the position and orientation of the dice to a buffer
+// that GpuCulling reads directly, so the states never go through the CPU.
+class GpuSimulation {
+public:
+  // Largest differences between the GPU and the CPU steps, as found by
+  // validate
+  struct Validation {
+    std::size_t steps{};
+    // Dice with different flags or directions, or with values farther apart
+    // than the tolerance
+    std::size_t mismatches{};
+    float maxPositionError{};
+    float maxOrientationError{};
+    float maxTimeError{};
+  };
+
+  // Same requirements as GpuCulling
+  [[nodiscard]] static bool isSupported();
+
+  void create(std::string const &shadersPath);
+  void destroy();
+
+  [[nodiscard]] bool isCreated() const { return m_stepProgram != 0; }
+
+  // Copies the state of dice simulated on the CPU, including the key of their
+  // random numbers, and reads it back
+  void upload(Dices const &dices);
+  void download(Dices &dices) const;
+
+  void roll();
+  void step(float deltaTime);
+
+  [[nodiscard]] std::size_t getDiceCount() const { return m_diceCount; }
+  // Positions and orientations after the last step, in the layout read by
+  // GpuCulling::cull
+  [[nodiscard]] GLuint getRenderStateBuffer() const {
+    return m_renderStateBuffer;
+  }
+  // Reads the positions and orientations back, for the per-die path. This
+  // waits for the last step to finish
+  void readStates(std::vector<DiceState> &states) const;
+
+  // Whether any die was spinning after the last step whose result is
+  // available. This never waits for the GPU, so it may lag a few frames
+  [[nodiscard]] bool isRolling();
+
+  // Runs steps both here and on the CPU from the same states, and compares
+  // the results of each step. The dice end up with the state of the CPU
+  Validation validate(Dices &dices, int steps, float deltaTime);
+
+private:
+  // Same layout as the std430 structure of sim_step.comp
+  struct GpuDice {
+    glm::vec4 positionTime{};
+    glm::vec4 orientation{};
+    glm::vec4 spinAxisSpeed{};
+    glm::ivec3 translateAxis{};
+    GLuint flags{};
+    float decayRate{};
+    std::array<float, 3> padding{};
+  };
+
+  // Cells of the grid of Dices, in which the contacts are found
+  static constexpr GLuint cellCount{Dices::gridCells * Dices::gridCells *
+                                    Dices::gridCells};
+
+  GLuint m_gridProgram{};
+  GLuint m_scanProgram{};
+  GLuint m_stepProgram{};
+
+  GLint m_gridDiceCountLoc{};
+  GLint m_gridScatterLoc{};
+  GLint m_gridOriginLoc{};
+  GLint m_gridCellsLoc{};
+  GLint m_scanCellCountLoc{};
+  GLint m_stepDiceCountLoc{};
+  GLint m_stepDeltaTimeLoc{};
+  GLint m_stepSeedLoc{};
+  GLint m_stepCountLoc{};
+  GLint m_stepRollLoc{};
+  GLint m_stepGridOriginLoc{};
+  GLint m_stepGridCellsLoc{};
+
+  // The one at m_current has the state after the last step
+  std::array<GLuint, 2> m_stateBuffers{};
+  std::size_t m_current{};
+  GLuint m_renderStateBuffer{};
+  GLuint m_cellBuffer{};
+  GLuint m_cellOffsetBuffer{};
+  GLuint m_sortedBuffer{};
+  GLuint m_counterBuffer{};
+
+  std::size_t m_diceCount{};
+  std::uint32_t m_seed{};
+  std::uint32_t m_stepCount{};
+
+  // Fence of the last step, and the number of spinning dice after the last
+  // step that was read back
+  GLsync m_fence{};
+  bool m_rolling{};
+
+  std::vector<GLuint> m_zeroCells;
+
+  static GpuDice toGpuDice(Dices::Dice const &dice);
+  static Dices::Dice fromGpuDice(GpuDice const &dice);
+
+  void dispatch(bool roll, float deltaTime);
+  void readDice(std::vector<GpuDice> &dice) const;
+};
+
+#endif
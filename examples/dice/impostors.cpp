@@ -0,0 +1,364 @@
+#include "impostors.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+#include <cppitertools/itertools.hpp>
+
+namespace {
+// Locations of the per-instance attributes in impostor.vert. A mat4 takes
+// four locations and a mat3 takes three
+constexpr GLuint modelMatrixLocation{3};
+constexpr GLuint normalMatrixLocation{7};
+
+// Texture units of the atlas
+constexpr GLint colorUnit{0};
+constexpr GLint normalDepthUnit{1};
+constexpr GLint materialUnit{2};
+
+// Inverse of the octahedral mapping of impostor.vert, from [0, 1]^2 to the
+// unit sphere
+glm::vec3 octDecode(glm::vec2 p) {
+  p = p * 2.0f - 1.0f;
+  glm::vec3 d{p, 1.0f - std::abs(p.x) - std::abs(p.y)};
+  if (d.z < 0.0f) {
+    glm::vec2 const signs{d.x >= 0.0f ? 1.0f : -1.0f,
+                          d.y >= 0.0f ? 1.0f : -1.0f};
+    d.x = (1.0f - std::abs(p.y)) * signs.x;
+    d.y = (1.0f - std::abs(p.x)) * signs.y;
+  }
+  return glm::normalize(d);
+}
+
+// Creates a texture of normalized colors, or of unsigned integers, which
+// cannot be filtered
+GLuint createAtlasTexture(GLsizei size, bool integer = false) {
+  GLuint texture{};
+  abcg::glGenTextures(1, &texture);
+  abcg::glBindTexture(GL_TEXTURE_2D, texture);
+  if (integer) {
+    abcg::glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, size, size, 0,
+                       GL_RED_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+  } else {
+    abcg::glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA,
+                       GL_UNSIGNED_BYTE, nullptr);
+  }
+  // No mipmaps, which would blend neighboring frames
+  auto const filter{integer ? GL_NEAREST : GL_LINEAR};
+  abcg::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+  abcg::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+  abcg::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  abcg::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  abcg::glBindTexture(GL_TEXTURE_2D, 0);
+  return texture;
+}
+} // namespace
+
+void Impostors::create(std::string const &shadersPath) {
+  destroy();
+
+  m_program = abcg::createOpenGLProgram(
+      {{.source = shadersPath + "impostor.vert",
+        .stage = abcg::ShaderStage::Vertex},
+       {.source = shadersPath + "impostor.frag",
+        .stage = abcg::ShaderStage::Fragment}});
+  m_bakeProgram = abcg::createOpenGLProgram(
+      {{.source = shadersPath + "impostor_bake.vert",
+        .stage = abcg::ShaderStage::Vertex},
+       {.source = shadersPath + "impostor_bake.frag",
+        .stage = abcg::ShaderStage::Fragment}});
+
+  auto const atlasSize{framesPerSide * frameSize};
+  m_colorTexture = createAtlasTexture(atlasSize);
+  m_normalDepthTexture = createAtlasTexture(atlasSize);
+  m_materialTexture = createAtlasTexture(atlasSize, true);
+
+  abcg::glGenRenderbuffers(1, &m_bakeDepthRBO);
+  abcg::glBindRenderbuffer(GL_RENDERBUFFER, m_bakeDepthRBO);
+  abcg::glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, atlasSize,
+                              atlasSize);
+  abcg::glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  abcg::glGenFramebuffers(1, &m_bakeFBO);
+  abcg::glBindFramebuffer(GL_FRAMEBUFFER, m_bakeFBO);
+  abcg::glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                  GL_RENDERBUFFER, m_bakeDepthRBO);
+  abcg::glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  // Two triangles, counterclockwise
+  std::array<GLuint, 6> const indices{0, 1, 2, 2, 1, 3};
+  abcg::glGenBuffers(1, &m_EBO);
+  abcg::glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+  abcg::glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices.data(),
+                     GL_STATIC_DRAW);
+  abcg::glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+  // The instances are written to a different range of the stream buffer every
+  // frame, so the attribute pointers are set by render
+  m_instanceStream.create(
+      gsl::narrow<GLsizeiptr>(sizeof(DiceTransform) * 1024));
+  abcg::glGenVertexArrays(1, &m_VAO);
+  abcg::glBindVertexArray(m_VAO);
+  abcg::glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+  for (auto const column : iter::range<GLuint>(4)) {
+    abcg::glEnableVertexAttribArray(modelMatrixLocation + column);
+    abcg::glVertexAttribDivisor(modelMatrixLocation + column, 1);
+  }
+  for (auto const column : iter::range<GLuint>(3)) {
+    abcg::glEnableVertexAttribArray(normalMatrixLocation + column);
+    abcg::glVertexAttribDivisor(normalMatrixLocation + column, 1);
+  }
+  abcg::glBindVertexArray(0);
+}
+
+void Impostors::destroy() {
+  abcg::glDeleteProgram(m_program);
+  abcg::glDeleteProgram(m_bakeProgram);
+  abcg::glDeleteTextures(1, &m_colorTexture);
+  abcg::glDeleteTextures(1, &m_normalDepthTexture);
+  abcg::glDeleteTextures(1, &m_materialTexture);
+  abcg::glDeleteFramebuffers(1, &m_bakeFBO);
+  abcg::glDeleteRenderbuffers(1, &m_bakeDepthRBO);
+  abcg::glDeleteBuffers(1, &m_EBO);
+  abcg::glDeleteVertexArrays(1, &m_VAO);
+  m_instanceStream.destroy();
+
+  m_program = 0;
+  m_bakeProgram = 0;
+  m_colorTexture = 0;
+  m_normalDepthTexture = 0;
+  m_materialTexture = 0;
+  m_bakeFBO = 0;
+  m_bakeDepthRBO = 0;
+  m_EBO = 0;
+  m_VAO = 0;
+}
+
+void Impostors::bake(Dices const &dices, GLuint program, int mappingMode) {
+  abcg::TraceScope const scope{"Impostors::bake", "asset"};
+
+  GLint framebuffer{};
+  std::array<GLint, 4> viewport{};
+  abcg::glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+  abcg::glGetIntegerv(GL_VIEWPORT, viewport.data());
+
+  // Each frame spans the bounding sphere, seen from outside of it
+  auto const &sphere{dices.getBoundingSphere()};
+  auto const radius{sphere.radius};
+  auto const projMatrix{
+      glm::ortho(-radius, radius, -radius, radius, radius, 3.0f * radius)};
+
+  // Unlit copy of the materials, with the ambient term alone at half
+  // intensity, as the weights of the triplanar mapping add up to more than
+  // one
+  auto unlitMaterials{dices.getMaterials()};
+  for (auto &material : unlitMaterials) {
+    material.Ka = {0.5f, 0.5f, 0.5f, 1.0f};
+    material.Kd = glm::vec4{0.0f};
+    material.Ks = glm::vec4{0.0f};
+  }
+  unlitMaterials.resize(Dices::maxMaterials);
+  GLuint unlitMaterialUBO{};
+  abcg::glGenBuffers(1, &unlitMaterialUBO);
+  abcg::glBindBuffer(GL_UNIFORM_BUFFER, unlitMaterialUBO);
+  abcg::glBufferData(GL_UNIFORM_BUFFER,
+                     gsl::narrow<GLsizeiptr>(sizeof(Material) *
+                                             unlitMaterials.size()),
+                     unlitMaterials.data(), GL_STATIC_DRAW);
+  abcg::glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+  // Renders every frame into the texture with the given program, which must
+  // be in use. The vertical axis of the frames is the same as in
+  // impostor.vert. Only the first color attachment and the depth are cleared
+  auto const bakeFrames{[&](GLuint frameProgram, GLuint texture,
+                            glm::vec4 const &background) {
+    abcg::glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                 GL_TEXTURE_2D, texture, 0);
+    abcg::glClearBufferfv(GL_COLOR, 0, &background.r);
+    abcg::glClear(GL_DEPTH_BUFFER_BIT);
+
+    auto const viewMatrixLoc{
+        abcg::glGetUniformLocation(frameProgram, "viewMatrix")};
+    auto const normalMatrixLoc{
+        abcg::glGetUniformLocation(frameProgram, "normalMatrix")};
+    abcg::glUniformMatrix4fv(
+        abcg::glGetUniformLocation(frameProgram, "projMatrix"), 1, GL_FALSE,
+        &projMatrix[0][0]);
+
+    dices.bind();
+    abcg::glBindBufferBase(GL_UNIFORM_BUFFER, Dices::materialBinding,
+                           unlitMaterialUBO);
+    for (auto const row : iter::range(framesPerSide)) {
+      for (auto const column : iter::range(framesPerSide)) {
+        auto const direction{octDecode(
+            glm::vec2{column, row} / gsl::narrow<float>(framesPerSide - 1))};
+        auto const up{std::abs(direction.y) > 0.999f ? glm::vec3{0, 0, 1}
+                                                     : glm::vec3{0, 1, 0}};
+        auto const viewMatrix{glm::lookAt(
+            sphere.center + direction * 2.0f * radius, sphere.center, up)};
+        // The model matrix is the identity
+        glm::mat3 const normalMatrix{viewMatrix};
+
+        abcg::glViewport(column * frameSize, row * frameSize, frameSize,
+                         frameSize);
+        abcg::glUniformMatrix4fv(viewMatrixLoc, 1, GL_FALSE,
+                                 &viewMatrix[0][0]);
+        abcg::glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE,
+                                 &normalMatrix[0][0]);
+        dices.draw();
+      }
+    }
+    abcg::glBindVertexArray(0);
+  }};
+
+  abcg::glBindFramebuffer(GL_FRAMEBUFFER, m_bakeFBO);
+  abcg::glEnable(GL_DEPTH_TEST);
+
+  // Unlit color, with the ambient term of dice.frag alone. Its alpha is the
+  // coverage, as the background is transparent
+  abcg::glUseProgram(program);
+  auto const location{[program](char const *name) {
+    return abcg::glGetUniformLocation(program, name);
+  }};
+  glm::mat4 const modelMatrix{1.0f};
+  glm::vec4 const one{1.0f};
+  glm::vec4 const zero{0.0f};
+  abcg::glUniformMatrix4fv(location("modelMatrix"), 1, GL_FALSE,
+                           &modelMatrix[0][0]);
+  abcg::glUniform4fv(location("lightDirWorldSpace"), 1, &one.x);
+  abcg::glUniform4fv(location("Ia"), 1, &one.x);
+  abcg::glUniform4fv(location("Id"), 1, &zero.x);
+  abcg::glUniform4fv(location("Is"), 1, &zero.x);
+  abcg::glUniform1i(location("diffuseTex"), 0);
+  abcg::glUniform1i(location("mappingMode"), mappingMode);
+  bakeFrames(program, m_colorTexture, glm::vec4{0.0f});
+
+  // Normal and depth, and the material in the second attachment. The
+  // background decodes to a zero normal, and has the first material
+  std::array<GLenum, 2> const drawBuffers{GL_COLOR_ATTACHMENT0,
+                                          GL_COLOR_ATTACHMENT1};
+  std::array<GLuint, 4> const firstMaterial{};
+  abcg::glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
+                               GL_TEXTURE_2D, m_materialTexture, 0);
+  abcg::glDrawBuffers(gsl::narrow<GLsizei>(drawBuffers.size()),
+                      drawBuffers.data());
+  abcg::glClearBufferuiv(GL_COLOR, 1, firstMaterial.data());
+  abcg::glUseProgram(m_bakeProgram);
+  bakeFrames(m_bakeProgram, m_normalDepthTexture,
+             glm::vec4{0.5f, 0.5f, 0.5f, 0.0f});
+
+  abcg::glDrawBuffers(1, drawBuffers.data());
+  abcg::glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                               GL_TEXTURE_2D, 0, 0);
+  abcg::glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
+                               GL_TEXTURE_2D, 0, 0);
+  abcg::glBindFramebuffer(GL_FRAMEBUFFER, gsl::narrow<GLuint>(framebuffer));
+  abcg::glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+  abcg::glDeleteBuffers(1, &unlitMaterialUBO);
+
+  // Uniform variables that depend only on the mesh and the atlas
+  abcg::glUseProgram(m_program);
+  glm::vec4 const boundingSphere{sphere.center, sphere.radius};
+  abcg::glUniform4fv(abcg::glGetUniformLocation(m_program, "boundingSphere"),
+                     1, &boundingSphere.x);
+  abcg::glUniform1f(abcg::glGetUniformLocation(m_program, "framesPerSide"),
+                    gsl::narrow<float>(framesPerSide));
+  abcg::glUniform1f(abcg::glGetUniformLocation(m_program, "frameTexelSize"),
+                    1.0f / gsl::narrow<float>(frameSize));
+  abcg::glUniform1i(abcg::glGetUniformLocation(m_program, "colorTex"),
+                    colorUnit);
+  abcg::glUniform1i(abcg::glGetUniformLocation(m_program, "normalDepthTex"),
+                    normalDepthUnit);
+  abcg::glUniform1i(abcg::glGetUniformLocation(m_program, "materialTex"),
+                    materialUnit);
+  abcg::glUseProgram(0);
+}
+
+std::size_t Impostors::select(std::span<DiceTransform const> transforms,
+                              BoundingSphere const &sphere,
+                              glm::mat4 const &viewMatrix,
+                              glm::mat4 const &projMatrix,
+                              std::span<std::uint8_t> visibility,
+                              std::span<std::uint8_t> impostors) {
+  std::size_t count{};
+  for (auto &&[transform, visible, impostor] :
+       iter::zip(transforms, visibility, impostors)) {
+    impostor = 0;
+    if (visible == 0)
+      continue;
+
+    // Same as in cull.comp. The model matrix is a rotation times a uniform
+    // scale, so the radius is only scaled
+    auto const scale{glm::length(glm::vec3{transform.modelMatrix[0]})};
+    auto const center{viewMatrix * transform.modelMatrix *
+                      glm::vec4{sphere.center, 1.0f}};
+    auto const depth{std::max(-center.z, 1e-4f)};
+    auto const size{sphere.radius * scale * projMatrix[1][1] / depth};
+    if (size < sizeThreshold) {
+      visible = 0;
+      impostor = 1;
+      ++count;
+    }
+  }
+  return count;
+}
+
+void Impostors::bindAtlas() const {
+  abcg::glActiveTexture(GL_TEXTURE0 + colorUnit);
+  abcg::glBindTexture(GL_TEXTURE_2D, m_colorTexture);
+  abcg::glActiveTexture(GL_TEXTURE0 + normalDepthUnit);
+  abcg::glBindTexture(GL_TEXTURE_2D, m_normalDepthTexture);
+  abcg::glActiveTexture(GL_TEXTURE0 + materialUnit);
+  abcg::glBindTexture(GL_TEXTURE_2D, m_materialTexture);
+  abcg::glActiveTexture(GL_TEXTURE0);
+}
+
+void Impostors::render(std::span<DiceTransform const> transforms,
+                       std::span<std::uint8_t const> selection) {
+  m_instances.clear();
+  for (auto &&[transform, selected] : iter::zip(transforms, selection)) {
+    if (selected != 0)
+      m_instances.push_back(transform);
+  }
+  if (m_instances.empty())
+    return;
+
+  // Written to a region that the previous frames are no longer reading
+  auto const size{
+      gsl::narrow<GLsizeiptr>(sizeof(DiceTransform) * m_instances.size())};
+  m_instanceStream.reserve(size);
+  m_instanceStream.beginFrame();
+  auto const allocation{m_instanceStream.allocate(size)};
+  std::memcpy(allocation.data, m_instances.data(),
+              sizeof(DiceTransform) * m_instances.size());
+  m_instanceStream.flush();
+
+  auto const offset{gsl::narrow<std::size_t>(allocation.offset)};
+  abcg::glBindVertexArray(m_VAO);
+  abcg::glBindBuffer(GL_ARRAY_BUFFER, allocation.buffer);
+  for (auto const column : iter::range<GLuint>(4)) {
+    abcg::glVertexAttribPointer(
+        modelMatrixLocation + column, 4, GL_FLOAT, GL_FALSE,
+        sizeof(DiceTransform),
+        reinterpret_cast<void *>(offset + offsetof(DiceTransform, modelMatrix) +
+                                 column * sizeof(glm::vec4)));
+  }
+  for (auto const column : iter::range<GLuint>(3)) {
+    abcg::glVertexAttribPointer(
+        normalMatrixLocation + column, 3, GL_FLOAT, GL_FALSE,
+        sizeof(DiceTransform),
+        reinterpret_cast<void *>(offset +
+                                 offsetof(DiceTransform, normalMatrix) +
+                                 column * sizeof(glm::vec3)));
+  }
+  abcg::glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  bindAtlas();
+  abcg::glDrawElementsInstanced(GL_TRIANGLES, getIndexCount(),
+                                GL_UNSIGNED_INT, nullptr,
+                                gsl::narrow<GLsizei>(m_instances.size()));
+  abcg::glBindVertexArray(0);
+  m_instanceStream.endFrame();
+}
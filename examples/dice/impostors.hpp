@@ -0,0 +1,91 @@
+#ifndef IMPOSTORS_HPP_
+#define IMPOSTORS_HPP_
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "abcgOpenGL.hpp"
+#include "dices.hpp"
+#include "transforms.hpp"
+
+// Impostors of the die, drawn instead of the mesh for the dice that cover only
+// a few pixels.
+//
+// When the model is loaded, the mesh is rendered with an orthographic
+// projection from directions sampled on an octahedron into the frames of an
+// atlas: one texture with the unlit color and the coverage, one with the
+// normal and the depth in model space, and one with the material. Each
+// impostor is a quad through the center of the die that faces the camera. Its
+// vertex shader finds the direction of the camera in model space, and the
+// four frames around it on the octahedral grid, which the fragment shader
+// blends and lights as dice.frag, with the material of the frame of largest
+// weight. The depth of the mesh is written, so that the impostors are hidden
+// by the dice in front of them and the other way around.
+//
+// The per-instance attributes are the same as in dice_instanced.vert, so the
+// impostors can also be drawn from the instances written by GpuCulling. Only
+// OpenGL ES 3.0 features are used.
+class Impostors {
+public:
+  // Radius of the projected bounding sphere, relative to half the viewport
+  // height, below which a die is drawn as an impostor. The same as the
+  // coarsest level of detail of GpuCulling, and close to the size of a frame
+  // at 1080p
+  static constexpr float sizeThreshold{0.05f};
+
+  void create(std::string const &shadersPath);
+  void destroy();
+
+  [[nodiscard]] bool isCreated() const { return m_program != 0; }
+
+  // Renders the atlas of the mesh of the dice. The color is rendered by the
+  // given program, made of dice.vert and dice.frag, with its vertex array set
+  // up by Dices::setupVAO
+  void bake(Dices const &dices, GLuint program, int mappingMode);
+
+  // Program used by render, with the same uniform variables and Materials
+  // block as dice.frag except for the texture and the mapping mode
+  [[nodiscard]] GLuint getProgram() const { return m_program; }
+  // Index buffer of the quad, whose vertices are numbered from 0 to 3
+  [[nodiscard]] GLuint getIndexBuffer() const { return m_EBO; }
+  [[nodiscard]] static GLsizei getIndexCount() { return 6; }
+
+  // Moves the dice with visibility[i] != 0 whose projected size is below
+  // sizeThreshold to impostors[i], and returns their number
+  static std::size_t select(std::span<DiceTransform const> transforms,
+                            BoundingSphere const &sphere,
+                            glm::mat4 const &viewMatrix,
+                            glm::mat4 const &projMatrix,
+                            std::span<std::uint8_t> visibility,
+                            std::span<std::uint8_t> impostors);
+
+  // Binds the atlas to the texture units read by the program
+  void bindAtlas() const;
+  // Draws the dice with selection[i] != 0. The program must be in use
+  void render(std::span<DiceTransform const> transforms,
+              std::span<std::uint8_t const> selection);
+
+private:
+  // Frames along each side of the atlas, and their size in texels
+  static constexpr GLsizei framesPerSide{16};
+  static constexpr GLsizei frameSize{64};
+
+  GLuint m_program{};
+  GLuint m_bakeProgram{};
+
+  GLuint m_colorTexture{};
+  GLuint m_normalDepthTexture{};
+  GLuint m_materialTexture{};
+  GLuint m_bakeFBO{};
+  GLuint m_bakeDepthRBO{};
+
+  GLuint m_EBO{};
+  GLuint m_VAO{};
+  // Instances of render, written to a different range every frame
+  abcg::OpenGLStreamBuffer m_instanceStream;
+  std::vector<DiceTransform> m_instances;
+};
+
+#endif
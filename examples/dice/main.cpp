@@ -1,3 +1,9 @@
+#include <charconv>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+
 #include "window.hpp"
 
 int main(int argc, char **argv) {
@@ -5,15 +11,106 @@ int main(int argc, char **argv) {
     abcg::Application app(argc, argv);
 
     Window window;
-    window.setOpenGLSettings({.samples = 4});
+    // OpenGL 4.3 enables culling on the GPU. If not supported, the context
+    // falls back to 3.3
+    window.setOpenGLSettings({.majorVersion = 4, .minorVersion = 3});
+    // Anti-aliasing is done in an offscreen target, so that it can be changed
+    // at runtime (F5)
+    window.setAntiAliasingSettings(
+        {.method = abcg::OpenGLAntiAliasing::MSAA, .samples = 4});
     window.setWindowSettings({
         .width = 600,
         .height = 600,
         .showFPS = false,
         .showFullscreenButton = false,
         .title = "Dice",
+        .renderOnDemand = true,
     });
 
+    // Usage: dice [--headless [frame count] [frame path] [reference path]]
+    //             [--gpu-simulation [dice count]]
+    //             [--validate-simulation [dice count]]
+    //             [--target-frame-time <milliseconds>]
+    //             [--anti-aliasing <none|fxaa|msaa[2|4|8|16]>]
+    //             [--trace <path> [--trace-frames <first>:<last>]]
+    // The --trace options are handled by abcg::Application
+    std::span const args{argv, static_cast<std::size_t>(argc)};
+    auto const isValue{[&args](std::size_t index) {
+      return args.size() > index &&
+             !std::string_view{args[index]}.starts_with("--");
+    }};
+
+    if (args.size() > 1 && std::string_view{args[1]} == "--headless") {
+      abcg::OpenGLHeadlessSettings headlessSettings{.enabled = true};
+      if (isValue(2)) {
+        headlessSettings.frameCount = std::stoi(args[2]);
+      }
+      if (isValue(2) && isValue(3)) {
+        headlessSettings.framePath = args[3];
+      }
+      // Saved frames are compared with these, e.g., on CI
+      if (isValue(2) && isValue(3) && isValue(4)) {
+        headlessSettings.referencePath = args[4];
+      }
+      window.setHeadlessSettings(headlessSettings);
+    }
+
+    GpuSimulationSettings gpuSimulationSettings;
+    for (std::size_t index{1}; index < args.size(); ++index) {
+      std::string_view const arg{args[index]};
+      if (arg == "--gpu-simulation") {
+        gpuSimulationSettings.enabled = true;
+        if (isValue(index + 1)) {
+          gpuSimulationSettings.quantity = std::stoi(args[index + 1]);
+        }
+      } else if (arg == "--validate-simulation") {
+        gpuSimulationSettings.validate = true;
+        if (isValue(index + 1)) {
+          gpuSimulationSettings.validationQuantity = std::stoi(args[index + 1]);
+        }
+      } else if (arg == "--target-frame-time" && isValue(index + 1)) {
+        // Scale the resolution of the scene to keep the GPU time within the
+        // budget, e.g., on fullscreen kiosks with weak GPUs
+        window.setDynamicResolutionSettings(
+            {.enabled = true, .targetFrameTime = std::stod(args[index + 1])});
+      } else if (arg == "--anti-aliasing" && isValue(index + 1)) {
+        // FXAA needs a fraction of the memory of MSAA, e.g., on integrated
+        // GPUs
+        std::string_view const mode{args[index + 1]};
+        if (mode == "none") {
+          window.setAntiAliasingSettings(
+              {.method = abcg::OpenGLAntiAliasing::None});
+        } else if (mode == "fxaa") {
+          window.setAntiAliasingSettings(
+              {.method = abcg::OpenGLAntiAliasing::FXAA});
+        } else if (mode.starts_with("msaa")) {
+          // 4 samples if not given
+          auto const count{mode.substr(4)};
+          auto samples{4};
+          auto const [end, error]{std::from_chars(
+              count.data(), count.data() + count.size(), samples)};
+          auto const parsed{count.empty() ||
+                            (error == std::errc{} &&
+                             end == count.data() + count.size())};
+          if (!parsed || (samples != 2 && samples != 4 && samples != 8 &&
+                          samples != 16)) {
+            throw abcg::RuntimeError(fmt::format(
+                "Invalid MSAA sample count in --anti-aliasing {}: expected "
+                "msaa2, msaa4, msaa8 or msaa16",
+                mode));
+          }
+          window.setAntiAliasingSettings(
+              {.method = abcg::OpenGLAntiAliasing::MSAA, .samples = samples});
+        } else {
+          throw abcg::RuntimeError(fmt::format(
+              "Unknown mode in --anti-aliasing {}: expected none, fxaa or "
+              "msaa[2|4|8|16]",
+              mode));
+        }
+      }
+    }
+    window.setGpuSimulationSettings(gpuSimulationSettings);
+
     app.run(window);
   } catch (std::exception const &exception) {
     fmt::print(stderr, "{}\n", exception.what());
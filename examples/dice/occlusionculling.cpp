@@ -0,0 +1,476 @@
+#include "occlusionculling.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+#include <cppitertools/itertools.hpp>
+
+namespace {
+// Saves the framebuffer, viewport and program bound by the caller, and
+// restores them when it goes out of scope
+class SavedState {
+public:
+  SavedState() {
+    abcg::glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &m_framebuffer);
+    abcg::glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &m_readFramebuffer);
+    abcg::glGetIntegerv(GL_VIEWPORT, m_viewport.data());
+    abcg::glGetIntegerv(GL_CURRENT_PROGRAM, &m_program);
+  }
+  SavedState(SavedState const &) = delete;
+  SavedState &operator=(SavedState const &) = delete;
+  ~SavedState() {
+    abcg::glBindFramebuffer(GL_DRAW_FRAMEBUFFER,
+                            gsl::narrow<GLuint>(m_framebuffer));
+    abcg::glBindFramebuffer(GL_READ_FRAMEBUFFER,
+                            gsl::narrow<GLuint>(m_readFramebuffer));
+    abcg::glViewport(m_viewport[0], m_viewport[1], m_viewport[2],
+                     m_viewport[3]);
+    abcg::glUseProgram(gsl::narrow<GLuint>(m_program));
+  }
+
+  [[nodiscard]] GLuint getFramebuffer() const {
+    return gsl::narrow<GLuint>(m_framebuffer);
+  }
+
+private:
+  GLint m_framebuffer{};
+  GLint m_readFramebuffer{};
+  std::array<GLint, 4> m_viewport{};
+  GLint m_program{};
+};
+
+// Internal format of the depth buffer of the framebuffer bound for reading.
+// Blitting the depth requires the same format on both sides
+GLenum getDepthFormat(GLuint framebuffer) {
+  auto const getParameter{[framebuffer](GLenum defaultAttachment,
+                                        GLenum attachment, GLenum name) {
+    GLint value{};
+    abcg::glGetFramebufferAttachmentParameteriv(
+        GL_READ_FRAMEBUFFER, framebuffer == 0 ? defaultAttachment : attachment,
+        name, &value);
+    return value;
+  }};
+
+  auto const floatDepth{getParameter(GL_DEPTH, GL_DEPTH_ATTACHMENT,
+                                     GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE) ==
+                        GL_FLOAT};
+  auto const depthBits{getParameter(GL_DEPTH, GL_DEPTH_ATTACHMENT,
+                                    GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE)};
+  auto const hasStencil{
+      getParameter(GL_STENCIL, GL_STENCIL_ATTACHMENT,
+                   GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE) != GL_NONE &&
+      getParameter(GL_STENCIL, GL_STENCIL_ATTACHMENT,
+                   GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE) > 0};
+
+  if (hasStencil) {
+    return floatDepth ? GL_DEPTH32F_STENCIL8 : GL_DEPTH24_STENCIL8;
+  }
+  if (floatDepth) {
+    return GL_DEPTH_COMPONENT32F;
+  }
+  return depthBits > 16 ? GL_DEPTH_COMPONENT24 : GL_DEPTH_COMPONENT16;
+}
+} // namespace
+
+void OcclusionCulling::create(std::string const &shadersPath) {
+  destroy();
+
+  m_downsampleProgram = abcg::createOpenGLProgram(
+      {{.source = shadersPath + "hiz_downsample.vert",
+        .stage = abcg::ShaderStage::Vertex},
+       {.source = shadersPath + "hiz_downsample.frag",
+        .stage = abcg::ShaderStage::Fragment}});
+  m_testProgram = abcg::createOpenGLProgram(
+      {{.source = shadersPath + "hiz_test.vert",
+        .stage = abcg::ShaderStage::Vertex},
+       {.source = shadersPath + "hiz_test.frag",
+        .stage = abcg::ShaderStage::Fragment}});
+
+  m_resultSizeLoc = abcg::glGetUniformLocation(m_testProgram, "resultSize");
+  m_maxLevelLoc = abcg::glGetUniformLocation(m_testProgram, "maxLevel");
+
+  abcg::glGenFramebuffers(1, &m_depthFBO);
+  abcg::glGenFramebuffers(1, &m_resultFBO);
+
+  // Depth only
+  abcg::glBindFramebuffer(GL_FRAMEBUFFER, m_depthFBO);
+  GLenum const drawBuffer{GL_NONE};
+  abcg::glDrawBuffers(1, &drawBuffer);
+  abcg::glReadBuffer(GL_NONE);
+  abcg::glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  abcg::glGenVertexArrays(1, &m_emptyVAO);
+
+  // The inputs are written to a different range of the stream buffer every
+  // frame, so the attribute pointers are set by test
+  m_testStream.create(gsl::narrow<GLsizeiptr>(sizeof(TestInput) * 1024));
+  abcg::glGenVertexArrays(1, &m_testVAO);
+  abcg::glBindVertexArray(m_testVAO);
+  abcg::glEnableVertexAttribArray(0);
+  abcg::glEnableVertexAttribArray(1);
+  abcg::glBindVertexArray(0);
+
+#if !defined(__EMSCRIPTEN__)
+  for (auto &readback : m_readbacks) {
+    abcg::glGenBuffers(1, &readback.buffer);
+  }
+#endif
+}
+
+void OcclusionCulling::destroy() {
+  abcg::glDeleteProgram(m_downsampleProgram);
+  abcg::glDeleteProgram(m_testProgram);
+  abcg::glDeleteTextures(1, &m_depthTexture);
+  abcg::glDeleteTextures(1, &m_resultTexture);
+  abcg::glDeleteFramebuffers(1, &m_depthFBO);
+  abcg::glDeleteFramebuffers(1, &m_resultFBO);
+  abcg::glDeleteVertexArrays(1, &m_emptyVAO);
+  abcg::glDeleteVertexArrays(1, &m_testVAO);
+  m_testStream.destroy();
+  for (auto &readback : m_readbacks) {
+    abcg::glDeleteBuffers(1, &readback.buffer);
+    if (readback.fence != nullptr) {
+      abcg::glDeleteSync(readback.fence);
+    }
+    readback = {};
+  }
+  m_readbackIndex = 0;
+  m_hasResults = false;
+
+  m_downsampleProgram = 0;
+  m_testProgram = 0;
+  m_depthTexture = 0;
+  m_resultTexture = 0;
+  m_depthFBO = 0;
+  m_resultFBO = 0;
+  m_emptyVAO = 0;
+  m_testVAO = 0;
+  m_pyramidSize = {};
+  m_pyramidFormat = 0;
+  m_levelCount = 0;
+  m_resultHeight = 0;
+}
+
+void OcclusionCulling::resizePyramid(glm::ivec2 size, GLenum format) {
+  if (size == m_pyramidSize && format == m_pyramidFormat)
+    return;
+  m_pyramidSize = size;
+  m_pyramidFormat = format;
+
+  auto const hasStencil{format == GL_DEPTH24_STENCIL8 ||
+                        format == GL_DEPTH32F_STENCIL8};
+  auto type{GLenum{GL_UNSIGNED_INT}};
+  switch (format) {
+  case GL_DEPTH32F_STENCIL8:
+    type = GL_FLOAT_32_UNSIGNED_INT_24_8_REV;
+    break;
+  case GL_DEPTH24_STENCIL8:
+    type = GL_UNSIGNED_INT_24_8;
+    break;
+  case GL_DEPTH_COMPONENT32F:
+    type = GL_FLOAT;
+    break;
+  case GL_DEPTH_COMPONENT16:
+    type = GL_UNSIGNED_SHORT;
+    break;
+  default:
+    break;
+  }
+
+  // Full chain down to 1x1, so that the coarsest level covers any rectangle
+  m_levelCount =
+      static_cast<GLint>(std::floor(std::log2(std::max(size.x, size.y)))) + 1;
+
+  abcg::glDeleteTextures(1, &m_depthTexture);
+  abcg::glGenTextures(1, &m_depthTexture);
+  abcg::glBindTexture(GL_TEXTURE_2D, m_depthTexture);
+  auto levelSize{size};
+  for (auto const level : iter::range(m_levelCount)) {
+    abcg::glTexImage2D(GL_TEXTURE_2D, level, gsl::narrow<GLint>(format),
+                       levelSize.x, levelSize.y, 0,
+                       hasStencil ? GL_DEPTH_STENCIL : GL_DEPTH_COMPONENT,
+                       type, nullptr);
+    levelSize = glm::max(levelSize / 2, 1);
+  }
+  // Only read with texelFetch
+  abcg::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                        GL_NEAREST_MIPMAP_NEAREST);
+  abcg::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  abcg::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  abcg::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  abcg::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, m_levelCount - 1);
+  abcg::glBindTexture(GL_TEXTURE_2D, 0);
+
+  // Bound for drawing only, as the depth buffer to copy is bound for reading
+  abcg::glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_depthFBO);
+  abcg::glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                               GL_TEXTURE_2D, m_depthTexture, 0);
+  if (abcg::glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) !=
+      GL_FRAMEBUFFER_COMPLETE) {
+    throw abcg::RuntimeError("Failed to create depth pyramid framebuffer");
+  }
+}
+
+void OcclusionCulling::resizeResults(std::size_t count) {
+  auto const height{
+      gsl::narrow<GLsizei>((count + resultWidth - 1) / resultWidth)};
+  if (height <= m_resultHeight)
+    return;
+  m_resultHeight = height;
+
+  abcg::glDeleteTextures(1, &m_resultTexture);
+  abcg::glGenTextures(1, &m_resultTexture);
+  abcg::glBindTexture(GL_TEXTURE_2D, m_resultTexture);
+  abcg::glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, resultWidth, m_resultHeight,
+                     0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  abcg::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  abcg::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  abcg::glBindTexture(GL_TEXTURE_2D, 0);
+
+  abcg::glBindFramebuffer(GL_FRAMEBUFFER, m_resultFBO);
+  abcg::glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                               GL_TEXTURE_2D, m_resultTexture, 0);
+  if (abcg::glCheckFramebufferStatus(GL_FRAMEBUFFER) !=
+      GL_FRAMEBUFFER_COMPLETE) {
+    throw abcg::RuntimeError("Failed to create occlusion test framebuffer");
+  }
+}
+
+void OcclusionCulling::buildPyramid(glm::ivec2 size) {
+  abcg::TraceScope const traceScope{"OcclusionCulling::buildPyramid", "dice"};
+
+  SavedState const savedState;
+  auto const framebuffer{savedState.getFramebuffer()};
+  abcg::glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+  resizePyramid(size, getDepthFormat(framebuffer));
+
+  // Level 0: copy of the depth drawn so far. A multisampled depth buffer is
+  // resolved to one of the samples of each pixel
+  abcg::glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_depthFBO);
+  abcg::glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                               GL_TEXTURE_2D, m_depthTexture, 0);
+  abcg::glBlitFramebuffer(0, 0, size.x, size.y, 0, 0, size.x, size.y,
+                          GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+  abcg::glBindFramebuffer(GL_FRAMEBUFFER, m_depthFBO);
+
+  // Coarser levels: farthest depth of each 2x2 block of the previous level.
+  // The previous level is the only one that can be sampled, so that the
+  // level being written is never read
+  abcg::glUseProgram(m_downsampleProgram);
+  abcg::glBindVertexArray(m_emptyVAO);
+  abcg::glActiveTexture(GL_TEXTURE0);
+  abcg::glBindTexture(GL_TEXTURE_2D, m_depthTexture);
+  abcg::glDepthFunc(GL_ALWAYS);
+
+  auto levelSize{size};
+  for (auto const level : iter::range(1, m_levelCount)) {
+    levelSize = glm::max(levelSize / 2, 1);
+    abcg::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+    abcg::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+    abcg::glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                 GL_TEXTURE_2D, m_depthTexture, level);
+    abcg::glViewport(0, 0, levelSize.x, levelSize.y);
+    abcg::glDrawArrays(GL_TRIANGLES, 0, 3);
+  }
+
+  abcg::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+  abcg::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, m_levelCount - 1);
+  abcg::glBindTexture(GL_TEXTURE_2D, 0);
+  abcg::glBindVertexArray(0);
+  abcg::glDepthFunc(GL_LESS);
+}
+
+void OcclusionCulling::test(std::span<DiceTransform const> transforms,
+                            BoundingBox const &box,
+                            glm::mat4 const &viewProjMatrix,
+                            std::span<std::uint8_t const> visibility) {
+  abcg::TraceScope const traceScope{"OcclusionCulling::test", "dice"};
+
+  std::array<glm::vec4, 8> corners{};
+  for (auto const index : iter::range(corners.size())) {
+    corners[index] = {(index & 1U) != 0 ? box.max.x : box.min.x,
+                      (index & 2U) != 0 ? box.max.y : box.min.y,
+                      (index & 4U) != 0 ? box.max.z : box.min.z, 1.0f};
+  }
+
+  // Written to a region whose results were read back or dropped
+  auto &readback{m_readbacks.at(m_readbackIndex)};
+  m_readbackIndex = (m_readbackIndex + 1) % readbackLatency;
+  if (readback.fence != nullptr) {
+    abcg::glDeleteSync(readback.fence);
+    readback.fence = nullptr;
+  }
+  readback.diceCount = transforms.size();
+
+  // Project the bounding boxes. Dice that cross the plane of the camera are
+  // always visible, and are not tested
+  m_inputs.clear();
+  readback.candidates.clear();
+  for (auto &&[index, transform, visible] :
+       iter::zip(iter::range(transforms.size()), transforms, visibility)) {
+    if (visible == 0)
+      continue;
+
+    auto const modelViewProjMatrix{viewProjMatrix * transform.modelMatrix};
+    glm::vec2 rectMin{1.0f};
+    glm::vec2 rectMax{0.0f};
+    auto depth{1.0f};
+    auto crossesCamera{false};
+    for (auto const &corner : corners) {
+      auto const position{modelViewProjMatrix * corner};
+      if (position.w <= 0.0f) {
+        crossesCamera = true;
+        break;
+      }
+      // From normalized device coordinates to texture coordinates and depth
+      auto const window{glm::vec3{position} / position.w * 0.5f + 0.5f};
+      rectMin = glm::min(rectMin, glm::vec2{window});
+      rectMax = glm::max(rectMax, glm::vec2{window});
+      depth = std::min(depth, window.z);
+    }
+    if (crossesCamera)
+      continue;
+
+    m_inputs.push_back({.rect = glm::clamp(glm::vec4{rectMin, rectMax}, 0.0f,
+                                           1.0f),
+                        .depth = depth});
+    readback.candidates.push_back(index);
+  }
+
+  if (m_inputs.empty()) {
+#if defined(__EMSCRIPTEN__)
+    applyResults(readback, {});
+#else
+    // Fenced anyway, so that the results stay in the order of the tests
+    readback.fence = abcg::glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#endif
+    return;
+  }
+
+  SavedState const savedState;
+  resizeResults(m_inputs.size());
+
+  // Written to a region that the previous frames are no longer reading
+  auto const size{
+      gsl::narrow<GLsizeiptr>(sizeof(TestInput) * m_inputs.size())};
+  m_testStream.reserve(size);
+  m_testStream.beginFrame();
+  auto const allocation{m_testStream.allocate(size)};
+  std::memcpy(allocation.data, m_inputs.data(),
+              sizeof(TestInput) * m_inputs.size());
+  m_testStream.flush();
+
+  auto const offset{gsl::narrow<std::size_t>(allocation.offset)};
+  abcg::glBindVertexArray(m_testVAO);
+  abcg::glBindBuffer(GL_ARRAY_BUFFER, allocation.buffer);
+  abcg::glVertexAttribPointer(
+      0, 4, GL_FLOAT, GL_FALSE, sizeof(TestInput),
+      reinterpret_cast<void *>(offset + offsetof(TestInput, rect)));
+  abcg::glVertexAttribPointer(
+      1, 1, GL_FLOAT, GL_FALSE, sizeof(TestInput),
+      reinterpret_cast<void *>(offset + offsetof(TestInput, depth)));
+  abcg::glBindBuffer(GL_ARRAY_BUFFER, 0);
+  abcg::glBindVertexArray(0);
+
+  // One point per die, written to one texel of the result texture
+  abcg::glBindFramebuffer(GL_FRAMEBUFFER, m_resultFBO);
+  abcg::glViewport(0, 0, resultWidth, m_resultHeight);
+  abcg::glDisable(GL_DEPTH_TEST);
+
+  abcg::glUseProgram(m_testProgram);
+  abcg::glUniform2i(m_resultSizeLoc, resultWidth, m_resultHeight);
+  abcg::glUniform1i(m_maxLevelLoc, m_levelCount - 1);
+  abcg::glActiveTexture(GL_TEXTURE0);
+  abcg::glBindTexture(GL_TEXTURE_2D, m_depthTexture);
+
+  abcg::glBindVertexArray(m_testVAO);
+  abcg::glDrawArrays(GL_POINTS, 0, gsl::narrow<GLsizei>(m_inputs.size()));
+  abcg::glBindVertexArray(0);
+  m_testStream.endFrame();
+
+  abcg::glBindTexture(GL_TEXTURE_2D, 0);
+  abcg::glEnable(GL_DEPTH_TEST);
+
+  // Rows that are only partially used are read whole
+  auto const rows{
+      gsl::narrow<GLsizei>((m_inputs.size() + resultWidth - 1) / resultWidth)};
+  auto const byteSize{static_cast<std::size_t>(resultWidth * rows) * 4};
+#if defined(__EMSCRIPTEN__)
+  // WebGL 2 cannot map buffers, and waits for the results here instead
+  m_pixels.resize(byteSize);
+  abcg::glReadPixels(0, 0, resultWidth, rows, GL_RGBA, GL_UNSIGNED_BYTE,
+                     m_pixels.data());
+  applyResults(readback, m_pixels);
+#else
+  abcg::glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+  if (readback.bufferSize < gsl::narrow<GLsizeiptr>(byteSize)) {
+    readback.bufferSize = gsl::narrow<GLsizeiptr>(byteSize);
+    abcg::glBufferData(GL_PIXEL_PACK_BUFFER, readback.bufferSize, nullptr,
+                       GL_STREAM_READ);
+  }
+  abcg::glReadPixels(0, 0, resultWidth, rows, GL_RGBA, GL_UNSIGNED_BYTE,
+                     nullptr);
+  abcg::glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  readback.fence = abcg::glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#endif
+}
+
+bool OcclusionCulling::readResults(std::span<std::uint8_t> visibility) {
+#if !defined(__EMSCRIPTEN__)
+  // From the oldest test to the newest. The fences are signaled in the same
+  // order, so the ones after a test still in flight are also in flight
+  for (auto const offset : iter::range(readbackLatency)) {
+    auto &readback{
+        m_readbacks.at((m_readbackIndex + offset) % readbackLatency)};
+    if (readback.fence == nullptr)
+      continue;
+
+    auto const status{abcg::glClientWaitSync(readback.fence, 0, 0)};
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+      break;
+    abcg::glDeleteSync(readback.fence);
+    readback.fence = nullptr;
+
+    if (readback.candidates.empty()) {
+      applyResults(readback, {});
+      continue;
+    }
+    auto const byteSize{
+        (readback.candidates.size() + resultWidth - 1) / resultWidth *
+        resultWidth * 4};
+    abcg::glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+    if (auto const *data{abcg::glMapBufferRange(
+            GL_PIXEL_PACK_BUFFER, 0, gsl::narrow<GLsizeiptr>(byteSize),
+            GL_MAP_READ_BIT)}) {
+      applyResults(readback,
+                   {static_cast<std::uint8_t const *>(data), byteSize});
+      abcg::glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    abcg::glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  }
+#endif
+
+  if (!std::exchange(m_hasResults, false) ||
+      m_results.size() != visibility.size())
+    return false;
+  std::ranges::copy(m_results, visibility.begin());
+  return true;
+}
+
+// Makes the results of a test, given the texels of the result texture, the
+// latest ones
+void OcclusionCulling::applyResults(Readback const &readback,
+                                    std::span<std::uint8_t const> pixels) {
+  m_results.assign(readback.diceCount, 1);
+  for (auto &&[result, candidate] :
+       iter::zip(iter::range(readback.candidates.size()),
+                 readback.candidates)) {
+    if (pixels[result * 4] == 0) {
+      m_results[candidate] = 0;
+    }
+  }
+  m_hasResults = true;
+}
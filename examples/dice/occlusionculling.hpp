@@ -0,0 +1,115 @@
+#ifndef OCCLUSIONCULLING_HPP_
+#define OCCLUSIONCULLING_HPP_
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "abcgOpenGL.hpp"
+#include "dices.hpp"
+#include "transforms.hpp"
+
+// Hierarchical-Z occlusion culling for the per-die path.
+//
+// The depth buffer after the first pass, which usually draws the dice visible
+// in the last frame, is copied to a depth texture whose mip levels are then
+// reduced to the farthest depth of each 2x2 block. The screen-space rectangle
+// of the bounding box of each die is tested against the level in which it
+// covers at most 2x2 texels: the die is hidden if its nearest point is behind
+// all of them. The tests run in a fragment shader, one point per die, and the
+// results are read back through a pixel buffer, so that the CPU never waits
+// for them. The second pass draws the dice found visible by the latest test
+// whose results have arrived, usually the one of the last frame.
+//
+// Only OpenGL ES 3.0 features are used, so it also works on WebGL 2, where
+// the results are read back in the same frame.
+class OcclusionCulling {
+public:
+  void create(std::string const &shadersPath);
+  void destroy();
+
+  [[nodiscard]] bool isCreated() const { return m_downsampleProgram != 0; }
+
+  // Copies the depth buffer of the framebuffer bound for drawing, of the
+  // given size, to the pyramid, and builds the coarser levels
+  void buildPyramid(glm::ivec2 size);
+
+  // Tests the dice with visibility[i] != 0 against the pyramid. The results
+  // are available from readResults once the GPU is done with them
+  void test(std::span<DiceTransform const> transforms, BoundingBox const &box,
+            glm::mat4 const &viewProjMatrix,
+            std::span<std::uint8_t const> visibility);
+
+  // Sets visibility[i] to 0 if the latest test whose results have arrived
+  // found die i hidden, and to 1 otherwise, also if it was not tested. Returns
+  // false, and leaves visibility as is, if there are no new results or if
+  // they are of another number of dice
+  bool readResults(std::span<std::uint8_t> visibility);
+
+private:
+  // Per-die input of the test pass
+  struct TestInput {
+    // Minimum and maximum texture coordinates of the projected bounding box
+    glm::vec4 rect{};
+    // Nearest window-space depth of the bounding box
+    float depth{};
+  };
+
+  // Results of a test on their way to the CPU
+  struct Readback {
+    GLuint buffer{};
+    GLsizeiptr bufferSize{};
+    GLsync fence{};
+    std::size_t diceCount{};
+    // Dice tested, in the order of the results
+    std::vector<std::size_t> candidates;
+  };
+
+  // Width of the texture with the test results, one texel per die
+  static constexpr GLsizei resultWidth{256};
+  // Number of tests that can be in flight, after which the oldest results
+  // are dropped
+  static constexpr std::size_t readbackLatency{3};
+
+  GLuint m_downsampleProgram{};
+  GLuint m_testProgram{};
+
+  GLint m_resultSizeLoc{};
+  GLint m_maxLevelLoc{};
+
+  // Depth pyramid and the framebuffer used to render into each of its levels.
+  // Its format is the one of the depth buffer, as required to copy it
+  GLuint m_depthTexture{};
+  GLuint m_depthFBO{};
+  glm::ivec2 m_pyramidSize{};
+  GLenum m_pyramidFormat{};
+  GLint m_levelCount{};
+
+  GLuint m_resultTexture{};
+  GLuint m_resultFBO{};
+  GLsizei m_resultHeight{};
+
+  // Vertex array without attributes for the fullscreen passes
+  GLuint m_emptyVAO{};
+  GLuint m_testVAO{};
+  abcg::OpenGLStreamBuffer m_testStream;
+
+  std::vector<TestInput> m_inputs;
+  std::array<Readback, readbackLatency> m_readbacks{};
+  // Next readback to be written, which is also the oldest one
+  std::size_t m_readbackIndex{};
+  // Visibility given by the latest test read back, and whether it was not
+  // yet returned by readResults
+  std::vector<std::uint8_t> m_results;
+  bool m_hasResults{};
+  std::vector<std::uint8_t> m_pixels;
+
+  void resizePyramid(glm::ivec2 size, GLenum format);
+  void resizeResults(std::size_t count);
+  void applyResults(Readback const &readback,
+                    std::span<std::uint8_t const> pixels);
+};
+
+#endif
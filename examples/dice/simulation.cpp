@@ -0,0 +1,143 @@
+#include "simulation.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+Simulation::~Simulation() { stop(); }
+
+void Simulation::start(Dices &dices, bool threaded) {
+  stop();
+
+  m_dices = &dices;
+#if defined(__EMSCRIPTEN__)
+  m_threaded = false;
+#else
+  m_threaded = threaded;
+#endif
+
+  // Publish the initial state before the first frame
+  step(0.0f);
+
+  if (m_threaded) {
+    m_running = true;
+    m_thread = std::thread{&Simulation::run, this};
+  }
+}
+
+void Simulation::stop() {
+  if (!m_thread.joinable())
+    return;
+
+  {
+    std::lock_guard const lock{m_wakeMutex};
+    m_running = false;
+    m_wakeRequested = true;
+  }
+  m_wakeCondition.notify_one();
+  m_thread.join();
+}
+
+// Returns false if the queue is full. The command can be sent again later
+bool Simulation::push(SimulationCommand const &command) {
+  if (!m_commands.push(command))
+    return false;
+  ++m_pushedCommands;
+
+  if (m_threaded) {
+    {
+      std::lock_guard const lock{m_wakeMutex};
+      m_wakeRequested = true;
+    }
+    m_wakeCondition.notify_one();
+  }
+  return true;
+}
+
+// Returns the latest snapshot, which is valid until the next call. The delta
+// time is used only if the simulation is not threaded
+DiceSnapshot const &Simulation::update(float deltaTime) {
+  if (!m_threaded && !m_paused) {
+    step(deltaTime);
+  }
+  m_snapshots.update();
+  return m_snapshots.getReadBuffer();
+}
+
+// Whether the dice are rolling or there are commands not yet simulated, i.e.,
+// whether the next snapshots will change
+bool Simulation::isBusy() const {
+  if (m_paused)
+    return false;
+
+  auto const &snapshot{m_snapshots.getReadBuffer()};
+  return snapshot.rolling || snapshot.appliedCommands < m_pushedCommands;
+}
+
+// Stops stepping the dice, as while they are simulated elsewhere. The commands
+// are kept until the simulation is resumed, and the last snapshot stays valid
+void Simulation::setPaused(bool paused) {
+  m_paused = paused;
+
+  if (m_threaded) {
+    {
+      std::lock_guard const lock{m_wakeMutex};
+      m_wakeRequested = true;
+    }
+    m_wakeCondition.notify_one();
+  }
+}
+
+void Simulation::run() {
+  abcg::Tracer::setThreadName("Simulation");
+
+  using Clock = std::chrono::steady_clock;
+  auto const period{std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<float>(stepTime))};
+
+  abcg::Timer timer;
+  auto nextStep{Clock::now()};
+  while (true) {
+    if (!m_paused) {
+      step(gsl::narrow_cast<float>(timer.restart()));
+    }
+
+    std::unique_lock lock{m_wakeMutex};
+    if (!m_paused && m_dices->isRolling()) {
+      // Step at a fixed rate
+      nextStep = std::max(nextStep + period, Clock::now());
+      m_wakeCondition.wait_until(lock, nextStep, [this] { return !m_running; });
+    } else {
+      // Sleep until there is a new command, or until resumed
+      m_wakeCondition.wait(lock, [this] { return m_wakeRequested; });
+      timer.restart();
+      nextStep = Clock::now();
+    }
+    m_wakeRequested = false;
+    if (!m_running)
+      break;
+  }
+}
+
+void Simulation::step(float deltaTime) {
+  abcg::TraceScope const scope{"Simulation::step", "dice"};
+
+  while (auto const command{m_commands.pop()}) {
+    switch (command->type) {
+    case SimulationCommand::Type::Roll:
+      m_dices->roll();
+      break;
+    case SimulationCommand::Type::SetQuantity:
+      m_dices->create(command->quantity);
+      break;
+    }
+    ++m_appliedCommands;
+  }
+
+  m_dices->update(deltaTime);
+
+  auto &snapshot{m_snapshots.getWriteBuffer()};
+  m_dices->copyStates(snapshot.dices);
+  snapshot.rolling = m_dices->isRolling();
+  snapshot.appliedCommands = m_appliedCommands;
+  m_snapshots.publish();
+}
@@ -0,0 +1,82 @@
+#ifndef SIMULATION_HPP_
+#define SIMULATION_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "abcgConcurrency.hpp"
+#include "dices.hpp"
+
+// Latest state of the dice, published by the simulation
+struct DiceSnapshot {
+  std::vector<DiceState> dices;
+  bool rolling{};
+  // Number of commands applied up to this snapshot
+  std::size_t appliedCommands{};
+};
+
+struct SimulationCommand {
+  enum class Type { Roll, SetQuantity };
+
+  Type type{Type::Roll};
+  int quantity{};
+};
+
+// Runs Dices::update on its own thread, so that a slow simulation step does
+// not delay frames and vice versa. The render thread sends commands through a
+// lock-free queue and reads the latest complete state from a triple buffer.
+//
+// If not threaded, as on WebAssembly or in headless mode, where the output
+// must be reproducible, the simulation is stepped by update instead.
+class Simulation {
+public:
+  // Time between the steps of the thread while the dice are rolling
+  static constexpr float stepTime{1.0f / 120.0f};
+
+  Simulation() = default;
+  Simulation(Simulation const &) = delete;
+  Simulation(Simulation &&) = delete;
+  Simulation &operator=(Simulation const &) = delete;
+  Simulation &operator=(Simulation &&) = delete;
+  ~Simulation();
+
+  void start(Dices &dices, bool threaded);
+  void stop();
+
+  // The following functions are called by the render thread
+  bool push(SimulationCommand const &command);
+  DiceSnapshot const &update(float deltaTime);
+  [[nodiscard]] bool isBusy() const;
+  void setPaused(bool paused);
+
+private:
+  void run();
+  void step(float deltaTime);
+
+  Dices *m_dices{};
+  bool m_threaded{};
+  std::thread m_thread;
+
+  // Used only to put the simulation thread to sleep while the dice are
+  // stopped, and to wake it up
+  std::mutex m_wakeMutex;
+  std::condition_variable m_wakeCondition;
+  bool m_wakeRequested{};
+  bool m_running{};
+  // Written by the render thread
+  std::atomic<bool> m_paused{};
+
+  abcg::SPSCQueue<SimulationCommand, 256> m_commands;
+  abcg::TripleBuffer<DiceSnapshot> m_snapshots;
+
+  // Written by the render thread
+  std::size_t m_pushedCommands{};
+  // Written by the simulation thread
+  std::size_t m_appliedCommands{};
+};
+
+#endif
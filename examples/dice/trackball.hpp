@@ -15,6 +15,11 @@ public:
   void setAxis(glm::vec3 const axis) noexcept { m_axis = axis; }
   void setVelocity(float const velocity) noexcept { m_velocity = velocity; }
 
+  // Whether the rotation changes with time, i.e., it is spinning on its own
+  [[nodiscard]] bool isSpinning() const noexcept {
+    return !m_mouseTracking && m_velocity > 0.0f;
+  }
+
 private:
   constexpr static float m_maxVelocity{glm::radians(720.0f)};
 
@@ -0,0 +1,135 @@
+#include "transforms.hpp"
+
+#include <algorithm>
+#include <array>
+
+namespace {
+// Number of dice processed together. The loops over the lanes have a fixed
+// trip count and no branches, so the compiler turns them into SIMD code: 8
+// floats fill one AVX register, or two SSE or NEON registers
+constexpr std::size_t laneCount{8};
+using Lanes = std::array<float, laneCount>;
+using Vec3Lanes = std::array<Lanes, 3>;
+// Indexed by [column][row], as in glm
+using Mat3Lanes = std::array<Vec3Lanes, 3>;
+// Quaternion components, in the order x, y, z, w
+using QuatLanes = std::array<Lanes, 4>;
+
+// Computes the rotation matrices of unit quaternions, as glm::mat3_cast
+void quatToMatrix(QuatLanes const &quats, Mat3Lanes &rotation) {
+  for (std::size_t lane{}; lane < laneCount; ++lane) {
+    auto const x{quats[0][lane]};
+    auto const y{quats[1][lane]};
+    auto const z{quats[2][lane]};
+    auto const w{quats[3][lane]};
+
+    auto const xx{x * x};
+    auto const yy{y * y};
+    auto const zz{z * z};
+    auto const xy{x * y};
+    auto const xz{x * z};
+    auto const yz{y * z};
+    auto const wx{w * x};
+    auto const wy{w * y};
+    auto const wz{w * z};
+
+    rotation[0][0][lane] = 1.0f - 2.0f * (yy + zz);
+    rotation[0][1][lane] = 2.0f * (xy + wz);
+    rotation[0][2][lane] = 2.0f * (xz - wy);
+    rotation[1][0][lane] = 2.0f * (xy - wz);
+    rotation[1][1][lane] = 1.0f - 2.0f * (xx + zz);
+    rotation[1][2][lane] = 2.0f * (yz + wx);
+    rotation[2][0][lane] = 2.0f * (xz + wy);
+    rotation[2][1][lane] = 2.0f * (yz - wx);
+    rotation[2][2][lane] = 1.0f - 2.0f * (xx + yy);
+  }
+}
+
+// Computes factor * (matrix * rotation), where matrix is the same for every
+// lane. The result is returned by value, so that the compiler knows that it
+// does not alias the input
+Mat3Lanes multiply(glm::mat3 const &matrix, Mat3Lanes const &rotation,
+                   float factor) {
+  Mat3Lanes result;
+  for (std::size_t column{}; column < 3; ++column) {
+    for (std::size_t row{}; row < 3; ++row) {
+      auto const index{static_cast<glm::length_t>(row)};
+      auto const m0{factor * matrix[0][index]};
+      auto const m1{factor * matrix[1][index]};
+      auto const m2{factor * matrix[2][index]};
+      for (std::size_t lane{}; lane < laneCount; ++lane) {
+        result[column][row][lane] = m0 * rotation[column][0][lane] +
+                                    m1 * rotation[column][1][lane] +
+                                    m2 * rotation[column][2][lane];
+      }
+    }
+  }
+  return result;
+}
+} // namespace
+
+void computeDiceTransforms(std::span<DiceState const> dices,
+                           glm::mat4 const &baseMatrix,
+                           glm::mat4 const &viewMatrix, float scale,
+                           std::span<DiceTransform> transforms) {
+  abcg::TraceScope const traceScope{"computeDiceTransforms", "dice"};
+
+  auto const count{std::min(dices.size(), transforms.size())};
+  glm::mat3 const baseRotation{baseMatrix};
+  // The inverse transpose of a rotation is the rotation itself, and the
+  // inverse transpose of a uniform scale s is 1/s
+  glm::mat3 const normalRotation{glm::mat3{viewMatrix} * baseRotation};
+
+  for (std::size_t first{}; first < count; first += laneCount) {
+    auto const lanes{std::min(laneCount, count - first)};
+
+    // Gather to structure-of-arrays. Unused lanes are left zeroed
+    Vec3Lanes positions{};
+    QuatLanes orientations{};
+    for (std::size_t lane{}; lane < lanes; ++lane) {
+      auto const &dice{dices[first + lane]};
+      for (std::size_t axis{}; axis < 3; ++axis) {
+        auto const index{static_cast<glm::length_t>(axis)};
+        positions[axis][lane] = dice.position[index];
+      }
+      orientations[0][lane] = dice.orientation.x;
+      orientations[1][lane] = dice.orientation.y;
+      orientations[2][lane] = dice.orientation.z;
+      orientations[3][lane] = dice.orientation.w;
+    }
+
+    Mat3Lanes rotation{};
+    quatToMatrix(orientations, rotation);
+
+    auto const model{multiply(baseRotation, rotation, scale)};
+    auto const normal{multiply(normalRotation, rotation, 1.0f / scale)};
+
+    Vec3Lanes translation{};
+    for (std::size_t row{}; row < 3; ++row) {
+      auto const index{static_cast<glm::length_t>(row)};
+      for (std::size_t lane{}; lane < laneCount; ++lane) {
+        translation[row][lane] = baseMatrix[0][index] * positions[0][lane] +
+                                 baseMatrix[1][index] * positions[1][lane] +
+                                 baseMatrix[2][index] * positions[2][lane] +
+                                 baseMatrix[3][index];
+      }
+    }
+
+    // Scatter to the packed output
+    for (std::size_t lane{}; lane < lanes; ++lane) {
+      auto &transform{transforms[first + lane]};
+      for (std::size_t column{}; column < 3; ++column) {
+        auto const index{static_cast<glm::length_t>(column)};
+        transform.modelMatrix[index] =
+            glm::vec4{model[column][0][lane], model[column][1][lane],
+                      model[column][2][lane], 0.0f};
+        transform.normalMatrix[index] =
+            glm::vec3{normal[column][0][lane], normal[column][1][lane],
+                      normal[column][2][lane]};
+      }
+      transform.modelMatrix[3] =
+          glm::vec4{translation[0][lane], translation[1][lane],
+                    translation[2][lane], 1.0f};
+    }
+  }
+}
@@ -0,0 +1,29 @@
+#ifndef TRANSFORMS_HPP_
+#define TRANSFORMS_HPP_
+
+#include <span>
+
+#include "abcg.hpp"
+#include "dices.hpp"
+
+// Per-die matrices, packed for upload
+struct DiceTransform {
+  glm::mat4 modelMatrix{1.0f};
+  glm::mat3 normalMatrix{1.0f};
+};
+
+// Computes the model matrix of each die as
+//
+//   baseMatrix * translate(position) * scale(scale) * mat4_cast(orientation)
+//
+// and the normal matrix as inverseTranspose(mat3(viewMatrix * modelMatrix)).
+// The upper 3x3 parts of baseMatrix and viewMatrix must be rotations, so the
+// normal matrix is obtained from the rotation and the uniform scale alone.
+//
+// The dice are processed in blocks, with one die per SIMD lane.
+void computeDiceTransforms(std::span<DiceState const> dices,
+                           glm::mat4 const &baseMatrix,
+                           glm::mat4 const &viewMatrix, float scale,
+                           std::span<DiceTransform> transforms);
+
+#endif
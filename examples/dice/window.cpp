@@ -1,10 +1,50 @@
 #include "window.hpp"
 
+#include <algorithm>
+#include <array>
 #include <cppitertools/itertools.hpp>
-#include <glm/gtc/matrix_inverse.hpp>
 #include <fmt/core.h>
+#include <optional>
 #include "imfilebrowser.h"
 
+namespace {
+// Anti-aliasing modes cycled with F5
+std::array<abcg::OpenGLAntiAliasingSettings, 5> const antiAliasingModes{{
+    {.method = abcg::OpenGLAntiAliasing::None, .samples = 0},
+    {.method = abcg::OpenGLAntiAliasing::FXAA, .samples = 0},
+    {.method = abcg::OpenGLAntiAliasing::MSAA, .samples = 2},
+    {.method = abcg::OpenGLAntiAliasing::MSAA, .samples = 4},
+    {.method = abcg::OpenGLAntiAliasing::MSAA, .samples = 8},
+}};
+
+// Most steps of the GPU simulation in a frame
+constexpr float maxGpuSimulationSteps{8.0f};
+
+// Name of the mode and memory of the scene target compared to 4x MSAA
+std::string describeAntiAliasing(abcg::OpenGLAntiAliasingSettings const &mode,
+                                 glm::ivec2 const &size) {
+  auto const toMiB{[&size](abcg::OpenGLAntiAliasingSettings const &settings) {
+    return static_cast<double>(
+               abcg::OpenGLDynamicResolution::estimateMemoryUsage(
+                   size, settings, true)) /
+           (1024.0 * 1024.0);
+  }};
+  auto const memory{toMiB(mode)};
+  auto const saved{
+      toMiB({.method = abcg::OpenGLAntiAliasing::MSAA, .samples = 4}) -
+      memory};
+
+  std::string name{"none"};
+  if (mode.method == abcg::OpenGLAntiAliasing::FXAA) {
+    name = "FXAA";
+  } else if (mode.method == abcg::OpenGLAntiAliasing::MSAA) {
+    name = fmt::format("{}x MSAA", mode.samples);
+  }
+  return fmt::format("{}, {:.1f} MiB ({:.1f} MiB less than 4x MSAA)", name,
+                     memory, saved);
+}
+} // namespace
+
 void Window::onEvent(SDL_Event const &event) {
   glm::ivec2 mousePosition;
   SDL_GetMouseState(&mousePosition.x, &mousePosition.y);
@@ -29,6 +69,60 @@ void Window::onEvent(SDL_Event const &event) {
       m_trackBallModel.mouseRelease(mousePosition);
   }
 
+  // Toggle the culling of meshlets in the per-die path
+  if (event.type == SDL_KEYUP && event.key.keysym.sym == SDLK_F3) {
+    m_meshletCullingEnabled = !m_meshletCullingEnabled;
+  }
+
+  // Toggle the impostors of the distant dice
+  if (event.type == SDL_KEYUP && event.key.keysym.sym == SDLK_F4) {
+    m_impostorsEnabled = !m_impostorsEnabled;
+  }
+
+  // Cycle the anti-aliasing modes
+  if (event.type == SDL_KEYUP && event.key.keysym.sym == SDLK_F5) {
+    cycleAntiAliasing();
+  }
+
+  // Toggle dynamic resolution scaling
+  if (event.type == SDL_KEYUP && event.key.keysym.sym == SDLK_F6) {
+    auto settings{getDynamicResolutionSettings()};
+    settings.enabled = !settings.enabled;
+    setDynamicResolutionSettings(settings);
+  }
+
+  // Toggle the depth pre-pass
+  if (event.type == SDL_KEYUP && event.key.keysym.sym == SDLK_F7) {
+    m_depthPrePassEnabled = !m_depthPrePassEnabled;
+  }
+
+  // Toggle occlusion culling in the per-die path
+  if (event.type == SDL_KEYUP && event.key.keysym.sym == SDLK_F8) {
+    m_occlusionCullingEnabled = !m_occlusionCullingEnabled;
+  }
+
+  // Toggle between culling on the GPU, if supported, and on the CPU
+  if (event.type == SDL_KEYUP && event.key.keysym.sym == SDLK_F9) {
+    m_gpuCullingEnabled = !m_gpuCullingEnabled;
+  }
+
+  // Toggle the profiler overlay
+  if (event.type == SDL_KEYUP && event.key.keysym.sym == SDLK_F10) {
+    getProfiler().setEnabled(!getProfiler().isEnabled());
+  }
+
+  // Toggle continuous capture to a video stream
+  if (event.type == SDL_KEYUP && event.key.keysym.sym == SDLK_F12) {
+    if (isCapturingFrames()) {
+      stopFrameCapture();
+    } else {
+      abcg::FrameCaptureSettings captureSettings;
+      captureSettings.format = abcg::FrameCaptureFormat::Y4M;
+      captureSettings.path = "dice.y4m";
+      startFrameCapture(captureSettings);
+    }
+  }
+
   if (event.type == SDL_MOUSEWHEEL) {
     m_zoom += (event.wheel.y > 0 ? -1.0f : 1.0f) / 5.0f;
     m_zoom = glm::clamp(m_zoom, -1.5f, 10.0f);
@@ -50,6 +144,14 @@ void Window::onCreate() {
          {.source = path + ".frag", .stage = abcg::ShaderStage::Fragment}})};
     m_programs.push_back(program);
   }
+  m_depthProgram = abcg::createOpenGLProgram(
+      {{.source = assetsPath + "shaders/depth.vert",
+        .stage = abcg::ShaderStage::Vertex},
+       {.source = assetsPath + "shaders/depth.frag",
+        .stage = abcg::ShaderStage::Fragment}});
+
+  m_occlusionCulling.create(assetsPath + "shaders/");
+  m_impostors.create(assetsPath + "shaders/");
 
   // Load default model
   loadModel(assetsPath + "dice.obj");
@@ -60,74 +162,331 @@ void Window::onCreate() {
   m_trackBallModel.setVelocity(0.1f);
 
   m_dices.create(quantity);
+  createGpuSimulation();
+
+  // Headless mode must run the simulation in lockstep with the frames, so
+  // that the output is reproducible. The GPU simulation, if any, replaces it
+  m_simulation.setPaused(m_gpuSimulation.isCreated());
+  m_simulation.start(m_dices, !getHeadlessSettings().enabled);
 }
 
 void Window::onPaint() {
   abcg::glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  abcg::glViewport(0, 0, m_viewportSize.x, m_viewportSize.y);
+  // With dynamic resolution, the scene is rendered at a smaller size and
+  // upscaled to the window, which keeps the aspect ratio
+  auto const renderSize{getRenderSize()};
+  abcg::glViewport(0, 0, renderSize.x, renderSize.y);
+
+  // Updated before use, as it is also used for culling
+  auto const aspect{gsl::narrow<float>(m_viewportSize.x) /
+                        gsl::narrow<float>(m_viewportSize.y)};
+  constexpr auto farPlane{25.0f};
+  m_projMatrix =
+            glm::perspective(glm::radians(45.0f), aspect, 0.1f, farPlane);
+
+  auto const gpuCulling{m_gpuCullingEnabled && m_gpuCulling.isCreated()};
+  auto const gpuSimulation{m_gpuSimulation.isCreated()};
+  auto const impostors{m_impostorsEnabled && m_impostors.isCreated()};
 
-  // Use currently selected program
-  auto const program{m_programs.at(m_currentProgramIndex)};
+  // The states of the GPU simulation are read back only for the per-die path
+  std::span<DiceState const> dices{m_diceSnapshot->dices};
+  if (gpuSimulation && !gpuCulling) {
+    m_gpuSimulation.readStates(m_gpuSimulationStates);
+    dices = m_gpuSimulationStates;
+  }
+  m_diceCount =
+      gpuSimulation ? m_gpuSimulation.getDiceCount() : dices.size();
+
+  if (gpuCulling) {
+    abcg::OpenGLProfileScope const cullScope{getProfiler(), "Dice cull"};
+    m_gpuCulling.setImpostorsEnabled(impostors);
+    if (gpuSimulation) {
+      m_gpuCulling.cull(m_gpuSimulation.getRenderStateBuffer(), m_diceCount,
+                        m_modelMatrix, m_viewMatrix, m_projMatrix, 0.5f);
+    } else {
+      m_gpuCulling.cull(dices, m_modelMatrix, m_viewMatrix, m_projMatrix,
+                        0.5f);
+    }
+    m_visibleDice = m_gpuCulling.getVisibleCount();
+    m_impostorDiceCount = m_gpuCulling.getImpostorCount();
+  }
+
+  // Set uniform variables that have the same value for every model, in the
+  // program of the dice or in the one of the impostors
+  auto const lightDirRotated{m_trackBallModel.getRotation() * m_lightDir};
+  auto const setSceneUniforms{[&](GLuint sceneProgram) {
+    auto const location{[sceneProgram](char const *name) {
+      return abcg::glGetUniformLocation(sceneProgram, name);
+    }};
+    abcg::glUniformMatrix4fv(location("viewMatrix"), 1, GL_FALSE,
+                             &m_viewMatrix[0][0]);
+    abcg::glUniformMatrix4fv(location("projMatrix"), 1, GL_FALSE,
+                             &m_projMatrix[0][0]);
+
+    abcg::glUniform4fv(location("lightDirWorldSpace"), 1, &lightDirRotated.x);
+    abcg::glUniform4fv(location("Ia"), 1, &m_Ia.x);
+    abcg::glUniform4fv(location("Id"), 1, &m_Id.x);
+    abcg::glUniform4fv(location("Is"), 1, &m_Is.x);
+  }};
+
+  // Use currently selected program, or the one that reads the matrices
+  // written by the culling pass
+  auto const program{gpuCulling ? m_gpuCulling.getRenderProgram()
+                                : m_programs.at(m_currentProgramIndex)};
   abcg::glUseProgram(program);
+  setSceneUniforms(program);
+  abcg::glUniform1i(abcg::glGetUniformLocation(program, "diffuseTex"), 0);
+  abcg::glUniform1i(abcg::glGetUniformLocation(program, "mappingMode"),
+                    m_mappingMode);
 
-  // Get location of uniform variables
-  auto const viewMatrixLoc{abcg::glGetUniformLocation(program, "viewMatrix")};
-  auto const projMatrixLoc{abcg::glGetUniformLocation(program, "projMatrix")};
   auto const modelMatrixLoc{abcg::glGetUniformLocation(program, "modelMatrix")};
   auto const normalMatrixLoc{
       abcg::glGetUniformLocation(program, "normalMatrix")};
-  auto const lightDirLoc{
-      abcg::glGetUniformLocation(program, "lightDirWorldSpace")};
-  auto const shininessLoc{abcg::glGetUniformLocation(program, "shininess")};
-  auto const IaLoc{abcg::glGetUniformLocation(program, "Ia")};
-  auto const IdLoc{abcg::glGetUniformLocation(program, "Id")};
-  auto const IsLoc{abcg::glGetUniformLocation(program, "Is")};
-  auto const KaLoc{abcg::glGetUniformLocation(program, "Ka")};
-  auto const KdLoc{abcg::glGetUniformLocation(program, "Kd")};
-  auto const KsLoc{abcg::glGetUniformLocation(program, "Ks")};
-  auto const diffuseTexLoc{abcg::glGetUniformLocation(program, "diffuseTex")};
-  auto const mappingModeLoc{abcg::glGetUniformLocation(program, "mappingMode")};
-
-  // Set uniform variables that have the same value for every model
-  abcg::glUniformMatrix4fv(viewMatrixLoc, 1, GL_FALSE, &m_viewMatrix[0][0]);
-  abcg::glUniformMatrix4fv(projMatrixLoc, 1, GL_FALSE, &m_projMatrix[0][0]);
-  abcg::glUniform1i(diffuseTexLoc, 0);
-  abcg::glUniform1i(mappingModeLoc, m_mappingMode);
 
-  auto const lightDirRotated{m_trackBallModel.getRotation() * m_lightDir};
-  abcg::glUniform4fv(lightDirLoc, 1, &lightDirRotated.x);
-  abcg::glUniform4fv(IaLoc, 1, &m_Ia.x);
-  abcg::glUniform4fv(IdLoc, 1, &m_Id.x);
-  abcg::glUniform4fv(IsLoc, 1, &m_Is.x);
-  
-  for(auto &dice : m_dices.m_dices){
-    dice.modelMatrix = glm::translate(m_modelMatrix, dice.position);
-    dice.modelMatrix = glm::scale(dice.modelMatrix, glm::vec3(0.5f));
-    dice.modelMatrix = glm::rotate(dice.modelMatrix, dice.rotationAngle.x, glm::vec3(1.0f, 0.0f, 0.0f));
-    dice.modelMatrix = glm::rotate(dice.modelMatrix, dice.rotationAngle.y, glm::vec3(0.0f, 1.0f, 0.0f));
-    dice.modelMatrix = glm::rotate(dice.modelMatrix, dice.rotationAngle.z, glm::vec3(0.0f, 0.0f, 1.0f));
+  // Dice drawn as impostors, after the meshes and with the usual depth test,
+  // as they are not in the depth pre-pass
+  auto const useImpostorProgram{[&] {
+    auto const impostorProgram{m_impostors.getProgram()};
+    abcg::glUseProgram(impostorProgram);
+    setSceneUniforms(impostorProgram);
+    m_dices.bindMaterials();
+    m_impostors.bindAtlas();
+  }};
+
+  // The depth pre-pass writes the depth of the dice with the positions alone,
+  // so that the shading pass, tested with GL_EQUAL, shades each visible pixel
+  // only once however much the dice overlap
+  auto const useDepthProgram{[&](GLuint depthProgram) {
+    abcg::glUseProgram(depthProgram);
+    abcg::glUniformMatrix4fv(
+        abcg::glGetUniformLocation(depthProgram, "viewMatrix"), 1, GL_FALSE,
+        &m_viewMatrix[0][0]);
+    abcg::glUniformMatrix4fv(
+        abcg::glGetUniformLocation(depthProgram, "projMatrix"), 1, GL_FALSE,
+        &m_projMatrix[0][0]);
+  }};
+  auto const setShadingDepthTest{[](bool enabled) {
+    abcg::glDepthFunc(enabled ? GL_EQUAL : GL_LESS);
+    abcg::glDepthMask(enabled ? GL_FALSE : GL_TRUE);
+  }};
+
+  abcg::OpenGLProfileScope const drawScope{getProfiler(), "Dice draw"};
+  if (gpuCulling) {
+    if (m_depthPrePassEnabled) {
+      {
+        abcg::OpenGLProfileScope const scope{getProfiler(), "Depth pre-pass"};
+        useDepthProgram(m_gpuCulling.getDepthProgram());
+        m_gpuCulling.renderDepth();
+        abcg::glUseProgram(program);
+      }
+      abcg::OpenGLProfileScope const scope{getProfiler(), "Shading pass"};
+      setShadingDepthTest(true);
+      m_gpuCulling.render(m_dices);
+      setShadingDepthTest(false);
+    } else {
+      m_gpuCulling.render(m_dices);
+    }
 
-    abcg::glUniformMatrix4fv(modelMatrixLoc, 1, GL_FALSE, &dice.modelMatrix[0][0]);
-    auto const modelViewMatrix{glm::mat3(m_viewMatrix * dice.modelMatrix)};
-    auto const normalMatrix{glm::inverseTranspose(modelViewMatrix)};
-    abcg::glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, &normalMatrix[0][0]);
+    if (impostors) {
+      abcg::OpenGLProfileScope const scope{getProfiler(), "Impostors"};
+      useImpostorProgram();
+      m_gpuCulling.renderImpostors();
+    }
+  } else {
+    m_diceTransforms.resize(dices.size());
+    computeDiceTransforms(dices, m_modelMatrix, m_viewMatrix, 0.5f,
+                          m_diceTransforms);
+
+    // Skip the dice outside the view
+    m_diceVisibility.resize(dices.size());
+    m_visibleDice = cullDiceSpheres(
+        m_diceTransforms, m_dices.getBoundingSphere(),
+        extractFrustum(m_projMatrix * m_viewMatrix), m_diceVisibility);
+
+    // The dice that cover only a few pixels are drawn as impostors alone
+    m_impostorDice.resize(dices.size());
+    m_impostorDiceCount =
+        impostors ? Impostors::select(m_diceTransforms,
+                                      m_dices.getBoundingSphere(),
+                                      m_viewMatrix, m_projMatrix,
+                                      m_diceVisibility, m_impostorDice)
+                  : 0;
+
+    // Meshlets of each die in the view that face the camera, found once and
+    // drawn in every pass, so that the depth-only and the shading draws of
+    // the pre-pass match
+    m_meshletStatistics = {};
+    m_meshletRangeOffsets.assign(dices.size() + 1, 0);
+    m_meshletRanges.clear();
+    if (m_meshletCullingEnabled) {
+      auto const viewProjMatrix{m_projMatrix * m_viewMatrix};
+      auto const eye{glm::vec3{glm::inverse(m_viewMatrix)[3]}};
+      for (auto &&[index, transform, visible] :
+           iter::zip(iter::range(dices.size()), m_diceTransforms,
+                     m_diceVisibility)) {
+        if (visible != 0) {
+          // The model matrix is a rotation with a uniform scale, so its
+          // inverse is the transpose divided by the squared scale
+          glm::mat3 const rotationScale{transform.modelMatrix};
+          auto const cameraPosition{
+              glm::transpose(rotationScale) *
+              (eye - glm::vec3{transform.modelMatrix[3]}) /
+              glm::dot(rotationScale[0], rotationScale[0])};
+          m_meshletStatistics.culledTriangles += cullMeshlets(
+              m_dices.getMeshlets(),
+              extractFrustum(viewProjMatrix * transform.modelMatrix),
+              cameraPosition, m_meshletRanges);
+          m_meshletStatistics.triangles +=
+              gsl::narrow<std::size_t>(m_dices.getNumTriangles());
+        }
+        m_meshletRangeOffsets[index + 1] = m_meshletRanges.size();
+      }
+    }
+
+    auto const depthModelMatrixLoc{
+        abcg::glGetUniformLocation(m_depthProgram, "modelMatrix")};
+
+    // Records the selected dice in the render queue and draws them from front
+    // to back, binding the mesh only when the state changes. The dice share
+    // the mesh, the materials and the texture array, so the key holds only
+    // the program and the depth. Depth-only draws use the program and vertex
+    // array of the pre-pass
+    m_renderStatistics = {};
+    auto const drawDice{[&](std::span<std::uint8_t const> selection,
+                            std::uint32_t pass, bool depthOnly) {
+      m_renderQueue.clear();
+      for (auto &&[index, transform, selected] :
+           iter::zip(iter::range(m_diceTransforms.size()), m_diceTransforms,
+                     selection)) {
+        if (selected == 0)
+          continue;
+
+        // Distance of the center along the view direction
+        auto const viewZ{(m_viewMatrix * transform.modelMatrix[3]).z};
+        m_renderQueue.push(
+            {.pass = pass,
+             .program = gsl::narrow<std::uint32_t>(m_currentProgramIndex),
+             .depth = -viewZ / farPlane},
+            gsl::narrow<std::uint32_t>(index));
+      }
+      m_renderQueue.sort();
 
-    abcg::glUniform4fv(KaLoc, 1, &m_Ka.x);
-    abcg::glUniform4fv(KdLoc, 1, &m_Kd.x);
-    abcg::glUniform4fv(KsLoc, 1, &m_Ks.x);
-    abcg::glUniform1f(shininessLoc, m_shininess);
+      if (depthOnly) {
+        useDepthProgram(m_depthProgram);
+      }
+      for (auto const &packet : m_renderQueue.getPackets()) {
+        if (packet.changes != 0) {
+          if (depthOnly) {
+            m_dices.bindDepth();
+          } else {
+            m_dices.bind();
+          }
+        }
+        auto const &transform{m_diceTransforms.at(packet.payload)};
+        abcg::glUniformMatrix4fv(
+            depthOnly ? depthModelMatrixLoc : modelMatrixLoc, 1, GL_FALSE,
+            &transform.modelMatrix[0][0]);
+        if (!depthOnly) {
+          abcg::glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE,
+                                   &transform.normalMatrix[0][0]);
+        }
+
+        if (m_meshletCullingEnabled) {
+          auto const first{m_meshletRangeOffsets.at(packet.payload)};
+          auto const last{m_meshletRangeOffsets.at(packet.payload + 1)};
+          m_dices.draw(
+              std::span{m_meshletRanges}.subspan(first, last - first));
+        } else {
+          m_dices.draw(m_trianglesToDraw);
+        }
+      }
+      abcg::glBindVertexArray(0);
 
-    m_dices.render(m_trianglesToDraw);
+      if (depthOnly) {
+        abcg::glUseProgram(program);
+        return;
+      }
+      auto const &statistics{m_renderQueue.getStatistics()};
+      m_renderStatistics.packets += statistics.packets;
+      m_renderStatistics.stateChanges += statistics.stateChanges;
+    }};
+
+    // With the pre-pass, the passes below write the depth alone, and the dice
+    // drawn in any of them are shaded at the end
+    std::optional<abcg::OpenGLProfileScope> prePassScope;
+    if (m_depthPrePassEnabled) {
+      prePassScope.emplace(getProfiler(), "Depth pre-pass");
+    }
+    std::span<std::uint8_t const> shadedDice{m_diceVisibility};
+
+    if (m_occlusionCullingEnabled) {
+      // Every die is drawn in the first pass after the quantity changes
+      if (m_lastVisibility.size() != dices.size()) {
+        m_lastVisibility.assign(dices.size(), 1);
+      }
+
+      // First pass: dice in the view not found hidden by the latest results
+      m_passDice.resize(dices.size());
+      for (auto &&[selected, visible, lastVisible] :
+           iter::zip(m_passDice, m_diceVisibility, m_lastVisibility)) {
+        selected = visible != 0 && lastVisible != 0 ? 1 : 0;
+      }
+      drawDice(m_passDice, 0, m_depthPrePassEnabled);
+
+      // Test every die in the view against the depth of the first pass. The
+      // results arrive in a later frame, usually the next one, and select
+      // the dice of both passes until newer ones arrive
+      {
+        abcg::OpenGLProfileScope const scope{getProfiler(),
+                                             "Occlusion culling"};
+        m_occlusionCulling.buildPyramid(renderSize);
+        m_occlusionCulling.test(m_diceTransforms, m_dices.getBoundingBox(),
+                                m_projMatrix * m_viewMatrix,
+                                m_diceVisibility);
+        m_occlusionCulling.readResults(m_lastVisibility);
+      }
+
+      // Second pass: dice in the view that were hidden in the results used by
+      // the first pass but not in the ones just read back. The ones hidden in
+      // both are not drawn at all
+      m_occludedDice = 0;
+      m_drawnDice.resize(dices.size());
+      for (auto &&[selected, drawn, visible, lastVisible] :
+           iter::zip(m_passDice, m_drawnDice, m_diceVisibility,
+                     m_lastVisibility)) {
+        auto const unhidden{visible != 0 && selected == 0 && lastVisible != 0};
+        if (visible != 0 && selected == 0 && lastVisible == 0)
+          ++m_occludedDice;
+        drawn = selected != 0 || unhidden ? 1 : 0;
+        selected = unhidden ? 1 : 0;
+      }
+      drawDice(m_passDice, 1, m_depthPrePassEnabled);
+      shadedDice = m_drawnDice;
+      abcg::Tracer::counter("Occluded dice",
+                            static_cast<double>(m_occludedDice));
+    } else {
+      m_occludedDice = 0;
+      drawDice(m_diceVisibility, 0, m_depthPrePassEnabled);
+    }
+
+    if (m_depthPrePassEnabled) {
+      prePassScope.reset();
+      abcg::OpenGLProfileScope const scope{getProfiler(), "Shading pass"};
+      setShadingDepthTest(true);
+      drawDice(shadedDice, 2, false);
+      setShadingDepthTest(false);
+    }
+
+    if (m_impostorDiceCount > 0) {
+      abcg::OpenGLProfileScope const scope{getProfiler(), "Impostors"};
+      useImpostorProgram();
+      m_impostors.render(m_diceTransforms, m_impostorDice);
+    }
   }
 
   abcg::glUseProgram(0);
 
-  auto const aspect{gsl::narrow<float>(m_viewportSize.x) /
-                        gsl::narrow<float>(m_viewportSize.y)};
-  m_projMatrix =
-            glm::perspective(glm::radians(45.0f), aspect, 0.1f, 25.0f);
-
   abcg::glFrontFace(GL_CCW);
 }
 
@@ -139,24 +498,87 @@ void Window::onUpdate() {
                   glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 
   const float deltaTime{static_cast<float>(getDeltaTime())};
-  m_dices.update(deltaTime);
+  m_diceSnapshot = &m_simulation.update(deltaTime);
+
+  // Stepped at the same fixed rate as the simulation thread. Time beyond a few
+  // steps is dropped, so that a slow frame does not slow down the next ones
+  auto gpuSimulationBusy{false};
+  if (m_gpuSimulation.isCreated() && m_gpuSimulation.isRolling()) {
+    m_gpuSimulationTime =
+        std::min(m_gpuSimulationTime + deltaTime,
+                 Simulation::stepTime * maxGpuSimulationSteps);
+    while (m_gpuSimulationTime >= Simulation::stepTime) {
+      m_gpuSimulation.step(Simulation::stepTime);
+      m_gpuSimulationTime -= Simulation::stepTime;
+    }
+    gpuSimulationBusy = true;
+  } else {
+    m_gpuSimulationTime = 0.0f;
+  }
+
+  // Render on demand only while nothing is moving
+  if (m_simulation.isBusy() || gpuSimulationBusy ||
+      m_trackBallModel.isSpinning()) {
+    requestRedraw();
+  }
 }
 
 void Window::onPaintUI() {
   abcg::OpenGLWindow::onPaintUI();
 
+  // Append the culling results to the FPS overlay
+  if (getWindowSettings().showFPS && m_diceSnapshot != nullptr) {
+    ImGui::Begin("FPS");
+    auto const gpuCulling{m_gpuCullingEnabled && m_gpuCulling.isCreated()};
+    ImGui::Text("%zu visible, %zu culled (%s)", m_visibleDice,
+                m_diceCount - m_visibleDice,
+                gpuCulling ? "GPU" : "CPU");
+    if (m_impostorsEnabled) {
+      ImGui::Text("%zu impostors", m_impostorDiceCount);
+    }
+    if (!gpuCulling && m_occlusionCullingEnabled) {
+      ImGui::Text("%zu occluded", m_occludedDice);
+    }
+    if (!gpuCulling) {
+      ImGui::Text("%zu draws, %zu state changes",
+                  m_renderStatistics.packets, m_renderStatistics.stateChanges);
+    }
+    if (!gpuCulling && m_meshletCullingEnabled &&
+        m_meshletStatistics.triangles > 0) {
+      ImGui::Text("%zu of %zu triangles culled by meshlets",
+                  m_meshletStatistics.culledTriangles,
+                  m_meshletStatistics.triangles);
+    }
+    ImGui::Text("AA: %s", describeAntiAliasing(getAntiAliasingSettings(),
+                                               m_viewportSize)
+                              .c_str());
+    if (getDynamicResolutionSettings().enabled) {
+      auto const &dynamicResolution{getDynamicResolution()};
+      auto const renderSize{dynamicResolution.getRenderSize()};
+      ImGui::Text("%dx%d (%.0f%%), %.2f ms", renderSize.x, renderSize.y,
+                  dynamicResolution.getScale() * 100.0f,
+                  dynamicResolution.getFrameTime());
+    }
+    ImGui::End();
+  }
+
   {
-    ImGui::SetNextWindowPos(ImVec2(m_viewportSize.x - 138, m_viewportSize.y - 40));
-    ImGui::SetNextWindowSize(ImVec2(128, 35));
+    ImGui::SetNextWindowPos(ImVec2(m_viewportSize.x - 138, m_viewportSize.y - 60));
+    ImGui::SetNextWindowSize(ImVec2(128, 55));
     ImGui::Begin("Button window", nullptr, ImGuiWindowFlags_NoDecoration);
 
     ImGui::PushItemWidth(200);
     if(m_gameData.m_input[static_cast<size_t>(Input::Roll)]){
-      for(auto &dice : m_dices.m_dices){
-        m_dices.jogarDado(dice);
-      } 
+      if (m_gpuSimulation.isCreated()) {
+        m_gpuSimulation.roll();
+        requestRedraw();
+      } else {
+        m_simulation.push({.type = SimulationCommand::Type::Roll});
+      }
     }
-    {
+    if (m_gpuSimulation.isCreated()) {
+      ImGui::Text("%zu dados (GPU)", m_gpuSimulation.getDiceCount());
+    } else {
       static std::size_t currentIndex{};
       const std::vector<std::string> comboItems{"1", "2", "3", "4", "5"};
 
@@ -172,9 +594,21 @@ void Window::onPaintUI() {
         ImGui::EndCombo();
       }
       ImGui::PopItemWidth();
-      if(quantity != (int)currentIndex + 1){
+
+      // Sum of the faces up, once the dice stop
+      if (m_diceSnapshot != nullptr && !m_diceSnapshot->rolling) {
+        auto total{0};
+        for (auto const &dice : m_diceSnapshot->dices) {
+          total += Dices::getFaceUp(dice.orientation);
+        }
+        ImGui::Text("Resultado: %d", total);
+      }
+
+      // If the queue is full, try again in the next frame
+      if (quantity != (int)currentIndex + 1 &&
+          m_simulation.push({.type = SimulationCommand::Type::SetQuantity,
+                             .quantity = (int)currentIndex + 1})) {
         quantity = currentIndex + 1;
-        m_dices.create(quantity);
       }
     }
 
@@ -188,10 +622,32 @@ void Window::onResize(glm::ivec2 const &size) {
 }
 
 void Window::onDestroy() {
+  m_simulation.stop();
+  m_gpuSimulation.destroy();
+  m_gpuCulling.destroy();
+  m_occlusionCulling.destroy();
+  m_impostors.destroy();
   m_dices.destroy();
   for (const auto& program : m_programs) {
     abcg::glDeleteProgram(program);
   }
+  abcg::glDeleteProgram(m_depthProgram);
+}
+
+void Window::cycleAntiAliasing() {
+  auto const &current{getAntiAliasingSettings()};
+  auto const it{std::ranges::find_if(
+      antiAliasingModes, [&current](auto const &mode) {
+        return mode.method == current.method &&
+               (mode.method != abcg::OpenGLAntiAliasing::MSAA ||
+                mode.samples == current.samples);
+      })};
+  auto const next{it == antiAliasingModes.end() ||
+                          std::next(it) == antiAliasingModes.end()
+                      ? antiAliasingModes.front()
+                      : *std::next(it)};
+
+  setAntiAliasingSettings(next);
 }
 
 void Window::loadModel(std::string_view path) {
@@ -199,15 +655,59 @@ void Window::loadModel(std::string_view path) {
 
   m_dices.destroy();
 
-  m_dices.loadDiffuseTexture(assetsPath + "maps/dice.jpg");
+  m_dices.setDiffuseTexture(assetsPath + "maps/dice.jpg");
   m_dices.loadObj(path);
   m_dices.setupVAO(m_programs.at(m_currentProgramIndex));
   m_trianglesToDraw = m_dices.getNumTriangles();
+  m_impostors.bake(m_dices, m_programs.at(m_currentProgramIndex),
+                   m_mappingMode);
 
-  // Use material properties from the loaded model
-  m_Ka = m_dices.getKa();
-  m_Kd = m_dices.getKd();
-  m_Ks = m_dices.getKs();
-  m_shininess = m_dices.getShininess();
+  // OpenGL 4.3 path. The per-die path is used on OpenGL ES and WebGL
+  if (GpuCulling::isSupported()) {
+    m_gpuCulling.create(m_dices, m_impostors, assetsPath + "shaders/");
+  }
 }
 
+
+// Validates the GPU simulation against the CPU one and replaces the CPU one,
+// as set from the command line
+void Window::createGpuSimulation() {
+  auto const &settings{m_gpuSimulationSettings};
+  if (!settings.enabled && !settings.validate)
+    return;
+
+  if (!GpuSimulation::isSupported()) {
+    if (settings.validate) {
+      throw abcg::RuntimeError("The GPU simulation requires OpenGL 4.3");
+    }
+    fmt::print(stderr, "Warning: the GPU simulation requires OpenGL 4.3, "
+                       "simulating on the CPU\n");
+    return;
+  }
+
+  m_gpuSimulation.create(abcg::Application::getAssetsPath() + "shaders/");
+
+  if (settings.validate) {
+    Dices reference;
+    reference.create(settings.validationQuantity);
+    auto const validation{m_gpuSimulation.validate(
+        reference, settings.validationSteps, Simulation::stepTime)};
+    fmt::print("GPU simulation: {} dice, {} steps, {} mismatches, max errors "
+               "{:.3g} (position), {:.3g} (orientation), {:.3g} (time)\n",
+               settings.validationQuantity, validation.steps,
+               validation.mismatches, validation.maxPositionError,
+               validation.maxOrientationError, validation.maxTimeError);
+    if (validation.mismatches > 0) {
+      throw abcg::RuntimeError("The GPU simulation differs from the CPU one");
+    }
+  }
+
+  if (!settings.enabled) {
+    m_gpuSimulation.destroy();
+    return;
+  }
+
+  Dices initial;
+  initial.create(settings.quantity);
+  m_gpuSimulation.upload(initial);
+}
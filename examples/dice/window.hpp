@@ -4,11 +4,33 @@
 #include <vector>
 #include <random>
 #include "abcgOpenGL.hpp"
+#include "culling.hpp"
 #include "dices.hpp"
+#include "gpuculling.hpp"
+#include "gpusimulation.hpp"
+#include "impostors.hpp"
+#include "occlusionculling.hpp"
 #include "trackball.hpp"
 #include "gamedata.hpp"
+#include "simulation.hpp"
+#include "transforms.hpp"
+
+// Options of the simulation on the GPU, set from the command line
+struct GpuSimulationSettings {
+  bool enabled{};
+  int quantity{4096};
+  // Compares the GPU and the CPU simulations before the first frame
+  bool validate{};
+  int validationQuantity{200};
+  int validationSteps{600};
+};
 
 class Window : public abcg::OpenGLWindow {
+ public:
+  void setGpuSimulationSettings(GpuSimulationSettings const &settings) {
+    m_gpuSimulationSettings = settings;
+  }
+
  protected:
   void onEvent(SDL_Event const &event) override;
   void onCreate() override;
@@ -22,6 +44,51 @@ class Window : public abcg::OpenGLWindow {
   GameData m_gameData;
   glm::ivec2 m_viewportSize{};
   Dices m_dices;
+  Simulation m_simulation;
+  DiceSnapshot const *m_diceSnapshot{};
+  GpuSimulationSettings m_gpuSimulationSettings;
+  GpuSimulation m_gpuSimulation;
+  // Frame time not yet simulated on the GPU
+  float m_gpuSimulationTime{};
+  // States read back from the GPU simulation for the per-die path
+  std::vector<DiceState> m_gpuSimulationStates;
+  std::size_t m_diceCount{};
+  std::vector<DiceTransform> m_diceTransforms;
+  std::vector<std::uint8_t> m_diceVisibility;
+  std::size_t m_visibleDice{};
+  GpuCulling m_gpuCulling;
+  bool m_gpuCullingEnabled{true};
+  OcclusionCulling m_occlusionCulling;
+  bool m_occlusionCullingEnabled{true};
+  // Dice not found hidden by the latest occlusion test read back, and the
+  // ones drawn in the current pass of this frame
+  std::vector<std::uint8_t> m_lastVisibility;
+  std::vector<std::uint8_t> m_passDice;
+  std::size_t m_occludedDice{};
+  // Depth-only pass before the shading pass, and the dice drawn by either
+  // pass of the occlusion culling, which are shaded after it
+  bool m_depthPrePassEnabled{};
+  GLuint m_depthProgram{};
+  std::vector<std::uint8_t> m_drawnDice;
+  // Dice drawn as impostors instead of meshes
+  Impostors m_impostors;
+  bool m_impostorsEnabled{true};
+  std::vector<std::uint8_t> m_impostorDice;
+  std::size_t m_impostorDiceCount{};
+  // Meshlets of each die drawn in the per-die path, and the triangles culled
+  // with them in the last frame
+  struct MeshletStatistics {
+    std::size_t triangles{};
+    std::size_t culledTriangles{};
+  };
+  bool m_meshletCullingEnabled{true};
+  std::vector<MeshLod> m_meshletRanges;
+  // Ranges of die i, from m_meshletRangeOffsets[i] to [i + 1]
+  std::vector<std::size_t> m_meshletRangeOffsets;
+  MeshletStatistics m_meshletStatistics;
+  // Draws of the per-die path, sorted by state and from front to back
+  abcg::RenderQueue m_renderQueue;
+  abcg::RenderQueueStatistics m_renderStatistics;
   int m_trianglesToDraw{40704};
   int quantity{1};
   TrackBall m_trackBallModel;
@@ -40,17 +107,15 @@ class Window : public abcg::OpenGLWindow {
   // 0: triplanar; 1: cylindrical; 2: spherical; 3: from mesh
   int m_mappingMode{};
 
-  // Light and material properties
+  // Light properties. The materials are in the uniform buffer of m_dices
   glm::vec4 m_lightDir{-1.0f, -1.0f, -1.0f, 0.0f};
   glm::vec4 m_Ia{1.0f};
   glm::vec4 m_Id{1.0f};
   glm::vec4 m_Is{1.0f};
-  glm::vec4 m_Ka{};
-  glm::vec4 m_Kd{};
-  glm::vec4 m_Ks{};
-  float m_shininess{};
 
   void loadModel(std::string_view path);
+  void createGpuSimulation();
+  void cycleAntiAliasing();
 };
 
 #endif
\ No newline at end of file